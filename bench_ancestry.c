@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * bench_ancestry.c - Benchmark answering many "is A an ancestor of B" questions
+ *                      about live pids, walking the parents for every question versus
+ *                      sharing one memo of parents (pid_ancestry.c), versus
+ *                      reading every parent up front and indexing them with
+ *                      depth-first intervals (pid_ancestry_build_index)
+ *
+ *   The memo's cost should grow with the number of distinct pids, not with the
+ *     number of questions. The index costs one read of every pid on the system,
+ *     after which each question is two comparisons.
+ *
+ *   Usage: bench_ancestry (Optional: [max questions])
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pid_tools.h"
+#include "pid_ident.h"
+#include "proc_pids.h"
+#include "pid_ancestry.h"
+
+#include "bench_utils.h"
+
+
+static size_t numPpidReads = 0;
+
+/* counting_lookup - pid_ident_lookup, counting the number of times /proc (or pidtreed) is asked */
+static int counting_lookup(pid_t pid, PidIdent *ident, pid_t *ppidOut)
+{
+    numPpidReads++;
+    return pid_ident_lookup(pid, ident, ppidOut);
+}
+
+/* counting_get_ppid - The parent of #pid (1 if no parent), or 0 on error, as getPpid */
+static pid_t counting_get_ppid(pid_t pid)
+{
+    PidIdent ident;
+    pid_t ppid;
+
+    if ( counting_lookup(pid, &ident, &ppid) != PID_IDENT_OK )
+        return 0;
+
+    return ppid;
+}
+
+/**
+ * walk_is_ancestor - What isachildof used to do for every question
+ */
+static int walk_is_ancestor(pid_t ancestorPid, pid_t pid)
+{
+    pid_t cur;
+
+    cur = counting_get_ppid(pid);
+    while ( cur != 0 && cur != ancestorPid )
+    {
+        if ( cur == 1 )
+            return 0;
+        cur = counting_get_ppid(cur);
+    }
+
+    return cur == ancestorPid;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int maxQuestions = 100000;
+    unsigned int numQuestions;
+    unsigned int i;
+    pid_t *pids;
+    size_t numPids;
+    pid_t *questions;
+    PidAncestry *ancestry;
+    double startTime, walkTime, memoTime, indexTime;
+    size_t walkReads, memoReads, indexReads;
+    int numWalkYes, numMemoYes, numIndexYes;
+
+    if ( argc > 1 )
+        maxQuestions = atoi(argv[1]);
+
+    pids = proc_pids_get_all(&numPids);
+
+    /* Random (ancestor, pid) pairs of live pids */
+    questions = malloc( sizeof(pid_t) * 2 * maxQuestions );
+    for( i=0; i < maxQuestions * 2; i++ )
+        questions[i] = pids[ bench_rand() % numPids ];
+
+    printf("%zu live pids\n\n", numPids);
+    printf("%10s  %12s %12s  %12s %12s  %12s %12s  %8s\n", "Questions", "Walk ms", "Walk reads",
+        "Memo ms", "Memo reads", "Indexed ms", "Index reads", "Speedup");
+
+    for( numQuestions = 100; numQuestions <= maxQuestions; numQuestions *= 10 )
+    {
+        numPpidReads = 0;
+        numWalkYes = 0;
+        startTime = bench_now_ns();
+        for( i=0; i < numQuestions; i++ )
+            numWalkYes += walk_is_ancestor(questions[i * 2], questions[i * 2 + 1]);
+        walkTime = bench_now_ns() - startTime;
+        walkReads = numPpidReads;
+
+        numPpidReads = 0;
+        numMemoYes = 0;
+        startTime = bench_now_ns();
+        ancestry = pid_ancestry_create(counting_lookup);
+        for( i=0; i < numQuestions; i++ )
+            numMemoYes += pid_ancestry_is_ancestor(ancestry, questions[i * 2], questions[i * 2 + 1]) == 1;
+        pid_ancestry_destroy(ancestry);
+        memoTime = bench_now_ns() - startTime;
+        memoReads = numPpidReads;
+
+        numPpidReads = 0;
+        numIndexYes = 0;
+        startTime = bench_now_ns();
+        ancestry = pid_ancestry_create(counting_lookup);
+        pid_ancestry_build_index(ancestry);
+        for( i=0; i < numQuestions; i++ )
+            numIndexYes += pid_ancestry_is_ancestor(ancestry, questions[i * 2], questions[i * 2 + 1]) == 1;
+        pid_ancestry_destroy(ancestry);
+        indexTime = bench_now_ns() - startTime;
+        indexReads = numPpidReads;
+
+        if ( numWalkYes != numMemoYes || numWalkYes != numIndexYes )
+            fprintf(stderr, "WARNING: Answers differ (%d vs %d vs %d yes). Did processes come or go?\n",
+                numWalkYes, numMemoYes, numIndexYes);
+
+        /* Speedup is of the faster of memo / indexed over the walk */
+        printf("%10u  %12.2f %12zu  %12.2f %12zu  %12.2f %12zu  %7.1fx\n", numQuestions,
+            walkTime / 1000000.0, walkReads, memoTime / 1000000.0, memoReads,
+            indexTime / 1000000.0, indexReads, walkTime / (memoTime < indexTime ? memoTime : indexTime));
+    }
+
+    free(questions);
+    free(pids);
+
+    return 0;
+}
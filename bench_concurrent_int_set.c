@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * bench_concurrent_int_set.c - Benchmark how ConcurrentIntSet scales from 1 to 64
+ *                                threads, against a SimpleIntMap behind one mutex
+ *
+ *   The keys are split evenly between the threads, which all start at once. Each
+ *     adds its share, then searches for its share (hits) and for as many keys which
+ *     were never added (misses). Reported in millions of operations per second across
+ *     all threads, with the speedup over one thread. Freezing and listing the values
+ *     afterwards is timed once per row.
+ *
+ *   Nothing can go faster than the number of cpus allows, so on a machine with few
+ *     of them the rows above that show what contention costs, not what it gains.
+ *
+ *   Usage: bench_concurrent_int_set (Optional: [number of keys, default 4194304])
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "pid_tools.h"
+#include "concurrent_int_set.h"
+#include "simple_int_map.h"
+
+#include "bench_utils.h"
+
+
+/* MAX_THREADS - Most threads run */
+#define MAX_THREADS 64
+
+/* BENCH_KEY - The #_n th key. Positive, random looking, and never repeated below 2^30 */
+#define BENCH_KEY(_n) ( (int)( 1 + ( ( (uint32_t)(_n) * 2654435761U ) & 0x3fffffff ) ) )
+
+/* BENCH_MISS_KEY - A key which is never added, in the same range of slots as #_n */
+#define BENCH_MISS_KEY(_n) ( BENCH_KEY(_n) | 0x40000000 )
+
+/* Phases timed, and the columns printed */
+enum { PHASE_ADD, PHASE_HIT, PHASE_MISS, NUM_PHASES };
+
+struct BenchThreadArgs {
+    ConcurrentIntSet *intSet;       /* Or NULL, for the locked map */
+    SimpleIntMap *intMap;
+    pthread_mutex_t *mapLock;
+    pthread_barrier_t *barrier;
+
+    size_t firstKey;
+    size_t numKeys;
+
+    double phaseNs[NUM_PHASES];     /* Set by thread 0 only, which waits for the others between phases */
+    size_t check;
+    int isTimer;
+};
+
+/**
+ * bench_thread - Add, then search for, this thread's share of the keys. Every thread
+ *                  waits for the others between phases, so each phase is timed whole.
+ */
+static void *bench_thread(void *argsPtr)
+{
+    struct BenchThreadArgs *args = argsPtr;
+    size_t i, lastKey;
+    double startTime = 0;
+    int phase;
+
+    lastKey = args->firstKey + args->numKeys;
+
+    for( phase=0; phase < NUM_PHASES; phase++ )
+    {
+        pthread_barrier_wait(args->barrier);
+        if ( args->isTimer )
+            startTime = bench_now_ns();
+
+        for( i=args->firstKey; i < lastKey; i++ )
+        {
+            if ( args->intSet != NULL )
+            {
+                if ( phase == PHASE_ADD )
+                    args->check += concurrent_int_set_add(args->intSet, BENCH_KEY(i));
+                else if ( phase == PHASE_HIT )
+                    args->check += concurrent_int_set_contains(args->intSet, BENCH_KEY(i));
+                else
+                    args->check += concurrent_int_set_contains(args->intSet, BENCH_MISS_KEY(i));
+            }
+            else
+            {
+                pthread_mutex_lock(args->mapLock);
+                if ( phase == PHASE_ADD )
+                    args->check += simple_int_map_add(args->intMap, BENCH_KEY(i));
+                else if ( phase == PHASE_HIT )
+                    args->check += simple_int_map_contains(args->intMap, BENCH_KEY(i));
+                else
+                    args->check += simple_int_map_contains(args->intMap, BENCH_MISS_KEY(i));
+                pthread_mutex_unlock(args->mapLock);
+            }
+        }
+
+        pthread_barrier_wait(args->barrier);
+        if ( args->isTimer )
+            args->phaseNs[phase] = bench_now_ns() - startTime;
+    }
+
+    return NULL;
+}
+
+/**
+ * run_row - Run #numThreads threads over #numKeys keys, with the concurrent set or
+ *             the locked map
+ *
+ *      @param phaseNs <double *> - Will be set to the NUM_PHASES times, in nanoseconds
+ *
+ *      @param freezeNs <double *> - Will be set to the time to freeze and list the values
+ *                      (the concurrent set), or to list them (the map)
+ */
+static void run_row(size_t numKeys, unsigned int numThreads, int isConcurrent, double *phaseNs, double *freezeNs)
+{
+    pthread_t threads[MAX_THREADS];
+    struct BenchThreadArgs threadArgs[MAX_THREADS];
+    pthread_barrier_t barrier;
+    pthread_mutex_t mapLock = PTHREAD_MUTEX_INITIALIZER;
+    ConcurrentIntSet *intSet = NULL;
+    SimpleIntMap *intMap = NULL;
+    unsigned int i;
+    size_t check, numValues;
+    double startTime;
+    int *values;
+
+    if ( isConcurrent )
+        intSet = concurrent_int_set_create(numKeys);
+    else
+        intMap = simple_int_map_create((unsigned int)numKeys);
+
+    pthread_barrier_init(&barrier, NULL, numThreads);
+
+    for( i=0; i < numThreads; i++ )
+    {
+        threadArgs[i].intSet = intSet;
+        threadArgs[i].intMap = intMap;
+        threadArgs[i].mapLock = &mapLock;
+        threadArgs[i].barrier = &barrier;
+        threadArgs[i].firstKey = numKeys * i / numThreads;
+        threadArgs[i].numKeys = numKeys * (i + 1) / numThreads - threadArgs[i].firstKey;
+        threadArgs[i].check = 0;
+        threadArgs[i].isTimer = ( i == 0 );
+
+        pthread_create(&threads[i], NULL, bench_thread, &threadArgs[i]);
+    }
+
+    check = 0;
+    for( i=0; i < numThreads; i++ )
+    {
+        pthread_join(threads[i], NULL);
+        check += threadArgs[i].check;
+    }
+    pthread_barrier_destroy(&barrier);
+
+    memcpy(phaseNs, threadArgs[0].phaseNs, sizeof(threadArgs[0].phaseNs));
+
+    startTime = bench_now_ns();
+    if ( isConcurrent )
+    {
+        concurrent_int_set_freeze(intSet);
+        values = concurrent_int_set_values(intSet, &numValues);
+    }
+    else
+    {
+        values = simple_int_map_values(intMap, &numValues);
+    }
+    *freezeNs = bench_now_ns() - startTime;
+    free(values);
+
+    /* Every add and hit succeeded, and every miss missed */
+    if ( check != numKeys * 2 || numValues != numKeys )
+        fprintf(stderr, "Warning: %zu threads gave the wrong answers (%zu of %zu, %zu values)\n", (size_t)numThreads, check, numKeys * 2, numValues);
+
+    if ( isConcurrent )
+        concurrent_int_set_destroy(intSet);
+    else
+        simple_int_map_destroy(intMap);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t numKeys = 4 * 1024 * 1024;
+    unsigned int numThreads;
+    double phaseNs[NUM_PHASES], freezeNs;
+    double firstAddNs = 0;
+    int isConcurrent;
+
+    if ( argc > 1 )
+        numKeys = strtoul(argv[1], NULL, 10);
+
+    if ( numKeys < MAX_THREADS )
+    {
+        fprintf(stderr, "Usage: bench_concurrent_int_set (Optional: [number of keys, at least %d, default 4194304])\n", MAX_THREADS);
+        return 1;
+    }
+
+    printf("%zu keys. Millions of operations per second across all threads (higher is better),\n", numKeys);
+    printf("\"freeze+values\" in milliseconds.\n\n");
+    printf("%-16s  %7s  %9s  %9s  %9s  %13s  %11s\n", "Set", "Threads", "add", "hit", "miss", "freeze+values", "add speedup");
+
+    for( isConcurrent=1; isConcurrent >= 0; isConcurrent-- )
+    {
+        for( numThreads=1; numThreads <= MAX_THREADS; numThreads *= 2 )
+        {
+            run_row(numKeys, numThreads, isConcurrent, phaseNs, &freezeNs);
+            if ( numThreads == 1 )
+                firstAddNs = phaseNs[PHASE_ADD];
+
+            printf("%-16s  %7u  %9.1f  %9.1f  %9.1f  %13.2f  %10.2fx\n", isConcurrent ? "concurrent set" : "map + mutex", numThreads,
+                numKeys / (phaseNs[PHASE_ADD] / 1000.0), numKeys / (phaseNs[PHASE_HIT] / 1000.0),
+                numKeys / (phaseNs[PHASE_MISS] / 1000.0), freezeNs / 1000000.0, firstAddNs / phaseNs[PHASE_ADD]);
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * bench_pid_bitset.c - Benchmark PidBitset against SimpleIntMap (+ qsort, where
+ *                        sorted output is needed) as a set of pids
+ *
+ *   Run at the two usual pid_max values, 32768 and 4194304, with sets of random
+ *     pids from a handful to nearly every pid. For each, reports the memory held,
+ *     filling a set and listing it sorted (as proc_children_get does), contains,
+ *     and union / intersect / difference of two such sets into a new one.
+ *
+ *   The "dense" column is PID_BITSET_IS_DENSE, which is what proc_children_get
+ *     uses to pick the bitset. It should say yes about where the bitset starts winning
+ *     the "fill + sorted" column.
+ *
+ *   Usage: bench_pid_bitset
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pid_tools.h"
+#include "simple_int_map.h"
+#include "pid_bitset.h"
+
+#include "bench_utils.h"
+
+
+/* OPS_PER_ROW - Repeat each row until about this many pids have gone through each phase */
+#define OPS_PER_ROW (2 * 1024 * 1024)
+
+/* MAX_ROUNDS - ..or this many times, as small sets still pay for every word of a large pid_max */
+#define MAX_ROUNDS 1000
+
+/* MAP_SIZE_HINT - Size hint the callers create their SimpleIntMap with */
+#define MAP_SIZE_HINT 1000
+
+/* Phases timed, and the columns printed */
+enum { PHASE_FILL_SORTED, PHASE_CONTAINS, PHASE_UNION, PHASE_INTERSECT, PHASE_DIFFERENCE, NUM_PHASES };
+
+static int cmp_pids(const void *p1, const void *p2)
+{
+    pid_t val1, val2;
+
+    val1 = *((pid_t *)p1);
+    val2 = *((pid_t *)p2);
+
+    return (val1 > val2) - (val1 < val2);
+}
+
+/**
+ * random_pids - Pick #numPids different random pids below #pidMax (leaving out 0)
+ *
+ *      @return <pid_t *> - A malloc'd list of the pids, in random order
+ */
+static pid_t *random_pids(pid_t pidMax, size_t numPids)
+{
+    char *isPicked;
+    pid_t *ret;
+    pid_t pid;
+    size_t i;
+
+    isPicked = calloc( pidMax, 1 );
+    ret = malloc( sizeof(pid_t) * numPids );
+
+    for( i=0; i < numPids; )
+    {
+        pid = (pid_t)( 1 + bench_rand() % (unsigned int)(pidMax - 1) );
+        if ( isPicked[pid] )
+            continue;
+
+        isPicked[pid] = 1;
+        ret[ i++ ] = pid;
+    }
+
+    free(isPicked);
+
+    return ret;
+}
+
+/**
+ * map_from - Create a SimpleIntMap holding #pids
+ */
+static SimpleIntMap *map_from(const pid_t *pids, size_t numPids)
+{
+    SimpleIntMap *intMap;
+    size_t i;
+
+    intMap = simple_int_map_create(MAP_SIZE_HINT);
+    for( i=0; i < numPids; i++ )
+        simple_int_map_add(intMap, pids[i]);
+
+    return intMap;
+}
+
+/**
+ * bitset_from - Create a PidBitset holding #pids
+ */
+static PidBitset *bitset_from(pid_t pidMax, const pid_t *pids, size_t numPids)
+{
+    PidBitset *bitset;
+    size_t i;
+
+    bitset = pid_bitset_create(pidMax);
+    for( i=0; i < numPids; i++ )
+        pid_bitset_add(bitset, pids[i]);
+
+    return bitset;
+}
+
+/**
+ * map_combine - The map equivalent of a bitset union (0), intersect (1) or difference (2),
+ *                 into a new map
+ */
+static SimpleIntMap *map_combine(SimpleIntMap *mapA, SimpleIntMap *mapB, int op)
+{
+    SimpleIntMap *ret;
+    int *values;
+    size_t numValues, i;
+
+    ret = simple_int_map_create(MAP_SIZE_HINT);
+
+    values = simple_int_map_values(mapA, &numValues);
+    for( i=0; i < numValues; i++ )
+    {
+        if ( op == 0 || ( simple_int_map_contains(mapB, values[i]) == ( op == 1 ) ) )
+            simple_int_map_add(ret, values[i]);
+    }
+    free(values);
+
+    if ( op == 0 )
+    {
+        values = simple_int_map_values(mapB, &numValues);
+        for( i=0; i < numValues; i++ )
+            simple_int_map_add(ret, values[i]);
+        free(values);
+    }
+
+    return ret;
+}
+
+/**
+ * bitset_combine - Union (0), intersect (1) or difference (2) of two bitsets, into a new one
+ */
+static PidBitset *bitset_combine(PidBitset *setA, PidBitset *setB, int op)
+{
+    PidBitset *ret;
+
+    ret = pid_bitset_create(setA->pidMax);
+    memcpy(ret->words, setA->words, sizeof(uint64_t) * setA->numWords);
+
+    if ( op == 0 )
+        pid_bitset_union(ret, setB);
+    else if ( op == 1 )
+        pid_bitset_intersect(ret, setB);
+    else
+        pid_bitset_difference(ret, setB);
+
+    return ret;
+}
+
+/**
+ * run_row - Time every phase for both kinds of set, and print a row for each
+ */
+static void run_row(pid_t pidMax, size_t numPids)
+{
+    pid_t *pidsA, *pidsB, *queries;
+    unsigned int round, numRounds;
+    double mapNs[NUM_PHASES], bitsetNs[NUM_PHASES];
+    size_t mapBytes, bitsetBytes;
+    size_t i, numValues, check;
+    double startTime;
+    SimpleIntMap *mapA, *mapB, *mapResult;
+    PidBitset *setA, *setB, *setResult;
+    pid_t *values;
+    int op;
+
+    pidsA = random_pids(pidMax, numPids);
+    pidsB = random_pids(pidMax, numPids);
+
+    /* Half of them in the set */
+    queries = malloc( sizeof(pid_t) * numPids );
+    for( i=0; i < numPids; i++ )
+        queries[i] = ( i & 1 ) ? pidsA[i] : pidsB[i];
+
+    numRounds = numPids < OPS_PER_ROW ? OPS_PER_ROW / numPids : 1;
+    if ( numRounds > MAX_ROUNDS )
+        numRounds = MAX_ROUNDS;
+
+    memset(mapNs, 0, sizeof(mapNs));
+    memset(bitsetNs, 0, sizeof(bitsetNs));
+    check = 0;
+
+    for( round=0; round < numRounds; round++ )
+    {
+        startTime = bench_now_ns();
+        mapA = map_from(pidsA, numPids);
+        values = simple_int_map_values(mapA, &numValues);
+        qsort(values, numValues, sizeof(pid_t), cmp_pids);
+        mapNs[PHASE_FILL_SORTED] += bench_now_ns() - startTime;
+        check += values[0];
+        free(values);
+
+        startTime = bench_now_ns();
+        setA = bitset_from(pidMax, pidsA, numPids);
+        values = pid_bitset_values(setA, &numValues);
+        bitsetNs[PHASE_FILL_SORTED] += bench_now_ns() - startTime;
+        check -= values[0];
+        free(values);
+
+        startTime = bench_now_ns();
+        for( i=0; i < numPids; i++ )
+            check += simple_int_map_contains(mapA, queries[i]);
+        mapNs[PHASE_CONTAINS] += bench_now_ns() - startTime;
+
+        startTime = bench_now_ns();
+        for( i=0; i < numPids; i++ )
+            check -= pid_bitset_contains(setA, queries[i]);
+        bitsetNs[PHASE_CONTAINS] += bench_now_ns() - startTime;
+
+        mapB = map_from(pidsB, numPids);
+        setB = bitset_from(pidMax, pidsB, numPids);
+
+        for( op=0; op < 3; op++ )
+        {
+            startTime = bench_now_ns();
+            mapResult = map_combine(mapA, mapB, op);
+            mapNs[PHASE_UNION + op] += bench_now_ns() - startTime;
+
+            startTime = bench_now_ns();
+            setResult = bitset_combine(setA, setB, op);
+            bitsetNs[PHASE_UNION + op] += bench_now_ns() - startTime;
+
+            check += MAP_NUM_ENTRIES(mapResult) - pid_bitset_count(setResult);
+
+            simple_int_map_destroy(mapResult);
+            pid_bitset_destroy(setResult);
+        }
+
+        if ( round == 0 )
+        {
+            mapBytes = sizeof(SimpleIntMap) + mapA->capacity * sizeof(int);
+            bitsetBytes = sizeof(PidBitset) + setA->numWords * sizeof(uint64_t);
+        }
+
+        simple_int_map_destroy(mapA);
+        simple_int_map_destroy(mapB);
+        pid_bitset_destroy(setA);
+        pid_bitset_destroy(setB);
+    }
+
+    if ( check != 0 )
+        fprintf(stderr, "Warning: the sets gave different answers\n");
+
+    printf("%8d  %7zu  %-6s  %-5s  %8.1f  %12.2f  %8.2f  %9.2f  %9.2f  %10.2f\n",
+        (int)pidMax, numPids, "map", "", mapBytes / 1024.0,
+        mapNs[PHASE_FILL_SORTED] / numRounds / 1000.0, mapNs[PHASE_CONTAINS] / numRounds / numPids,
+        mapNs[PHASE_UNION] / numRounds / 1000.0, mapNs[PHASE_INTERSECT] / numRounds / 1000.0,
+        mapNs[PHASE_DIFFERENCE] / numRounds / 1000.0);
+
+    printf("%8d  %7zu  %-6s  %-5s  %8.1f  %12.2f  %8.2f  %9.2f  %9.2f  %10.2f\n",
+        (int)pidMax, numPids, "bitset", PID_BITSET_IS_DENSE(numPids, pidMax) ? "yes" : "no", bitsetBytes / 1024.0,
+        bitsetNs[PHASE_FILL_SORTED] / numRounds / 1000.0, bitsetNs[PHASE_CONTAINS] / numRounds / numPids,
+        bitsetNs[PHASE_UNION] / numRounds / 1000.0, bitsetNs[PHASE_INTERSECT] / numRounds / 1000.0,
+        bitsetNs[PHASE_DIFFERENCE] / numRounds / 1000.0);
+
+    free(pidsA);
+    free(pidsB);
+    free(queries);
+}
+
+int main(int argc, char* argv[])
+{
+    static const pid_t pidMaxes[] = { 32768, 4194304 };
+    static const size_t setSizes[] = { 10, 100, 1000, 4000, 10000, 30000, 100000, 1000000 };
+    unsigned int maxIdx, sizeIdx;
+
+    printf("Memory in KB, \"fill + sorted\" and set operations in microseconds per set, contains in ns per pid.\n");
+    printf("Set operations combine two sets of that many pids into a new set.\n\n");
+    printf("%8s  %7s  %-6s  %-5s  %8s  %12s  %8s  %9s  %9s  %10s\n",
+        "pid_max", "pids", "set", "dense", "memory", "fill+sorted", "contains", "union", "intersect", "difference");
+
+    for( maxIdx=0; maxIdx < sizeof(pidMaxes) / sizeof(pidMaxes[0]); maxIdx++ )
+    {
+        for( sizeIdx=0; sizeIdx < sizeof(setSizes) / sizeof(setSizes[0]); sizeIdx++ )
+        {
+            /* Leave room to pick random pids without searching forever */
+            if ( setSizes[sizeIdx] > (size_t)pidMaxes[maxIdx] - (size_t)pidMaxes[maxIdx] / 8 )
+                break;
+
+            run_row(pidMaxes[maxIdx], setSizes[sizeIdx]);
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * bench_pid_tree.c - Benchmark for building and querying the parent->children index
+ *
+ *   Uses synthetic process tables so results are reproducible and can go
+ *     well beyond the size of the live process table.
+ *
+ *   Usage: bench_pid_tree
+ *              Run over synthetic tables of increasing size, then compare
+ *              ancestor checks and "which root is this pid under" lookups
+ *              walking parents versus depth-first intervals
+ *
+ *          bench_pid_tree [snapshot file]
+ *              Run over a snapshot written by pidsnap (or --write-synthetic)
+ *
+ *          bench_pid_tree --write-synthetic [numPids] [snapshot file]
+ *              Write a synthetic table of #numPids pids as a snapshot file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "pid_tools.h"
+#include "pid_tree.h"
+#include "pid_snapshot.h"
+
+#include "bench_utils.h"
+
+
+/**
+ * make_synthetic_table - Create a process table of #numPids pids, where every
+ *     pid other than 1 has a random parent with a lower pid (like a real fork tree)
+ */
+static void make_synthetic_table(size_t numPids, pid_t **pidsOut, pid_t **ppidsOut)
+{
+    pid_t *pids, *ppids;
+    size_t i;
+
+    pids = malloc( sizeof(pid_t) * numPids );
+    ppids = malloc( sizeof(pid_t) * numPids );
+
+    for( i=0; i < numPids; i++ )
+    {
+        pids[i] = (pid_t) (i + 1);
+        /* Bias towards recent parents, so the tree has some depth */
+        if ( i == 0 )
+            ppids[i] = 1;
+        else if ( bench_rand() % 4 == 0 )
+            ppids[i] = 1 + (bench_rand() % i);
+        else
+            ppids[i] = 1 + i - 1 - ( bench_rand() % ( i < 16 ? i : 16 ) );
+    }
+
+    *pidsOut = pids;
+    *ppidsOut = ppids;
+}
+
+/**
+ * write_synthetic_snapshot - Write a synthetic table as a snapshot file
+ *
+ *      @return <int> - Exit code for main
+ */
+static int write_synthetic_snapshot(size_t numPids, const char *path)
+{
+    PidSnapshotEntry *entries;
+    pid_t *pids, *ppids;
+    size_t i;
+    int ret;
+
+    make_synthetic_table(numPids, &pids, &ppids);
+
+    entries = calloc( numPids + 1, sizeof(PidSnapshotEntry) );
+    for( i=0; i < numPids; i++ )
+    {
+        entries[i].pid = pids[i];
+        entries[i].ppid = i == 0 ? 0 : ppids[i];
+        entries[i].startTime = i;
+        entries[i].uid = bench_rand() % 1000;
+        sprintf(entries[i].comm, "proc%zu", i % 100000);
+    }
+
+    ret = pid_snapshot_write(path, entries, numPids);
+    if ( ret != 0 )
+        fprintf(stderr, "Failed to write '%s'. Error %d: %s\n", path, errno, strerror(errno));
+
+    free(entries);
+    free(pids);
+    free(ppids);
+
+    return ret == 0 ? 0 : 1;
+}
+
+/**
+ * bench_snapshot - Time opening a snapshot and querying its stored index,
+ *                    versus rebuilding the index from its pids and parents.
+ *
+ *      @return <int> - Exit code for main
+ */
+static int bench_snapshot(const char *path)
+{
+    PidSnapshot *snapshot;
+    PidTree *pidTree;
+    pid_t *pids, *ppids, *children;
+    pid_t rootPid;
+    size_t numPids, numChildren, i;
+    double startTime, openTime, queryTime, buildTime, rebuiltQueryTime;
+
+    startTime = bench_now_ns();
+    snapshot = pid_snapshot_open(path);
+    openTime = bench_now_ns() - startTime;
+
+    if ( snapshot == NULL )
+    {
+        fprintf(stderr, "Cannot open snapshot '%s'. Error %d: %s\n", path, errno, strerror(errno));
+        return 1;
+    }
+
+    numPids = PID_SNAPSHOT_NUM_ENTRIES(snapshot);
+
+    rootPid = 1;
+    startTime = bench_now_ns();
+    children = pid_tree_get_children(&snapshot->tree, &rootPid, 1, 1, &numChildren);
+    queryTime = bench_now_ns() - startTime;
+    free(children);
+
+    pids = malloc( sizeof(pid_t) * (numPids + 1) );
+    ppids = malloc( sizeof(pid_t) * (numPids + 1) );
+    for( i=0; i < numPids; i++ )
+    {
+        pids[i] = snapshot->pids[i];
+        ppids[i] = snapshot->ppids[i] != 0 ? snapshot->ppids[i] : 1;
+    }
+
+    startTime = bench_now_ns();
+    pidTree = pid_tree_create(pids, ppids, numPids);
+    buildTime = bench_now_ns() - startTime;
+
+    startTime = bench_now_ns();
+    children = pid_tree_get_children(pidTree, &rootPid, 1, 1, &numChildren);
+    rebuiltQueryTime = bench_now_ns() - startTime;
+    free(children);
+
+    printf("Snapshot '%s' from host '%s': %zu pids\n\n", path, snapshot->header->hostname, numPids);
+    printf("%-36s %12.3f ms\n", "Open + read + validate:", openTime / 1e6);
+    printf("%-36s %12.3f ms\n", "Query -r 1 on stored index:", queryTime / 1e6);
+    printf("%-36s %12.3f ms\n", "Rebuild index from pids/ppids:", buildTime / 1e6);
+    printf("%-36s %12.3f ms\n", "Query -r 1 on rebuilt index:", rebuiltQueryTime / 1e6);
+    printf("\nMatched %zu pids\n", numChildren);
+
+    pid_tree_destroy(pidTree);
+    pid_snapshot_close(snapshot);
+
+    return 0;
+}
+
+/**
+ * walk_is_ancestor - Ancestor check by walking parents in the table, as getPpid
+ *                      chains do (minus the cost of /proc)
+ */
+static int walk_is_ancestor(const PidTree *pidTree, pid_t ancestorPid, pid_t pid)
+{
+    ssize_t idx;
+
+    /* Strictly above, even for init which is its own parent here */
+    if ( pid == ancestorPid )
+        return 0;
+
+    idx = pid_tree_index_of(pidTree, pid);
+    while ( idx >= 0 && pidTree->ppids[idx] != ancestorPid && pidTree->ppids[idx] != pidTree->pids[idx] )
+        idx = pid_tree_index_of(pidTree, pidTree->ppids[idx]);
+
+    return idx >= 0 && pidTree->ppids[idx] == ancestorPid;
+}
+
+/**
+ * walk_find_root - Nearest of the marked roots above #pid, by walking parents
+ */
+static pid_t walk_find_root(const PidTree *pidTree, const char *isRoot, pid_t pid)
+{
+    ssize_t idx;
+
+    idx = pid_tree_index_of(pidTree, pid);
+    while ( idx >= 0 && pidTree->ppids[idx] != pidTree->pids[idx] )
+    {
+        idx = pid_tree_index_of(pidTree, pidTree->ppids[idx]);
+        if ( idx >= 0 && isRoot[idx] )
+            return pidTree->pids[idx];
+    }
+
+    return 0;
+}
+
+/**
+ * bench_intervals - Time ancestor checks and root lookups over synthetic tables,
+ *                     walking parents versus the depth-first interval index
+ */
+static void bench_intervals(void)
+{
+    static const size_t SIZES[] = { 10000, 100000, 1000000 };
+    static const size_t NUM_QUESTIONS = 1000000;
+    static const size_t NUM_ROOTS = 200;
+
+    pid_t *pids, *ppids, *questions, *rootPids;
+    char *isRoot;
+    size_t i, j;
+    size_t numWalkYes, numIndexYes, numWalkFound, numIndexFound;
+    double startTime, indexTime, walkTime, intervalTime, rootTableTime, rootWalkTime, rootFindTime;
+    PidTree *pidTree;
+    PidTreeIntervals *intervals;
+    PidTreeRootTable *rootTable;
+    pid_t root;
+
+    questions = malloc( sizeof(pid_t) * NUM_QUESTIONS * 2 );
+    rootPids = malloc( sizeof(pid_t) * NUM_ROOTS );
+
+    printf("\n%10s %12s  %14s %14s  %14s %14s\n", "numPids", "index (ms)",
+        "walk ns/check", "index ns/check", "walk ns/root", "index ns/root");
+
+    for( i=0; i < sizeof(SIZES) / sizeof(SIZES[0]); i++ )
+    {
+        make_synthetic_table(SIZES[i], &pids, &ppids);
+        pidTree = pid_tree_create(pids, ppids, SIZES[i]);
+
+        for( j=0; j < NUM_QUESTIONS * 2; j++ )
+            questions[j] = 1 + ( bench_rand() % SIZES[i] );
+
+        isRoot = calloc( SIZES[i], 1 );
+        for( j=0; j < NUM_ROOTS; j++ )
+        {
+            rootPids[j] = 2 + ( bench_rand() % (SIZES[i] - 1) );
+            isRoot[ rootPids[j] - 1 ] = 1;
+        }
+
+        startTime = bench_now_ns();
+        intervals = pid_tree_intervals_create(pidTree);
+        indexTime = bench_now_ns() - startTime;
+
+        numWalkYes = 0;
+        startTime = bench_now_ns();
+        for( j=0; j < NUM_QUESTIONS; j++ )
+            numWalkYes += walk_is_ancestor(pidTree, questions[j * 2], questions[j * 2 + 1]);
+        walkTime = bench_now_ns() - startTime;
+
+        numIndexYes = 0;
+        startTime = bench_now_ns();
+        for( j=0; j < NUM_QUESTIONS; j++ )
+            numIndexYes += pid_tree_intervals_is_ancestor(intervals, questions[j * 2], questions[j * 2 + 1]) == 1;
+        intervalTime = bench_now_ns() - startTime;
+
+        numWalkFound = 0;
+        startTime = bench_now_ns();
+        for( j=0; j < NUM_QUESTIONS; j++ )
+            numWalkFound += walk_find_root(pidTree, isRoot, questions[j]) != 0;
+        rootWalkTime = bench_now_ns() - startTime;
+
+        numIndexFound = 0;
+        startTime = bench_now_ns();
+        rootTable = pid_tree_root_table_create(intervals, rootPids, NUM_ROOTS);
+        rootTableTime = bench_now_ns() - startTime;
+        for( j=0; j < NUM_QUESTIONS; j++ )
+        {
+            root = pid_tree_root_table_find(rootTable, questions[j]);
+            numIndexFound += root > 0;
+        }
+        rootFindTime = bench_now_ns() - startTime;
+
+        if ( numWalkYes != numIndexYes || numWalkFound != numIndexFound )
+            fprintf(stderr, "WARNING: Answers differ (%zu vs %zu yes, %zu vs %zu under a root)\n",
+                numWalkYes, numIndexYes, numWalkFound, numIndexFound);
+
+        printf("%10zu %12.3f  %14.2f %14.2f  %14.2f %14.2f\n", SIZES[i], (indexTime + rootTableTime) / 1e6,
+            walkTime / NUM_QUESTIONS, intervalTime / NUM_QUESTIONS,
+            rootWalkTime / NUM_QUESTIONS, rootFindTime / NUM_QUESTIONS);
+
+        pid_tree_root_table_destroy(rootTable);
+        pid_tree_intervals_destroy(intervals);
+        pid_tree_destroy(pidTree);
+        free(isRoot);
+    }
+
+    printf("\n(%zu random checks per size, %zu roots)\n", NUM_QUESTIONS, NUM_ROOTS);
+
+    free(rootPids);
+    free(questions);
+}
+
+int main(int argc, char* argv[])
+{
+    static const size_t SIZES[] = { 1000, 10000, 100000, 1000000, 4000000 };
+
+    pid_t *pids, *ppids, *children;
+    pid_t rootPid;
+    size_t numChildren;
+    unsigned int i;
+    double startTime, buildTime, queryTime;
+    PidTree *pidTree;
+
+    if ( argc > 1 && strcmp(argv[1], "--write-synthetic") == 0 )
+    {
+        if ( argc != 4 || atol(argv[2]) <= 0 )
+        {
+            fputs("Usage: bench_pid_tree --write-synthetic [numPids] [snapshot file]\n", stderr);
+            return 1;
+        }
+        return write_synthetic_snapshot(atol(argv[2]), argv[3]);
+    }
+
+    if ( argc > 1 )
+        return bench_snapshot(argv[1]);
+
+    printf("%10s %14s %14s %14s %12s\n", "numPids", "build (ms)", "query -r (ms)", "ns per pid", "matched");
+
+    for( i=0; i < sizeof(SIZES) / sizeof(SIZES[0]); i++ )
+    {
+        make_synthetic_table(SIZES[i], &pids, &ppids);
+
+        startTime = bench_now_ns();
+        pidTree = pid_tree_create(pids, ppids, SIZES[i]);
+        buildTime = bench_now_ns() - startTime;
+
+        rootPid = 1;
+        startTime = bench_now_ns();
+        children = pid_tree_get_children(pidTree, &rootPid, 1, 1, &numChildren);
+        queryTime = bench_now_ns() - startTime;
+
+        printf("%10zu %14.3f %14.3f %14.2f %12zu\n", SIZES[i], buildTime / 1e6, queryTime / 1e6,
+            (buildTime + queryTime) / SIZES[i], numChildren);
+
+        free(children);
+        pid_tree_destroy(pidTree);
+    }
+
+    bench_intervals();
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * bench_pidtreed.c - Benchmark parent lookups and full-table copies from a running
+ *                      pidtreed's shared table, versus reading /proc
+ *
+ *   Start pidtreed first (with the same $PIDTREED_SHM, if set).
+ *
+ *   Usage: bench_pidtreed (Optional: [iterations])
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pid_tools.h"
+#include "proc_handle.h"
+#include "proc_pids.h"
+#include "pidtreed_shm.h"
+
+#include "bench_utils.h"
+
+
+/**
+ * read_ppid_proc - Read the parent of a pid from /proc/$PID/stat
+ */
+static pid_t read_ppid_proc(pid_t pid)
+{
+    char buff[256];
+    char *cur;
+    ssize_t bytesRead;
+    int fd;
+
+    fd = proc_open_pid_file(pid, "stat", O_RDONLY);
+    if ( fd < 0 )
+        return -1;
+
+    bytesRead = read(fd, buff, sizeof(buff) - 1);
+    close(fd);
+    if ( bytesRead <= 0 )
+        return -1;
+    buff[bytesRead] = '\0';
+
+    cur = strrchr(buff, ')');
+    if ( cur == NULL )
+        return -1;
+
+    /* ") S ppid" */
+    return atoi(cur + 4);
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int numIterations = 200;
+    unsigned int i;
+    size_t j;
+    pid_t *pids, *tablePids, *tablePpids;
+    size_t numPids, numTablePids;
+    double startTime, procTime, tableTime, copyTime;
+    volatile pid_t sink;
+
+    if ( argc > 1 )
+        numIterations = atoi(argv[1]);
+
+    if ( pidtreed_client_get() == NULL || pidtreed_copy_table(&tablePids, &tablePpids, &numTablePids) != 0 )
+    {
+        fprintf(stderr, "No usable pidtreed table found at '%s'. Start pidtreed first, as root so it gets process events.\n", pidtreed_get_path());
+        return 1;
+    }
+    free(tablePids);
+    free(tablePpids);
+
+    pids = proc_pids_get_all(&numPids);
+
+    startTime = bench_now_ns();
+    for( i=0; i < numIterations; i++ )
+    {
+        for( j=0; j < numPids; j++ )
+            sink = read_ppid_proc(pids[j]);
+    }
+    procTime = bench_now_ns() - startTime;
+
+    startTime = bench_now_ns();
+    for( i=0; i < numIterations; i++ )
+    {
+        for( j=0; j < numPids; j++ )
+            sink = pidtreed_lookup_ppid(pids[j]);
+    }
+    tableTime = bench_now_ns() - startTime;
+
+    startTime = bench_now_ns();
+    for( i=0; i < numIterations; i++ )
+    {
+        pidtreed_copy_table(&tablePids, &tablePpids, &numTablePids);
+        free(tablePids);
+        free(tablePpids);
+    }
+    copyTime = bench_now_ns() - startTime;
+
+    (void)sink;
+
+    printf("Looked up %zu pids, %u iterations each\n\n", numPids, numIterations);
+    printf("%-36s %12.3f us per lookup\n", "/proc/$PID/stat:", procTime / numIterations / numPids / 1000.0);
+    printf("%-36s %12.3f us per lookup\n", "pidtreed table:", tableTime / numIterations / numPids / 1000.0);
+    printf("\nSpeedup: %.2fx\n\n", procTime / tableTime);
+    printf("%-36s %12.2f us per copy (%zu entries)\n", "Full table copy (getcpids):", copyTime / numIterations / 1000.0, numTablePids);
+
+    free(pids);
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * bench_proc_pids.c - Benchmark listing all pids via getdents64 (proc_pids.c)
+ *                       versus the previous readdir + SimpleIntMap + qsort path
+ *
+ *   Usage: bench_proc_pids (Optional: [iterations])
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <ctype.h>
+
+#include "pid_tools.h"
+#include "simple_int_map.h"
+#include "proc_pids.h"
+
+#include "bench_utils.h"
+
+
+static int cmp_pids(const void *p1, const void *p2)
+{
+    pid_t val1, val2;
+
+    val1 = *((pid_t *)p1);
+    val2 = *((pid_t *)p2);
+
+    return val1 - val2;
+}
+
+/**
+ * get_all_pids_readdir - The way getcpids listed pids before proc_pids.c
+ */
+static pid_t *get_all_pids_readdir(size_t *numPids)
+{
+    SimpleIntMap *allPidsMap;
+    DIR *procDir;
+    struct dirent *dirInfo;
+    pid_t *ret;
+
+    allPidsMap = simple_int_map_create(25);
+
+    procDir = opendir("/proc");
+    while( (dirInfo = readdir(procDir)) )
+    {
+        if(!isdigit(dirInfo->d_name[0]))
+                continue;
+
+        simple_int_map_add( allPidsMap, atoi(dirInfo->d_name) );
+    }
+    closedir(procDir);
+
+    ret = simple_int_map_values(allPidsMap, numPids);
+    simple_int_map_destroy(allPidsMap);
+
+    qsort(ret, *numPids, sizeof(pid_t), cmp_pids);
+
+    return ret;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int numIterations = 2000;
+    unsigned int i;
+    size_t numPidsOld, numPidsNew;
+    pid_t *pids;
+    double startTime, oldTime, newTime;
+
+    if ( argc > 1 )
+        numIterations = atoi(argv[1]);
+
+    startTime = bench_now_ns();
+    for( i=0; i < numIterations; i++ )
+    {
+        pids = get_all_pids_readdir(&numPidsOld);
+        free(pids);
+    }
+    oldTime = bench_now_ns() - startTime;
+
+    startTime = bench_now_ns();
+    for( i=0; i < numIterations; i++ )
+    {
+        pids = proc_pids_get_all(&numPidsNew);
+        free(pids);
+    }
+    newTime = bench_now_ns() - startTime;
+
+    printf("Listed ~%zu pids, %u iterations each\n\n", numPidsNew, numIterations);
+    printf("%-36s %12.2f us per listing\n", "readdir + SimpleIntMap + qsort:", oldTime / numIterations / 1000.0);
+    printf("%-36s %12.2f us per listing\n", "getdents64 (proc_pids_get_all):", newTime / numIterations / 1000.0);
+    printf("\nSpeedup: %.2fx\n", oldTime / newTime);
+
+    return 0;
+}
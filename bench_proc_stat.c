@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * bench_proc_stat.c - Benchmark parsing /proc/$PID/stat lines
+ *
+ *   The corpus is the stat line of every process currently running, plus
+ *     copies of them renamed to awkward names (spaces and parens), which
+ *     the old space-counting parser in getPpid got wrong.
+ *
+ *   Only parsing is timed, the lines are all read up front.
+ *
+ *   Usage: bench_proc_stat (Optional: [iterations])
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pid_tools.h"
+#include "proc_handle.h"
+#include "proc_pids.h"
+#include "proc_stat.h"
+
+#include "bench_utils.h"
+
+
+#define ALL_FIELDS ( PROC_STAT_FIELD_COMM | PROC_STAT_FIELD_STATE | PROC_STAT_FIELD_PPID | PROC_STAT_FIELD_PGRP | \
+                     PROC_STAT_FIELD_SESSION | PROC_STAT_FIELD_UTIME | PROC_STAT_FIELD_STIME | \
+                     PROC_STAT_FIELD_NUM_THREADS | PROC_STAT_FIELD_STARTTIME | PROC_STAT_FIELD_RSS )
+
+static const char *awkwardNames[] = { "a) b (c", "x y z", ")", "((", ") 1 2 3 (" };
+#define NUM_AWKWARD_NAMES ( sizeof(awkwardNames) / sizeof(awkwardNames[0]) )
+
+typedef struct {
+    char *line;
+    size_t len;
+} StatLine;
+
+
+/**
+ * old_space_count_ppid - The parser getPpid used to have. Takes the 4th space-separated field.
+ */
+static pid_t old_space_count_ppid(const char *line)
+{
+    char buff[128];
+    char *cur;
+    unsigned int numSpaces;
+
+    strncpy(buff, line, 127);
+    buff[127] = '\0';
+
+    for( cur = buff, numSpaces = 0; numSpaces < 3 && *cur != '\0'; cur++ )
+    {
+        if ( *cur == ' ' )
+            numSpaces++;
+    }
+
+    return (pid_t)atoi(cur);
+}
+
+/**
+ * reference_parse - Straightforward strrchr + strtoull walk over every field, used
+ *                     to check the results (and as the baseline time)
+ */
+static void reference_parse(const char *line, ProcStat *stat)
+{
+    const char *cur;
+    unsigned int fieldNum;
+    unsigned long long value;
+
+    stat->pid = atoi(line);
+    cur = strrchr(line, ')') + 2;
+    stat->state = *cur;
+
+    for( fieldNum = 3; cur != NULL; fieldNum++ )
+    {
+        value = strtoll(cur, NULL, 10);
+        switch( fieldNum )
+        {
+            case 4:  stat->ppid = (pid_t)value; break;
+            case 5:  stat->pgrp = (pid_t)value; break;
+            case 6:  stat->session = (pid_t)value; break;
+            case 14: stat->utime = value; break;
+            case 15: stat->stime = value; break;
+            case 20: stat->numThreads = (long)value; break;
+            case 22: stat->startTime = value; break;
+            case 24: stat->rss = (long)value; return;
+        }
+
+        cur = strchr(cur, ' ');
+        if ( cur != NULL )
+            cur++;
+    }
+}
+
+/**
+ * read_corpus - Read every stat line, plus the renamed copies
+ */
+static StatLine *read_corpus(size_t *numLines)
+{
+    char buff[PROC_STAT_READ_SIZE];
+    StatLine *lines;
+    pid_t *pids;
+    size_t numPids, i, j, n;
+    ssize_t bytesRead;
+    char *commEnd;
+    int fd;
+
+    pids = proc_pids_get_all(&numPids);
+    lines = malloc( sizeof(StatLine) * numPids * (1 + NUM_AWKWARD_NAMES) );
+    n = 0;
+
+    for( i=0; i < numPids; i++ )
+    {
+        fd = proc_open_pid_file(pids[i], "stat", O_RDONLY);
+        if ( fd < 0 )
+            continue;
+        bytesRead = read(fd, buff, sizeof(buff) - 1);
+        close(fd);
+        if ( bytesRead <= 0 )
+            continue;
+        buff[bytesRead] = '\0';
+
+        lines[n].line = strdup(buff);
+        lines[n].len = bytesRead;
+        n++;
+
+        commEnd = strrchr(buff, ')');
+        for( j=0; j < NUM_AWKWARD_NAMES; j++ )
+        {
+            lines[n].line = malloc( bytesRead + 64 );
+            lines[n].len = sprintf(lines[n].line, "%d (%s%s", (int)pids[i], awkwardNames[j], commEnd);
+            n++;
+        }
+    }
+
+    free(pids);
+
+    *numLines = n;
+    return lines;
+}
+
+static int stats_match(const ProcStat *a, const ProcStat *b)
+{
+    return a->pid == b->pid && a->state == b->state && a->ppid == b->ppid && a->pgrp == b->pgrp &&
+        a->session == b->session && a->utime == b->utime && a->stime == b->stime &&
+        a->numThreads == b->numThreads && a->startTime == b->startTime && a->rss == b->rss;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int numIterations = 2000;
+    unsigned int i;
+    size_t j, numLines;
+    size_t oldMismatches = 0, newMismatches = 0;
+    StatLine *lines;
+    ProcStat stat, refStat;
+    double startTime, oldTime, refTime, ppidTime, allTime;
+    volatile long long sink = 0;
+
+    if ( argc > 1 )
+        numIterations = atoi(argv[1]);
+
+    lines = read_corpus(&numLines);
+
+    for( j=0; j < numLines; j++ )
+    {
+        memset(&refStat, 0, sizeof(ProcStat));
+        memset(&stat, 0, sizeof(ProcStat));
+        reference_parse(lines[j].line, &refStat);
+
+        if ( old_space_count_ppid(lines[j].line) != refStat.ppid )
+            oldMismatches++;
+
+        if ( proc_stat_parse(lines[j].line, lines[j].len, ALL_FIELDS, &stat) != 0 || !stats_match(&stat, &refStat) )
+        {
+            fprintf(stderr, "MISMATCH: %s", lines[j].line);
+            newMismatches++;
+        }
+    }
+
+    startTime = bench_now_ns();
+    for( i=0; i < numIterations; i++ )
+    {
+        for( j=0; j < numLines; j++ )
+            sink += old_space_count_ppid(lines[j].line);
+    }
+    oldTime = bench_now_ns() - startTime;
+
+    startTime = bench_now_ns();
+    for( i=0; i < numIterations; i++ )
+    {
+        for( j=0; j < numLines; j++ )
+        {
+            reference_parse(lines[j].line, &refStat);
+            sink += refStat.ppid;
+        }
+    }
+    refTime = bench_now_ns() - startTime;
+
+    startTime = bench_now_ns();
+    for( i=0; i < numIterations; i++ )
+    {
+        for( j=0; j < numLines; j++ )
+        {
+            proc_stat_parse(lines[j].line, lines[j].len, PROC_STAT_FIELD_PPID, &stat);
+            sink += stat.ppid;
+        }
+    }
+    ppidTime = bench_now_ns() - startTime;
+
+    startTime = bench_now_ns();
+    for( i=0; i < numIterations; i++ )
+    {
+        for( j=0; j < numLines; j++ )
+        {
+            proc_stat_parse(lines[j].line, lines[j].len, ALL_FIELDS, &stat);
+            sink += stat.rss;
+        }
+    }
+    allTime = bench_now_ns() - startTime;
+
+    (void)sink;
+
+    printf("Parsed %zu stat lines, %u iterations each\n\n", numLines, numIterations);
+    printf("%-40s %10.1f ns per line  (%zu wrong ppids)\n", "Old space counter (ppid):",
+        oldTime / numIterations / numLines, oldMismatches);
+    printf("%-40s %10.1f ns per line\n", "strrchr + strtoll (all fields):",
+        refTime / numIterations / numLines);
+    printf("%-40s %10.1f ns per line\n", "proc_stat_parse (ppid):",
+        ppidTime / numIterations / numLines);
+    printf("%-40s %10.1f ns per line  (%zu mismatches)\n", "proc_stat_parse (all fields):",
+        allTime / numIterations / numLines, newMismatches);
+
+    for( j=0; j < numLines; j++ )
+        free(lines[j].line);
+    free(lines);
+
+    return newMismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,588 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * bench_simple_int_map.c - Benchmark the open-addressed SimpleIntMap against the
+ *                            chained map it replaced (kept here as ChainedIntMap)
+ *
+ *   Each size is run with random keys, and with sequential keys (like the pids of
+ *     a busy system). The chained map is run with one bucket per entry (its best
+ *     case), and with the 1000 buckets its callers used to create it with (skipped
+ *     above 100k entries, where its chains make it take minutes).
+ *
+ *   SimpleIntMap is also run through its batch calls ("open, batched"), which prefetch
+ *     the slots of a block of keys before probing any. Past 100k entries the table no
+ *     longer fits in L2, and that is where they should pull ahead of one call per key.
+ *
+ *   Every phase is repeated on a fresh map until about 4M operations have been
+ *     timed, and reported in millions of operations per second.
+ *
+ *   Then each map is filled, and churned with cycles of removing one key and adding
+ *     another (as a set of live pids is), counting the calls to malloc and free.
+ *
+ *   Usage: bench_simple_int_map (Optional: [max entries, default 4194304])
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pid_tools.h"
+#include "simple_int_map.h"
+
+#include "bench_utils.h"
+
+
+/* OPS_PER_ROW - Repeat each size until about this many operations of each kind are timed */
+#define OPS_PER_ROW (4 * 1024 * 1024)
+
+/* CHAINED_CALLER_MOD_SIZE - Number of buckets the callers created the chained map with */
+#define CHAINED_CALLER_MOD_SIZE 1000
+
+/* CHURN_CYCLES - Number of remove + add cycles timed by run_churn */
+#define CHURN_CYCLES (1024U * 1024U)
+
+/* CHAINED_CALLER_MAX_ENTRIES - Largest size to run the chained map with CHAINED_CALLER_MOD_SIZE buckets */
+#define CHAINED_CALLER_MAX_ENTRIES 100000
+
+
+/*
+ * ChainedIntMap - The SimpleIntMap as it was: a fixed number of buckets (#modSize),
+ *   each the head node of a malloc'd linked list, plus a byte per bucket saying
+ *   whether the head holds a value.
+ */
+struct ChainedIntMapNode {
+    int data;
+    struct ChainedIntMapNode *next;
+};
+
+typedef struct {
+    unsigned int modSize;
+    struct ChainedIntMapNode *nodeData;
+    char *nodeHasData;
+    size_t numEntries;
+
+    size_t numAllocs;   /* Counted here, to compare allocator traffic with MAP_NUM_ALLOCS */
+    size_t numFrees;
+} ChainedIntMap;
+
+static ChainedIntMap *chained_map_create(unsigned int modSize)
+{
+    ChainedIntMap *ret;
+
+    ret = malloc( sizeof(ChainedIntMap) );
+    ret->modSize = modSize;
+    ret->nodeData = calloc( modSize + 1, sizeof(struct ChainedIntMapNode) );
+    ret->nodeHasData = calloc( modSize + 1, 1 );
+    ret->numEntries = 0;
+    ret->numAllocs = 3;
+    ret->numFrees = 0;
+
+    return ret;
+}
+
+/* chained_map_destroy - Free the map. Returns the number of frees made */
+static size_t chained_map_destroy(ChainedIntMap *intMap)
+{
+    struct ChainedIntMapNode *curNode, *nextNode;
+    unsigned int i;
+    size_t numFrees = 3;
+
+    for( i=0; i < intMap->modSize; i++ )
+    {
+        if ( ! intMap->nodeHasData[i] )
+            continue;
+
+        for( curNode = intMap->nodeData[i].next; curNode != NULL; curNode = nextNode )
+        {
+            nextNode = curNode->next;
+            free(curNode);
+            numFrees += 1;
+        }
+    }
+
+    free(intMap->nodeData);
+    free(intMap->nodeHasData);
+    free(intMap);
+
+    return numFrees;
+}
+
+static int chained_map_contains(ChainedIntMap *intMap, int testInt)
+{
+    unsigned int idxVal = testInt % intMap->modSize;
+    struct ChainedIntMapNode *curNode;
+
+    if ( ! intMap->nodeHasData[idxVal] )
+        return 0;
+
+    for( curNode = &intMap->nodeData[idxVal]; curNode != NULL; curNode = curNode->next )
+    {
+        if ( curNode->data == testInt )
+            return 1;
+    }
+
+    return 0;
+}
+
+static int chained_map_add(ChainedIntMap *intMap, int toAdd)
+{
+    unsigned int idxVal = toAdd % intMap->modSize;
+    struct ChainedIntMapNode *curNode;
+
+    curNode = &intMap->nodeData[idxVal];
+
+    if ( ! intMap->nodeHasData[idxVal] )
+    {
+        intMap->nodeHasData[idxVal] = 1;
+        curNode->data = toAdd;
+        curNode->next = NULL;
+        intMap->numEntries += 1;
+        return 1;
+    }
+
+    while ( 1 )
+    {
+        if ( curNode->data == toAdd )
+            return 0;
+
+        if ( curNode->next == NULL )
+        {
+            curNode->next = malloc( sizeof(struct ChainedIntMapNode) );
+            intMap->numAllocs += 1;
+            curNode->next->data = toAdd;
+            curNode->next->next = NULL;
+            intMap->numEntries += 1;
+            return 1;
+        }
+
+        curNode = curNode->next;
+    }
+}
+
+static int chained_map_rem(ChainedIntMap *intMap, int toRem)
+{
+    unsigned int idxVal = toRem % intMap->modSize;
+    struct ChainedIntMapNode *prevNode, *curNode, *nextNode;
+
+    if ( ! intMap->nodeHasData[idxVal] )
+        return 0;
+
+    prevNode = NULL;
+    for( curNode = &intMap->nodeData[idxVal]; curNode != NULL; prevNode = curNode, curNode = curNode->next )
+    {
+        if ( curNode->data != toRem )
+            continue;
+
+        nextNode = curNode->next;
+        if ( prevNode == NULL )
+        {
+            if ( nextNode == NULL )
+            {
+                intMap->nodeHasData[idxVal] = 0;
+            }
+            else
+            {
+                curNode->data = nextNode->data;
+                curNode->next = nextNode->next;
+                free(nextNode);
+                intMap->numFrees += 1;
+            }
+        }
+        else
+        {
+            prevNode->next = nextNode;
+            free(curNode);
+            intMap->numFrees += 1;
+        }
+
+        intMap->numEntries -= 1;
+        return 1;
+    }
+
+    return 0;
+}
+
+static int *chained_map_values(ChainedIntMap *intMap, size_t *retLen)
+{
+    struct ChainedIntMapNode *curNode;
+    unsigned int i;
+    size_t retIdx = 0;
+    int *ret;
+
+    ret = malloc( intMap->numEntries * sizeof(int) );
+
+    for( i=0; i < intMap->modSize; i++ )
+    {
+        if ( ! intMap->nodeHasData[i] )
+            continue;
+
+        for( curNode = &intMap->nodeData[i]; curNode != NULL; curNode = curNode->next )
+            ret[ retIdx++ ] = curNode->data;
+    }
+
+    *retLen = intMap->numEntries;
+
+    return ret;
+}
+
+
+/* PHASE_* - Index of each timed phase, and the columns printed */
+enum { PHASE_ADD, PHASE_HIT, PHASE_MISS, PHASE_VALUES, PHASE_REM, NUM_PHASES };
+
+/**
+ * run_open - Time every phase with SimpleIntMap
+ *
+ *      @param phaseNs <double *> - NUM_PHASES totals, in nanoseconds, added to
+ *
+ *      @return <size_t> - A checksum of the results (successful adds, hits, values
+ *                           and removes), so nothing is optimised away
+ */
+static size_t run_open(const int *keys, const int *missKeys, size_t numKeys, unsigned int numRounds, double *phaseNs)
+{
+    SimpleIntMap *intMap;
+    unsigned int round;
+    size_t i, numValues;
+    size_t check = 0;
+    int *values;
+    double startTime;
+
+    for( round=0; round < numRounds; round++ )
+    {
+        intMap = simple_int_map_create(0);
+
+        startTime = bench_now_ns();
+        for( i=0; i < numKeys; i++ )
+            check += simple_int_map_add(intMap, keys[i]);
+        phaseNs[PHASE_ADD] += bench_now_ns() - startTime;
+
+        startTime = bench_now_ns();
+        for( i=0; i < numKeys; i++ )
+            check += simple_int_map_contains(intMap, keys[i]);
+        phaseNs[PHASE_HIT] += bench_now_ns() - startTime;
+
+        startTime = bench_now_ns();
+        for( i=0; i < numKeys; i++ )
+            check += simple_int_map_contains(intMap, missKeys[i]);
+        phaseNs[PHASE_MISS] += bench_now_ns() - startTime;
+
+        startTime = bench_now_ns();
+        values = simple_int_map_values(intMap, &numValues);
+        phaseNs[PHASE_VALUES] += bench_now_ns() - startTime;
+        check += numValues;
+        free(values);
+
+        startTime = bench_now_ns();
+        for( i=0; i < numKeys; i++ )
+            check += simple_int_map_rem(intMap, keys[i]);
+        phaseNs[PHASE_REM] += bench_now_ns() - startTime;
+
+        simple_int_map_destroy(intMap);
+    }
+
+    return check;
+}
+
+/**
+ * run_open_batched - Time every phase with SimpleIntMap, adding, checking and removing
+ *                      all the keys in one add_many / contains_many / rem_many call each
+ *
+ *      @return <size_t> - A checksum of the results, which should match run_open
+ */
+static size_t run_open_batched(const int *keys, const int *missKeys, size_t numKeys, unsigned int numRounds, double *phaseNs)
+{
+    SimpleIntMap *intMap;
+    unsigned int round;
+    size_t numValues;
+    size_t check = 0;
+    int *values;
+    uint64_t *resultBits;
+    double startTime;
+
+    resultBits = malloc( sizeof(uint64_t) * SIMPLE_INT_MAP_RESULT_WORDS(numKeys) );
+
+    for( round=0; round < numRounds; round++ )
+    {
+        intMap = simple_int_map_create(0);
+
+        startTime = bench_now_ns();
+        check += simple_int_map_add_many(intMap, keys, numKeys);
+        phaseNs[PHASE_ADD] += bench_now_ns() - startTime;
+
+        startTime = bench_now_ns();
+        check += simple_int_map_contains_many(intMap, keys, numKeys, resultBits);
+        phaseNs[PHASE_HIT] += bench_now_ns() - startTime;
+
+        startTime = bench_now_ns();
+        check += simple_int_map_contains_many(intMap, missKeys, numKeys, resultBits);
+        phaseNs[PHASE_MISS] += bench_now_ns() - startTime;
+
+        startTime = bench_now_ns();
+        values = simple_int_map_values(intMap, &numValues);
+        phaseNs[PHASE_VALUES] += bench_now_ns() - startTime;
+        check += numValues;
+        free(values);
+
+        startTime = bench_now_ns();
+        check += simple_int_map_rem_many(intMap, keys, numKeys);
+        phaseNs[PHASE_REM] += bench_now_ns() - startTime;
+
+        simple_int_map_destroy(intMap);
+    }
+
+    free(resultBits);
+
+    return check;
+}
+
+/**
+ * run_chained - Time every phase with ChainedIntMap, with #modSize buckets
+ *
+ *      @return <size_t> - A checksum of the results, which should match run_open
+ */
+static size_t run_chained(const int *keys, const int *missKeys, size_t numKeys, unsigned int numRounds, unsigned int modSize, double *phaseNs)
+{
+    ChainedIntMap *intMap;
+    unsigned int round;
+    size_t i, numValues;
+    size_t check = 0;
+    int *values;
+    double startTime;
+
+    for( round=0; round < numRounds; round++ )
+    {
+        intMap = chained_map_create(modSize);
+
+        startTime = bench_now_ns();
+        for( i=0; i < numKeys; i++ )
+            check += chained_map_add(intMap, keys[i]);
+        phaseNs[PHASE_ADD] += bench_now_ns() - startTime;
+
+        startTime = bench_now_ns();
+        for( i=0; i < numKeys; i++ )
+            check += chained_map_contains(intMap, keys[i]);
+        phaseNs[PHASE_HIT] += bench_now_ns() - startTime;
+
+        startTime = bench_now_ns();
+        for( i=0; i < numKeys; i++ )
+            check += chained_map_contains(intMap, missKeys[i]);
+        phaseNs[PHASE_MISS] += bench_now_ns() - startTime;
+
+        startTime = bench_now_ns();
+        values = chained_map_values(intMap, &numValues);
+        phaseNs[PHASE_VALUES] += bench_now_ns() - startTime;
+        check += numValues;
+        free(values);
+
+        startTime = bench_now_ns();
+        for( i=0; i < numKeys; i++ )
+            check += chained_map_rem(intMap, keys[i]);
+        phaseNs[PHASE_REM] += bench_now_ns() - startTime;
+
+        chained_map_destroy(intMap);
+    }
+
+    return check;
+}
+
+/**
+ * run_churn - Fill a map with #numKeys keys, then time CHURN_CYCLES cycles of removing
+ *               a random key and adding a new one, and print the allocator calls made
+ *
+ *      @param modSize <unsigned int> - Number of buckets for the chained map, or 0 for SimpleIntMap
+ */
+/* CHURN_KEY - The #_n th key used by run_churn. Positive, random looking, and never repeated
+ *   (multiplying by an odd number is a bijection on the low 30 bits)
+ */
+#define CHURN_KEY(_n) ( (int)( 1 + ( ( (uint32_t)(_n) * 2654435761U ) & 0x3fffffff ) ) )
+
+static void run_churn(size_t numKeys, unsigned int modSize)
+{
+    SimpleIntMap *openMap;
+    ChainedIntMap *chainedMap;
+    int *keys;
+    size_t i, idx, check, nextKey;
+    size_t fillAllocs, churnAllocs, churnFrees, destroyFrees;
+    double startTime, churnNs;
+    char label[32];
+
+    keys = malloc( sizeof(int) * numKeys );
+    for( nextKey=0; nextKey < numKeys; nextKey++ )
+        keys[nextKey] = CHURN_KEY(nextKey);
+
+    check = 0;
+
+    if ( modSize == 0 )
+    {
+        openMap = simple_int_map_create(0);
+        for( i=0; i < numKeys; i++ )
+            simple_int_map_add(openMap, keys[i]);
+        fillAllocs = MAP_NUM_ALLOCS(openMap);
+
+        startTime = bench_now_ns();
+        for( i=0; i < CHURN_CYCLES; i++ )
+        {
+            idx = bench_rand() % numKeys;
+            check += simple_int_map_rem(openMap, keys[idx]);
+            keys[idx] = CHURN_KEY(nextKey++);
+            check += simple_int_map_add(openMap, keys[idx]);
+        }
+        churnNs = bench_now_ns() - startTime;
+
+        /* Nothing is freed until it grows (the old slots) or is destroyed (slots and map) */
+        churnAllocs = MAP_NUM_ALLOCS(openMap) - fillAllocs;
+        churnFrees = churnAllocs;
+        destroyFrees = 2;
+
+        simple_int_map_destroy(openMap);
+        snprintf(label, sizeof(label), "open addressing");
+    }
+    else
+    {
+        chainedMap = chained_map_create(modSize);
+        for( i=0; i < numKeys; i++ )
+            chained_map_add(chainedMap, keys[i]);
+        fillAllocs = chainedMap->numAllocs;
+        churnFrees = chainedMap->numFrees;
+
+        startTime = bench_now_ns();
+        for( i=0; i < CHURN_CYCLES; i++ )
+        {
+            idx = bench_rand() % numKeys;
+            check += chained_map_rem(chainedMap, keys[idx]);
+            keys[idx] = CHURN_KEY(nextKey++);
+            check += chained_map_add(chainedMap, keys[idx]);
+        }
+        churnNs = bench_now_ns() - startTime;
+
+        churnAllocs = chainedMap->numAllocs - fillAllocs;
+        churnFrees = chainedMap->numFrees - churnFrees;
+
+        destroyFrees = chained_map_destroy(chainedMap);
+        snprintf(label, sizeof(label), "chained, %u", modSize);
+    }
+
+    printf("%9zu  %-18s  %12.1f  %14.1f  %14.1f  %10zu\n", numKeys, label, churnNs / CHURN_CYCLES,
+        churnAllocs * 1000.0 / CHURN_CYCLES, churnFrees * 1000.0 / CHURN_CYCLES, destroyFrees);
+
+    if ( check != CHURN_CYCLES * 2 )
+        fprintf(stderr, "Warning: %zu of the removes and adds failed\n", CHURN_CYCLES * 2 - check);
+
+    free(keys);
+}
+
+/**
+ * print_row - Print the millions of operations per second of each phase
+ */
+static void print_row(size_t numKeys, const char *keyKind, const char *mapKind, size_t numOps, const double *phaseNs)
+{
+    unsigned int phase;
+
+    printf("%9zu  %-10s  %-18s", numKeys, keyKind, mapKind);
+    for( phase=0; phase < NUM_PHASES; phase++ )
+        printf("  %9.1f", numOps / (phaseNs[phase] / 1000.0));
+    printf("\n");
+}
+
+int main(int argc, char* argv[])
+{
+    size_t maxKeys = 4 * 1024 * 1024;
+    static const size_t sizes[] = { 1000, 100000, 4 * 1024 * 1024 };
+    int *keys, *missKeys;
+    size_t numKeys, i;
+    unsigned int sizeIdx, isSequential, numRounds;
+    double openNs[NUM_PHASES], batchedNs[NUM_PHASES], chainedNs[NUM_PHASES], callerNs[NUM_PHASES];
+    size_t openCheck, batchedCheck, chainedCheck;
+    char label[32];
+
+    if ( argc > 1 )
+        maxKeys = strtoul(argv[1], NULL, 10);
+
+    if ( maxKeys == 0 )
+    {
+        fputs("Usage: bench_simple_int_map (Optional: [max entries, default 4194304])\n", stderr);
+        return 1;
+    }
+
+    printf("Millions of operations per second (higher is better). \"hit\" and \"miss\" are contains.\n\n");
+    printf("%9s  %-10s  %-18s  %9s  %9s  %9s  %9s  %9s\n", "Entries", "Keys", "Map", "add", "hit", "miss", "values", "rem");
+
+    for( sizeIdx=0; sizeIdx < sizeof(sizes) / sizeof(sizes[0]); sizeIdx++ )
+    {
+        numKeys = sizes[sizeIdx] < maxKeys ? sizes[sizeIdx] : maxKeys;
+        if ( sizeIdx > 0 && numKeys == sizes[sizeIdx - 1] )
+            break;
+
+        numRounds = numKeys < OPS_PER_ROW ? OPS_PER_ROW / numKeys : 1;
+
+        keys = malloc( sizeof(int) * numKeys );
+        missKeys = malloc( sizeof(int) * numKeys );
+
+        for( isSequential=0; isSequential < 2; isSequential++ )
+        {
+            /* Keys are positive (like pids). Misses are never keys, but fall in the same
+             *   buckets of the chained map, so it has to walk a chain for them too.
+             */
+            for( i=0; i < numKeys; i++ )
+            {
+                if ( isSequential )
+                {
+                    keys[i] = (int)( 1000 + i );
+                    missKeys[i] = (int)( 1000 + numKeys + i );
+                }
+                else
+                {
+                    keys[i] = (int)( 1 + ( bench_rand() & 0x3ffffffe ) );
+                    missKeys[i] = keys[i] | 0x40000000;
+                }
+            }
+
+            memset(openNs, 0, sizeof(openNs));
+            memset(batchedNs, 0, sizeof(batchedNs));
+            memset(chainedNs, 0, sizeof(chainedNs));
+            memset(callerNs, 0, sizeof(callerNs));
+
+            openCheck = run_open(keys, missKeys, numKeys, numRounds, openNs);
+            batchedCheck = run_open_batched(keys, missKeys, numKeys, numRounds, batchedNs);
+            chainedCheck = run_chained(keys, missKeys, numKeys, numRounds, (unsigned int)numKeys, chainedNs);
+
+            print_row(numKeys, isSequential ? "sequential" : "random", "open addressing", numKeys * numRounds, openNs);
+            print_row(numKeys, isSequential ? "sequential" : "random", "open, batched", numKeys * numRounds, batchedNs);
+            snprintf(label, sizeof(label), "chained, %zu", numKeys);
+            print_row(numKeys, isSequential ? "sequential" : "random", label, numKeys * numRounds, chainedNs);
+
+            if ( numKeys != CHAINED_CALLER_MOD_SIZE && numKeys <= CHAINED_CALLER_MAX_ENTRIES )
+            {
+                run_chained(keys, missKeys, numKeys, numRounds, CHAINED_CALLER_MOD_SIZE, callerNs);
+                snprintf(label, sizeof(label), "chained, %u", CHAINED_CALLER_MOD_SIZE);
+                print_row(numKeys, isSequential ? "sequential" : "random", label, numKeys * numRounds, callerNs);
+            }
+
+            if ( openCheck != chainedCheck || openCheck != batchedCheck )
+                fprintf(stderr, "Warning: the maps gave different answers (%zu vs %zu vs %zu)\n", openCheck, batchedCheck, chainedCheck);
+        }
+
+        free(keys);
+        free(missKeys);
+    }
+
+    printf("\nChurn: %u cycles of removing a random key and adding a new one, after filling.\n", CHURN_CYCLES);
+    printf("Calls to malloc and free are per 1000 cycles, and at destroy.\n\n");
+    printf("%9s  %-18s  %12s  %14s  %14s  %10s\n", "Entries", "Map", "ns per cycle", "mallocs", "frees", "destroy");
+
+    for( sizeIdx=0; sizeIdx < 2 && sizes[sizeIdx] <= maxKeys; sizeIdx++ )
+    {
+        numKeys = sizes[sizeIdx];
+
+        run_churn(numKeys, 0);
+        run_churn(numKeys, (unsigned int)numKeys);
+        if ( numKeys != CHAINED_CALLER_MOD_SIZE )
+            run_churn(numKeys, CHAINED_CALLER_MOD_SIZE);
+    }
+
+    return 0;
+}
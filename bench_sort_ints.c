@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * bench_sort_ints.c - Benchmark the radix sort behind simple_int_map_sorted_values
+ *                       against qsort (with the comparator the tools used)
+ *
+ *   Sorts lists of 10k to 1M pids (positive, below the largest pid_max), and of
+ *     ints anywhere in the range (so no radix pass can be skipped). Each size is
+ *     repeated until about 4M values have been sorted, from the same unsorted copy.
+ *
+ *   Then times getting the sorted values of a SimpleIntMap of that many pids, as
+ *     values + qsort against simple_int_map_sorted_values.
+ *
+ *   Usage: bench_sort_ints
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pid_tools.h"
+#include "simple_int_map.h"
+
+#include "bench_utils.h"
+
+
+/* VALUES_PER_ROW - Repeat each size until about this many values have been sorted */
+#define VALUES_PER_ROW (4 * 1024 * 1024)
+
+/* PID_RANGE - Pids are picked below this (the largest pid_max) */
+#define PID_RANGE 4194304
+
+static int cmp_ints(const void *p1, const void *p2)
+{
+    int val1, val2;
+
+    val1 = *((int *)p1);
+    val2 = *((int *)p2);
+
+    return (val1 > val2) - (val1 < val2);
+}
+
+/**
+ * run_row - Time qsort and the radix sort on the same lists, and print a row
+ *
+ *      @param isPids <int> - 1 for pids, 0 for ints anywhere in the range
+ */
+static void run_row(size_t numValues, int isPids)
+{
+    int *unsorted, *values, *expected;
+    unsigned int round, numRounds;
+    double startTime, qsortNs, radixNs;
+    size_t i;
+
+    unsorted = malloc( sizeof(int) * numValues );
+    values = malloc( sizeof(int) * numValues );
+    expected = malloc( sizeof(int) * numValues );
+
+    for( i=0; i < numValues; i++ )
+    {
+        if ( isPids )
+            unsorted[i] = (int)( 1 + bench_rand() % (PID_RANGE - 1) );
+        else
+            unsorted[i] = (int)( bench_rand() ^ ( bench_rand() << 16 ) );
+    }
+
+    numRounds = numValues < VALUES_PER_ROW ? VALUES_PER_ROW / numValues : 1;
+    qsortNs = radixNs = 0;
+
+    for( round=0; round < numRounds; round++ )
+    {
+        memcpy(expected, unsorted, sizeof(int) * numValues);
+        startTime = bench_now_ns();
+        qsort(expected, numValues, sizeof(int), cmp_ints);
+        qsortNs += bench_now_ns() - startTime;
+
+        memcpy(values, unsorted, sizeof(int) * numValues);
+        startTime = bench_now_ns();
+        simple_int_map_sort_ints(values, numValues);
+        radixNs += bench_now_ns() - startTime;
+    }
+
+    if ( memcmp(values, expected, sizeof(int) * numValues) != 0 )
+        fprintf(stderr, "Warning: the sorts gave different answers\n");
+
+    printf("%9zu  %-7s  %10.2f  %10.2f  %8.1fx\n", numValues, isPids ? "pids" : "any int",
+        qsortNs / numRounds / numValues, radixNs / numRounds / numValues, qsortNs / radixNs);
+
+    free(unsorted);
+    free(values);
+    free(expected);
+}
+
+/**
+ * run_map_row - Time getting the sorted values of a map of #numValues pids, both ways
+ */
+static void run_map_row(size_t numValues)
+{
+    SimpleIntMap *intMap;
+    int *values;
+    size_t numReturned;
+    unsigned int round, numRounds;
+    double startTime, qsortNs, radixNs;
+    size_t check = 0;
+
+    intMap = simple_int_map_create(0);
+    while ( MAP_NUM_ENTRIES(intMap) < numValues )
+        simple_int_map_add(intMap, (int)( 1 + bench_rand() % (PID_RANGE - 1) ));
+
+    numRounds = numValues < VALUES_PER_ROW ? VALUES_PER_ROW / numValues : 1;
+    qsortNs = radixNs = 0;
+
+    for( round=0; round < numRounds; round++ )
+    {
+        startTime = bench_now_ns();
+        values = simple_int_map_values(intMap, &numReturned);
+        qsort(values, numReturned, sizeof(int), cmp_ints);
+        qsortNs += bench_now_ns() - startTime;
+        check += values[0];
+        free(values);
+
+        startTime = bench_now_ns();
+        values = simple_int_map_sorted_values(intMap, &numReturned);
+        radixNs += bench_now_ns() - startTime;
+        check -= values[0];
+        free(values);
+    }
+
+    if ( check != 0 )
+        fprintf(stderr, "Warning: the sorted values differ\n");
+
+    printf("%9zu  %10.2f  %10.2f  %8.1fx\n", numValues,
+        qsortNs / numRounds / numValues, radixNs / numRounds / numValues, qsortNs / radixNs);
+
+    simple_int_map_destroy(intMap);
+}
+
+int main(int argc, char* argv[])
+{
+    static const size_t sizes[] = { 10000, 100000, 1000000 };
+    unsigned int sizeIdx;
+    int isPids;
+
+    printf("Nanoseconds per value (lower is better).\n\n");
+    printf("%9s  %-7s  %10s  %10s  %9s\n", "Values", "Kind", "qsort", "radix", "speedup");
+
+    for( isPids=1; isPids >= 0; isPids-- )
+    {
+        for( sizeIdx=0; sizeIdx < sizeof(sizes) / sizeof(sizes[0]); sizeIdx++ )
+            run_row(sizes[sizeIdx], isPids);
+    }
+
+    printf("\nSorted values of a SimpleIntMap of pids: values + qsort vs sorted_values.\n\n");
+    printf("%9s  %10s  %10s  %9s\n", "Entries", "qsort", "radix", "speedup");
+
+    for( sizeIdx=0; sizeIdx < sizeof(sizes) / sizeof(sizes[0]); sizeIdx++ )
+        run_map_row(sizes[sizeIdx]);
+
+    return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * bench_startup.c - Benchmark the time to start and run each tool as its own
+ *                     executable, versus through a symlink to the "pidtools"
+ *                     multicall executable. Also compares the size on disk
+ *                     (and so in the page cache) of the two.
+ *
+ *   With "--cold", the pages of the executable are dropped from the page cache
+ *     (posix_fadvise DONTNEED) before every run, to approximate a first start.
+ *
+ *   pidtools may be taken from another directory, e.x. to compare the separate tools
+ *     against a static pidtools ("make static" in a copy of the source).
+ *
+ *   Usage: bench_startup (Optional: --cold) (Optional: [num runs] [directory of the tools, default bin]
+ *                          [directory of pidtools, default same as the tools])
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "pid_tools.h"
+
+#include "bench_utils.h"
+
+extern char **environ;
+
+
+static const char *TOOLS[] = {
+    "getppid", "getcpids", "isaparentof", "isachildof",
+    "getpcmd", "waitpid", "getpenv", "getpmem",
+};
+
+#define NUM_TOOLS ( sizeof(TOOLS) / sizeof(TOOLS[0]) )
+
+
+/**
+ * drop_cached_pages - Ask the kernel to drop the page cache of a file
+ */
+static void drop_cached_pages(const char *path)
+{
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if ( fd < 0 )
+        return;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+/**
+ * run_tool - Run #path (a tool, or a link to pidtools) #numRuns times with "--version"
+ *              (which every tool supports, and which reads nothing from /proc)
+ *
+ *      @param dropPath <const char *> - If not NULL, file to drop from the page cache before each run
+ *
+ *      @return <double> - Average nanoseconds per run, or -1 on error
+ */
+static double run_tool(const char *path, const char *dropPath, unsigned int numRuns)
+{
+    posix_spawn_file_actions_t fileActions;
+    char *args[3];
+    unsigned int i;
+    pid_t childPid;
+    int status;
+    double totalTime = 0;
+    double startTime;
+
+    args[0] = (char *)path;
+    args[1] = "--version";
+    args[2] = NULL;
+
+    posix_spawn_file_actions_init(&fileActions);
+    posix_spawn_file_actions_addopen(&fileActions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&fileActions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    for( i=0; i < numRuns; i++ )
+    {
+        if ( dropPath != NULL )
+            drop_cached_pages(dropPath);
+
+        startTime = bench_now_ns();
+        if ( posix_spawn(&childPid, path, &fileActions, NULL, args, environ) != 0 )
+        {
+            posix_spawn_file_actions_destroy(&fileActions);
+            return -1;
+        }
+        waitpid(childPid, &status, 0);
+        totalTime += bench_now_ns() - startTime;
+    }
+
+    posix_spawn_file_actions_destroy(&fileActions);
+
+    return totalTime / numRuns;
+}
+
+/**
+ * file_size - Size of a file in bytes, or 0 if it cannot be read
+ */
+static long long file_size(const char *path)
+{
+    struct stat statBuf;
+
+    if ( stat(path, &statBuf) != 0 )
+        return 0;
+
+    return (long long)statBuf.st_size;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int numRuns = 500;
+    const char *toolDir = "bin";
+    const char *multicallDir = NULL;
+    int isCold = 0;
+    int argIdx = 1;
+    char multicallPath[PATH_MAX];
+    char linkDir[] = "/tmp/bench_startup.XXXXXX";
+    char toolPath[PATH_MAX + 32];
+    char linkPath[sizeof(linkDir) + 32];
+    double separateTime, multicallTime;
+    double separateTotal = 0, multicallTotal = 0;
+    long long separateSize = 0;
+    unsigned int i;
+    int ret = 0;
+
+    if ( argc > argIdx && strcmp(argv[argIdx], "--cold") == 0 )
+    {
+        isCold = 1;
+        argIdx++;
+    }
+    if ( argc > argIdx )
+        numRuns = atoi(argv[argIdx++]);
+    if ( argc > argIdx )
+        toolDir = argv[argIdx++];
+    if ( argc > argIdx )
+        multicallDir = argv[argIdx++];
+
+    if ( numRuns == 0 )
+    {
+        fputs("Usage: bench_startup (Optional: --cold) (Optional: [num runs] [directory of the tools, default bin]\n", stderr);
+        fputs("                       [directory of pidtools, default same as the tools])\n", stderr);
+        return 1;
+    }
+
+    snprintf(toolPath, sizeof(toolPath), "%s/pidtools", multicallDir != NULL ? multicallDir : toolDir);
+    if ( realpath(toolPath, multicallPath) == NULL )
+    {
+        fprintf(stderr, "Cannot find '%s' (run make first). Error %d: %s\n", toolPath, errno, strerror(errno));
+        return 1;
+    }
+
+    /* Links named as each tool, as "make install" creates */
+    if ( mkdtemp(linkDir) == NULL )
+    {
+        fprintf(stderr, "Cannot create a temporary directory. Error %d: %s\n", errno, strerror(errno));
+        return 1;
+    }
+
+    printf("%u runs of each tool (\"--version\")%s\n\n", numRuns, isCold ? ", page cache dropped before each" : "");
+    printf("%12s  %14s  %14s  %9s\n", "Tool", "separate us", "pidtools us", "Speedup");
+
+    for( i=0; i < NUM_TOOLS; i++ )
+    {
+        snprintf(toolPath, sizeof(toolPath), "%s/%s", toolDir, TOOLS[i]);
+        snprintf(linkPath, sizeof(linkPath), "%s/%s", linkDir, TOOLS[i]);
+
+        if ( symlink(multicallPath, linkPath) != 0 )
+        {
+            fprintf(stderr, "Cannot create link '%s'. Error %d: %s\n", linkPath, errno, strerror(errno));
+            ret = 1;
+            break;
+        }
+
+        separateSize += file_size(toolPath);
+
+        separateTime = run_tool(toolPath, isCold ? toolPath : NULL, numRuns);
+        multicallTime = run_tool(linkPath, isCold ? multicallPath : NULL, numRuns);
+
+        unlink(linkPath);
+
+        if ( separateTime < 0 || multicallTime < 0 )
+        {
+            fprintf(stderr, "Failed to run '%s'. Error %d: %s\n", TOOLS[i], errno, strerror(errno));
+            ret = 1;
+            break;
+        }
+
+        separateTotal += separateTime;
+        multicallTotal += multicallTime;
+
+        printf("%12s  %14.1f  %14.1f  %8.2fx\n", TOOLS[i], separateTime / 1000.0, multicallTime / 1000.0, separateTime / multicallTime);
+    }
+
+    rmdir(linkDir);
+
+    if ( ret == 0 )
+    {
+        printf("%12s  %14.1f  %14.1f  %8.2fx\n", "average", separateTotal / NUM_TOOLS / 1000.0,
+            multicallTotal / NUM_TOOLS / 1000.0, separateTotal / multicallTotal);
+
+        printf("\nOn disk: %lld bytes for the %u separate tools, %lld bytes for pidtools\n",
+            separateSize, (unsigned int)NUM_TOOLS, file_size(multicallPath));
+    }
+
+    return ret;
+}
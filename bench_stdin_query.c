@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * bench_stdin_query.c - Benchmark queries per second for each tool, running
+ *                         the tool once per query versus keeping one "--stdin"
+ *                         process open and writing queries to it
+ *
+ *   The "--stdin" process is measured both one query at a time (write, then wait for
+ *     the answer, as a shell coprocess would) and with queries sent in batches.
+ *
+ *   Usage: bench_stdin_query (Optional: [num queries] [directory of the tools, default bin])
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "pid_tools.h"
+
+#include "bench_utils.h"
+
+extern char **environ;
+
+
+/* BENCH_BATCH_SIZE - Number of queries written before reading their answers,
+ *   small enough that neither pipe fills up
+ */
+#define BENCH_BATCH_SIZE 64
+
+/**
+ * struct bench_tool - A tool, and the arguments for one query by exec and by --stdin
+ */
+struct bench_tool {
+    const char *name;
+    const char *extraArg;   /* Second argument after the pid (or NULL) */
+    const char *option;     /* Extra option for both modes (or NULL) */
+};
+
+static const struct bench_tool TOOLS[] = {
+    { "getppid", NULL, NULL },
+    { "getpcmd", NULL, NULL },
+    { "getpenv", "PATH", NULL },
+    { "getpmem", NULL, "-k" },
+};
+
+
+/**
+ * run_exec - Run the tool once per query, with its output thrown away
+ *
+ *      @return <double> - Nanoseconds taken, or -1 on error
+ */
+static double run_exec(const char *path, const struct bench_tool *tool, const char *pidStr, unsigned int numQueries)
+{
+    posix_spawn_file_actions_t fileActions;
+    char *args[5];
+    int numArgs = 0;
+    unsigned int i;
+    pid_t childPid;
+    int status;
+    double startTime;
+
+    args[numArgs++] = (char *)path;
+    if ( tool->option != NULL )
+        args[numArgs++] = (char *)tool->option;
+    args[numArgs++] = (char *)pidStr;
+    if ( tool->extraArg != NULL )
+        args[numArgs++] = (char *)tool->extraArg;
+    args[numArgs] = NULL;
+
+    posix_spawn_file_actions_init(&fileActions);
+    posix_spawn_file_actions_addopen(&fileActions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+    startTime = bench_now_ns();
+    for( i=0; i < numQueries; i++ )
+    {
+        if ( posix_spawn(&childPid, path, &fileActions, NULL, args, environ) != 0 )
+        {
+            posix_spawn_file_actions_destroy(&fileActions);
+            return -1;
+        }
+        waitpid(childPid, &status, 0);
+    }
+
+    posix_spawn_file_actions_destroy(&fileActions);
+
+    return bench_now_ns() - startTime;
+}
+
+/**
+ * read_answers - Read until #numAnswers newlines have arrived
+ *
+ *      @return <int> - 0 on success, -1 if the tool went away
+ */
+static int read_answers(int fd, unsigned int numAnswers)
+{
+    char buff[65536];
+    ssize_t numRead, i;
+
+    while ( numAnswers > 0 )
+    {
+        numRead = read(fd, buff, sizeof(buff));
+        if ( numRead <= 0 )
+            return -1;
+
+        for( i=0; i < numRead; i++ )
+        {
+            if ( buff[i] == '\n' )
+                numAnswers--;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * run_stdin - Start one "--stdin" process and send it every query, #batchSize at a time
+ *
+ *      @return <double> - Nanoseconds taken (including starting the process), or -1 on error
+ */
+static double run_stdin(const char *path, const struct bench_tool *tool, const char *query, unsigned int numQueries, unsigned int batchSize)
+{
+    posix_spawn_file_actions_t fileActions;
+    char *args[4];
+    int numArgs = 0;
+    int toChild[2], fromChild[2];
+    char *batch;
+    size_t queryLen;
+    unsigned int i, numThisBatch;
+    pid_t childPid;
+    int status;
+    int ret = 0;
+    double startTime, endTime = 0;
+
+    args[numArgs++] = (char *)path;
+    if ( tool->option != NULL )
+        args[numArgs++] = (char *)tool->option;
+    args[numArgs++] = "--stdin";
+    args[numArgs] = NULL;
+
+    queryLen = strlen(query);
+    batch = malloc( queryLen * batchSize );
+    for( i=0; i < batchSize; i++ )
+        memcpy(&batch[i * queryLen], query, queryLen);
+
+    if ( pipe(toChild) != 0 || pipe(fromChild) != 0 )
+    {
+        free(batch);
+        return -1;
+    }
+
+    posix_spawn_file_actions_init(&fileActions);
+    posix_spawn_file_actions_adddup2(&fileActions, toChild[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&fileActions, fromChild[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&fileActions, toChild[1]);
+    posix_spawn_file_actions_addclose(&fileActions, fromChild[0]);
+
+    startTime = bench_now_ns();
+    if ( posix_spawn(&childPid, path, &fileActions, NULL, args, environ) != 0 )
+    {
+        ret = -1;
+        goto __cleanup_and_exit;
+    }
+    close(toChild[0]);
+    close(fromChild[1]);
+
+    for( i=0; i < numQueries; i += numThisBatch )
+    {
+        numThisBatch = numQueries - i < batchSize ? numQueries - i : batchSize;
+
+        if ( write(toChild[1], batch, queryLen * numThisBatch) != (ssize_t)(queryLen * numThisBatch) ||
+             read_answers(fromChild[0], numThisBatch) != 0 )
+        {
+            ret = -1;
+            break;
+        }
+    }
+
+    close(toChild[1]);
+    waitpid(childPid, &status, 0);
+    endTime = bench_now_ns();
+
+    close(fromChild[0]);
+
+__cleanup_and_exit:
+    posix_spawn_file_actions_destroy(&fileActions);
+    free(batch);
+
+    return ret == 0 ? endTime - startTime : -1;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int numQueries = 1000;
+    const char *toolDir = "bin";
+    char path[4096];
+    char pidStr[32];
+    char query[64];
+    double execTime, roundTripTime, batchTime;
+    unsigned int i;
+
+    if ( argc > 1 )
+        numQueries = atoi(argv[1]);
+    if ( argc > 2 )
+        toolDir = argv[2];
+
+    if ( numQueries == 0 )
+    {
+        fputs("Usage: bench_stdin_query (Optional: [num queries] [directory of the tools, default bin])\n", stderr);
+        return 1;
+    }
+
+    sprintf(pidStr, "%d", (int)getpid());
+
+    printf("%u queries per tool, for pid %s\n\n", numQueries, pidStr);
+    printf("%10s  %15s  %15s  %15s  %9s\n", "Tool", "exec q/s", "stdin 1 q/s", "stdin batch q/s", "Speedup");
+
+    for( i=0; i < sizeof(TOOLS) / sizeof(TOOLS[0]); i++ )
+    {
+        snprintf(path, sizeof(path), "%s/%s", toolDir, TOOLS[i].name);
+        if ( TOOLS[i].extraArg != NULL )
+            snprintf(query, sizeof(query), "%s %s\n", pidStr, TOOLS[i].extraArg);
+        else
+            snprintf(query, sizeof(query), "%s\n", pidStr);
+
+        execTime = run_exec(path, &TOOLS[i], pidStr, numQueries);
+        roundTripTime = run_stdin(path, &TOOLS[i], query, numQueries, 1);
+        batchTime = run_stdin(path, &TOOLS[i], query, numQueries, BENCH_BATCH_SIZE);
+
+        if ( execTime < 0 || roundTripTime < 0 || batchTime < 0 )
+        {
+            fprintf(stderr, "Failed to run '%s'. Error %d: %s\n", path, errno, strerror(errno));
+            return 1;
+        }
+
+        /* Speedup is of one query at a time over --stdin, against exec */
+        printf("%10s  %15.0f  %15.0f  %15.0f  %8.1fx\n", TOOLS[i].name,
+            numQueries / (execTime / 1e9), numQueries / (roundTripTime / 1e9), numQueries / (batchTime / 1e9),
+            execTime / roundTripTime);
+    }
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * bench_utils.h - some static utility functions shared by the benchmark programs
+ *
+ */
+
+#ifndef _BENCH_UTILS_H
+#define _BENCH_UTILS_H
+
+#include "pid_tools.h"
+
+#include <time.h>
+
+/* bench_now_ns - Returns a monotonic timestamp in nanoseconds */
+MAYBE_UNUSED static double bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ( ts.tv_sec * 1000000000.0 ) + ts.tv_nsec;
+}
+
+/* bench_rand - Small, fast xorshift PRNG so runs are reproducible */
+MAYBE_UNUSED static unsigned int bench_rand(void)
+{
+    static unsigned int state = 2463534242U;
+
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    return state;
+}
+
+#endif
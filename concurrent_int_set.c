@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * concurrent_int_set.c - Interface implementations for a set of ints which many
+ *                          threads can add to and search at once, without locks
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pid_tools.h"
+
+#include "concurrent_int_set.h"
+
+/* CONCURRENT_INT_SET_MIN_CAPACITY - Smallest number of slots. Must be a power of 2 */
+#define CONCURRENT_INT_SET_MIN_CAPACITY 16
+
+/* CONCURRENT_INT_SET_EMPTY - Value of an empty slot */
+#define CONCURRENT_INT_SET_EMPTY 0
+
+/* _CONCURRENT_INT_SET_READ - Read a slot (or flag) another thread may be writing.
+ *   An aligned int is read whole, this just stops the compiler reusing an old read.
+ */
+#define _CONCURRENT_INT_SET_READ(_ptr) ( *(volatile int *)(_ptr) )
+
+
+/**
+ * _concurrent_int_set_ideal_slot - The slot a value hashes to, where its probe run starts
+ */
+static inline size_t _concurrent_int_set_ideal_slot(const ConcurrentIntSet *intSet, int value)
+{
+    uint32_t hash;
+
+    /* As SimpleIntMap */
+    hash = (uint32_t)value * 2654435769U;
+    hash ^= hash >> 16;
+
+    return (size_t)hash & ( intSet->capacity - 1 );
+}
+
+ConcurrentIntSet *concurrent_int_set_create(size_t maxEntries)
+{
+    ConcurrentIntSet *ret;
+    size_t capacity;
+
+    /* Aligned, so each counter has a cache line to itself */
+    if ( posix_memalign((void **)&ret, 64, sizeof(ConcurrentIntSet)) != 0 )
+        return NULL;
+
+    memset(ret, 0, sizeof(ConcurrentIntSet));
+
+    /* Room for #maxEntries values without going over half full */
+    capacity = CONCURRENT_INT_SET_MIN_CAPACITY;
+    while ( capacity < maxEntries * 2 )
+        capacity <<= 1;
+
+    ret->capacity = capacity;
+    ret->slots = calloc( capacity, sizeof(int) );
+
+    return ret;
+}
+
+void concurrent_int_set_destroy(ConcurrentIntSet *intSet)
+{
+    free(intSet->slots);
+    free(intSet);
+}
+
+int concurrent_int_set_add(ConcurrentIntSet *intSet, int toAdd)
+{
+    size_t mask = intSet->capacity - 1;
+    size_t idx, numProbed;
+    int slotValue;
+
+    if ( unlikely( _CONCURRENT_INT_SET_READ(&intSet->isFrozen) ) )
+        return CONCURRENT_INT_SET_ADD_FAILED;
+
+    if ( unlikely( toAdd == CONCURRENT_INT_SET_EMPTY ) )
+    {
+        if ( _CONCURRENT_INT_SET_READ(&intSet->hasZero) || ! __sync_bool_compare_and_swap(&intSet->hasZero, 0, 1) )
+            return 0;
+
+        __sync_fetch_and_add(&intSet->counters[0].count, 1);
+        return 1;
+    }
+
+    idx = _concurrent_int_set_ideal_slot(intSet, toAdd);
+    for( numProbed=0; numProbed < intSet->capacity; numProbed++ )
+    {
+        slotValue = _CONCURRENT_INT_SET_READ(&intSet->slots[idx]);
+
+        if ( slotValue == CONCURRENT_INT_SET_EMPTY )
+        {
+            /* Claim it. If another thread got there first, #slotValue is what it wrote,
+             *   which may be this same value (then it was added by that thread).
+             */
+            slotValue = __sync_val_compare_and_swap(&intSet->slots[idx], CONCURRENT_INT_SET_EMPTY, toAdd);
+            if ( slotValue == CONCURRENT_INT_SET_EMPTY )
+            {
+                /* Threads adding at once usually land on different slots, so different counters */
+                __sync_fetch_and_add(&intSet->counters[ (idx / 16) & (CONCURRENT_INT_SET_NUM_COUNTERS - 1) ].count, 1);
+                return 1;
+            }
+        }
+
+        /* Values never move or go away, so once passed a slot never needs checking again */
+        if ( slotValue == toAdd )
+            return 0;
+
+        idx = (idx + 1) & mask;
+    }
+
+    return CONCURRENT_INT_SET_ADD_FAILED;
+}
+
+int concurrent_int_set_contains(ConcurrentIntSet *intSet, int testInt)
+{
+    size_t mask = intSet->capacity - 1;
+    size_t idx, numProbed;
+    int slotValue;
+
+    if ( unlikely( testInt == CONCURRENT_INT_SET_EMPTY ) )
+        return _CONCURRENT_INT_SET_READ(&intSet->hasZero);
+
+    idx = _concurrent_int_set_ideal_slot(intSet, testInt);
+    for( numProbed=0; numProbed < intSet->capacity; numProbed++ )
+    {
+        slotValue = _CONCURRENT_INT_SET_READ(&intSet->slots[idx]);
+
+        if ( slotValue == testInt )
+            return 1;
+
+        /* An add of #testInt would have taken the first empty slot of the run */
+        if ( slotValue == CONCURRENT_INT_SET_EMPTY )
+            return 0;
+
+        idx = (idx + 1) & mask;
+    }
+
+    return 0;
+}
+
+size_t concurrent_int_set_freeze(ConcurrentIntSet *intSet)
+{
+    size_t i;
+
+    /* See every add made by the other threads before counting */
+    __sync_synchronize();
+
+    if ( ! intSet->isFrozen )
+    {
+        intSet->numEntries = 0;
+        for( i=0; i < CONCURRENT_INT_SET_NUM_COUNTERS; i++ )
+            intSet->numEntries += intSet->counters[i].count;
+
+        intSet->isFrozen = 1;
+        __sync_synchronize();
+    }
+
+    return intSet->numEntries;
+}
+
+int *concurrent_int_set_values(ConcurrentIntSet *intSet, size_t *retLen)
+{
+    int *ret;
+    size_t i;
+    size_t retIdx;
+
+    if ( unlikely( ! intSet->isFrozen ) )
+        return NULL;
+
+    ret = malloc( intSet->numEntries * sizeof(int) );
+    retIdx = 0;
+
+    for ( i = 0; i < intSet->capacity; i++ )
+    {
+        if ( intSet->slots[i] != CONCURRENT_INT_SET_EMPTY )
+            ret[ retIdx++ ] = intSet->slots[i];
+    }
+
+    if ( intSet->hasZero )
+        ret[ retIdx++ ] = 0;
+
+    *retLen = intSet->numEntries;
+
+    return ret;
+}
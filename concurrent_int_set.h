@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * concurrent_int_set.h - Interface definitions for a set of ints which many
+ *                          threads can add to and search at once, without locks
+ *
+ */
+
+#ifndef _CONCURRENT_INT_SET_H
+#define _CONCURRENT_INT_SET_H
+
+#include <sys/types.h>
+
+#include "pid_tools.h"
+
+/*******************
+ * DATA TYPES
+ ******************/
+
+/* CONCURRENT_INT_SET_NUM_COUNTERS - Number of separate counters adds are spread over. Must be a power of 2 */
+#define CONCURRENT_INT_SET_NUM_COUNTERS 64
+
+/**
+ *   struct ConcurrentIntSetCounter - One of the counts of values added, a cache line each
+ *          so threads counting at once don't contend. You should not need to reference this directly.
+ */
+struct ConcurrentIntSetCounter {
+    size_t count;
+    char pad[64 - sizeof(size_t)];
+} ALIGN_64;
+
+/**
+ *   ConcurrentIntSet - A set of ints which any number of threads may add to
+ *                        and search at the same time, e.x. the pids matched by
+ *                        workers scanning /proc in parallel
+ *
+ *      Open-addressed table with linear probing, like SimpleIntMap, whose empty
+ *        slots are claimed with a compare-and-swap. A slot only ever goes from empty
+ *        to holding a value, never back (there is no remove), so a search needs no
+ *        lock and can never see a value half moved or removed under it.
+ *
+ *      The table never grows (moving values while other threads probe would need
+ *        locks), so create it with the most values it will hold, e.x. the number of
+ *        pids being scanned. It stays at most half full up to that many; past it,
+ *        adds still succeed but probe further, until the table is completely full.
+ *
+ *      Once every thread is done adding, freeze it. That makes it read-only, and
+ *        counts the values, so CONCURRENT_INT_SET_NUM_ENTRIES and concurrent_int_set_values
+ *        can be used.
+ *
+ *      0 marks an empty slot, so 0 itself is tracked by #hasZero instead.
+ *
+ *      Create with - concurrent_int_set_create
+ *
+ *      Free/Destroy with - concurrent_int_set_destroy
+ *
+ *      Other operations -- see functions below
+ */
+typedef struct {
+
+    int *slots;
+    size_t capacity;     /* Always a power of 2 */
+    int hasZero;         /* 1 if 0 is in the set */
+
+    int isFrozen;        /* 1 once concurrent_int_set_freeze is called */
+    size_t numEntries;   /* Counted by concurrent_int_set_freeze */
+
+    struct ConcurrentIntSetCounter counters[CONCURRENT_INT_SET_NUM_COUNTERS];
+
+} ConcurrentIntSet ALIGN_64;
+
+
+/*******************
+ * MACROS
+ ******************/
+
+/* CONCURRENT_INT_SET_NUM_ENTRIES - Number of values in a frozen set */
+#define CONCURRENT_INT_SET_NUM_ENTRIES(setObj) ((setObj)->numEntries)
+
+/* CONCURRENT_INT_SET_ADD_FAILED - Returned by concurrent_int_set_add if the set is frozen or completely full */
+#define CONCURRENT_INT_SET_ADD_FAILED (-1)
+
+/*******************
+ * PUBLIC FUNCTIONS
+ ******************/
+
+/**
+ *    concurrent_int_set_create - Allocate a ConcurrentIntSet for use
+ *
+ *          @param maxEntries <size_t> - Most values expected. The table is sized to stay
+ *                      at most half full with this many, and never grows
+ *
+ *          @return - Pointer to an allocated ConcurrentIntSet ready to use
+ *
+ *              This must be freed using concurrent_int_set_destroy
+ */
+ConcurrentIntSet *concurrent_int_set_create(size_t maxEntries);
+
+/**
+ *    concurrent_int_set_destroy - Deallocate a ConcurrentIntSet. No thread may still be using it
+ *
+ *          @param intSet <ConcurrentIntSet *> - Pointer to the set to free
+ */
+void concurrent_int_set_destroy(ConcurrentIntSet *intSet);
+
+/**
+ *    concurrent_int_set_add - Add a value to the set. Safe to call from many threads at once
+ *
+ *      @param intSet <ConcurrentIntSet *> - Pointer to the set into which to add
+ *
+ *      @param toAdd <int> - Integer to add
+ *
+ *      @return <int> - 1 if added (by this call. If several threads add the same value
+ *                        at once, exactly one of them gets 1)
+ *                      0 if already present
+ *                      CONCURRENT_INT_SET_ADD_FAILED if the set is frozen, or full
+ */
+int concurrent_int_set_add(ConcurrentIntSet *intSet, int toAdd);
+
+/**
+ *    concurrent_int_set_contains - Check if the set contains a value. Safe to call
+ *                                    from many threads at once, including while adding
+ *
+ *          @param intSet <ConcurrentIntSet *> - Pointer to the set to search
+ *
+ *          @param testInt <int> - Int to search for
+ *
+ *          @return - 1 if found (including any value whose add has returned, in any thread)
+ *                    0 if not found
+ */
+int concurrent_int_set_contains(ConcurrentIntSet *intSet, int testInt);
+
+/**
+ *    concurrent_int_set_freeze - Make the set read-only, and count its values
+ *
+ *      Call once no thread is adding any more (e.x. after joining them). Later adds fail.
+ *        Only reads the counters, so it costs the same whatever the size of the set.
+ *
+ *      @param intSet <ConcurrentIntSet *> - Pointer to the set
+ *
+ *      @return <size_t> - Number of values in the set
+ */
+size_t concurrent_int_set_freeze(ConcurrentIntSet *intSet);
+
+/**
+ *    concurrent_int_set_values - Return a list of all the values in a frozen set,
+ *                                  as simple_int_map_values
+ *
+ *      @param intSet <ConcurrentIntSet *> - Pointer to the set, which must be frozen
+ *
+ *      @param retLen <size_t *> - The size of the returned list will be stored here
+ *
+ *      @return <int *> - A list of all the values in #intSet (in no particular order),
+ *                          or NULL if it is not frozen
+ *
+ *          You are responsible for freeing this list
+ */
+int *concurrent_int_set_values(ConcurrentIntSet *intSet, size_t *retLen);
+
+
+#endif
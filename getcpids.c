@@ -17,25 +17,43 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
-#include <dirent.h>
-#include <ctype.h>
 
 #include "pid_tools.h"
 #include "pid_utils.h"
 
+#include "pid_tree.h"
+#include "proc_pids.h"
+#include "proc_children.h"
+#include "proc_scan.h"
+#include "proc_events.h"
 #include "simple_int_map.h"
+#include "pidtreed_shm.h"
+#include "pid_ident.h"
+#include "pid_snapshot.h"
 
 #include "ppid.h"
 
-const volatile char *copyright = "getcpids - Copyright (c) 2016, 2017, 2018 Tim Savannah.";
+STATIC_MULTICALL_ONLY const volatile char *copyright = "getcpids - Copyright (c) 2016, 2017, 2018 Tim Savannah.";
 
 static inline void usage()
 {
     fputs("Usage: getcpids (Options) [pid] (Optional: [pid2] [pid..N])\n", stderr);
     fputs("  Prints the child process ids (pids) belonging to a given pid or pids.\n\n", stderr);
-    fputs("    Options:\n\t\t-r\t\tRecursive mode. Gets child pids, and their children, and so on.\n\n", stderr);
+    fputs("    Options:\n\t\t-r\t\tRecursive mode. Gets child pids, and their children, and so on.\n", stderr);
+    fputs("\t\t-j [num]\tNumber of threads to use when scanning /proc. Default is number of online cpus.\n", stderr);
+    fputs("\t\t--follow\tPrint the current children, then keep running and print changes as they happen.\n", stderr);
+    fputs("\t\t\t\t  One line per change, \"+PID\" when a child is added and \"-PID\" when removed.\n", stderr);
+    fputs("\t\t\t\t  Exits once all the given pids, and all their followed children, have exited.\n", stderr);
+    fputs("\t\t--snapshot [file]\tAnswer from a snapshot written by \"pidsnap\", instead of the live system.\n\n", stderr);
 }
 
+/* FOLLOW_RESCAN_INTERVAL_MS - How often to rescan /proc in --follow mode when
+ *   process events are unavailable (e.x. not running as root)
+ */
+#define FOLLOW_RESCAN_INTERVAL_MS 250
+
+/* FOLLOW_MAX_EVENTS - Max number of events to handle in one batch */
+#define FOLLOW_MAX_EVENTS 256
 
 static int cmp_pids(const void *p1, const void *p2)
 {
@@ -44,42 +62,387 @@ static int cmp_pids(const void *p1, const void *p2)
     val1 = *((pid_t *)p1);
     val2 = *((pid_t *)p2);
 
-    return val1 - val2;
+    return (val1 > val2) - (val1 < val2);
 }
 
-/* TODO: Investigate if we strip out from allPidsList when we add if we can speedup getcpids 1 -r more */
-static void get_cpids_recursive(SimpleIntMap *matchedPidsMap, pid_t providedPid, pid_t *allPids, size_t allPidsLen)
+
+/**
+ *   struct PpidScanResult - What scan_ppid reads for each pid
+ */
+struct PpidScanResult {
+    PidIdent ident;
+    pid_t ppid;     /* 0 if the pid could not be read */
+};
+
+/**
+ * scan_ppid - proc_scan_func which reads the identity and parent pid of #pid
+ *               into #result (a struct PpidScanResult)
+ */
+static void scan_ppid(pid_t pid, void *result, void *threadBuffer)
 {
-    unsigned int i;
+    struct PpidScanResult *scan = (struct PpidScanResult *)result;
 
-    static pid_t nextPid;
-    static pid_t ppid;
+    if ( pid_ident_read(pid, &scan->ident, &scan->ppid) != PID_IDENT_OK )
+        scan->ppid = 0;
+}
 
-    for( i=0; i < allPidsLen; i++ )
+/**
+ * scanned_ppids - Collect the parents read by scan_ppid, leaving out (as 0, unknown)
+ *                   any parent which started after its child. Its pid was reused while
+ *                   scanning, and following it would graft an unrelated tree onto the child.
+ *
+ *      @param allPids <const pid_t *> - The sorted pids which were scanned
+ *
+ *      @param scans <const struct PpidScanResult *> - The result for each of #allPids
+ *
+ *      @param numPids <size_t> - Number of elements in #allPids
+ *
+ *      @return <pid_t *> - A malloc'd list of the parent of each of #allPids
+ */
+static pid_t *scanned_ppids(const pid_t *allPids, const struct PpidScanResult *scans, size_t numPids)
+{
+    const pid_t *parentPtr;
+    pid_t *ppids;
+    size_t i, parentIdx;
+
+    ppids = malloc( sizeof(pid_t) * (numPids + 1) );
+
+    for( i=0; i < numPids; i++ )
     {
-        nextPid = allPids[i];
-        if ( simple_int_map_contains( matchedPidsMap, nextPid ) )
-            continue; /* Already added and recursed */
+        ppids[i] = scans[i].ppid;
+        if ( ppids[i] <= 1 )
+            continue;
 
-        ppid = getPpid(nextPid);
-        if(ppid == providedPid)
+        parentPtr = bsearch(&ppids[i], allPids, numPids, sizeof(pid_t), cmp_pids);
+        if ( parentPtr == NULL )
+            continue;
+
+        parentIdx = parentPtr - allPids;
+        if ( scans[parentIdx].ppid != 0 && ! PID_IDENT_CAN_BE_PARENT(&scans[parentIdx].ident, &scans[i].ident) )
+            ppids[i] = 0;
+    }
+
+    return ppids;
+}
+
+/**
+ * get_children - Get the children of a set of pids
+ *
+ *      @param rootPids <const pid_t *> - The pids whose children to get
+ *
+ *      @param numRootPids <size_t> - Number of elements in #rootPids
+ *
+ *      @param isRecursive <int> - If 1, also get their children, and so on.
+ *
+ *      @param numThreads <int> - Number of threads used to scan /proc, or 0 for the default
+ *
+ *      @param retList <pid_t **> - Will be set to a sorted, malloc'd list of the children,
+ *                      or NULL if there are none
+ *
+ *      @param retLen <size_t *> - Will be set to the number of elements in #retList
+ *
+ *      @return <int> - 0 on success, -1 if /proc could not be read (errno is set)
+ */
+static int get_children(const pid_t *rootPids, size_t numRootPids, int isRecursive, int numThreads, pid_t **retList, size_t *retLen)
+{
+    pid_t *allPids;
+    pid_t *allPpids;
+    struct PpidScanResult *scans;
+    size_t allPidsLen = 0;
+    PidTree *pidTree;
+    size_t i;
+
+    *retLen = 0;
+
+    /* If pidtreed is running, build the index straight from its table */
+    if ( pidtreed_copy_table(&allPids, &allPpids, &allPidsLen) == 0 )
+    {
+        /* Same as getPpid, no parent means init is the parent */
+        for( i=0; i < allPidsLen; i++ )
         {
-            /* Already known to not be present because of above check */
-            simple_int_map_add( matchedPidsMap, nextPid );
-            get_cpids_recursive( matchedPidsMap, nextPid, allPids, allPidsLen );
-            /*
-            if ( simple_int_map_add( matchedPidsMap, nextPid ) )
-            {*/
-                /* 
-                   We successfully added this entry (wasn't already in list)
-                    so recurse to add all children of matched pid 
-                */
-                /*
-                get_cpids_recursive( matchedPidsMap, nextPid, allPids, allPidsLen );
+            if ( allPpids[i] == 0 )
+                allPpids[i] = 1;
+        }
+
+        goto __build_tree;
+    }
+
+    /* If the kernel can list children directly, only walk the requested subtree(s)
+     *   instead of scanning every pid on the system.
+     *
+     * Pid 1 is excluded, as pids without a parent (ppid=0, e.x. kthreadd) are
+     *   reported as children of init, which the kernel's list won't contain.
+     *   And the full scan is no worse there, since nearly everything is under init.
+     */
+    if ( proc_children_supported() )
+    {
+        for( i=0; i < numRootPids; i++ )
+        {
+            if ( rootPids[i] == 1 )
+                break;
+        }
+
+        if ( i == numRootPids )
+        {
+            *retList = proc_children_get(rootPids, numRootPids, isRecursive, retLen);
+            return 0;
+        }
+    }
+
+    /* Gather every live pid, already sorted */
+    allPids = proc_pids_get_all(&allPidsLen);
+    if ( unlikely( allPids == NULL ) )
+        return -1;
+
+    /* Read the parent of every pid exactly once, and build a parent->children
+     *   index from that. All queries (recursive or not, any number of pids)
+     *   are then answered by walking the index, without touching /proc again.
+     */
+    scans = malloc( sizeof(struct PpidScanResult) * (allPidsLen + 1) );
+    proc_scan_run(allPids, allPidsLen, scans, sizeof(struct PpidScanResult), scan_ppid, 0, numThreads);
+
+    allPpids = scanned_ppids(allPids, scans, allPidsLen);
+    free(scans);
+
+__build_tree:
+    /* pidTree takes ownership of allPids and allPpids */
+    pidTree = pid_tree_create(allPids, allPpids, allPidsLen);
+
+    *retList = pid_tree_get_children(pidTree, rootPids, numRootPids, isRecursive, retLen);
+
+    pid_tree_destroy(pidTree);
+
+    return 0;
+}
+
+/**
+ * follow_apply_snapshot - Make the followed set match a fresh list of children,
+ *                          printing a line for every pid added or removed.
+ *
+ *      @param followedMap <SimpleIntMap *> - The currently followed pids. Will be updated
+ *
+ *      @param snapshot <const pid_t *> - Sorted list of the current children
+ *
+ *      @param snapshotLen <size_t> - Number of elements in #snapshot
+ */
+static void follow_apply_snapshot(SimpleIntMap *followedMap, const pid_t *snapshot, size_t snapshotLen)
+{
+    pid_t *followed = NULL;
+    size_t followedLen = 0;
+    size_t i, j;
+
+    if ( MAP_NUM_ENTRIES(followedMap) > 0 )
+    {
+        followed = simple_int_map_sorted_values(followedMap, &followedLen);
+    }
+
+    /* Both lists are sorted, so merge them to find the differences */
+    i = j = 0;
+    while ( i < followedLen || j < snapshotLen )
+    {
+        if ( j == snapshotLen || ( i < followedLen && followed[i] < snapshot[j] ) )
+        {
+            simple_int_map_rem(followedMap, followed[i]);
+            printf("-%d\n", followed[i++]);
+        }
+        else if ( i == followedLen || snapshot[j] < followed[i] )
+        {
+            simple_int_map_add(followedMap, snapshot[j]);
+            printf("+%d\n", snapshot[j++]);
+        }
+        else
+        {
+            i++;
+            j++;
+        }
+    }
+
+    if ( followed != NULL )
+        free(followed);
+}
+
+/**
+ * follow_prune_orphans - Stop following any pid whose parent is no longer a root or followed pid.
+ *
+ *      When a process exits, the kernel moves its children to another parent
+ *        (init, or the nearest subreaper), which is usually outside the tree we follow.
+ *
+ *      @param followedMap <SimpleIntMap *> - The currently followed pids. Will be updated
+ *
+ *      @param rootsMap <SimpleIntMap *> - The pids given on the commandline
+ *
+ *      @param isRecursive <int> - If 0, only children of a root are followed
+ */
+static void follow_prune_orphans(SimpleIntMap *followedMap, SimpleIntMap *rootsMap, int isRecursive)
+{
+    pid_t *followed;
+    size_t followedLen;
+    size_t i;
+    pid_t ppid;
+    int removedAny;
+
+    /* Repeat until nothing changes, as removing one pid may orphan its own children */
+    do {
+        removedAny = 0;
+
+        if ( MAP_NUM_ENTRIES(followedMap) == 0 )
+            break;
+
+        followed = simple_int_map_sorted_values(followedMap, &followedLen);
+
+        for( i=0; i < followedLen; i++ )
+        {
+            /* A pid which has already exited gives 0, and is removed here (its exit event is then ignored) */
+            ppid = getPpid(followed[i]);
+
+            if ( simple_int_map_contains(rootsMap, ppid) )
+                continue;
+            if ( isRecursive && simple_int_map_contains(followedMap, ppid) )
+                continue;
+
+            simple_int_map_rem(followedMap, followed[i]);
+            printf("-%d\n", followed[i]);
+            removedAny = 1;
+        }
+
+        free(followed);
+
+    } while ( removedAny && isRecursive );
+}
+
+/**
+ * follow_children - Implements --follow. Print the current children of a set of pids,
+ *                     then print each change to that set until the pids and their
+ *                     followed children have all exited.
+ *
+ *      Changes are read from the kernel's process connector when available
+ *        (see proc_events.h), and otherwise found by rescanning /proc every
+ *        FOLLOW_RESCAN_INTERVAL_MS.
+ *
+ *      In recursive mode a new process is followed if it was forked by a root
+ *        or a followed process, and stays followed until it exits or is
+ *        reparented outside of the tree.
+ *
+ *      @return <int> - Exit code for main
+ */
+static int follow_children(const pid_t *rootPids, size_t numRootPids, int isRecursive, int numThreads)
+{
+    SimpleIntMap *followedMap;
+    SimpleIntMap *rootsMap;
+    ProcEvent *events = NULL;
+    pid_t *snapshot;
+    size_t snapshotLen;
+    struct stat statBuf;
+    int eventsFd;
+    int numEvents;
+    int needsPrune;
+    int needsResync;
+    size_t i;
+    int returnCode = 0;
+
+    followedMap = simple_int_map_create(1000);
+    rootsMap = simple_int_map_create(100);
+
+    simple_int_map_add_many(rootsMap, (const int *)rootPids, numRootPids);
+
+    /* Subscribe before taking the snapshot, so nothing happening in between is missed */
+    eventsFd = proc_events_open();
+    if ( eventsFd >= 0 )
+        events = malloc( sizeof(ProcEvent) * FOLLOW_MAX_EVENTS );
+
+    needsResync = 1;
+    while ( 1 )
+    {
+        if ( needsResync )
+        {
+            if ( unlikely( get_children(rootPids, numRootPids, isRecursive, numThreads, &snapshot, &snapshotLen) != 0 ) )
+            {
+                fprintf(stderr, "Failed to list /proc. Error %d: %s\n", errno, strerror(errno));
+                returnCode = 1;
+                break;
+            }
+
+            follow_apply_snapshot(followedMap, snapshot, snapshotLen);
+            if ( snapshot != NULL )
+                free(snapshot);
+
+            /* Forget any roots which have exited */
+            for( i=0; i < numRootPids; i++ )
+            {
+                if ( proc_stat_pid_dir(rootPids[i], &statBuf) != 0 )
+                    simple_int_map_rem(rootsMap, rootPids[i]);
+            }
+
+            needsResync = 0;
+        }
+
+        fflush(stdout);
+
+        if ( MAP_NUM_ENTRIES(rootsMap) == 0 && MAP_NUM_ENTRIES(followedMap) == 0 )
+            break;
+
+        if ( eventsFd < 0 )
+        {
+            usleep( FOLLOW_RESCAN_INTERVAL_MS * 1000 );
+            needsResync = 1;
+            continue;
+        }
+
+        numEvents = proc_events_read(eventsFd, events, FOLLOW_MAX_EVENTS, -1);
+        if ( numEvents == PROC_EVENTS_ERROR_OVERRUN )
+        {
+            /* We missed some events, start over from a fresh scan */
+            needsResync = 1;
+            continue;
+        }
+        if ( unlikely( numEvents < 0 ) )
+        {
+            fprintf(stderr, "Failed to read process events. Error %d: %s\n", errno, strerror(errno));
+            returnCode = 1;
+            break;
+        }
+
+        needsPrune = 0;
+        for( i=0; i < (size_t)numEvents; i++ )
+        {
+            switch( events[i].eventType )
+            {
+                case PROC_EVENT_TYPE_FORK:
+                    if ( simple_int_map_contains(rootsMap, events[i].ppid) ||
+                         ( isRecursive && simple_int_map_contains(followedMap, events[i].ppid) ) )
+                    {
+                        if ( simple_int_map_add(followedMap, events[i].pid) )
+                            printf("+%d\n", events[i].pid);
+                    }
+                    break;
+                case PROC_EVENT_TYPE_EXIT:
+                    if ( simple_int_map_rem(followedMap, events[i].pid) )
+                    {
+                        printf("-%d\n", events[i].pid);
+                        /* Its children (if any) were just reparented */
+                        if ( isRecursive )
+                            needsPrune = 1;
+                    }
+                    /* A root may also be a child of another root */
+                    if ( simple_int_map_rem(rootsMap, events[i].pid) )
+                        needsPrune = 1;
+                    break;
             }
-                */
         }
+
+        if ( needsPrune )
+            follow_prune_orphans(followedMap, rootsMap, isRecursive);
     }
+
+    if ( eventsFd >= 0 )
+        proc_events_close(eventsFd);
+    if ( events != NULL )
+        free(events);
+
+    simple_int_map_destroy(followedMap);
+    simple_int_map_destroy(rootsMap);
+
+    return returnCode;
 }
 
 /**
@@ -90,27 +453,21 @@ static void get_cpids_recursive(SimpleIntMap *matchedPidsMap, pid_t providedPid,
  */
 int main(int argc, char* argv[])
 {
-    SimpleIntMap *matchedPidsMap = NULL;
-
-    SimpleIntMap *allPidsMap = NULL;
-    pid_t *allPids = NULL;
-    size_t allPidsLen = 0;
-
-    DIR *procDir;
-    struct dirent *dirInfo;
     pid_t *providedPids = NULL;
     pid_t providedPid;
-    pid_t nextPid;
-    char* nextPidStr;
-    pid_t ppid;
 
     pid_t *printList;
     size_t numItems;
-    unsigned int i, j;
+    unsigned int i;
     unsigned int numArgs; /* Total number of arguments */
     unsigned int numPidArgs; /* Total number of arguments that were pids */
 
     char isRecursiveMode = 0; /* Set to 1 in recursive mode */
+    char isFollowMode = 0; /* Set to 1 with --follow */
+    const char *snapshotPath = NULL; /* Set with --snapshot */
+    PidSnapshot *snapshot = NULL;
+    int numThreads = 0; /* 0 means use the default */
+    char *numThreadsStr;
 
     int returnCode = 0;
 
@@ -148,12 +505,50 @@ int main(int argc, char* argv[])
                 goto __cleanup_and_exit;
             }
 
+            if ( strcmp("--follow", argv[i]) == 0 )
+            {
+                isFollowMode = 1;
+                continue;
+            }
+
+            if ( strcmp("--snapshot", argv[i]) == 0 )
+            {
+                if ( i == numArgs )
+                {
+                    fputs("Missing file after --snapshot\n", stderr);
+                    returnCode = 1;
+                    goto __cleanup_and_exit;
+                }
+                snapshotPath = argv[++i];
+                continue;
+            }
+
             if ( argv[i][0] == '-' && (argv[i][1] == 'r' || argv[i][1] == 'R') && argv[i][2] == '\0' )
             {
                 isRecursiveMode = 1;
                 continue;
             }
 
+            if ( argv[i][0] == '-' && argv[i][1] == 'j' )
+            {
+                /* Accept both "-j N" and "-jN" */
+                if ( argv[i][2] != '\0' )
+                    numThreadsStr = &argv[i][2];
+                else if ( i < numArgs )
+                    numThreadsStr = argv[++i];
+                else
+                    numThreadsStr = "";
+
+                numThreads = strtoint(numThreadsStr);
+                if ( numThreads <= 0 )
+                {
+                    fprintf(stderr, "Invalid number of threads: '%s'\n", numThreadsStr);
+                    returnCode = 1;
+                    goto __cleanup_and_exit;
+                }
+                continue;
+            }
+
             /* Nope -- fail out. */
             fprintf(stderr, "Invalid pid: %s\n", argv[i]);
             returnCode = 1;
@@ -164,75 +559,47 @@ int main(int argc, char* argv[])
     }
 
 
-    numItems = 0;
-
-    matchedPidsMap = simple_int_map_create(10);
-    /* First, assemble all pids into a single map (so we aren't opendir/readdir/closedir
-     *    over and over with conflicts in static data in recursive mode )
-     */
-
-    allPidsMap = simple_int_map_create(25);
-    /* Iterate over entries in /proc looking for numeric folders.
-     *   These are active pids.
-     *   Directory info is returned already-sorted, so no need to sort output
-     */
-    procDir = opendir("/proc");
-    while( (dirInfo = readdir(procDir)) )
+    if ( snapshotPath != NULL )
     {
-        nextPidStr = dirInfo->d_name;
-        if(!isdigit(nextPidStr[0]))
-                continue;
+        if ( isFollowMode )
+        {
+            fputs("--follow cannot be used with --snapshot\n", stderr);
+            returnCode = 1;
+            goto __cleanup_and_exit;
+        }
 
-        nextPid = atoi(nextPidStr);
+        snapshot = pid_snapshot_open(snapshotPath);
+        if ( snapshot == NULL )
+        {
+            fprintf(stderr, "Cannot open snapshot '%s'. Error %d: %s\n", snapshotPath, errno, strerror(errno));
+            returnCode = 1;
+            goto __cleanup_and_exit;
+        }
 
-        simple_int_map_add( allPidsMap, nextPid );
+        /* The snapshot carries its own children index, so this is just a walk over it */
+        printList = pid_tree_get_children(&snapshot->tree, providedPids, numPidArgs, isRecursiveMode, &numItems);
+        goto __print_results;
     }
-    closedir(procDir);
 
-    allPids = simple_int_map_values(allPidsMap, &allPidsLen);
-
-    for( i=0; i < allPidsLen; i++ )
+    if ( isFollowMode )
     {
-        nextPid = allPids[i];
-
-        if ( i > 0 && simple_int_map_contains( matchedPidsMap, nextPid ) )
-            continue;
-
-        ppid = getPpid(nextPid);
-
-        /* Iterate over each argument and if parent pid of
-         *   entryy we are checking is a match, we add to list.
-         * Duplicates are handled by break-ing after a match.
-         */
-        for( j=0; j < numPidArgs; j++ )
-        {
-            providedPid = providedPids[j];
-            if(ppid == providedPid)
-            {
-                /* Is recursive, so add this pid and recurse */
-                simple_int_map_add( matchedPidsMap, nextPid );
+        returnCode = follow_children(providedPids, numPidArgs, isRecursiveMode, numThreads);
+        goto __cleanup_and_exit;
+    }
 
-                if ( isRecursiveMode == 0 )
-                {
-                    break;
-                }
-                else
-                {
-                    get_cpids_recursive( matchedPidsMap, nextPid , allPids, allPidsLen);
-                }
-            }
-        }
+    if ( unlikely( get_children(providedPids, numPidArgs, isRecursiveMode, numThreads, &printList, &numItems) != 0 ) )
+    {
+        fprintf(stderr, "Failed to list /proc. Error %d: %s\n", errno, strerror(errno));
+        returnCode = 1;
+        goto __cleanup_and_exit;
     }
 
-    numItems = MAP_NUM_ENTRIES(matchedPidsMap);
+__print_results:
+
     /* Check for no matched children. */
     if ( numItems == 0 )
         goto __cleanup_and_exit;
 
-    printList = simple_int_map_values(matchedPidsMap, &numItems);
-
-    qsort(printList, numItems, sizeof(int), cmp_pids);
-
     for( i=0; i < numItems; i++ )
     {
         printf("%d", printList[i]);
@@ -247,14 +614,8 @@ __cleanup_and_exit:
     if ( providedPids != NULL )
         free(providedPids);
 
-    if ( matchedPidsMap != NULL )
-        simple_int_map_destroy(matchedPidsMap);
-
-    if ( allPidsMap != NULL )
-        simple_int_map_destroy(allPidsMap);
-
-    if ( allPids != NULL )
-        free(allPids);
+    if ( snapshot != NULL )
+        pid_snapshot_close(snapshot);
 
     return returnCode;
 }
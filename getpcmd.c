@@ -23,8 +23,10 @@
 
 #include "ppid.h"
 #include "pid_utils.h"
+#include "proc_handle.h"
+#include "stdin_query.h"
 
-const volatile char *copyright = "getpcmd - Copyright (c) 2017 Tim Savannah.";
+STATIC_MULTICALL_ONLY const volatile char *copyright = "getpcmd - Copyright (c) 2017 Tim Savannah.";
 
 /*
  * usage - print usage/help to stderr
@@ -33,7 +35,11 @@ static inline void usage()
 {
     fputs("Usage: getpcmd (Options) [pid] (Optional: [pid2] [pid3])\n", stderr);
     fputs("  Prints the commandline string of given pids\n", stderr);
-    fputs("\n  Options:\n\n     --quote              Quote the command arguments in output\n\n", stderr);
+    fputs("\n  Options:\n\n     --quote              Quote the command arguments in output\n", stderr);
+    fputs("     --stdin              Read one pid per line from stdin (instead of arguments),\n", stderr);
+    fputs("                            and answer each with one line: \"ok COMMANDLINE\" or\n", stderr);
+    fputs("                            \"error MESSAGE\". Newlines within arguments are printed\n", stderr);
+    fputs("                            as spaces. Answers are flushed as they are ready.\n\n", stderr);
 }
 
 /**
@@ -42,29 +48,27 @@ static inline void usage()
 static void do_print_commandline(char *ptr, ssize_t size, int quoteArgs);
 
 /**
- *   read_and_print_proc_cmdline - Read the "cmdline" property of a given pid, 
- *                        and either print it or an error message.
+ *   read_proc_cmdline - Read the "cmdline" property of a given pid
  *
- *       Returns 1 on success, 0 on error
-*/
-static int read_and_print_proc_cmdline(pid_t pid, int quoteArgs)
+ *       @param sizeOut <ssize_t *> - Will be set to the number of bytes read
+ *
+ *       @return <char *> - Allocated contents (free when done), or NULL on error
+ */
+static char *read_proc_cmdline(pid_t pid, ssize_t *sizeOut)
 {
-    static char path[64] = { '/', 'p', 'r', 'o', 'c', '/' };
     int fd;
     char *ret = NULL;
     ssize_t size, bytesRead;
 
     long int curBuffSize = 4096 << 1;
 
-    sprintf(&path[6], "%d/cmdline", pid);
-
     errno = 0;
 
-    fd = open(path, O_RDONLY);
+    fd = proc_open_pid_file(pid, "cmdline", O_RDONLY);
 
     if( unlikely(fd == -1 || errno) )
     {
-        goto cleanup_err_exit;
+        return NULL;
     }
 
     /* fseek doesn't seem to work on proc to get file size.. */
@@ -89,7 +93,8 @@ static int read_and_print_proc_cmdline(pid_t pid, int quoteArgs)
         if ( unlikely ( !bytesRead ) )
         {
             close(fd);
-            goto cleanup_err;
+            free(ret);
+            return NULL;
         }
         else if ( bytesRead < nextSize )
         {
@@ -115,6 +120,28 @@ static int read_and_print_proc_cmdline(pid_t pid, int quoteArgs)
             
     close(fd);
 
+    *sizeOut = size;
+    return ret;
+}
+
+/**
+ *   read_and_print_proc_cmdline - Read the "cmdline" property of a given pid, 
+ *                        and either print it or an error message.
+ *
+ *       Returns 1 on success, 0 on error
+*/
+static int read_and_print_proc_cmdline(pid_t pid, int quoteArgs)
+{
+    char *ret;
+    ssize_t size;
+
+    ret = read_proc_cmdline(pid, &size);
+    if ( unlikely( ret == NULL ) )
+    {
+        fprintf(stderr, "Error, pid %d does not exist or is not accessable.\n", pid);
+        return 0;
+    }
+
     /* Empty commandline str? */
     if ( size == 0 )
     {
@@ -129,22 +156,53 @@ static int read_and_print_proc_cmdline(pid_t pid, int quoteArgs)
 
 
     return 1;
+}
 
-/* cleanup_err - Free "ret", print error message and exit=0 */
-cleanup_err:
+/**
+ * answer_query - stdin_query_func for "--stdin" mode. The query is one pid,
+ *                  and #data points to quoteArgs.
+ */
+static int answer_query(char **args, int numArgs, void *data)
+{
+    pid_t pid;
+    char *cmdline;
+    ssize_t size, i;
 
-    free(ret);
+    pid = strtoint(args[0]);
+    if ( numArgs != 1 || pid <= 0 )
+    {
+        printf("error Invalid query (expected one pid > 0): %s\n", args[0]);
+        return 1;
+    }
 
-/* cleanup_err_exit - Just print error message and exit=0 (go directly here if ret not allocated) */
-cleanup_err_exit:
+    cmdline = read_proc_cmdline(pid, &size);
+    if ( unlikely( cmdline == NULL ) )
+    {
+        printf("error pid %d does not exist or is not accessable.\n", pid);
+        return 1;
+    }
 
-    fprintf(stderr, "Error, pid %d does not exist or is not accessable.\n", pid);
-    return 0;
+    fputs("ok ", stdout);
+    if ( size == 0 )
+    {
+        putchar('\n');
+    }
+    else
+    {
+        /* So every answer is one line */
+        for( i=0; i < size; i++ )
+        {
+            if ( unlikely( cmdline[i] == '\n' ) )
+                cmdline[i] = ' ';
+        }
+        do_print_commandline(cmdline, size, *(int *)data);
+    }
 
+    free(cmdline);
 
+    return 0;
 }
 
-
 /**
  * do_print_commandline - Print the value of the proc cmdline contents, optionally quoting each argument.
  */
@@ -211,6 +269,7 @@ int main(int argc, char* argv[])
     pid_t *pids;
     unsigned int numPids = 0;
     int quoteArgs = 0;
+    int readStdin = 0;
     int i;
     int ret = 0;
 
@@ -253,6 +312,12 @@ _invalid_arg_exit:
             continue;
         }
 
+        if ( unlikely(strcmp("--stdin", arg) == 0) )
+        {
+            readStdin = 1;
+            continue;
+        }
+
 
         /* Convert and validate provided "pid" argument */
         pid = strtoint(arg);
@@ -264,6 +329,16 @@ _invalid_arg_exit:
         pids[numPids++] = pid;
     }
 
+    if ( readStdin )
+    {
+        if ( numPids > 0 )
+        {
+            fputs("Pids cannot be given as arguments with --stdin.\n", stderr);
+            return 1;
+        }
+        return stdin_query_run(answer_query, &quoteArgs);
+    }
+
     if( unlikely(numPids <= 0) )
     {
         fprintf(stderr, "Missing pid argument. See `%s --help' for usage.\n", argv[0]);
@@ -23,8 +23,10 @@
 
 #include "ppid.h"
 #include "pid_utils.h"
+#include "proc_handle.h"
+#include "stdin_query.h"
 
-const volatile char *copyright = "getpenv - Copyright (c) 2016, 2017 Tim Savannah.";
+STATIC_MULTICALL_ONLY const volatile char *copyright = "getpenv - Copyright (c) 2016, 2017 Tim Savannah.";
 
 /*
  * usage - print usage/help to stderr
@@ -35,6 +37,10 @@ static inline void usage()
     fputs("  Prints the value of an env var as set for given pid\n\n", stderr);
     fputs("Return code is 254 if no such name in the environ of given process\n Otherwise is non-zero indicating error (in case of error).\n\n", stderr);
     fputs("Example: getpenv 12345 PATH\n\n", stderr);
+    fputs("   or: getpenv --stdin\n", stderr);
+    fputs("  Reads one \"[pid] [env var name]\" per line from stdin, and answers each with one line:\n", stderr);
+    fputs("    \"ok VALUE\", \"notfound\", or \"error MESSAGE\". Newlines within values are printed\n", stderr);
+    fputs("    as spaces. Answers are flushed as they are ready.\n\n", stderr);
 }
 
 #define NOT_FOUND ( (char*) 1)
@@ -112,21 +118,25 @@ _read_again:
 
 static char* getEnvValueForPid(pid_t pid, const char* envName)
 {
-    static char path[64] = { '/', 'p', 'r', 'o', 'c', '/', 0 };
-    
     char *buf, *cur, *val, *ret;
     FILE *envFile;
+    int envFd;
     size_t idx, maxIdx, thisLen, envNameLen;
 
     /* "Not Found" marker */
     ret = NOT_FOUND;
 
-    sprintf( &path[6], "%d/environ", pid );
+    envFd = proc_open_pid_file(pid, "environ", O_RDONLY);
+    if ( envFd < 0 )
+    {
+//        errno = ESRCH;
+        return NULL;
+    }
 
-    envFile = fopen(path, "r");
+    envFile = fdopen(envFd, "r");
     if ( envFile == NULL )
     {
-//        errno = ESRCH;
+        close(envFd);
         return NULL;
     }
 
@@ -162,6 +172,43 @@ static char* getEnvValueForPid(pid_t pid, const char* envName)
     return ret;
 }
 
+/**
+ * answer_query - stdin_query_func for "--stdin" mode. The query is a pid and an env var name.
+ */
+static int answer_query(char **args, int numArgs, void *data)
+{
+    pid_t pid;
+    char *envVal;
+
+    pid = strtoint(args[0]);
+    if ( numArgs != 2 || pid <= 0 )
+    {
+        printf("error Invalid query (expected a pid > 0 and an env var name): %s\n", args[0]);
+        return 1;
+    }
+
+    envVal = getEnvValueForPid(pid, args[1]);
+
+    if ( unlikely(envVal == NOT_FOUND) )
+    {
+        puts("notfound");
+        return 1;
+    }
+    else if ( unlikely(envVal == NULL) )
+    {
+        printf("error Error reading env var '%s' from pid=%d. Error %d: %s\n", args[1], pid, errno, strerror(errno));
+        return 1;
+    }
+
+    fputs("ok ", stdout);
+    stdin_query_print_value(envVal, strlen(envVal));
+    putchar('\n');
+
+    free(envVal);
+
+    return 0;
+}
+
 /**
  * main - takes two arguments, the pid and env var name
  *
@@ -195,6 +242,9 @@ int main(int argc, char* argv[])
     }
 
 
+    if ( argc == 2 && strcmp("--stdin", argv[1]) == 0 )
+        return stdin_query_run(answer_query, NULL);
+
     if ( argc != 3 ) {
         fputs("Invalid number of arguments.\n\n", stderr);
         usage();
@@ -24,6 +24,10 @@
 #include "pid_tools.h"
 #include "pid_utils.h"
 
+#include "proc_scan.h"
+#include "proc_handle.h"
+#include "stdin_query.h"
+
 #define OUTPUT_MODE_RSS 1
 
 /* uint64 - 8-byte unsigned integer (in both 32-bit and 64-bit mode) */
@@ -65,6 +69,21 @@ struct pmem_rss_info_converted {
 };
 
 
+/* PMEM_NAME_SIZE - Space for the "Name:" field of status. The kernel limits the
+ *   name to 16 characters, but escaping of special characters can grow that.
+ */
+#define PMEM_NAME_SIZE 72
+
+/* struct pmem_pid_info - Everything we extract from a single pid's status file.
+ *                         These are filled in by the /proc scan, and printed afterwards.
+ */
+struct pmem_pid_info {
+    int errorNum;              /* 0 if status was read, otherwise the errno from trying */
+    char name[PMEM_NAME_SIZE]; /* Empty string if not found */
+    struct pmem_rss_info rssInfo;
+};
+
+
 /* LABELS_OUTPUT_UNITS - Labels for the various units.
  *    index matches the enum outputUnitOptions values
  */
@@ -75,7 +94,7 @@ static const char *LABELS_OUTPUT_UNITS[] = { "", "B", "kB", "KiB", "mB", "MiB",
  */
 #define STATUS_BUFFER_SIZE 4096
 
-const volatile char *copyright = "getpmem - Copyright (c) 2018 Tim Savannah.";
+STATIC_MULTICALL_ONLY const volatile char *copyright = "getpmem - Copyright (c) 2018 Tim Savannah.";
 
 static inline void print_version(void)
 {
@@ -91,6 +110,12 @@ static inline void print_usage(void)
 "\n" \
 "         --help          - Print usage information\n" \
 "         --version       - Print version information on getpmem\n" \
+"         -j [num]        - Number of threads to use when reading /proc.\n" \
+"                             Default is number of online cpus\n" \
+"         --stdin         - Read one pid per line from stdin (instead of arguments),\n" \
+"                             and answer each with one line, in the output units:\n" \
+"                             \"ok RssAnon RssFile RssShmem VmRSS NAME\" or\n" \
+"                             \"error MESSAGE\". Answers are flushed as they are ready.\n" \
 "\n" \
 "     Output Mode:\n" \
 "       (select one or more of the following)\n" \
@@ -247,7 +272,8 @@ static inline struct pmem_rss_info_converted convertRssValues(struct pmem_rss_in
  *
  *     pid   -  The process ID
  *
- *     buffer - A pointer to an allocated char* in which to place the contents
+ *     buffer - A pointer to an allocated char* in which to place the contents.
+ *               Must hold at least STATUS_BUFFER_SIZE + 1 bytes.
  *
  *  Return Value:
  *
@@ -256,23 +282,26 @@ static inline struct pmem_rss_info_converted convertRssValues(struct pmem_rss_in
  */
 static size_t read_status_contents(pid_t pid, char **buffer)
 {
-    FILE *statFile;
-    static char procPath[24] = { '/', 'p', 'r', 'o', 'c', '/' };
+    int statFd;
     char *buf;
     size_t numBytesRead;
-
-    numBytesRead = sprintf( &procPath[6], "%u/status", pid);
+    ssize_t thisRead;
 
     buf = *buffer;
 
-    statFile = fopen(procPath, "r");
-    if( !statFile )
+    statFd = proc_open_pid_file(pid, "status", O_RDONLY);
+    if( statFd < 0 )
         return 0;
 
-    numBytesRead = fread(buf, 1, STATUS_BUFFER_SIZE, statFile);
+    numBytesRead = 0;
+    while ( numBytesRead < STATUS_BUFFER_SIZE &&
+            ( thisRead = read(statFd, &buf[numBytesRead], STATUS_BUFFER_SIZE - numBytesRead) ) > 0 )
+    {
+        numBytesRead += thisRead;
+    }
     buf[numBytesRead] = '\0';
 
-    fclose(statFile);
+    close(statFd);
 
     return numBytesRead;
 }
@@ -306,6 +335,9 @@ static size_t read_status_contents(pid_t pid, char **buffer)
  *
  *    inputStr - String to split by newlines
  *
+ *    linesBuffer - If SPLIT_LINES_CALC_SIZE is 0, an array of at least
+ *         SPLIT_LINES_MAX_LINES char pointers to hold the result. Ignored otherwise.
+ *
  *    _numLines - Pointer to a size_t which will be set
  *         to the number of lines.
  *
@@ -314,16 +346,12 @@ static size_t read_status_contents(pid_t pid, char **buffer)
  *    A char** where the values are the beginnings of lines
  *      within #inputStr.
  *
- *    If SPLIT_LINES_CALC_SIZE is 0, this is a static array and
+ *    If SPLIT_LINES_CALC_SIZE is 0, this is #linesBuffer and
  *      should not be freed. Otherwise, it is dynamic and must be freed.
  */
-static char **split_lines(char *inputStr, size_t *_numLines)
+static char **split_lines(char *inputStr, char **linesBuffer, size_t *_numLines)
 {
-    #if SPLIT_LINES_CALC_SIZE == 0
-      static char **ret = NULL;
-    #else
-      char **ret;
-    #endif
+    char **ret;
     int retIdx = 0;
 
     char *cur;
@@ -333,11 +361,10 @@ static char **split_lines(char *inputStr, size_t *_numLines)
 
     #if SPLIT_LINES_CALC_SIZE == 0
       /* 
-       * If we are going to just use one large buffer, make it static
-       *   and allocate it once.
+       * If we are going to just use one large buffer, use the one
+       *   provided by the caller (one per scanning thread).
        */
-      if ( ret == NULL )
-          ret = malloc( sizeof(char *) * SPLIT_LINES_MAX_LINES );
+      ret = linesBuffer;
     #else
       numLines = 0;
       for( cur=inputStr; *cur != '\0'; cur++ )
@@ -370,6 +397,12 @@ static char **split_lines(char *inputStr, size_t *_numLines)
              }
             *cur = '\0';
 
+            #if SPLIT_LINES_CALC_SIZE == 0
+              /* Don't overflow the fixed-size buffer */
+              if ( unlikely( retIdx >= SPLIT_LINES_MAX_LINES ) )
+                  break;
+            #endif
+
             cur += 1;
             ret[ retIdx++ ] = cur;
         }
@@ -510,35 +543,49 @@ static struct pmem_rss_info extractRssValuesFromLines(char **lines, size_t numLi
     return extractedValues;
 }
 
-static inline void printProcessInfoHeader(pid_t curPid, char **lines, size_t numLines)
+/**
+ * extractNameFromLines - Copy the "Name:" field from status lines into #name
+ *
+ *    @param lines - /proc/$pid/status lines that have been split with split_lines
+ *
+ *    @param numLines - Number of lines in #lines array
+ *
+ *    @param name - Buffer of PMEM_NAME_SIZE to hold the name. Will be an empty string if not found.
+ */
+static void extractNameFromLines(char **lines, size_t numLines, char *name)
 {
-    static const char *UNKNOWN_NAME = "UNKNOWN";
-    char *namePtr = NULL;
+    int i;
+    char *curLine;
+    char *namePtr;
 
-    if ( lines != NULL )
-    {
-        int i;
-        char *curLine;
+    static const uint32_t NAME_STR = ('e' << 24) + ('m' << 16) + ('a' << 8) + 'N';
 
-        static const uint32_t NAME_STR = ('e' << 24) + ('m' << 16) + ('a' << 8) + 'N';
+    name[0] = '\0';
 
-        for( i=0; i < numLines; i++ )
+    for( i=0; i < numLines; i++ )
+    {
+        curLine = lines[i];
+        if ( ((uint32_t *)curLine)[0] == NAME_STR && curLine[4] == ':' )
         {
-            curLine = lines[i];
-            if ( ((uint32_t *)curLine)[0] == NAME_STR && curLine[4] == ':' )
-            {
-                namePtr = &curLine[5];
-                while( *namePtr == '\t' || *namePtr == ' ' )
-                    namePtr += 1;
-                break;
-            }
+            namePtr = &curLine[5];
+            while( *namePtr == '\t' || *namePtr == ' ' )
+                namePtr += 1;
+
+            strncpy(name, namePtr, PMEM_NAME_SIZE - 1);
+            name[PMEM_NAME_SIZE - 1] = '\0';
+            break;
         }
     }
+}
 
-    if ( unlikely( namePtr == NULL ) )
-        namePtr = (char *)UNKNOWN_NAME;
+static inline void printProcessInfoHeader(pid_t curPid, const char *name)
+{
+    static const char *UNKNOWN_NAME = "UNKNOWN";
+
+    if ( unlikely( name == NULL || name[0] == '\0' ) )
+        name = UNKNOWN_NAME;
 
-    printf("Memory info for pid: %d ( %s )\n", curPid, namePtr);
+    printf("Memory info for pid: %d ( %s )\n", curPid, name);
     puts("----------------------------------------");
 }
 
@@ -554,11 +601,9 @@ static inline void printProcessInfoFooter(void)
 }
 
 /**
- * prorcessRssLines - Process status lines associated with the RSS format (-r)
- *
- *    @param lines - /proc/$pid/status lines that have been split with split_lines
+ * processRssInfo - Process the extracted values associated with the RSS format (-r)
  *
- *    @param numLines - Number of lines in #lines array
+ *    @param thisRssInfo <struct pmem_rss_info *> - RSS values in kB as extracted from status lines
  *
  *    @param outputUnits <enum outputUnitOptions> - The desired output unit
  *
@@ -566,27 +611,23 @@ static inline void printProcessInfoFooter(void)
  *                              Otherwise, the processed rss values will be added to the totals.
  *
  *
- *    @return <pmem_rss_info_converted> - The converted fields extracted from provided lines and
- *                                          converted to the requested output unit
+ *    @return <pmem_rss_info_converted> - The provided fields converted to the requested output unit
  */
-static struct pmem_rss_info_converted processRssLines(char **lines, size_t numLines, enum outputUnitOptions outputUnits, struct pmem_rss_info *rssInfoTotal)
+static struct pmem_rss_info_converted processRssInfo(struct pmem_rss_info *thisRssInfo, enum outputUnitOptions outputUnits, struct pmem_rss_info *rssInfoTotal)
 {
 
-    struct pmem_rss_info thisRssInfo;
     struct pmem_rss_info_converted thisRssInfoConverted;
 
 
-    thisRssInfo = extractRssValuesFromLines(lines, numLines);
-
     if ( rssInfoTotal != NULL )
     {
-        rssInfoTotal->rssAnon += thisRssInfo.rssAnon;
-        rssInfoTotal->rssFile  += thisRssInfo.rssFile;
-        rssInfoTotal->rssShmem += thisRssInfo.rssShmem;
-        rssInfoTotal->vmRss    += thisRssInfo.vmRss;
+        rssInfoTotal->rssAnon += thisRssInfo->rssAnon;
+        rssInfoTotal->rssFile  += thisRssInfo->rssFile;
+        rssInfoTotal->rssShmem += thisRssInfo->rssShmem;
+        rssInfoTotal->vmRss    += thisRssInfo->vmRss;
     }
 
-    thisRssInfoConverted = convertRssValues(&thisRssInfo, outputUnits);
+    thisRssInfoConverted = convertRssValues(thisRssInfo, outputUnits);
 
     return thisRssInfoConverted;
 }
@@ -642,13 +683,13 @@ static inline void printRssInfo
 }
 
 
-static void printRssLines(char **lines, size_t numLines, enum outputUnitOptions outputUnits, struct pmem_rss_info *rssInfoTotal)
+static void printRssValues(struct pmem_rss_info *thisRssInfo, enum outputUnitOptions outputUnits, struct pmem_rss_info *rssInfoTotal)
 {
 
     struct pmem_rss_info_converted thisRssInfoConverted;
     const char *unitLabel;
 
-    thisRssInfoConverted = processRssLines(lines, numLines, outputUnits, rssInfoTotal);
+    thisRssInfoConverted = processRssInfo(thisRssInfo, outputUnits, rssInfoTotal);
 
     unitLabel = get_unit_label(outputUnits);
 
@@ -656,6 +697,99 @@ static void printRssLines(char **lines, size_t numLines, enum outputUnitOptions
 }
 
 
+/* PMEM_SCAN_BUFFER_SIZE - Scratch space each scanning thread needs:
+ *    the split lines array, followed by the status contents (plus a null)
+ */
+#define PMEM_SCAN_BUFFER_SIZE ( ( sizeof(char *) * SPLIT_LINES_MAX_LINES ) + STATUS_BUFFER_SIZE + 1 )
+
+/**
+ * scan_pid_status - proc_scan_func which reads /proc/$pid/status and extracts
+ *      everything we may print into the struct pmem_pid_info pointed to by #result
+ */
+static void scan_pid_status(pid_t pid, void *result, void *threadBuffer)
+{
+    struct pmem_pid_info *pidInfo = (struct pmem_pid_info *)result;
+    char **lines;
+    size_t numLines;
+    char *statContents;
+    size_t statContentsSize;
+
+    statContents = &((char *)threadBuffer)[ sizeof(char *) * SPLIT_LINES_MAX_LINES ];
+
+    errno = 0;
+    statContentsSize = read_status_contents(pid, &statContents);
+    if ( statContentsSize == 0 )
+    {
+        /* An empty read leaves errno at 0, but is still a failure */
+        pidInfo->errorNum = errno ? errno : EIO;
+        return;
+    }
+    pidInfo->errorNum = 0;
+
+    lines = split_lines(statContents, (char **)threadBuffer, &numLines);
+
+    extractNameFromLines(lines, numLines, pidInfo->name);
+    pidInfo->rssInfo = extractRssValuesFromLines(lines, numLines);
+
+    #if SPLIT_LINES_CALC_SIZE == 1
+      /* If SPLIT_LINES_CALC_SIZE is 0, we are using the thread buffer
+       *   so don't free it.
+       */
+      free(lines);
+    #endif
+}
+
+/**
+ * struct pmem_query_state - What answer_query needs for every query in "--stdin" mode
+ */
+struct pmem_query_state {
+    enum outputUnitOptions outputUnits;
+    char *scanBuffer; /* PMEM_SCAN_BUFFER_SIZE bytes, for scan_pid_status */
+};
+
+/**
+ * answer_query - stdin_query_func for "--stdin" mode. The query is one pid,
+ *                  and #data points to a struct pmem_query_state
+ */
+static int answer_query(char **args, int numArgs, void *data)
+{
+    struct pmem_query_state *queryState = (struct pmem_query_state *)data;
+    struct pmem_pid_info pidInfo;
+    struct pmem_rss_info_converted converted;
+    pid_t pid;
+
+    memset(&pidInfo, 0, sizeof(pidInfo));
+
+    pid = strtoint(args[0]);
+    if ( numArgs != 1 || pid <= 0 )
+    {
+        printf("error Invalid query (expected one pid > 0): %s\n", args[0]);
+        return 1;
+    }
+
+    scan_pid_status(pid, &pidInfo, queryState->scanBuffer);
+    if ( pidInfo.errorNum != 0 )
+    {
+        printf("error Failed reading memory information for pid=%u. Error %d: %s\n", pid, pidInfo.errorNum, strerror(pidInfo.errorNum));
+        return 1;
+    }
+
+    converted = convertRssValues(&pidInfo.rssInfo, queryState->outputUnits);
+
+    if ( queryState->outputUnits == OUTPUT_UNITS_BYTES || queryState->outputUnits == OUTPUT_UNITS_KILOBYTES )
+    {
+        printf("ok %llu %llu %llu %llu %s\n", (uint64) converted.rssAnon, (uint64) converted.rssFile,
+            (uint64) converted.rssShmem, (uint64) converted.vmRss, pidInfo.name);
+    }
+    else
+    {
+        printf("ok %.3F %.3F %.3F %.3F %s\n", converted.rssAnon, converted.rssFile,
+            converted.rssShmem, converted.vmRss, pidInfo.name);
+    }
+
+    return 0;
+}
+
 /**
  * main - Takes one or more requires arguments, the pid(s).
  *    May have options as well.
@@ -669,19 +803,20 @@ int main(int argc, char* argv[])
     pid_t *allPids = NULL;
     size_t numPids = 0;
 
-    char **lines = NULL;
-    size_t numLines;
+    struct pmem_pid_info *pidInfos = NULL;
+    struct pmem_pid_info *pidInfo;
+    int numThreads = 0; /* 0 means use the default */
+    char *numThreadsStr;
 
     pid_t curPid;
 
     int returnCode = 0;
     int outputMode = 0;
+    int readStdin = 0;
+    struct pmem_query_state queryState;
     enum outputUnitOptions outputUnits = OUTPUT_UNITS_NONE;
     int i;
 
-    char *statContents = NULL;
-    size_t statContentsSize;
-
     /* totalInfo - If we have the "total flag" we will allocate this.
      *               Allocated vs NULL is the difference in the api,
      *                so no need for a flag.
@@ -733,11 +868,33 @@ int main(int argc, char* argv[])
                 print_usage();
                 goto __cleanup_and_exit;
             }
+            else if ( strcmp(argv[i], "--stdin") == 0 )
+            {
+                readStdin = 1;
+            }
             else if ( strcmp(argv[i], "--version") == 0 )
             {
                 print_version();
                 goto __cleanup_and_exit;
             }
+            else if ( argv[i][0] == '-' && argv[i][1] == 'j' )
+            {
+                /* Accept both "-j N" and "-jN" */
+                if ( argv[i][2] != '\0' )
+                    numThreadsStr = &argv[i][2];
+                else if ( i + 1 < argc )
+                    numThreadsStr = argv[++i];
+                else
+                    numThreadsStr = "";
+
+                numThreads = strtoint(numThreadsStr);
+                if ( numThreads <= 0 )
+                {
+                    fprintf(stderr, "Invalid number of threads: '%s'\n\nRun `getpmem --help' for usage information.\n", numThreadsStr);
+                    returnCode = 1;
+                    goto __cleanup_and_exit;
+                }
+            }
             else if ( strlen(argv[i]) == 2 && argv[i][0] == '-' )
             {
                 #define _SELECT_OUTPUT_UNIT(_newUnit) _ENSURE_ONE_OUTPUT_UNIT(_newUnit); outputUnits = _newUnit;
@@ -778,6 +935,24 @@ int main(int argc, char* argv[])
         }
     }
 
+    if ( readStdin )
+    {
+        if ( numPids != 0 || totalInfo != NULL )
+        {
+            fputs("Pids and -t/--total cannot be given with --stdin.\n", stderr);
+            returnCode = 1;
+            goto __cleanup_and_exit;
+        }
+
+        queryState.outputUnits = outputUnits != OUTPUT_UNITS_NONE ? outputUnits : OUTPUT_UNITS_KILOBYTES;
+        queryState.scanBuffer = malloc( PMEM_SCAN_BUFFER_SIZE );
+
+        returnCode = stdin_query_run(answer_query, &queryState);
+
+        free(queryState.scanBuffer);
+        goto __cleanup_and_exit;
+    }
+
     if ( numPids == 0 )
     {
         fprintf(stderr, "Missing any pids on which to report!\n\n");
@@ -793,49 +968,38 @@ int main(int argc, char* argv[])
     if ( outputUnits == OUTPUT_UNITS_NONE )
         outputUnits = OUTPUT_UNITS_KILOBYTES;
 
-    /* statContents - Allocate a large static buffer to 
-     *     store the /proc/pid/status contents 
+    /* Read and parse the status of every pid up front (in parallel),
+     *   then print the results in the order the pids were requested.
      */
-    statContents = malloc( sizeof(char) * STATUS_BUFFER_SIZE );
+    pidInfos = calloc( numPids, sizeof(struct pmem_pid_info) );
+    proc_scan_run(allPids, numPids, pidInfos, sizeof(struct pmem_pid_info), scan_pid_status, PMEM_SCAN_BUFFER_SIZE, numThreads);
 
     putchar('\n');
     /* Alright, allPids contains our list of pids, we have the mode, let's go! */
     for( i=0; i < numPids; i++ )
     {
         curPid = allPids[i];
+        pidInfo = &pidInfos[i];
 
-
-        errno = 0;
-        statContentsSize = read_status_contents(curPid, &statContents);
-        if ( statContentsSize == 0 )
+        if ( pidInfo->errorNum != 0 )
         {
-            printProcessInfoHeader(curPid, NULL, 0);
-            fprintf(stderr, "Failed reading memory information for pid=%u.\n  Error %d: %s\n", curPid, errno, strerror(errno));
+            printProcessInfoHeader(curPid, NULL);
+            fprintf(stderr, "Failed reading memory information for pid=%u.\n  Error %d: %s\n", curPid, pidInfo->errorNum, strerror(pidInfo->errorNum));
             printProcessInfoFooter();
             returnCode = ENOENT; /* error 2, No such file or directory */
             continue;
         }
-        /*printf("Stat contents: [%d]\n%s\n", statContentsSize, statContents);*/
-
-        lines = split_lines(statContents, &numLines);
 
-        printProcessInfoHeader(curPid, lines, numLines);
+        printProcessInfoHeader(curPid, pidInfo->name);
 
         if ( !!( outputMode & OUTPUT_MODE_RSS ) )
         {
-            printRssLines(lines, numLines, outputUnits, totalInfo);
+            printRssValues(&(pidInfo->rssInfo), outputUnits, totalInfo);
         }
 
         printProcessInfoFooter();
         if ( likely( (i + 1) != numPids ) )
             putchar('\n');
-        #if SPLIT_LINES_CALC_SIZE == 1
-          /* If SPLIT_LINES_CALC_SIZE is 0, we are using a static buffer
-           *   so don't free it.
-           */
-          free(lines);
-          lines = NULL;
-        #endif
     }
 
     if ( totalInfo != NULL )
@@ -859,11 +1023,8 @@ __cleanup_and_exit:
     if ( allPids != NULL )
         free(allPids);
 
-    if ( statContents != NULL )
-        free(statContents);
-
-    if ( lines != NULL )
-        free(lines);
+    if ( pidInfos != NULL )
+        free(pidInfos);
 
     if ( totalInfo != NULL )
         free(totalInfo);
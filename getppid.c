@@ -23,8 +23,9 @@
 
 #include "ppid.h"
 #include "pid_utils.h"
+#include "stdin_query.h"
 
-const volatile char *copyright = "getppid - Copyright (c) 2016, 2017 Tim Savannah.";
+STATIC_MULTICALL_ONLY const volatile char *copyright = "getppid - Copyright (c) 2016, 2017 Tim Savannah.";
 
 /*
  * usage - print usage/help to stderr
@@ -33,6 +34,34 @@ static inline void usage()
 {
     fputs("Usage: getppid [pid]\n", stderr);
     fputs("  Prints the parent process id (PPID) for a given pid.\n", stderr);
+    fputs("\n   or: getppid --stdin\n", stderr);
+    fputs("  Reads one pid per line from stdin, and answers each with one line:\n", stderr);
+    fputs("    \"ok PPID\" or \"error MESSAGE\". Answers are flushed as they are ready.\n", stderr);
+}
+
+/**
+ * answer_query - stdin_query_func for "--stdin" mode. The query is one pid.
+ */
+static int answer_query(char **args, int numArgs, void *data)
+{
+    pid_t pid, ppid;
+
+    pid = strtoint(args[0]);
+    if ( numArgs != 1 || pid <= 0 )
+    {
+        printf("error Invalid query (expected one pid > 0): %s\n", args[0]);
+        return 1;
+    }
+
+    ppid = getPpid(pid);
+    if ( ppid == 0 )
+    {
+        printf("error Invalid pid or could not obtain information on: %d\n", pid);
+        return 1;
+    }
+
+    printf("ok %u\n", ppid);
+    return 0;
 }
 
 /**
@@ -67,6 +96,9 @@ int main(int argc, char* argv[])
         return 0;
     }
 
+    if ( strcmp("--stdin", argv[1]) == 0 )
+        return stdin_query_run(answer_query, NULL);
+
     pid = strtoint(argv[1]);
     if ( pid <= 0 )
     {
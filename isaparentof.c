@@ -21,10 +21,13 @@
 
 #include "pid_tools.h"
 
-#include "ppid.h"
 #include "pid_utils.h"
+#include "pid_ident.h"
+#include "pid_ancestry.h"
+#include "pid_snapshot.h"
+#include "stdin_query.h"
 
-const volatile char *copyright = "isaparentof - Copyright (c) 2017 Tim Savannah.";
+STATIC_MULTICALL_ONLY const volatile char *copyright = "isaparentof - Copyright (c) 2017 Tim Savannah.";
 
 /*
  * usage - print usage/help to stderr
@@ -32,12 +35,109 @@ const volatile char *copyright = "isaparentof - Copyright (c) 2017 Tim Savannah.
 static inline void usage()
 {
     fputs("Usage: isaparentof [ppid] [check pid]\n", stderr);
-    fputs("  Checks if 'ppid' is a parent of any level for 'check pid'\n", stderr);
+    fputs("  Checks if 'ppid' is a parent of any level for 'check pid'\n\n", stderr);
+    fputs("  Exit code is 0 if it is, 1 if it is not, and 2 if a pid disappeared (or was reused\n", stderr);
+    fputs("  by another process) while checking.\n\n", stderr);
+    fputs("  Many pairs may be checked at once, by giving more pairs as arguments:\n\n", stderr);
+    fputs("      isaparentof [ppid] [check pid] [ppid] [check pid] ...\n\n", stderr);
+    fputs("    or by passing \"--stdin\" and writing one pair per line to stdin.\n", stderr);
+    fputs("    One line is printed per pair: \"PPID PID [result]\", where result is\n", stderr);
+    fputs("    yes, no, nopid (a pid does not exist), gone (a pid disappeared or was reused while checking)\n", stderr);
+    fputs("    or invalid (the line could not be parsed). Exit code is 0 if every result is yes, otherwise 1.\n\n", stderr);
+    fputs("    The parent of each pid is read at most once per run, however many pairs share it.\n", stderr);
+    fputs("    With --stdin, results are flushed as soon as every line received so far is answered,\n", stderr);
+    fputs("    so it can be kept open as a coprocess (for a short while, as parents are not re-read).\n\n", stderr);
+    fputs("    Options:\n\t\t--indexed\tRead the parent of every pid on the system once up front, and index\n", stderr);
+    fputs("\t\t\t\tthem so every pair is answered in constant time. Faster when checking many\n", stderr);
+    fputs("\t\t\t\tpairs spread across the system. Always prints result lines.\n", stderr);
+    fputs("\t\t--snapshot [file]\tAnswer from a snapshot written by \"pidsnap\", instead of the live system.\n", stderr);
+    fputs("\t\t\t\tImplies --indexed. Results are as of when the snapshot was taken, so are never \"gone\".\n", stderr);
 }
 
+/**
+ * check_pair - Answer one pair in batch mode, printing the result line
+ *
+ *      @return <int> - 1 if the answer is yes, otherwise 0
+ */
+static int check_pair(PidAncestry *ancestry, pid_t ppid, pid_t checkPid)
+{
+    const char *result;
+    int ret;
+
+    ret = pid_ancestry_is_ancestor(ancestry, ppid, checkPid);
+    switch( ret )
+    {
+        case 1:
+            result = "yes";
+            break;
+        case 0:
+            result = "no";
+            break;
+        case PID_ANCESTRY_NO_SUCH_PID:
+            result = "nopid";
+            break;
+        default:
+            result = "gone";
+            break;
+    }
+
+    printf("%d %d %s\n", (int)ppid, (int)checkPid, result);
+
+    return ret == 1;
+}
+
+/**
+ * answer_stdin_pair - stdin_query_func for "--stdin" mode. The query is one pair,
+ *                       and #data is the PidAncestry
+ */
+static int answer_stdin_pair(char **args, int numArgs, void *data)
+{
+    pid_t ppid, checkPid;
+
+    ppid = strtoint(args[0]);
+    checkPid = numArgs > 1 ? strtoint(args[1]) : 0;
+
+    if ( ppid <= 0 || checkPid <= 0 || numArgs != 2 )
+    {
+        printf("%s %s invalid\n", args[0], numArgs > 1 ? args[1] : "");
+        return 1;
+    }
+
+    return check_pair((PidAncestry *)data, ppid, checkPid) ? 0 : 1;
+}
+
+/**
+ * create_ancestry - Create the PidAncestry which every pair is answered from
+ *
+ *      @param snapshot <const PidSnapshot *> - Answer from this snapshot alone, or NULL for the live system
+ *
+ *      @return <PidAncestry *> - The ancestry, or NULL if /proc could not be listed (an error is printed)
+ */
+static PidAncestry *create_ancestry(int isIndexed, const PidSnapshot *snapshot)
+{
+    PidAncestry *ancestry;
+
+    if ( snapshot != NULL )
+    {
+        /* Parents come from the snapshot as well, so /proc is never read */
+        ancestry = pid_ancestry_create(NULL);
+        pid_ancestry_index_tree(ancestry, &snapshot->tree);
+        return ancestry;
+    }
+
+    ancestry = pid_ancestry_create(pid_ident_lookup);
+    if ( isIndexed && pid_ancestry_build_index(ancestry) != 0 )
+    {
+        fprintf(stderr, "Failed to list /proc. Error %d: %s\n", errno, strerror(errno));
+        pid_ancestry_destroy(ancestry);
+        return NULL;
+    }
+
+    return ancestry;
+}
 
 /**
- * main - takes two arguements, parent and check pid.
+ * main - takes pairs of parent and check pids, or "--stdin".
  *
  *
  */
@@ -45,43 +145,154 @@ int main(int argc, char* argv[])
 {
 
     pid_t ppid, checkPid, cur, prev;
+    PidIdent curIdent, prevIdent;
+    PidAncestry *ancestry;
+    PidSnapshot *snapshot = NULL;
+    const char *snapshotPath = NULL; /* Set with --snapshot */
+    int isStdinMode = 0;
+    int isIndexed = 0;
+    int numOptions = 0;
+    int allYes = 1;
+    int argIdx;
+    int ret;
 
+    for( argIdx=1; argIdx < argc; argIdx++ )
+    {
+        if ( strcmp("--help", argv[argIdx]) == 0 )
+        {
+            usage();
+            return 0;
+        }
 
-    if ( argc != 3 ) {
-        fputs("Invalid number of arguments.\n\n", stderr);
-        usage();
-        return 1;
+        if ( strcmp("--version", argv[argIdx]) == 0 )
+        {
+            fprintf(stderr, "\nisaparentof version %s by Timothy Savannah\n\n", PID_TOOLS_VERSION);
+            return 0;
+        }
+
+        if ( strcmp("--stdin", argv[argIdx]) == 0 || strcmp("--indexed", argv[argIdx]) == 0 )
+        {
+            if ( argIdx != numOptions + 1 )
+            {
+                fprintf(stderr, "Options must come before the pids: '%s'\n\n", argv[argIdx]);
+                usage();
+                return 1;
+            }
+
+            if ( argv[argIdx][2] == 's' )
+                isStdinMode = 1;
+            else
+                isIndexed = 1;
+            numOptions++;
+        }
+
+        if ( strcmp("--snapshot", argv[argIdx]) == 0 )
+        {
+            if ( argIdx != numOptions + 1 || argIdx + 1 >= argc )
+            {
+                fputs(argIdx + 1 >= argc ? "Missing file after --snapshot\n\n" : "Options must come before the pids: '--snapshot'\n\n", stderr);
+                usage();
+                return 1;
+            }
+
+            snapshotPath = argv[++argIdx];
+            numOptions += 2;
+        }
     }
 
-    if ( strncmp("--help", argv[1], 6) == 0 )
+    /* Options come first, so drop them and leave just the pids */
+    argv += numOptions;
+    argc -= numOptions;
+
+    if ( snapshotPath != NULL )
     {
-        usage();
-        return 0;
+        snapshot = pid_snapshot_open(snapshotPath);
+        if ( snapshot == NULL )
+        {
+            fprintf(stderr, "Cannot open snapshot '%s'. Error %d: %s\n", snapshotPath, errno, strerror(errno));
+            return 1;
+        }
+        isIndexed = 1;
     }
-    
-    if ( strncmp("--version", argv[1], 9) == 0 )
+
+    if ( isStdinMode )
     {
-        fprintf(stderr, "\nisaparentof version %s by Timothy Savannah\n\n", PID_TOOLS_VERSION);
-        return 0;
+        if ( argc != 1 )
+        {
+            fputs("--stdin does not take any pids as arguments.\n\n", stderr);
+            usage();
+            ret = 1;
+            goto __cleanup_and_exit;
+        }
+
+        ancestry = create_ancestry(isIndexed, snapshot);
+        if ( ancestry == NULL )
+        {
+            ret = 1;
+            goto __cleanup_and_exit;
+        }
+        ret = stdin_query_run(answer_stdin_pair, ancestry);
+        pid_ancestry_destroy(ancestry);
+
+        goto __cleanup_and_exit;
     }
 
-    ppid = strtoint(argv[1]);
-    if ( ppid <= 0 )
+    if ( argc < 3 || argc % 2 != 1 ) {
+        fputs("Invalid number of arguments.\n\n", stderr);
+        usage();
+        ret = 1;
+        goto __cleanup_and_exit;
+    }
+
+    /* Validate every pair before answering any */
+    for( argIdx=1; argIdx < argc; argIdx += 2 )
     {
-        fprintf(stderr, "Parent PID is not a valid integer: '%s'\n", argv[1]);
-        return 1;
+        ppid = strtoint(argv[argIdx]);
+        if ( ppid <= 0 )
+        {
+            fprintf(stderr, "Parent PID is not a valid integer: '%s'\n", argv[argIdx]);
+            ret = 1;
+            goto __cleanup_and_exit;
+        }
+
+        checkPid = strtoint(argv[argIdx + 1]);
+        if ( checkPid <= 0 )
+        {
+            fprintf(stderr, "Check PID is not a valid integer: '%s'\n", argv[argIdx + 1]);
+            ret = 1;
+            goto __cleanup_and_exit;
+        }
     }
 
-    checkPid = strtoint(argv[2]);
-    if ( ppid <= 0 )
+    if ( argc > 3 || isIndexed )
     {
-        fprintf(stderr, "Check PID is not a valid integer: '%s'\n", argv[2]);
-        return 1;
+        /* Batch mode. One result line per pair, sharing one memo of parents */
+        ancestry = create_ancestry(isIndexed, snapshot);
+        if ( ancestry == NULL )
+        {
+            ret = 1;
+            goto __cleanup_and_exit;
+        }
+
+        for( argIdx=1; argIdx < argc; argIdx += 2 )
+        {
+            ppid = strtoint(argv[argIdx]);
+            checkPid = strtoint(argv[argIdx + 1]);
+
+            if ( ! check_pair(ancestry, ppid, checkPid) )
+                allYes = 0;
+        }
+
+        pid_ancestry_destroy(ancestry);
+
+        ret = allYes ? 0 : 1;
+        goto __cleanup_and_exit;
     }
-        
 
-    cur = getPpid(checkPid);
-    if ( cur == 0 )
+    /* Single pair, just an exit code.
+     *   Each parent must have started no later than the pid before it, else its pid was reused
+     */
+    if ( pid_ident_lookup(checkPid, &curIdent, &cur) != PID_IDENT_OK )
     {
         fprintf(stderr, "No such pid: %u\n", checkPid);
         return 1;
@@ -95,10 +306,14 @@ int main(int argc, char* argv[])
     while ( cur != 1 )
     {
         prev = cur;
-        cur = getPpid(cur);
-        if ( cur == 0 )
+        prevIdent = curIdent;
+        ret = pid_ident_lookup(prev, &curIdent, &cur);
+        if ( ret == PID_IDENT_OK && unlikely( ! PID_IDENT_CAN_BE_PARENT(&curIdent, &prevIdent) ) )
+            ret = PID_IDENT_STALE;
+
+        if ( ret != PID_IDENT_OK )
         {
-            fprintf(stderr, "Pid %u disappered while checking.\n", prev);
+            fprintf(stderr, "Pid %u disappeared while checking (%s).\n", prev, pid_ident_strerror(ret));
             return 2;
         }
 
@@ -108,4 +323,9 @@ int main(int argc, char* argv[])
 
     return 1;
 
+__cleanup_and_exit:
+    if ( snapshot != NULL )
+        pid_snapshot_close(snapshot);
+
+    return ret;
 }
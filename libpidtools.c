@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * libpidtools.c - Implementations of the public libpidtools interface (libpidtools.h)
+ *
+ *   Always compiled with SHARED_LIB. Nothing in here keeps state between calls,
+ *     other than the /proc directory handle and the pidtreed mapping, which are
+ *     set up once (atomically) and shared by every thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "pid_tools.h"
+
+#include "libpidtools.h"
+#include "proc_handle.h"
+#include "proc_stat.h"
+#include "proc_pids.h"
+#include "proc_children.h"
+#include "pid_tree.h"
+#include "pidtreed_shm.h"
+
+
+/* LIBPIDTOOLS_MAX_DEPTH - Give up walking up the parents after this many, in case of a loop
+ *   (a pid being reused while we walk)
+ */
+#define LIBPIDTOOLS_MAX_DEPTH 4096
+
+/**
+ * _read_ppid - Read the parent of #pid from /proc, with no parent meaning init
+ *
+ *    @return <pid_t> - The parent, or -1 on error (errno is set)
+ */
+static pid_t _read_ppid(pid_t pid)
+{
+    ProcStat stat;
+
+    if ( proc_stat_read(pid, PROC_STAT_FIELD_PPID, &stat) != 0 )
+        return -1;
+
+    return stat.ppid == 0 ? 1 : stat.ppid;
+}
+
+PIDTOOLS_API const char *pidtools_version(void)
+{
+    return (const char *)PID_TOOLS_VERSION;
+}
+
+PIDTOOLS_API pid_t pidtools_get_ppid(pid_t pid)
+{
+    pid_t ppid;
+
+    if ( unlikely( pid <= 0 ) )
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ppid = pidtreed_lookup_ppid(pid);
+    if ( ppid >= 0 )
+        return ppid == 0 ? 1 : ppid;
+
+    return _read_ppid(pid);
+}
+
+PIDTOOLS_API size_t pidtools_get_ppids(const pid_t *pids, size_t numPids, pid_t *ppidsOut)
+{
+    size_t i;
+    size_t numFound = 0;
+    int haveTable;
+
+    haveTable = pidtreed_lookup_ppids(pids, numPids, ppidsOut) == 0;
+
+    for( i=0; i < numPids; i++ )
+    {
+        if ( haveTable && ppidsOut[i] >= 0 )
+        {
+            if ( ppidsOut[i] == 0 )
+                ppidsOut[i] = 1;
+        }
+        else if ( likely( pids[i] > 0 ) )
+        {
+            /* Not in the table (e.x. just forked), or no table. Same fallback as pidtools_get_ppid */
+            ppidsOut[i] = _read_ppid(pids[i]);
+        }
+        else
+        {
+            ppidsOut[i] = -1;
+        }
+
+        if ( ppidsOut[i] >= 0 )
+            numFound++;
+    }
+
+    return numFound;
+}
+
+/**
+ * _copy_pidtreed_table - Copy every pid and its parent from pidtreed, with no parent meaning init
+ *
+ *    @return <int> - 0 on success, -1 if pidtreed is not running
+ */
+static int _copy_pidtreed_table(pid_t **pidsOut, pid_t **ppidsOut, size_t *numPidsOut)
+{
+    size_t i;
+
+    if ( pidtreed_copy_table(pidsOut, ppidsOut, numPidsOut) != 0 )
+        return -1;
+
+    for( i=0; i < *numPidsOut; i++ )
+    {
+        if ( (*ppidsOut)[i] == 0 )
+            (*ppidsOut)[i] = 1;
+    }
+
+    return 0;
+}
+
+/**
+ * _read_proc_table - Read every pid and its parent from /proc
+ *
+ *    @return <int> - 0 on success, -1 on error (errno is set)
+ */
+static int _read_proc_table(pid_t **pidsOut, pid_t **ppidsOut, size_t *numPidsOut)
+{
+    pid_t *pids, *ppids;
+    size_t numPids;
+    size_t i;
+
+    pids = proc_pids_get_all(&numPids);
+    if ( unlikely( pids == NULL ) )
+        return -1;
+
+    /* Pids which exit while we read get a parent of 0, which matches nothing */
+    ppids = malloc( sizeof(pid_t) * (numPids + 1) );
+    for( i=0; i < numPids; i++ )
+    {
+        ppids[i] = _read_ppid(pids[i]);
+        if ( ppids[i] < 0 )
+            ppids[i] = 0;
+    }
+
+    *pidsOut = pids;
+    *ppidsOut = ppids;
+    *numPidsOut = numPids;
+
+    return 0;
+}
+
+PIDTOOLS_API int pidtools_get_children(const pid_t *rootPids, size_t numRootPids, int isRecursive,
+    pid_t **childrenOut, size_t *numChildrenOut)
+{
+    pid_t *allPids;
+    pid_t *allPpids;
+    size_t allPidsLen = 0;
+    PidTree *pidTree;
+    size_t i;
+
+    *childrenOut = NULL;
+    *numChildrenOut = 0;
+
+    if ( numRootPids == 0 )
+        return 0;
+
+    /* Same order of preference as getcpids */
+    if ( _copy_pidtreed_table(&allPids, &allPpids, &allPidsLen) == 0 )
+        goto __build_tree;
+
+    if ( proc_children_supported() )
+    {
+        for( i=0; i < numRootPids; i++ )
+        {
+            if ( rootPids[i] == 1 )
+                break;
+        }
+
+        if ( i == numRootPids )
+        {
+            *childrenOut = proc_children_get(rootPids, numRootPids, isRecursive, numChildrenOut);
+            return 0;
+        }
+    }
+
+    if ( _read_proc_table(&allPids, &allPpids, &allPidsLen) != 0 )
+        return -1;
+
+__build_tree:
+    /* pidTree takes ownership of allPids and allPpids */
+    pidTree = pid_tree_create(allPids, allPpids, allPidsLen);
+
+    *childrenOut = pid_tree_get_children(pidTree, rootPids, numRootPids, isRecursive, numChildrenOut);
+
+    pid_tree_destroy(pidTree);
+
+    if ( *numChildrenOut == 0 && *childrenOut != NULL )
+    {
+        free(*childrenOut);
+        *childrenOut = NULL;
+    }
+
+    return 0;
+}
+
+PIDTOOLS_API int pidtools_is_child_of(pid_t pid, pid_t parentPid, int isRecursive)
+{
+    pid_t cur;
+    unsigned int depth;
+
+    cur = pidtools_get_ppid(pid);
+    if ( cur < 0 )
+        return -1;
+
+    for( depth=0; cur != parentPid; depth++ )
+    {
+        if ( ! isRecursive || cur == 1 || depth >= LIBPIDTOOLS_MAX_DEPTH )
+            return 0;
+
+        cur = pidtools_get_ppid(cur);
+        if ( cur < 0 )
+            return -1;
+    }
+
+    return 1;
+}
+
+struct PidToolsForest {
+    PidTree *pidTree;
+    PidTreeIntervals *intervals;
+};
+
+PIDTOOLS_API PidToolsForest *pidtools_forest_create(void)
+{
+    PidToolsForest *forest;
+    pid_t *pids, *ppids;
+    size_t numPids;
+
+    if ( _copy_pidtreed_table(&pids, &ppids, &numPids) != 0 &&
+         _read_proc_table(&pids, &ppids, &numPids) != 0 )
+    {
+        return NULL;
+    }
+
+    forest = malloc( sizeof(PidToolsForest) );
+
+    /* pidTree takes ownership of pids and ppids */
+    forest->pidTree = pid_tree_create(pids, ppids, numPids);
+    forest->intervals = pid_tree_intervals_create(forest->pidTree);
+
+    return forest;
+}
+
+PIDTOOLS_API void pidtools_forest_destroy(PidToolsForest *forest)
+{
+    pid_tree_intervals_destroy(forest->intervals);
+    pid_tree_destroy(forest->pidTree);
+    free(forest);
+}
+
+PIDTOOLS_API int pidtools_forest_is_ancestor(const PidToolsForest *forest, pid_t ancestorPid, pid_t pid)
+{
+    int ret;
+
+    ret = pid_tree_intervals_is_ancestor(forest->intervals, ancestorPid, pid);
+    if ( ret < 0 )
+        errno = ENOENT;
+
+    return ret;
+}
+
+PIDTOOLS_API size_t pidtools_forest_find_roots(const PidToolsForest *forest, const pid_t *rootPids, size_t numRootPids,
+    const pid_t *pids, size_t numPids, pid_t *rootsOut)
+{
+    PidTreeRootTable *rootTable;
+    size_t numFound = 0;
+    size_t i;
+
+    rootTable = pid_tree_root_table_create(forest->intervals, rootPids, numRootPids);
+
+    for( i=0; i < numPids; i++ )
+    {
+        rootsOut[i] = pid_tree_root_table_find(rootTable, pids[i]);
+        if ( rootsOut[i] > 0 )
+            numFound++;
+    }
+
+    pid_tree_root_table_destroy(rootTable);
+
+    return numFound;
+}
+
+PIDTOOLS_API long pidtools_get_inode(pid_t pid)
+{
+    struct stat statBuf;
+
+    if ( proc_stat_pid_dir(pid, &statBuf) < 0 )
+        return -1;
+
+    return (long)statBuf.st_ino;
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * libpidtools.h - Public interface of libpidtools, for programs which want
+ *                   the answers of the pid-tools without running them.
+ *
+ *   Build with "make lib", which produces lib/libpidtools.so and lib/libpidtools.a,
+ *     and link with -lpidtools.
+ *
+ *   Every function is reentrant and safe to call from multiple threads at once.
+ *     Nothing is printed, errors are returned (and errno is set). Lists returned
+ *     are allocated with malloc, and are for the caller to free.
+ *
+ *   When pidtreed is running, answers come from its shared table (as with the tools),
+ *     otherwise from /proc.
+ */
+
+#ifndef _LIBPIDTOOLS_H
+#define _LIBPIDTOOLS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *   PidToolsForest - The whole process table as of one moment, indexed for
+ *                      constant-time ancestor checks. Opaque.
+ *
+ *      Create with - pidtools_forest_create
+ *
+ *      Free/Destroy with - pidtools_forest_destroy
+ */
+typedef struct PidToolsForest PidToolsForest;
+
+#ifdef __GNUC__
+  #define PIDTOOLS_API __attribute__((visibility("default")))
+#else
+  #define PIDTOOLS_API
+#endif
+
+
+/**
+ *    pidtools_version - Get the version of pid-tools this library is from
+ *
+ *          @return <const char *> - e.x. "5.1.0"
+ */
+PIDTOOLS_API const char *pidtools_version(void);
+
+/**
+ *    pidtools_get_ppid - Get the parent of a pid
+ *
+ *          @param pid <pid_t> - The pid
+ *
+ *          @return <pid_t> - The parent pid. 1 (init) if it has no parent, same as getppid.
+ *                      -1 on error (errno is set, e.x. ENOENT if the pid does not exist)
+ */
+PIDTOOLS_API pid_t pidtools_get_ppid(pid_t pid);
+
+/**
+ *    pidtools_get_ppids - Get the parents of many pids at once
+ *
+ *          With pidtreed running, every lookup is made within a single read of its table.
+ *            Otherwise each pid is one openat + read relative to a shared /proc handle.
+ *
+ *          @param pids <const pid_t *> - The pids
+ *
+ *          @param numPids <size_t> - Number of elements in #pids
+ *
+ *          @param ppidsOut <pid_t *> - Array of #numPids elements. ppidsOut[i] will be set
+ *                      to the parent of pids[i] (as pidtools_get_ppid), or -1 if it does not exist
+ *
+ *          @return <size_t> - The number of pids whose parent was found
+ */
+PIDTOOLS_API size_t pidtools_get_ppids(const pid_t *pids, size_t numPids, pid_t *ppidsOut);
+
+/**
+ *    pidtools_get_children - Get the children of one or more pids, as getcpids does
+ *
+ *          The process table is read once (or copied from pidtreed) and indexed,
+ *            however many roots are given or however deep the recursion goes.
+ *
+ *          @param rootPids <const pid_t *> - The pids whose children to list
+ *
+ *          @param numRootPids <size_t> - Number of elements in #rootPids
+ *
+ *          @param isRecursive <int> - If non-zero, include children of children, and so on
+ *
+ *          @param childrenOut <pid_t **> - Will be set to an allocated list of the children,
+ *                      sorted ascending (NULL if there are none). Free it with free.
+ *
+ *          @param numChildrenOut <size_t *> - Will be set to the number of children
+ *
+ *          @return <int> - 0 on success, -1 on error (errno is set)
+ */
+PIDTOOLS_API int pidtools_get_children(const pid_t *rootPids, size_t numRootPids, int isRecursive,
+    pid_t **childrenOut, size_t *numChildrenOut);
+
+/**
+ *    pidtools_is_child_of - Check if a pid is a child, or descendant, of another
+ *
+ *          @param pid <pid_t> - The pid to check
+ *
+ *          @param parentPid <pid_t> - The possible parent
+ *
+ *          @param isRecursive <int> - If non-zero, also check grandparents and so on
+ *
+ *          @return <int> - 1 if it is, 0 if it is not, -1 on error (errno is set)
+ */
+PIDTOOLS_API int pidtools_is_child_of(pid_t pid, pid_t parentPid, int isRecursive);
+
+/**
+ *    pidtools_forest_create - Read the whole process table once, and index it so
+ *                               ancestry questions need neither /proc nor walking parents
+ *
+ *          Every pid is numbered by a depth-first walk, so "is A an ancestor of B" is
+ *            an interval comparison. Processes started afterwards are not in the forest.
+ *
+ *          @return <PidToolsForest *> - The forest, or NULL on error (errno is set).
+ *                      It is read-only, so may be queried from many threads at once.
+ */
+PIDTOOLS_API PidToolsForest *pidtools_forest_create(void);
+
+/**
+ *    pidtools_forest_destroy - Free a forest made by pidtools_forest_create
+ *
+ *          @param forest <PidToolsForest *> - The forest
+ */
+PIDTOOLS_API void pidtools_forest_destroy(PidToolsForest *forest);
+
+/**
+ *    pidtools_forest_is_ancestor - Check if a pid is a parent (of any level) of another
+ *
+ *          @param forest <const PidToolsForest *> - The forest
+ *
+ *          @param ancestorPid <pid_t> - The possible parent, grandparent, etc.
+ *
+ *          @param pid <pid_t> - The pid to check
+ *
+ *          @return <int> - 1 if it is, 0 if it is not, -1 if either pid is not in the forest
+ *                      (errno is set to ENOENT)
+ */
+PIDTOOLS_API int pidtools_forest_is_ancestor(const PidToolsForest *forest, pid_t ancestorPid, pid_t pid);
+
+/**
+ *    pidtools_forest_find_roots - For each of many pids, find which of a set of roots it is under
+ *
+ *          The roots are sorted by their depth-first intervals once, then each pid is
+ *            a binary search of that table.
+ *
+ *          @param forest <const PidToolsForest *> - The forest
+ *
+ *          @param rootPids <const pid_t *> - The roots (e.x. service main pids)
+ *
+ *          @param numRootPids <size_t> - Number of elements in #rootPids
+ *
+ *          @param pids <const pid_t *> - The pids to look up
+ *
+ *          @param numPids <size_t> - Number of elements in #pids
+ *
+ *          @param rootsOut <pid_t *> - Array of #numPids elements. rootsOut[i] will be set to the
+ *                      nearest root which is an ancestor of pids[i] (the innermost, if roots are
+ *                      nested), 0 if it is under none of them, or -1 if pids[i] is not in the forest
+ *
+ *          @return <size_t> - The number of pids found under one of the roots
+ */
+PIDTOOLS_API size_t pidtools_forest_find_roots(const PidToolsForest *forest, const pid_t *rootPids, size_t numRootPids,
+    const pid_t *pids, size_t numPids, pid_t *rootsOut);
+
+/**
+ *    pidtools_get_inode - Get the inode of /proc/$PID, which changes if the pid is reused
+ *
+ *          @param pid <pid_t> - The pid
+ *
+ *          @return <long> - The inode, or -1 on error (errno is set)
+ */
+PIDTOOLS_API long pidtools_get_inode(pid_t pid);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * pid_ancestry.c - Interface implementations for answering many "is A an ancestor of B"
+ *                    questions, with the parent of every pid looked up at most once
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pid_tools.h"
+
+#include "pid_ancestry.h"
+#include "pid_tree.h"
+#include "proc_pids.h"
+#include "simple_int_value_map.h"
+
+
+/* PID_ANCESTRY_SIZE_HINT - Number of pids the memo starts with room for */
+#define PID_ANCESTRY_SIZE_HINT 128
+
+/* PID_ANCESTRY_MAX_DEPTH - Give up walking up the parents after this many, in case of a loop.
+ *   Start times rule out following a reused pid, but two processes may start in the same tick
+ */
+#define PID_ANCESTRY_MAX_DEPTH 4096
+
+
+
+PidAncestry *pid_ancestry_create(pid_ancestry_ident_func identFunc)
+{
+    PidAncestry *ancestry;
+
+    ancestry = malloc( sizeof(PidAncestry) );
+
+    ancestry->identFunc = identFunc;
+    ancestry->memo = simple_int_value_map_create(sizeof(struct PidAncestryEntry), PID_ANCESTRY_SIZE_HINT);
+    ancestry->numLookups = 0;
+    ancestry->pidTree = NULL;
+    ancestry->ownedTree = NULL;
+    ancestry->intervals = NULL;
+
+    return ancestry;
+}
+
+void pid_ancestry_destroy(PidAncestry *ancestry)
+{
+    if ( ancestry->intervals != NULL )
+        pid_tree_intervals_destroy(ancestry->intervals);
+    if ( ancestry->ownedTree != NULL )
+        pid_tree_destroy(ancestry->ownedTree);
+
+    simple_int_value_map_destroy(ancestry->memo);
+    free(ancestry);
+}
+
+/**
+ * _pid_ancestry_lookup - Get the memoised entry for a pid, calling the ident func
+ *                          only the first time a pid is asked about
+ *
+ *    @return <struct PidAncestryEntry> - A copy of the entry (#ppid is 0 if the lookup failed)
+ */
+static struct PidAncestryEntry _pid_ancestry_lookup(PidAncestry *ancestry, pid_t pid)
+{
+    struct PidAncestryEntry *entry;
+    PidIdent ident;
+    ssize_t idx;
+    int wasInserted;
+
+    entry = simple_int_value_map_get_or_insert(ancestry->memo, pid, &wasInserted);
+    if ( ! wasInserted )
+        return *entry;
+
+    if ( ancestry->identFunc == NULL )
+    {
+        /* From the tree alone. It is one point in time, so no pid in it can have been reused */
+        idx = pid_tree_index_of(ancestry->pidTree, pid);
+        entry->ppid = idx < 0 ? 0 : ( ancestry->pidTree->ppids[idx] ? ancestry->pidTree->ppids[idx] : 1 );
+        entry->startTime = 0;
+    }
+    /* Failures are remembered as well (ppid 0), so a missing pid costs one lookup per run */
+    else if ( ancestry->identFunc(pid, &ident, &entry->ppid) == PID_IDENT_OK )
+        entry->startTime = ident.startTime;
+    else
+        entry->ppid = 0;
+    ancestry->numLookups += 1;
+
+    return *entry;
+}
+
+pid_t pid_ancestry_get_ppid(PidAncestry *ancestry, pid_t pid)
+{
+    if ( unlikely( pid <= 0 ) )
+        return 0;
+
+    return _pid_ancestry_lookup(ancestry, pid).ppid;
+}
+
+int pid_ancestry_build_index(PidAncestry *ancestry)
+{
+    struct PidAncestryEntry entry, parent;
+    pid_t *pids, *ppids;
+    size_t numPids;
+    size_t i;
+
+    if ( ancestry->intervals != NULL )
+        return 0;
+
+    pids = proc_pids_get_all(&numPids);
+    if ( unlikely( pids == NULL ) )
+        return -1;
+
+    /* Through the memo, so pids already asked about aren't read again.
+     *   A pid which exits meanwhile gets 0 (unknown parent), and becomes a tree of its own.
+     */
+    ppids = malloc( sizeof(pid_t) * (numPids + 1) );
+    for( i=0; i < numPids; i++ )
+        ppids[i] = pid_ancestry_get_ppid(ancestry, pids[i]);
+
+    /* As does a pid whose parent is now another process (started after it), which
+     *   would otherwise graft it onto an unrelated tree. Every pid is in the memo by now.
+     */
+    for( i=0; i < numPids; i++ )
+    {
+        if ( ppids[i] <= 1 )
+            continue;
+
+        entry = _pid_ancestry_lookup(ancestry, pids[i]);
+        parent = _pid_ancestry_lookup(ancestry, ppids[i]);
+        if ( parent.ppid != 0 && parent.startTime > entry.startTime )
+            ppids[i] = 0;
+    }
+
+    /* pidTree takes ownership of pids and ppids */
+    ancestry->ownedTree = pid_tree_create(pids, ppids, numPids);
+    pid_ancestry_index_tree(ancestry, ancestry->ownedTree);
+
+    return 0;
+}
+
+void pid_ancestry_index_tree(PidAncestry *ancestry, const PidTree *pidTree)
+{
+    ancestry->pidTree = pidTree;
+    ancestry->intervals = pid_tree_intervals_create(pidTree);
+}
+
+int pid_ancestry_is_ancestor(PidAncestry *ancestry, pid_t ancestorPid, pid_t pid)
+{
+    struct PidAncestryEntry cur, parent;
+    unsigned int depth;
+    ssize_t ancestorIdx, idx;
+
+    /* A pid asked about itself is left to the walk, which (like isachildof always has)
+     *   says yes for init, as getPpid reports init as its own parent.
+     */
+    if ( ancestry->intervals != NULL && pid != ancestorPid )
+    {
+        idx = pid_tree_index_of(ancestry->pidTree, pid);
+        if ( idx < 0 )
+            return PID_ANCESTRY_NO_SUCH_PID;
+
+        ancestorIdx = pid_tree_index_of(ancestry->pidTree, ancestorPid);
+        if ( ancestorIdx < 0 )
+            return 0;
+
+        return PID_TREE_IS_ANCESTOR_IDX(ancestry->intervals, ancestorIdx, idx) ? 1 : 0;
+    }
+
+    if ( unlikely( pid <= 0 ) )
+        return PID_ANCESTRY_NO_SUCH_PID;
+
+    cur = _pid_ancestry_lookup(ancestry, pid);
+    if ( cur.ppid == 0 )
+        return PID_ANCESTRY_NO_SUCH_PID;
+
+    for( depth=0; cur.ppid != ancestorPid; depth++ )
+    {
+        if ( cur.ppid == 1 || unlikely( depth >= PID_ANCESTRY_MAX_DEPTH ) )
+            return 0;
+
+        parent = _pid_ancestry_lookup(ancestry, cur.ppid);
+        if ( parent.ppid == 0 )
+            return PID_ANCESTRY_DISAPPEARED;
+
+        /* Started after its child, so the parent exited and its pid went to someone else */
+        if ( unlikely( parent.startTime > cur.startTime ) )
+            return PID_ANCESTRY_STALE;
+
+        cur = parent;
+    }
+
+    return 1;
+}
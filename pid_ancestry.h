@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * pid_ancestry.h - Interface definitions for answering many "is A an ancestor of B"
+ *                    questions, with the parent of every pid looked up at most once
+ *
+ */
+
+#ifndef _PID_ANCESTRY_H
+#define _PID_ANCESTRY_H
+
+#include <sys/types.h>
+
+#include "pid_tools.h"
+#include "pid_tree.h"
+#include "pid_ident.h"
+#include "simple_int_value_map.h"
+
+/*******************
+ * DATA TYPES
+ ******************/
+
+/**
+ *   pid_ancestry_ident_func - Function to look up the identity and parent of a pid, with the
+ *                               same contract as pid_ident_lookup (which is the usual one)
+ */
+typedef int (*pid_ancestry_ident_func)(pid_t pid, PidIdent *ident, pid_t *ppidOut);
+
+/**
+ *   struct PidAncestryEntry - What is memoised for each pid (the key).
+ *          You should not need to reference this directly.
+ */
+struct PidAncestryEntry {
+    pid_t ppid;  /* As returned by the ident func (1 if no parent), or 0 if the lookup failed */
+    uint64_t startTime; /* Of #pid, so a parent which started after it is known to be a reused pid */
+};
+
+/**
+ *   PidAncestry - A memo of pid -> parent pid, filled in as questions are asked.
+ *
+ *      Held in a SimpleIntValueMap of pid -> struct PidAncestryEntry.
+ *
+ *      The start time of every pid is kept with its parent, so a walk up the parents
+ *        never follows a pid which was reused by an unrelated process part way through.
+ *
+ *      Optionally (pid_ancestry_build_index), the parent of every pid on the system is
+ *        read up front and indexed with depth-first intervals, after which every
+ *        question is answered with two comparisons. Or (pid_ancestry_index_tree) an
+ *        existing tree, e.x. of a snapshot, is indexed instead of the live system.
+ *
+ *      Create with - pid_ancestry_create
+ *
+ *      Free/Destroy with - pid_ancestry_destroy
+ */
+typedef struct {
+
+    pid_ancestry_ident_func identFunc;  /* NULL to look up parents in #pidTree instead */
+
+    SimpleIntValueMap *memo;
+
+    size_t numLookups;  /* Number of times #identFunc was called */
+
+    const PidTree *pidTree;       /* NULL unless pid_ancestry_build_index or pid_ancestry_index_tree was called */
+    PidTree *ownedTree;           /* #pidTree, if made by pid_ancestry_build_index (and so freed with the memo) */
+    PidTreeIntervals *intervals;
+
+} PidAncestry;
+
+
+/*******************
+ * MACROS
+ ******************/
+
+/* Return values of pid_ancestry_is_ancestor other than yes (1) and no (0) */
+
+/* PID_ANCESTRY_NO_SUCH_PID - The pid being checked does not exist */
+#define PID_ANCESTRY_NO_SUCH_PID (-1)
+/* PID_ANCESTRY_DISAPPEARED - A pid in the chain of parents exited while checking */
+#define PID_ANCESTRY_DISAPPEARED (-2)
+/* PID_ANCESTRY_STALE - A pid in the chain of parents exited, and was reused by another process, while checking */
+#define PID_ANCESTRY_STALE (-3)
+
+/* PID_ANCESTRY_NUM_LOOKUPS - Number of parent lookups made so far (one per distinct pid) */
+#define PID_ANCESTRY_NUM_LOOKUPS(ancestry) ((ancestry)->numLookups)
+
+
+/*******************
+ * PUBLIC FUNCTIONS
+ ******************/
+
+/**
+ *    pid_ancestry_create - Allocate an empty PidAncestry
+ *
+ *          @param identFunc <pid_ancestry_ident_func> - Function used to look up parents, e.x. pid_ident_lookup,
+ *                      or NULL to answer only from a tree given to pid_ancestry_index_tree (which must be
+ *                      called before anything else)
+ *
+ *          @return - Pointer to an allocated PidAncestry ready to use
+ *
+ *              This must be freed using pid_ancestry_destroy
+ */
+PidAncestry *pid_ancestry_create(pid_ancestry_ident_func identFunc);
+
+/**
+ *    pid_ancestry_destroy - Free a PidAncestry and everything it references
+ *
+ *          @param ancestry <PidAncestry *> - The memo
+ */
+void pid_ancestry_destroy(PidAncestry *ancestry);
+
+/**
+ *    pid_ancestry_get_ppid - Get the parent of a pid, calling the ident func only
+ *                              the first time a pid is asked about
+ *
+ *          @param ancestry <PidAncestry *> - The memo
+ *
+ *          @param pid <pid_t> - The pid
+ *
+ *          @return <pid_t> - The parent (1 if no parent), or 0 on error
+ */
+pid_t pid_ancestry_get_ppid(PidAncestry *ancestry, pid_t pid);
+
+/**
+ *    pid_ancestry_build_index - Read the parent of every pid now on the system, and index
+ *                                 them so pid_ancestry_is_ancestor no longer walks parents
+ *
+ *          Worth it when asking about many pids across the whole system. Pids started
+ *            after this is called are reported as PID_ANCESTRY_NO_SUCH_PID. A pid whose
+ *            parent was reused while reading is indexed as having no parent.
+ *
+ *          @param ancestry <PidAncestry *> - The memo
+ *
+ *          @return <int> - 0 on success, -1 if /proc could not be listed (errno is set)
+ */
+int pid_ancestry_build_index(PidAncestry *ancestry);
+
+/**
+ *    pid_ancestry_index_tree - Index the pids of an existing tree (e.x. the #tree of a PidSnapshot)
+ *                                instead of the live system, as pid_ancestry_build_index
+ *
+ *          Pids not in the tree are reported as PID_ANCESTRY_NO_SUCH_PID. If #ancestry was
+ *            created without an ident func, parents are also looked up in the tree, so
+ *            nothing is ever read from /proc.
+ *
+ *          @param ancestry <PidAncestry *> - The memo, not yet indexed
+ *
+ *          @param pidTree <const PidTree *> - The tree. Must outlive #ancestry, which does not free it
+ */
+void pid_ancestry_index_tree(PidAncestry *ancestry, const PidTree *pidTree);
+
+/**
+ *    pid_ancestry_is_ancestor - Check if a pid is a parent (of any level) of another
+ *
+ *          @param ancestry <PidAncestry *> - The memo
+ *
+ *          @param ancestorPid <pid_t> - The possible parent, grandparent, etc.
+ *
+ *          @param pid <pid_t> - The pid to check
+ *
+ *          @return <int> - 1 if #ancestorPid is an ancestor of #pid, 0 if not,
+ *                      or one of PID_ANCESTRY_NO_SUCH_PID / PID_ANCESTRY_DISAPPEARED / PID_ANCESTRY_STALE
+ */
+int pid_ancestry_is_ancestor(PidAncestry *ancestry, pid_t ancestorPid, pid_t pid);
+
+
+#endif
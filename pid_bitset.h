@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * pid_bitset.h - some static utility functions for a set of pids held as
+ *            one bit per possible pid.
+ *
+ *         Pids are always below /proc/sys/kernel/pid_max, so a set of them fits
+ *         in pid_max bits: 4K for the classic 32768, or 512K for the 64-bit
+ *         limit of 4194304. Add, remove and contains are a shift and a mask,
+ *         iterating visits 64 pids per word (skipping empty words in one compare)
+ *         and comes out already sorted, and union / intersection / difference
+ *         are a loop over the words, which the compiler vectorises at -O3.
+ *
+ *         Against a SimpleIntMap + qsort this wins once the set is dense, that is
+ *         once there are enough pids that walking every word is cheaper than
+ *         sorting them. See PID_BITSET_IS_DENSE, and bench_pid_bitset.c
+ *
+ *         These are contained in this header versus a .c file to allow
+ *         optimizations which wouldn't otherwise get applied if not single unit
+ *         (e.x. inlining).
+ *
+ */
+
+#ifndef _PID_BITSET_H
+#define _PID_BITSET_H
+
+#include "pid_tools.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+
+/**
+ *   PidBitset - A set of pids, one bit per pid below #pidMax
+ *
+ *      Create with - pid_bitset_create
+ *
+ *      Free/Destroy with - pid_bitset_destroy
+ */
+typedef struct {
+
+    uint64_t *words;
+    size_t numWords;
+    pid_t pidMax;       /* Pids below this fit without growing (numWords * 64) */
+
+} PidBitset;
+
+
+/* PID_BITSET_WORD_BITS - Number of pids held by each word */
+#define PID_BITSET_WORD_BITS 64
+
+/* PID_BITSET_DEFAULT_PID_MAX - pid_max to assume when /proc/sys is unavailable. The kernel's limit */
+#define PID_BITSET_DEFAULT_PID_MAX 4194304
+
+/* PID_BITSET_DENSE_WORDS_PER_PID - Words to walk per pid in the set at which a PidBitset
+ *   is as fast as a SimpleIntMap + qsort to build and list sorted (measured with bench_pid_bitset)
+ */
+#define PID_BITSET_DENSE_WORDS_PER_PID 32
+
+/* PID_BITSET_IS_DENSE - Whether #_numPids pids below #_pidMax are better held in a PidBitset */
+#define PID_BITSET_IS_DENSE(_numPids, _pidMax) \
+    ( (size_t)(_pidMax) / PID_BITSET_WORD_BITS <= (size_t)(_numPids) * PID_BITSET_DENSE_WORDS_PER_PID )
+
+/* _PID_BITSET_WORD / _PID_BITSET_BIT - The word holding a pid, and its bit within that word */
+#define _PID_BITSET_WORD(_pid) ( (size_t)(_pid) / PID_BITSET_WORD_BITS )
+#define _PID_BITSET_BIT(_pid) ( (uint64_t)1 << ( (size_t)(_pid) % PID_BITSET_WORD_BITS ) )
+
+
+/**
+ * pid_bitset_read_pid_max - Read /proc/sys/kernel/pid_max, which every pid is below
+ *
+ *    @return <pid_t> - pid_max, or PID_BITSET_DEFAULT_PID_MAX if it cannot be read
+ */
+MAYBE_UNUSED static pid_t pid_bitset_read_pid_max(void)
+{
+    FILE *pidMaxFile;
+    unsigned int pidMax = 0;
+
+    pidMaxFile = fopen("/proc/sys/kernel/pid_max", "r");
+    if ( pidMaxFile != NULL )
+    {
+        if ( fscanf(pidMaxFile, "%u", &pidMax) != 1 )
+            pidMax = 0;
+        fclose(pidMaxFile);
+    }
+
+    if ( pidMax == 0 || pidMax > PID_BITSET_DEFAULT_PID_MAX )
+        pidMax = PID_BITSET_DEFAULT_PID_MAX;
+
+    return (pid_t)pidMax;
+}
+
+/**
+ * pid_bitset_create - Allocate an empty PidBitset
+ *
+ *    @param pidMax <pid_t> - Pids below this fit without growing, or 0 to read
+ *                      pid_max (pid_bitset_read_pid_max)
+ *
+ *    @return <PidBitset *> - The set. Free it with pid_bitset_destroy
+ */
+MAYBE_UNUSED static PidBitset *pid_bitset_create(pid_t pidMax)
+{
+    PidBitset *ret;
+
+    if ( pidMax <= 0 )
+        pidMax = pid_bitset_read_pid_max();
+
+    ret = malloc( sizeof(PidBitset) );
+    ret->numWords = ( (size_t)pidMax + PID_BITSET_WORD_BITS - 1 ) / PID_BITSET_WORD_BITS;
+    ret->pidMax = (pid_t)( ret->numWords * PID_BITSET_WORD_BITS );
+
+    /* calloc hands back untouched zero pages, so a sparse set only costs the pages it uses */
+    ret->words = calloc( ret->numWords, sizeof(uint64_t) );
+
+    return ret;
+}
+
+/**
+ * pid_bitset_destroy - Free a PidBitset
+ */
+MAYBE_UNUSED static void pid_bitset_destroy(PidBitset *bitset)
+{
+    free(bitset->words);
+    free(bitset);
+}
+
+/**
+ * _pid_bitset_grow - Make room for pids below #pidMax (if pid_max was raised since creating)
+ */
+MAYBE_UNUSED static void _pid_bitset_grow(PidBitset *bitset, pid_t pidMax)
+{
+    size_t numWords;
+
+    numWords = ( (size_t)pidMax + PID_BITSET_WORD_BITS - 1 ) / PID_BITSET_WORD_BITS;
+    if ( numWords <= bitset->numWords )
+        return;
+
+    bitset->words = realloc(bitset->words, sizeof(uint64_t) * numWords);
+    memset(&bitset->words[bitset->numWords], 0, sizeof(uint64_t) * (numWords - bitset->numWords));
+
+    bitset->numWords = numWords;
+    bitset->pidMax = (pid_t)( numWords * PID_BITSET_WORD_BITS );
+}
+
+/**
+ * pid_bitset_add - Add a pid to the set
+ *
+ *    @param pid <pid_t> - The pid, which must not be negative
+ *
+ *    @return <int> - 1 if it was added, 0 if it was already in the set
+ */
+MAYBE_UNUSED static inline int pid_bitset_add(PidBitset *bitset, pid_t pid)
+{
+    uint64_t *word;
+
+    if ( unlikely( pid >= bitset->pidMax ) )
+        _pid_bitset_grow(bitset, pid + 1);
+
+    word = &bitset->words[ _PID_BITSET_WORD(pid) ];
+    if ( *word & _PID_BITSET_BIT(pid) )
+        return 0;
+
+    *word |= _PID_BITSET_BIT(pid);
+
+    return 1;
+}
+
+/**
+ * pid_bitset_contains - Check if a pid is in the set
+ *
+ *    @return <int> - 1 if it is, otherwise 0
+ */
+MAYBE_UNUSED static inline int pid_bitset_contains(const PidBitset *bitset, pid_t pid)
+{
+    if ( unlikely( pid < 0 || pid >= bitset->pidMax ) )
+        return 0;
+
+    return ( bitset->words[ _PID_BITSET_WORD(pid) ] & _PID_BITSET_BIT(pid) ) != 0;
+}
+
+/**
+ * pid_bitset_rem - Remove a pid from the set
+ *
+ *    @return <int> - 1 if it was removed, 0 if it was not in the set
+ */
+MAYBE_UNUSED static inline int pid_bitset_rem(PidBitset *bitset, pid_t pid)
+{
+    uint64_t *word;
+
+    if ( unlikely( pid < 0 || pid >= bitset->pidMax ) )
+        return 0;
+
+    word = &bitset->words[ _PID_BITSET_WORD(pid) ];
+    if ( ! ( *word & _PID_BITSET_BIT(pid) ) )
+        return 0;
+
+    *word &= ~_PID_BITSET_BIT(pid);
+
+    return 1;
+}
+
+/**
+ * pid_bitset_count - Count the pids in the set
+ *
+ *    @return <size_t> - The number of pids
+ */
+MAYBE_UNUSED static size_t pid_bitset_count(const PidBitset *bitset)
+{
+    size_t count = 0;
+    size_t i;
+
+    for( i=0; i < bitset->numWords; i++ )
+        count += __builtin_popcountll(bitset->words[i]);
+
+    return count;
+}
+
+/**
+ * pid_bitset_next - Find the lowest pid in the set at or above #fromPid,
+ *                     for walking the set in ascending order:
+ *
+ *          for( pid = pid_bitset_next(bitset, 0); pid >= 0; pid = pid_bitset_next(bitset, pid + 1) )
+ *
+ *    @return <pid_t> - The pid, or -1 if there are no more
+ */
+MAYBE_UNUSED static inline pid_t pid_bitset_next(const PidBitset *bitset, pid_t fromPid)
+{
+    size_t wordIdx;
+    uint64_t word;
+
+    if ( unlikely( fromPid >= bitset->pidMax ) )
+        return -1;
+
+    wordIdx = _PID_BITSET_WORD(fromPid);
+    /* Drop the bits below #fromPid in its word */
+    word = bitset->words[wordIdx] & ( ~(uint64_t)0 << ( (size_t)fromPid % PID_BITSET_WORD_BITS ) );
+
+    while ( word == 0 )
+    {
+        if ( ++wordIdx >= bitset->numWords )
+            return -1;
+        word = bitset->words[wordIdx];
+    }
+
+    return (pid_t)( wordIdx * PID_BITSET_WORD_BITS + __builtin_ctzll(word) );
+}
+
+/**
+ * pid_bitset_values - Get every pid in the set, in ascending order
+ *
+ *    @param retLen <size_t *> - The number of pids returned will be stored here
+ *
+ *    @return <pid_t *> - A malloc'd list of the pids, sorted ascending.
+ *
+ *        You are responsible for freeing this list
+ */
+MAYBE_UNUSED static pid_t *pid_bitset_values(const PidBitset *bitset, size_t *retLen)
+{
+    pid_t *ret;
+    size_t retIdx = 0;
+    size_t i;
+    uint64_t word;
+
+    ret = malloc( sizeof(pid_t) * ( pid_bitset_count(bitset) + 1 ) );
+
+    for( i=0; i < bitset->numWords; i++ )
+    {
+        /* Take the lowest set bit, then clear it, until the word is empty */
+        for( word = bitset->words[i]; word != 0; word &= word - 1 )
+            ret[ retIdx++ ] = (pid_t)( i * PID_BITSET_WORD_BITS + __builtin_ctzll(word) );
+    }
+
+    *retLen = retIdx;
+
+    return ret;
+}
+
+/**
+ * pid_bitset_union - Add every pid in #src to #dest
+ *
+ *    #dest and #src must be different sets
+ */
+MAYBE_UNUSED static void pid_bitset_union(PidBitset *dest, const PidBitset *src)
+{
+    uint64_t * restrict destWords;
+    const uint64_t * restrict srcWords;
+    size_t i;
+
+    if ( unlikely( src->numWords > dest->numWords ) )
+        _pid_bitset_grow(dest, src->pidMax);
+
+    destWords = dest->words;
+    srcWords = src->words;
+
+    for( i=0; i < src->numWords; i++ )
+        destWords[i] |= srcWords[i];
+}
+
+/**
+ * pid_bitset_intersect - Remove every pid from #dest which is not in #src
+ *
+ *    #dest and #src must be different sets
+ */
+MAYBE_UNUSED static void pid_bitset_intersect(PidBitset *dest, const PidBitset *src)
+{
+    uint64_t * restrict destWords;
+    const uint64_t * restrict srcWords;
+    size_t i, numWords;
+
+    destWords = dest->words;
+    srcWords = src->words;
+    numWords = src->numWords < dest->numWords ? src->numWords : dest->numWords;
+
+    for( i=0; i < numWords; i++ )
+        destWords[i] &= srcWords[i];
+
+    /* Nothing in #src above its last word */
+    if ( numWords < dest->numWords )
+        memset(&destWords[numWords], 0, sizeof(uint64_t) * (dest->numWords - numWords));
+}
+
+/**
+ * pid_bitset_difference - Remove every pid in #src from #dest
+ *
+ *    #dest and #src must be different sets
+ */
+MAYBE_UNUSED static void pid_bitset_difference(PidBitset *dest, const PidBitset *src)
+{
+    uint64_t * restrict destWords;
+    const uint64_t * restrict srcWords;
+    size_t i, numWords;
+
+    destWords = dest->words;
+    srcWords = src->words;
+    numWords = src->numWords < dest->numWords ? src->numWords : dest->numWords;
+
+    for( i=0; i < numWords; i++ )
+        destWords[i] &= ~srcWords[i];
+}
+
+
+#endif
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * pid_ident.h - some static utility functions for identifying a process by its
+ *            pid plus its start time (field 22 of /proc/$PID/stat), which
+ *            together never repeat, even when the pid alone is reused.
+ *
+ *         A process always starts at or after its parent, so a parent which
+ *         started later than its child is a different process that reused the
+ *         parent's pid. This is how the walks up (isachildof, isaparentof)
+ *         and down (getcpids) notice a reused pid instead of following it.
+ *
+ *         These are contained in this header versus a .c file to allow
+ *         optimizations which wouldn't otherwise get applied if not single unit
+ *         (e.x. inlining).
+ *
+ */
+
+#ifndef _PID_IDENT_H
+#define _PID_IDENT_H
+
+#include "pid_tools.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "proc_stat.h"
+#include "pidtreed_shm.h"
+
+
+/**
+ *   PidIdent - The identity of a process: the pid, and when it started
+ */
+typedef struct {
+
+    pid_t pid;
+    uint64_t startTime; /* Clock ticks after boot the process started */
+
+} PidIdent;
+
+
+/* Return values of the functions below */
+
+/* PID_IDENT_OK - The process exists, and is the one identified */
+#define PID_IDENT_OK 0
+/* PID_IDENT_NO_SUCH_PID - No process has the pid */
+#define PID_IDENT_NO_SUCH_PID (-1)
+/* PID_IDENT_STALE - The pid now belongs to another process */
+#define PID_IDENT_STALE (-2)
+
+/* PID_IDENT_CAN_BE_PARENT - Whether the process #_parent (PidIdent *) started early enough
+ *   to be the parent of #_child (PidIdent *). If not, the parent's pid was reused.
+ */
+#define PID_IDENT_CAN_BE_PARENT(_parent, _child) ( (_parent)->startTime <= (_child)->startTime )
+
+
+/**
+ * pid_ident_read - Read the identity of a process (and its parent) from /proc
+ *
+ *    @param pid <pid_t> - The pid
+ *
+ *    @param ident <PidIdent *> - Will be filled in with the identity
+ *
+ *    @param ppidOut <pid_t *> - If not NULL, will be set to the parent pid,
+ *                      as getPpid (1 if it has no parent)
+ *
+ *    @return <int> - PID_IDENT_OK, or PID_IDENT_NO_SUCH_PID (errno is set)
+ */
+MAYBE_UNUSED static int pid_ident_read(pid_t pid, PidIdent *ident, pid_t *ppidOut)
+{
+    ProcStat stat;
+
+    if ( unlikely( proc_stat_read(pid, PROC_STAT_FIELD_PPID | PROC_STAT_FIELD_STARTTIME, &stat) != 0 ) )
+        return PID_IDENT_NO_SUCH_PID;
+
+    ident->pid = pid;
+    ident->startTime = stat.startTime;
+
+    if ( ppidOut != NULL )
+        *ppidOut = stat.ppid == 0 ? 1 : stat.ppid;
+
+    return PID_IDENT_OK;
+}
+
+/**
+ * pid_ident_lookup - Get the identity of a process (and its parent), from pidtreed's
+ *                      table if it is running, otherwise from /proc (pid_ident_read)
+ *
+ *      The table may be a moment behind, so use pid_ident_read where a pid which
+ *        has just exited must not be reported as running.
+ *
+ *    @param pid <pid_t> - The pid
+ *
+ *    @param ident <PidIdent *> - Will be filled in with the identity
+ *
+ *    @param ppidOut <pid_t *> - If not NULL, will be set to the parent pid,
+ *                      as getPpid (1 if it has no parent)
+ *
+ *    @return <int> - PID_IDENT_OK, or PID_IDENT_NO_SUCH_PID
+ */
+MAYBE_UNUSED static int pid_ident_lookup(pid_t pid, PidIdent *ident, pid_t *ppidOut)
+{
+    PidTreedEntry entry;
+
+    if ( pidtreed_lookup_entry(pid, &entry) != 0 )
+        return pid_ident_read(pid, ident, ppidOut);
+
+    ident->pid = pid;
+    ident->startTime = entry.startTime;
+
+    if ( ppidOut != NULL )
+        *ppidOut = entry.ppid == 0 ? 1 : entry.ppid;
+
+    return PID_IDENT_OK;
+}
+
+/**
+ * pid_ident_check - Check whether an identity still refers to a running process
+ *
+ *    @param ident <const PidIdent *> - An identity from pid_ident_read or pid_ident_lookup
+ *
+ *    @return <int> - PID_IDENT_OK if it is still running, PID_IDENT_NO_SUCH_PID if
+ *                      the pid is gone, or PID_IDENT_STALE if the pid is now another process
+ */
+MAYBE_UNUSED static int pid_ident_check(const PidIdent *ident)
+{
+    PidIdent cur;
+
+    if ( pid_ident_read(ident->pid, &cur, NULL) != PID_IDENT_OK )
+        return PID_IDENT_NO_SUCH_PID;
+
+    return cur.startTime == ident->startTime ? PID_IDENT_OK : PID_IDENT_STALE;
+}
+
+/**
+ * pid_ident_strerror - Describe one of the PID_IDENT_* return values
+ *
+ *    @param err <int> - The return value
+ *
+ *    @return <const char *> - A static string, e.x. "pid was reused by another process"
+ */
+MAYBE_UNUSED static inline const char *pid_ident_strerror(int err)
+{
+    switch( err )
+    {
+        case PID_IDENT_OK:
+            return "ok";
+        case PID_IDENT_NO_SUCH_PID:
+            return "no such pid";
+        case PID_IDENT_STALE:
+            return "pid was reused by another process";
+        default:
+            return "unknown error";
+    }
+}
+
+#endif
@@ -18,6 +18,7 @@
 #define _PID_INODE_UTILS_H
 
 #include "pid_tools.h"
+#include "proc_handle.h"
 
 #include <errno.h>
 #include <stdlib.h>
@@ -51,7 +52,7 @@
  */
 MAYBE_UNUSED static int get_inode_by_filedes(int fileDes)
 {
-    static struct stat statBuf;
+    struct stat statBuf;
     int inode;
     int oldErrno;
 
@@ -87,8 +88,8 @@ MAYBE_UNUSED static int get_inode_by_filedes(int fileDes)
  */
 MAYBE_UNUSED static int get_inode_by_path(const char* filePath)
 {
-    static int fileDes = -1;
-    static struct stat statBuf;
+    int fileDes = -1;
+    struct stat statBuf;
     int oldErrno;
     int inode;
 
@@ -110,4 +111,27 @@ MAYBE_UNUSED static int get_inode_by_path(const char* filePath)
     return inode;
 }
 
+/* get_inode_by_pid - Returns the inode of the /proc/$PID directory for a given pid.
+ *
+ *      A pid which has been reused by a new process will have a different inode.
+ *
+ *   @param pid <pid_t> - The pid
+ *
+ *     @return <int> - If > 0 - The inode of /proc/$PID
+ *                     If -1  - A failure was returned by the `fstatat' call
+ *                                (e.x. the pid does not exist). errno contains the reason.
+ *
+ *         NOTE: This is cheaper than #get_inode_by_path on "/proc/$PID", as it is a single
+ *            fstatat relative to an already-open /proc, and doesn't open the directory.
+ */
+MAYBE_UNUSED static int get_inode_by_pid(pid_t pid)
+{
+    struct stat statBuf;
+
+    if ( unlikely( proc_stat_pid_dir(pid, &statBuf) < 0 ) )
+        return PIU_ERROR_FSTAT;
+
+    return statBuf.st_ino;
+}
+
 #endif
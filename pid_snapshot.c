@@ -0,0 +1,446 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * pid_snapshot.c - Interface implementations for writing and reading binary
+ *                    snapshots of the process table
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "pid_tools.h"
+
+#include "pid_snapshot.h"
+#include "pid_tree.h"
+#include "proc_pids.h"
+#include "proc_scan.h"
+#include "proc_handle.h"
+#include "proc_stat.h"
+
+
+/* SNAPSHOT_ALIGN - Round up to the 8-byte section alignment */
+#define SNAPSHOT_ALIGN(_size) ( ( (_size) + 7 ) & ~((uint64_t)7) )
+
+
+static int _cmp_entries(const void *p1, const void *p2)
+{
+    pid_t val1, val2;
+
+    val1 = ((const PidSnapshotEntry *)p1)->pid;
+    val2 = ((const PidSnapshotEntry *)p2)->pid;
+
+    return (val1 > val2) - (val1 < val2);
+}
+
+/**
+ * _read_live_entry - Read one process from /proc/$PID
+ *
+ *      @return <int> - 0 on success, -1 if the process is gone
+ */
+static int _read_live_entry(pid_t pid, PidSnapshotEntry *entry)
+{
+    ProcHandle handle;
+    struct stat statBuf;
+    ProcStat stat;
+    int ret;
+
+    /* Read the owner and stat through one handle, so both are of the same process */
+    if ( proc_handle_open(&handle, pid) != 0 )
+        return -1;
+
+    if ( fstat(handle.dirFd, &statBuf) != 0 )
+    {
+        proc_handle_close(&handle);
+        return -1;
+    }
+
+    ret = proc_stat_read_handle(&handle, PROC_STAT_FIELD_PPID | PROC_STAT_FIELD_STARTTIME | PROC_STAT_FIELD_COMM, &stat);
+    proc_handle_close(&handle);
+    if ( ret != 0 )
+        return -1;
+
+    memset(entry, 0, sizeof(PidSnapshotEntry));
+    entry->pid = pid;
+    entry->ppid = stat.ppid;
+    entry->startTime = stat.startTime;
+    entry->uid = statBuf.st_uid;
+    strncpy(entry->comm, stat.comm, PID_SNAPSHOT_COMM_SIZE - 1);
+
+    return 0;
+}
+
+/**
+ * _scan_live_entry - proc_scan_func which reads #pid into the PidSnapshotEntry at #result.
+ *                      The entry's pid is 0 if the process is gone.
+ */
+static void _scan_live_entry(pid_t pid, void *result, void *threadBuffer)
+{
+    if ( _read_live_entry(pid, (PidSnapshotEntry *)result) != 0 )
+        ((PidSnapshotEntry *)result)->pid = 0;
+}
+
+PidSnapshotEntry *pid_snapshot_read_live(unsigned int numThreads, size_t *numEntries)
+{
+    pid_t *pids;
+    size_t numPids;
+    PidSnapshotEntry *entries;
+    size_t i;
+
+    *numEntries = 0;
+
+    pids = proc_pids_get_all(&numPids);
+    if ( unlikely( pids == NULL ) )
+        return NULL;
+
+    entries = malloc( sizeof(PidSnapshotEntry) * (numPids + 1) );
+    proc_scan_run(pids, numPids, entries, sizeof(PidSnapshotEntry), _scan_live_entry, 0, numThreads);
+    free(pids);
+
+    /* Drop any which exited during the scan. Order (sorted by pid) is kept. */
+    for( i=0; i < numPids; i++ )
+    {
+        if ( entries[i].pid == 0 )
+            continue;
+        if ( *numEntries != i )
+            memcpy(&entries[*numEntries], &entries[i], sizeof(PidSnapshotEntry));
+        (*numEntries)++;
+    }
+
+    return entries;
+}
+
+/**
+ * _write_all - write() until everything is written
+ *
+ *      @return <int> - 0 on success, -1 on error (errno is set)
+ */
+static int _write_all(int fd, const char *data, size_t size)
+{
+    ssize_t written;
+
+    while ( size > 0 )
+    {
+        written = write(fd, data, size);
+        if ( written < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+            return -1;
+        }
+        data += written;
+        size -= written;
+    }
+
+    return 0;
+}
+
+int pid_snapshot_write(const char *path, const PidSnapshotEntry *entries, size_t numEntries)
+{
+    PidSnapshotEntry *sortedEntries;
+    PidSnapshotFileHeader layout;
+    PidSnapshotFileHeader *header;
+    PidTree *pidTree;
+    pid_t *treePids, *treePpids;
+    char *fileData;
+    uint64_t offset;
+    uint32_t stringPoolSize;
+    uint32_t numChildIdxs;
+    uint32_t *commOffsets;
+    size_t commLen;
+    size_t i;
+    int fd;
+    int savedErrno;
+    int ret;
+
+    /* Sort a copy, so the caller may pass entries in any order */
+    sortedEntries = malloc( sizeof(PidSnapshotEntry) * (numEntries + 1) );
+    memcpy(sortedEntries, entries, sizeof(PidSnapshotEntry) * numEntries);
+    for( i=1; i < numEntries; i++ )
+    {
+        if ( sortedEntries[i].pid < sortedEntries[i - 1].pid )
+        {
+            qsort(sortedEntries, numEntries, sizeof(PidSnapshotEntry), _cmp_entries);
+            break;
+        }
+    }
+
+    /* Build the children index the same way getcpids does (no parent means init) */
+    treePids = malloc( sizeof(pid_t) * (numEntries + 1) );
+    treePpids = malloc( sizeof(pid_t) * (numEntries + 1) );
+    for( i=0; i < numEntries; i++ )
+    {
+        treePids[i] = sortedEntries[i].pid;
+        treePpids[i] = sortedEntries[i].ppid != 0 ? sortedEntries[i].ppid : 1;
+    }
+    pidTree = pid_tree_create(treePids, treePpids, numEntries);
+    numChildIdxs = pidTree->childOffsets[numEntries];
+
+    stringPoolSize = 0;
+    for( i=0; i < numEntries; i++ )
+        stringPoolSize += strnlen(sortedEntries[i].comm, PID_SNAPSHOT_COMM_SIZE - 1) + 1;
+
+    /* Lay out the sections */
+    memset(&layout, 0, sizeof(layout));
+    offset = SNAPSHOT_ALIGN( sizeof(PidSnapshotFileHeader) );
+
+    layout.pidsOffset = offset;
+    offset = SNAPSHOT_ALIGN( offset + sizeof(pid_t) * numEntries );
+    layout.ppidsOffset = offset;
+    offset = SNAPSHOT_ALIGN( offset + sizeof(pid_t) * numEntries );
+    layout.startTimesOffset = offset;
+    offset = SNAPSHOT_ALIGN( offset + sizeof(uint64_t) * numEntries );
+    layout.uidsOffset = offset;
+    offset = SNAPSHOT_ALIGN( offset + sizeof(uint32_t) * numEntries );
+    layout.commOffsetsOffset = offset;
+    offset = SNAPSHOT_ALIGN( offset + sizeof(uint32_t) * numEntries );
+    layout.childOffsetsOffset = offset;
+    offset = SNAPSHOT_ALIGN( offset + sizeof(uint32_t) * (numEntries + 1) );
+    layout.childIdxsOffset = offset;
+    offset = SNAPSHOT_ALIGN( offset + sizeof(uint32_t) * numChildIdxs );
+    layout.stringPoolOffset = offset;
+    offset = SNAPSHOT_ALIGN( offset + stringPoolSize );
+
+    fileData = calloc(1, offset);
+    header = (PidSnapshotFileHeader *)fileData;
+    memcpy(header, &layout, sizeof(layout));
+
+    header->magic = PID_SNAPSHOT_MAGIC;
+    header->formatVersion = PID_SNAPSHOT_FORMAT_VERSION;
+    header->createTime = (uint64_t)time(NULL);
+    header->fileSize = offset;
+    header->numEntries = numEntries;
+    header->numChildIdxs = numChildIdxs;
+    header->stringPoolSize = stringPoolSize;
+    gethostname(header->hostname, PID_SNAPSHOT_HOSTNAME_SIZE - 1);
+
+    commOffsets = (uint32_t *)&fileData[header->commOffsetsOffset];
+    stringPoolSize = 0;
+    for( i=0; i < numEntries; i++ )
+    {
+        ((pid_t *)&fileData[header->pidsOffset])[i] = sortedEntries[i].pid;
+        ((pid_t *)&fileData[header->ppidsOffset])[i] = sortedEntries[i].ppid;
+        ((uint64_t *)&fileData[header->startTimesOffset])[i] = sortedEntries[i].startTime;
+        ((uint32_t *)&fileData[header->uidsOffset])[i] = sortedEntries[i].uid;
+
+        commLen = strnlen(sortedEntries[i].comm, PID_SNAPSHOT_COMM_SIZE - 1);
+        commOffsets[i] = stringPoolSize;
+        memcpy(&fileData[header->stringPoolOffset + stringPoolSize], sortedEntries[i].comm, commLen);
+        stringPoolSize += commLen + 1;
+    }
+
+    memcpy(&fileData[header->childOffsetsOffset], pidTree->childOffsets, sizeof(uint32_t) * (numEntries + 1));
+    memcpy(&fileData[header->childIdxsOffset], pidTree->childIdxs, sizeof(uint32_t) * numChildIdxs);
+
+    pid_tree_destroy(pidTree);
+    free(sortedEntries);
+
+    ret = -1;
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if ( fd >= 0 )
+    {
+        ret = _write_all(fd, fileData, header->fileSize);
+        savedErrno = errno;
+        if ( close(fd) != 0 && ret == 0 )
+            ret = -1;
+        else
+            errno = savedErrno;
+    }
+
+    free(fileData);
+
+    return ret;
+}
+
+/**
+ * _section_fits - Check that a section lies entirely within the file
+ */
+static inline int _section_fits(uint64_t offset, uint64_t size, uint64_t fileSize)
+{
+    return offset <= fileSize && size <= fileSize - offset && (offset & 7) == 0;
+}
+
+/**
+ * _validate - Check that the contents of a file are a snapshot which is safe to query
+ *
+ *      The index arrays are checked fully, so no query can read outside #data, and
+ *        every walk of the children index ends: pids must strictly increase (for the
+ *        binary search), and each row of children must strictly increase and hold only
+ *        pids whose parent is the pid owning the row (init for those without one), so
+ *        no pid is listed more than once.
+ */
+static int _validate(const char *data, size_t size)
+{
+    const PidSnapshotFileHeader *header;
+    const uint32_t *childOffsets, *childIdxs, *commOffsets;
+    const pid_t *pids, *ppids;
+    uint64_t numEntries;
+    uint64_t i, j;
+    pid_t parentPid;
+
+    if ( size < sizeof(PidSnapshotFileHeader) )
+        return -1;
+
+    header = (const PidSnapshotFileHeader *)data;
+    if ( header->magic != PID_SNAPSHOT_MAGIC || header->formatVersion != PID_SNAPSHOT_FORMAT_VERSION || header->fileSize != size )
+        return -1;
+
+    /* Bound the counts before multiplying by them, so no section size can wrap */
+    numEntries = header->numEntries;
+    if ( numEntries > size / sizeof(uint64_t) || header->numChildIdxs > numEntries )
+        return -1;
+
+    if ( ! _section_fits(header->pidsOffset, sizeof(pid_t) * numEntries, size) ||
+         ! _section_fits(header->ppidsOffset, sizeof(pid_t) * numEntries, size) ||
+         ! _section_fits(header->startTimesOffset, sizeof(uint64_t) * numEntries, size) ||
+         ! _section_fits(header->uidsOffset, sizeof(uint32_t) * numEntries, size) ||
+         ! _section_fits(header->commOffsetsOffset, sizeof(uint32_t) * numEntries, size) ||
+         ! _section_fits(header->childOffsetsOffset, sizeof(uint32_t) * (numEntries + 1), size) ||
+         ! _section_fits(header->childIdxsOffset, sizeof(uint32_t) * header->numChildIdxs, size) ||
+         ! _section_fits(header->stringPoolOffset, header->stringPoolSize, size) )
+        return -1;
+
+    pids = (const pid_t *)&data[header->pidsOffset];
+    ppids = (const pid_t *)&data[header->ppidsOffset];
+    childOffsets = (const uint32_t *)&data[header->childOffsetsOffset];
+    childIdxs = (const uint32_t *)&data[header->childIdxsOffset];
+    commOffsets = (const uint32_t *)&data[header->commOffsetsOffset];
+
+    if ( childOffsets[0] != 0 || childOffsets[numEntries] != header->numChildIdxs )
+        return -1;
+
+    for( i=0; i < numEntries; i++ )
+    {
+        if ( childOffsets[i + 1] < childOffsets[i] )
+            return -1;
+        if ( commOffsets[i] >= header->stringPoolSize )
+            return -1;
+        if ( i > 0 && pids[i] <= pids[i - 1] )
+            return -1;
+    }
+
+    for( i=0; i < numEntries; i++ )
+    {
+        for( j=childOffsets[i]; j < childOffsets[i + 1]; j++ )
+        {
+            if ( childIdxs[j] >= numEntries )
+                return -1;
+            if ( j > childOffsets[i] && childIdxs[j] <= childIdxs[j - 1] )
+                return -1;
+
+            /* As written by pid_snapshot_write */
+            parentPid = ppids[ childIdxs[j] ] != 0 ? ppids[ childIdxs[j] ] : 1;
+            if ( parentPid != pids[i] )
+                return -1;
+        }
+    }
+
+    /* Every name must end within the pool */
+    if ( header->stringPoolSize > 0 && data[ header->stringPoolOffset + header->stringPoolSize - 1 ] != '\0' )
+        return -1;
+
+    return 0;
+}
+
+PidSnapshot *pid_snapshot_open(const char *path)
+{
+    PidSnapshot *snapshot;
+    struct stat statBuf;
+    char *data;
+    size_t dataSize, numRead;
+    ssize_t thisRead;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if ( fd < 0 )
+        return NULL;
+
+    if ( fstat(fd, &statBuf) != 0 )
+    {
+        close(fd);
+        return NULL;
+    }
+
+    if ( (size_t)statBuf.st_size < sizeof(PidSnapshotFileHeader) )
+    {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /* Read into a private copy rather than mapping the file, so what is validated is
+     *   what gets queried, even if the file is truncated or rewritten while open
+     *   (which, through a shared mapping, would mean SIGBUS or unchecked offsets)
+     */
+    dataSize = statBuf.st_size;
+    data = malloc(dataSize);
+    if ( data == NULL )
+    {
+        close(fd);
+        return NULL;
+    }
+
+    numRead = 0;
+    while ( numRead < dataSize && ( thisRead = read(fd, &data[numRead], dataSize - numRead) ) != 0 )
+    {
+        if ( thisRead < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+
+            close(fd);
+            free(data);
+            return NULL;
+        }
+        numRead += thisRead;
+    }
+    close(fd);
+
+    /* Shrunk since the fstat. The header's #fileSize no longer matches, so this fails */
+    if ( _validate(data, numRead) != 0 )
+    {
+        free(data);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    snapshot = malloc( sizeof(PidSnapshot) );
+
+    snapshot->data = data;
+    snapshot->dataSize = numRead;
+    snapshot->header = (const PidSnapshotFileHeader *)data;
+    snapshot->numEntries = snapshot->header->numEntries;
+
+    snapshot->pids = (const pid_t *)&data[snapshot->header->pidsOffset];
+    snapshot->ppids = (const pid_t *)&data[snapshot->header->ppidsOffset];
+    snapshot->startTimes = (const uint64_t *)&data[snapshot->header->startTimesOffset];
+    snapshot->uids = (const uint32_t *)&data[snapshot->header->uidsOffset];
+    snapshot->commOffsets = (const uint32_t *)&data[snapshot->header->commOffsetsOffset];
+    snapshot->stringPool = &data[snapshot->header->stringPoolOffset];
+
+    /* The queries only read these, so pointing them at the copy is safe */
+    snapshot->tree.numPids = snapshot->numEntries;
+    snapshot->tree.pids = (pid_t *)snapshot->pids;
+    snapshot->tree.ppids = (pid_t *)snapshot->ppids;
+    snapshot->tree.childOffsets = (unsigned int *)&data[snapshot->header->childOffsetsOffset];
+    snapshot->tree.childIdxs = (unsigned int *)&data[snapshot->header->childIdxsOffset];
+
+    return snapshot;
+}
+
+void pid_snapshot_close(PidSnapshot *snapshot)
+{
+    free(snapshot->data);
+    free(snapshot);
+}
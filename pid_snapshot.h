@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * pid_snapshot.h - Interface definitions for writing and reading binary
+ *                    snapshots of the process table
+ *
+ *   A snapshot file captures every process (pid, ppid, start time, uid, comm)
+ *     at one point in time, along with a ready-made parent->children index.
+ *     It is read into memory whole, so queries need neither /proc nor any
+ *     parsing or index building.
+ *
+ *   File layout (native byte order, every section 8-byte aligned):
+ *
+ *      PidSnapshotFileHeader
+ *      pids            pid_t    [numEntries]      Sorted ascending
+ *      ppids           pid_t    [numEntries]      0 if no parent
+ *      startTimes      uint64_t [numEntries]      Clock ticks since boot (stat field 22)
+ *      uids            uint32_t [numEntries]      Owner of /proc/$PID
+ *      commOffsets     uint32_t [numEntries]      Offset of the name within the string pool
+ *      childOffsets    uint32_t [numEntries + 1]  As PidTree->childOffsets
+ *      childIdxs       uint32_t [numChildIdxs]    As PidTree->childIdxs
+ *      string pool     char     [stringPoolSize]  Null-terminated names
+ *
+ *   The children index follows getcpids' rules, so processes without a parent
+ *     (e.x. kthreadd) are listed as children of pid 1.
+ */
+
+#ifndef _PID_SNAPSHOT_H
+#define _PID_SNAPSHOT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "pid_tools.h"
+#include "pid_tree.h"
+
+/*******************
+ * DATA TYPES
+ ******************/
+
+/* PID_SNAPSHOT_MAGIC - "PSNP" */
+#define PID_SNAPSHOT_MAGIC (0x504e5350)
+
+/* PID_SNAPSHOT_FORMAT_VERSION - Bump whenever the file layout changes */
+#define PID_SNAPSHOT_FORMAT_VERSION (1)
+
+/* PID_SNAPSHOT_COMM_SIZE - Max size of a name, including the null (same as the kernel's TASK_COMM_LEN) */
+#define PID_SNAPSHOT_COMM_SIZE 16
+
+/* PID_SNAPSHOT_HOSTNAME_SIZE - Size of the hostname field in the header */
+#define PID_SNAPSHOT_HOSTNAME_SIZE 64
+
+/**
+ *   PidSnapshotFileHeader - The start of a snapshot file.
+ *
+ *      All offsets are in bytes from the start of the file.
+ */
+typedef struct {
+
+    uint32_t magic;
+    uint32_t formatVersion;
+
+    uint64_t createTime; /* Seconds since the epoch */
+    uint64_t fileSize;
+
+    uint32_t numEntries;
+    uint32_t numChildIdxs;
+    uint32_t stringPoolSize;
+    uint32_t _reserved;
+
+    uint64_t pidsOffset;
+    uint64_t ppidsOffset;
+    uint64_t startTimesOffset;
+    uint64_t uidsOffset;
+    uint64_t commOffsetsOffset;
+    uint64_t childOffsetsOffset;
+    uint64_t childIdxsOffset;
+    uint64_t stringPoolOffset;
+
+    char hostname[PID_SNAPSHOT_HOSTNAME_SIZE];
+
+} PidSnapshotFileHeader;
+
+/**
+ *   PidSnapshotEntry - One process, as passed to pid_snapshot_write
+ */
+typedef struct {
+
+    pid_t pid;
+    pid_t ppid;          /* 0 if no parent */
+    uint64_t startTime;
+    uint32_t uid;
+    char comm[PID_SNAPSHOT_COMM_SIZE];
+
+} PidSnapshotEntry;
+
+/**
+ *   PidSnapshot - An open snapshot file, read into memory.
+ *
+ *      The arrays point straight into #data, and #tree is a PidTree
+ *        whose arrays do as well. Use it with any of the pid_tree_* query
+ *        functions, but never pass it to pid_tree_destroy.
+ *
+ *      Open with - pid_snapshot_open
+ *
+ *      Close with - pid_snapshot_close
+ */
+typedef struct {
+
+    char *data;          /* Private copy of the whole file */
+    size_t dataSize;
+
+    const PidSnapshotFileHeader *header;
+
+    size_t numEntries;
+
+    const pid_t *pids;
+    const pid_t *ppids;
+    const uint64_t *startTimes;
+    const uint32_t *uids;
+    const uint32_t *commOffsets;
+    const char *stringPool;
+
+    PidTree tree;
+
+} PidSnapshot;
+
+
+/*******************
+ * MACROS
+ ******************/
+
+#define PID_SNAPSHOT_NUM_ENTRIES(snapshot) ((snapshot)->numEntries)
+
+/* PID_SNAPSHOT_COMM - Name of the process at index #idx */
+#define PID_SNAPSHOT_COMM(snapshot, idx) ( &(snapshot)->stringPool[ (snapshot)->commOffsets[(idx)] ] )
+
+
+/*******************
+ * PUBLIC FUNCTIONS
+ ******************/
+
+/**
+ *    pid_snapshot_write - Write a snapshot file from a list of processes
+ *
+ *          @param path <const char *> - File to write. Replaced if it exists.
+ *
+ *          @param entries <const PidSnapshotEntry *> - The processes, in any order
+ *
+ *          @param numEntries <size_t> - Number of elements in #entries
+ *
+ *          @return <int> - 0 on success, -1 on error (errno is set)
+ */
+int pid_snapshot_write(const char *path, const PidSnapshotEntry *entries, size_t numEntries);
+
+/**
+ *    pid_snapshot_read_live - Read every process on the system from /proc
+ *
+ *          @param numThreads <unsigned int> - Number of threads to scan with, or 0 for the default
+ *
+ *          @param numEntries <size_t *> - Will be set to the number of entries returned
+ *
+ *          @return <PidSnapshotEntry *> - Allocated list of entries, sorted by pid,
+ *                      or NULL if /proc could not be listed (errno is set)
+ *
+ *              You are responsible for freeing this list
+ */
+PidSnapshotEntry *pid_snapshot_read_live(unsigned int numThreads, size_t *numEntries);
+
+/**
+ *    pid_snapshot_open - Open and validate a snapshot file
+ *
+ *          @param path <const char *> - File to open
+ *
+ *          @return <PidSnapshot *> - The open snapshot, or NULL on error (errno is set,
+ *                      EINVAL if the file is not a snapshot or is damaged)
+ */
+PidSnapshot *pid_snapshot_open(const char *path);
+
+/**
+ *    pid_snapshot_close - Free a snapshot opened with pid_snapshot_open
+ *
+ *          @param snapshot <PidSnapshot *> - The snapshot
+ */
+void pid_snapshot_close(PidSnapshot *snapshot);
+
+
+#endif
@@ -14,14 +14,20 @@
   #define unlikely(x)  __builtin_expect(!!(x),0)
   #define __hot __attribute__((hot))
   #define MAYBE_UNUSED __attribute__((unused))
+  #define WEAK_SYMBOL __attribute__((weak))
 
   #define ALIGN_4  __attribute__ ((aligned(4)))
   #define ALIGN_8  __attribute__ ((aligned(8)))
   #define ALIGN_16  __attribute__ ((aligned(16)))
   #define ALIGN_32 __attribute__ ((aligned(32)))
+  #define ALIGN_64 __attribute__ ((aligned(64)))
 
   #define builtin_ceil(_x) ( __builtin_ceil((_x)) )
 
+  /* Start loading the cache line holding #_addr, to be read or written soon */
+  #define prefetch_read(_addr)  __builtin_prefetch((_addr), 0, 3)
+  #define prefetch_write(_addr) __builtin_prefetch((_addr), 1, 3)
+
 #else
 
   #define ALWAYS_INLINE
@@ -29,14 +35,19 @@
   #define unlikely(x) (x)
   #define __hot
   #define MAYBE_UNUSED
+  #define WEAK_SYMBOL
   
   #define ALIGN_4
   #define ALIGN_8
   #define ALIGN_16
   #define ALIGN_32
+  #define ALIGN_64
 
   #define builtin_ceil(_x) ( ((float)(_x)) - ((int(_x))) < 1e-6 ? ( int((_x)) ) : (int((float)(_x)) + 1) )
 
+  #define prefetch_read(_addr)
+  #define prefetch_write(_addr)
+
 #endif
 
 #ifndef SHARED_LIB
@@ -51,12 +62,25 @@
   #define STATIC_EXE_ONLY
   #define INLINE_EXE_ONLY
 
-  #define STATIC_SHARED_ONLY
+  /* Every module compiled as SHARED_LIB carries a copy of the version strings,
+   *   so mark them weak to let the linker fold them into one.
+   */
+  #define STATIC_SHARED_ONLY WEAK_SYMBOL
 
   #define STATIC_INLINE_EXE_ONLY
   #define ALWAYS_INLINE_EXE_ONLY
 #endif
 
+/* PIDTOOLS_MULTICALL - Defined when a tool is compiled into the "pidtools" multicall
+ *   binary (pidtools.c), with its main renamed (e.x. getppid_main). Anything the tools
+ *   would each define globally must then be static, so they can be linked together.
+ */
+#ifdef PIDTOOLS_MULTICALL
+  #define STATIC_MULTICALL_ONLY static MAYBE_UNUSED
+#else
+  #define STATIC_MULTICALL_ONLY
+#endif
+
 STATIC_SHARED_ONLY MAYBE_UNUSED const volatile char *PID_TOOLS_VERSION = "5.0.2";
 STATIC_SHARED_ONLY MAYBE_UNUSED const volatile char *PID_TOOLS_COPYRIGHT = "Copyright (c) 2018 Timothy Savannah All Rights Reserved, licensed under GNU General Purpose License version 2";
 
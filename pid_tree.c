@@ -0,0 +1,506 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * pid_tree.c - Interface implementations for a parent->children index
+ *                over a snapshot of the process table
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pid_tools.h"
+
+#include "pid_tree.h"
+
+
+/* struct _pid_ppid_pair - Used to sort pids alongside their parent when input is unsorted */
+struct _pid_ppid_pair {
+    pid_t pid;
+    pid_t ppid;
+};
+
+static int _cmp_pid_ppid_pairs(const void *p1, const void *p2)
+{
+    pid_t val1, val2;
+
+    val1 = ((struct _pid_ppid_pair *)p1)->pid;
+    val2 = ((struct _pid_ppid_pair *)p2)->pid;
+
+    return (val1 > val2) - (val1 < val2);
+}
+
+/**
+ * _pid_tree_sort_input - Sort #pids ascending, keeping #ppids aligned.
+ *
+ *    Input is almost always already sorted (/proc lists pids in order),
+ *      so this is just a linear check in the common case.
+ */
+static void _pid_tree_sort_input(pid_t *pids, pid_t *ppids, size_t numPids)
+{
+    size_t i;
+    struct _pid_ppid_pair *pairs;
+
+    for( i=1; i < numPids; i++ )
+    {
+        if ( unlikely( pids[i] < pids[i - 1] ) )
+            break;
+    }
+
+    if ( likely( i >= numPids ) )
+        return;
+
+    pairs = malloc( sizeof(struct _pid_ppid_pair) * numPids );
+    for( i=0; i < numPids; i++ )
+    {
+        pairs[i].pid = pids[i];
+        pairs[i].ppid = ppids[i];
+    }
+
+    qsort(pairs, numPids, sizeof(struct _pid_ppid_pair), _cmp_pid_ppid_pairs);
+
+    for( i=0; i < numPids; i++ )
+    {
+        pids[i] = pairs[i].pid;
+        ppids[i] = pairs[i].ppid;
+    }
+
+    free(pairs);
+}
+
+PidTree *pid_tree_create(pid_t *pids, pid_t *ppids, size_t numPids)
+{
+    PidTree *ret;
+    ssize_t *parentIdxs;
+    unsigned int *childOffsets;
+    unsigned int *childIdxs;
+    unsigned int *fillOffsets;
+    size_t i;
+
+    ret = malloc( sizeof(PidTree) );
+
+    _pid_tree_sort_input(pids, ppids, numPids);
+
+    ret->numPids = numPids;
+    ret->pids = pids;
+    ret->ppids = ppids;
+
+    /* First pass - resolve each parent pid to its index, and count children per parent */
+    parentIdxs = malloc( sizeof(ssize_t) * (numPids + 1) );
+    childOffsets = calloc( numPids + 1, sizeof(unsigned int) );
+
+    for( i=0; i < numPids; i++ )
+    {
+        if ( unlikely( ppids[i] == 0 ) )
+        {
+            parentIdxs[i] = -1;
+            continue;
+        }
+
+        parentIdxs[i] = pid_tree_index_of(ret, ppids[i]);
+        if ( likely( parentIdxs[i] >= 0 ) )
+            childOffsets[ parentIdxs[i] + 1 ] += 1;
+    }
+
+    /* Prefix-sum the counts into offsets */
+    for( i=0; i < numPids; i++ )
+        childOffsets[i + 1] += childOffsets[i];
+
+    /* Second pass - place each child in its parent's row.
+     *   We walk in ascending pid order, so every row ends up sorted.
+     */
+    childIdxs = malloc( sizeof(unsigned int) * (childOffsets[numPids] + 1) );
+    fillOffsets = malloc( sizeof(unsigned int) * (numPids + 1) );
+    memcpy(fillOffsets, childOffsets, sizeof(unsigned int) * (numPids + 1) );
+
+    for( i=0; i < numPids; i++ )
+    {
+        if ( parentIdxs[i] < 0 )
+            continue;
+
+        childIdxs[ fillOffsets[ parentIdxs[i] ]++ ] = i;
+    }
+
+    free(fillOffsets);
+    free(parentIdxs);
+
+    ret->childOffsets = childOffsets;
+    ret->childIdxs = childIdxs;
+
+    return ret;
+}
+
+void pid_tree_destroy(PidTree *pidTree)
+{
+    free(pidTree->pids);
+    free(pidTree->ppids);
+    free(pidTree->childOffsets);
+    free(pidTree->childIdxs);
+    free(pidTree);
+}
+
+ssize_t pid_tree_index_of(const PidTree *pidTree, pid_t pid)
+{
+    size_t low, high, mid;
+    pid_t *pids;
+
+    pids = pidTree->pids;
+    low = 0;
+    high = pidTree->numPids;
+
+    while ( low < high )
+    {
+        mid = low + ( (high - low) >> 1 );
+
+        if ( pids[mid] < pid )
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    if ( low < pidTree->numPids && pids[low] == pid )
+        return (ssize_t)low;
+
+    return -1;
+}
+
+pid_t *pid_tree_get_children(PidTree *pidTree, const pid_t *rootPids, size_t numRootPids, int isRecursive, size_t *retLen)
+{
+    char *isMatched;
+    unsigned int *queue;
+    size_t queueHead, queueTail;
+    size_t numMatched;
+    size_t i;
+    unsigned int childIdx, curIdx, endOffset, offset;
+    ssize_t rootIdx;
+    pid_t *ret;
+
+    *retLen = 0;
+
+    if ( unlikely( pidTree->numPids == 0 ) )
+        return NULL;
+
+    isMatched = calloc( pidTree->numPids, sizeof(char) );
+    queue = malloc( sizeof(unsigned int) * (pidTree->numPids + 1) );
+    numMatched = 0;
+
+    /* Breadth-first walk. Each pid is matched (and thus expanded) at most once,
+     *   so the whole walk is linear in the size of the matched subtree.
+     */
+    for( i=0; i < numRootPids; i++ )
+    {
+        rootIdx = pid_tree_index_of(pidTree, rootPids[i]);
+        if ( rootIdx < 0 )
+            continue;
+
+        queueHead = queueTail = 0;
+        queue[ queueTail++ ] = (unsigned int)rootIdx;
+
+        while ( queueHead < queueTail )
+        {
+            curIdx = queue[ queueHead++ ];
+
+            endOffset = pidTree->childOffsets[curIdx + 1];
+            for( offset = pidTree->childOffsets[curIdx]; offset < endOffset; offset++ )
+            {
+                childIdx = pidTree->childIdxs[offset];
+                if ( isMatched[childIdx] )
+                    continue;
+
+                isMatched[childIdx] = 1;
+                numMatched += 1;
+
+                if ( isRecursive )
+                    queue[ queueTail++ ] = childIdx;
+            }
+        }
+    }
+
+    if ( numMatched == 0 )
+    {
+        ret = NULL;
+        goto __cleanup_and_exit;
+    }
+
+    /* Gather in index order, which is ascending pid order */
+    ret = malloc( sizeof(pid_t) * numMatched );
+    for( i=0, childIdx=0; i < pidTree->numPids; i++ )
+    {
+        if ( isMatched[i] )
+            ret[ childIdx++ ] = pidTree->pids[i];
+    }
+
+    *retLen = numMatched;
+
+__cleanup_and_exit:
+
+    free(isMatched);
+    free(queue);
+
+    return ret;
+}
+
+/* PID_TREE_NOT_NUMBERED - entryNums value of a pid the depth-first walk hasn't reached yet */
+#define PID_TREE_NOT_NUMBERED ((unsigned int)-1)
+
+/**
+ * _pid_tree_is_forest_root - Check if the pid at #idx starts a tree of the forest,
+ *                              i.e. its parent is unknown, not in the tree, or itself
+ */
+static inline int _pid_tree_is_forest_root(const PidTree *pidTree, size_t idx)
+{
+    ssize_t parentIdx;
+
+    if ( pidTree->ppids[idx] == 0 )
+        return 1;
+
+    parentIdx = pid_tree_index_of(pidTree, pidTree->ppids[idx]);
+
+    return parentIdx < 0 || (size_t)parentIdx == idx;
+}
+
+/**
+ * _pid_tree_number_subtree - Number the subtree at #rootIdx, depth-first, without recursion
+ *
+ *      @param stackIdxs <unsigned int *> - Scratch space for numPids entries
+ *
+ *      @param stackOffsets <unsigned int *> - Scratch space for numPids entries
+ *
+ *      @param nextNum <unsigned int *> - The next entry number to hand out. Will be updated
+ */
+static void _pid_tree_number_subtree(PidTreeIntervals *intervals, unsigned int rootIdx,
+    unsigned int *stackIdxs, unsigned int *stackOffsets, unsigned int *nextNum)
+{
+    const PidTree *pidTree;
+    size_t depth;
+    unsigned int curIdx, childIdx;
+
+    pidTree = intervals->pidTree;
+
+    intervals->entryNums[rootIdx] = (*nextNum)++;
+    stackIdxs[0] = rootIdx;
+    stackOffsets[0] = pidTree->childOffsets[rootIdx];
+    depth = 1;
+
+    while ( depth > 0 )
+    {
+        curIdx = stackIdxs[depth - 1];
+
+        if ( stackOffsets[depth - 1] < pidTree->childOffsets[curIdx + 1] )
+        {
+            childIdx = pidTree->childIdxs[ stackOffsets[depth - 1]++ ];
+
+            /* Already numbered means a self-parented pid (or a loop), don't descend again */
+            if ( intervals->entryNums[childIdx] != PID_TREE_NOT_NUMBERED )
+                continue;
+
+            intervals->entryNums[childIdx] = (*nextNum)++;
+            stackIdxs[depth] = childIdx;
+            stackOffsets[depth] = pidTree->childOffsets[childIdx];
+            depth++;
+        }
+        else
+        {
+            /* Every pid numbered since this one is within its subtree */
+            intervals->exitNums[curIdx] = *nextNum - 1;
+            depth--;
+        }
+    }
+}
+
+PidTreeIntervals *pid_tree_intervals_create(const PidTree *pidTree)
+{
+    PidTreeIntervals *intervals;
+    unsigned int *stackIdxs, *stackOffsets;
+    unsigned int nextNum;
+    size_t numPids;
+    size_t i;
+    int pass;
+
+    numPids = pidTree->numPids;
+
+    intervals = malloc( sizeof(PidTreeIntervals) );
+    intervals->pidTree = pidTree;
+    intervals->entryNums = malloc( sizeof(unsigned int) * (numPids + 1) );
+    intervals->exitNums = malloc( sizeof(unsigned int) * (numPids + 1) );
+
+    for( i=0; i < numPids; i++ )
+        intervals->entryNums[i] = PID_TREE_NOT_NUMBERED;
+
+    stackIdxs = malloc( sizeof(unsigned int) * (numPids + 1) );
+    stackOffsets = malloc( sizeof(unsigned int) * (numPids + 1) );
+    nextNum = 0;
+
+    /* First walk down from every root of the forest. Anything left after that
+     *   is only reachable from itself (a loop of parents, which a snapshot taken
+     *   while pids were being reused could in theory contain), so start there.
+     */
+    for( pass=0; pass < 2; pass++ )
+    {
+        for( i=0; i < numPids; i++ )
+        {
+            if ( intervals->entryNums[i] != PID_TREE_NOT_NUMBERED )
+                continue;
+
+            if ( pass == 0 && ! _pid_tree_is_forest_root(pidTree, i) )
+                continue;
+
+            _pid_tree_number_subtree(intervals, (unsigned int)i, stackIdxs, stackOffsets, &nextNum);
+        }
+    }
+
+    free(stackIdxs);
+    free(stackOffsets);
+
+    return intervals;
+}
+
+void pid_tree_intervals_destroy(PidTreeIntervals *intervals)
+{
+    free(intervals->entryNums);
+    free(intervals->exitNums);
+    free(intervals);
+}
+
+int pid_tree_intervals_is_ancestor(const PidTreeIntervals *intervals, pid_t ancestorPid, pid_t pid)
+{
+    ssize_t ancestorIdx, idx;
+
+    ancestorIdx = pid_tree_index_of(intervals->pidTree, ancestorPid);
+    idx = pid_tree_index_of(intervals->pidTree, pid);
+    if ( ancestorIdx < 0 || idx < 0 )
+        return -1;
+
+    return PID_TREE_IS_ANCESTOR_IDX(intervals, ancestorIdx, idx) ? 1 : 0;
+}
+
+/* struct _root_interval - Used to sort roots by their entry number */
+struct _root_interval {
+    unsigned int entryNum;
+    unsigned int exitNum;
+    pid_t pid;
+};
+
+static int _cmp_root_intervals(const void *p1, const void *p2)
+{
+    unsigned int val1, val2;
+
+    val1 = ((struct _root_interval *)p1)->entryNum;
+    val2 = ((struct _root_interval *)p2)->entryNum;
+
+    return (val1 > val2) - (val1 < val2);
+}
+
+PidTreeRootTable *pid_tree_root_table_create(const PidTreeIntervals *intervals, const pid_t *rootPids, size_t numRootPids)
+{
+    PidTreeRootTable *rootTable;
+    struct _root_interval *roots;
+    ssize_t *stack;
+    size_t numRoots, stackLen;
+    size_t i;
+    ssize_t idx;
+
+    roots = malloc( sizeof(struct _root_interval) * (numRootPids + 1) );
+    numRoots = 0;
+
+    for( i=0; i < numRootPids; i++ )
+    {
+        idx = pid_tree_index_of(intervals->pidTree, rootPids[i]);
+        if ( idx < 0 )
+            continue;
+
+        roots[numRoots].entryNum = intervals->entryNums[idx];
+        roots[numRoots].exitNum = intervals->exitNums[idx];
+        roots[numRoots].pid = rootPids[i];
+        numRoots++;
+    }
+
+    qsort(roots, numRoots, sizeof(struct _root_interval), _cmp_root_intervals);
+
+    rootTable = malloc( sizeof(PidTreeRootTable) );
+    rootTable->intervals = intervals;
+    rootTable->entryNums = malloc( sizeof(unsigned int) * (numRoots + 1) );
+    rootTable->exitNums = malloc( sizeof(unsigned int) * (numRoots + 1) );
+    rootTable->rootPids = malloc( sizeof(pid_t) * (numRoots + 1) );
+    rootTable->enclosingIdxs = malloc( sizeof(ssize_t) * (numRoots + 1) );
+
+    /* Intervals are either nested or disjoint, so with them sorted by start, a stack
+     *   of the ones still open gives each its nearest enclosing interval.
+     */
+    stack = malloc( sizeof(ssize_t) * (numRoots + 1) );
+    stackLen = 0;
+
+    for( i=0, idx=0; i < numRoots; i++ )
+    {
+        /* Skip duplicates */
+        if ( idx > 0 && roots[i].entryNum == rootTable->entryNums[idx - 1] )
+            continue;
+
+        while ( stackLen > 0 && rootTable->exitNums[ stack[stackLen - 1] ] < roots[i].entryNum )
+            stackLen--;
+
+        rootTable->entryNums[idx] = roots[i].entryNum;
+        rootTable->exitNums[idx] = roots[i].exitNum;
+        rootTable->rootPids[idx] = roots[i].pid;
+        rootTable->enclosingIdxs[idx] = stackLen > 0 ? stack[stackLen - 1] : -1;
+
+        stack[stackLen++] = idx;
+        idx++;
+    }
+
+    rootTable->numRoots = (size_t)idx;
+
+    free(stack);
+    free(roots);
+
+    return rootTable;
+}
+
+void pid_tree_root_table_destroy(PidTreeRootTable *rootTable)
+{
+    free(rootTable->entryNums);
+    free(rootTable->exitNums);
+    free(rootTable->rootPids);
+    free(rootTable->enclosingIdxs);
+    free(rootTable);
+}
+
+pid_t pid_tree_root_table_find(const PidTreeRootTable *rootTable, pid_t pid)
+{
+    size_t low, high, mid;
+    ssize_t idx, rootIdx;
+    unsigned int entryNum;
+
+    idx = pid_tree_index_of(rootTable->intervals->pidTree, pid);
+    if ( idx < 0 )
+        return -1;
+
+    entryNum = rootTable->intervals->entryNums[idx];
+
+    /* Find the last root which starts before #pid */
+    low = 0;
+    high = rootTable->numRoots;
+    while ( low < high )
+    {
+        mid = low + ( (high - low) >> 1 );
+
+        if ( rootTable->entryNums[mid] < entryNum )
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    /* If it has already ended, the only roots that can contain #pid are those containing it */
+    for( rootIdx = (ssize_t)low - 1; rootIdx >= 0; rootIdx = rootTable->enclosingIdxs[rootIdx] )
+    {
+        if ( rootTable->exitNums[rootIdx] >= entryNum )
+            return rootTable->rootPids[rootIdx];
+    }
+
+    return 0;
+}
@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * pid_tree.h - Interface definitions for a parent->children index
+ *                over a snapshot of the process table
+ *
+ */
+
+#ifndef _PID_TREE_H
+#define _PID_TREE_H
+
+#include <sys/types.h>
+
+#include "pid_tools.h"
+
+/*******************
+ * DATA TYPES
+ ******************/
+
+/**
+ *   PidTree - An index of pid -> parent pid relations, with the children of
+ *               each pid stored in compressed-sparse-row (CSR) form.
+ *
+ *      The children of pids[i] are the pids at the indexes
+ *         childIdxs[ childOffsets[i] ] through childIdxs[ childOffsets[i + 1] - 1 ]
+ *
+ *      and are stored in ascending pid order.
+ *
+ *      Create with - pid_tree_create
+ *
+ *      Free/Destroy with - pid_tree_destroy
+ */
+typedef struct {
+
+    size_t numPids;
+
+    pid_t *pids;  /* Sorted ascending */
+    pid_t *ppids; /* ppids[i] is the parent pid of pids[i], or 0 if unknown */
+
+    unsigned int *childOffsets; /* numPids + 1 entries */
+    unsigned int *childIdxs;    /* Indexes into #pids */
+
+} PidTree ALIGN_32;
+
+/**
+ *   PidTreeIntervals - Depth-first entry/exit numbers for every pid of a PidTree,
+ *                        which turn "is A an ancestor of B" into two comparisons.
+ *
+ *      Every pid is numbered in the order a depth-first walk of the forest first
+ *        reaches it (#entryNums). #exitNums holds the largest number within its
+ *        subtree, so the descendants of pids[i] are exactly the pids whose entry
+ *        number is in ( entryNums[i], exitNums[i] ].
+ *
+ *      Pids whose parent is not in the tree (or who are their own parent,
+ *        like init when no parent is mapped to 1) start a new tree of the forest.
+ *
+ *      Create with - pid_tree_intervals_create
+ *
+ *      Free/Destroy with - pid_tree_intervals_destroy
+ */
+typedef struct {
+
+    const PidTree *pidTree;
+
+    unsigned int *entryNums; /* entryNums[i] is the entry number of pidTree->pids[i] */
+    unsigned int *exitNums;  /* exitNums[i] is the largest entry number in the subtree of pidTree->pids[i] */
+
+} PidTreeIntervals;
+
+/**
+ *   PidTreeRootTable - A set of root pids, sorted by their depth-first interval,
+ *                        for finding which root (if any) a pid is under.
+ *
+ *      Create with - pid_tree_root_table_create
+ *
+ *      Free/Destroy with - pid_tree_root_table_destroy
+ */
+typedef struct {
+
+    const PidTreeIntervals *intervals;
+
+    size_t numRoots;
+
+    unsigned int *entryNums;  /* Sorted ascending */
+    unsigned int *exitNums;
+    pid_t *rootPids;
+    ssize_t *enclosingIdxs;   /* Index of the nearest root whose interval contains this one, or -1 */
+
+} PidTreeRootTable;
+
+
+/*******************
+ * MACROS
+ ******************/
+
+#define PID_TREE_NUM_PIDS(pidTree) ((pidTree)->numPids)
+
+/* PID_TREE_NUM_CHILDREN - Number of direct children of the pid at index #idx */
+#define PID_TREE_NUM_CHILDREN(pidTree, idx) ( (pidTree)->childOffsets[(idx) + 1] - (pidTree)->childOffsets[(idx)] )
+
+/* PID_TREE_IS_ANCESTOR_IDX - Non-zero if the pid at index #ancestorIdx is a parent (of any level)
+ *   of the pid at index #idx. A pid is not its own ancestor.
+ */
+#define PID_TREE_IS_ANCESTOR_IDX(intervals, ancestorIdx, idx) \
+    ( (intervals)->entryNums[(idx)] > (intervals)->entryNums[(ancestorIdx)] && \
+      (intervals)->entryNums[(idx)] <= (intervals)->exitNums[(ancestorIdx)] )
+
+
+/*******************
+ * PUBLIC FUNCTIONS
+ ******************/
+
+/**
+ *    pid_tree_create - Build a parent->children index from a list of pids and their parents
+ *
+ *          @param pids <pid_t *> - An allocated array of pids. Should be sorted ascending
+ *                      (as returned by reading /proc), otherwise it will be sorted here.
+ *
+ *          @param ppids <pid_t *> - An allocated array where ppids[i] is the parent of pids[i].
+ *                      Use 0 for a pid whose parent could not be determined.
+ *
+ *          @param numPids <size_t> - Number of elements in #pids and #ppids
+ *
+ *          @return - Pointer to an allocated PidTree ready to use
+ *
+ *              The PidTree takes ownership of #pids and #ppids, which will be freed by pid_tree_destroy
+ */
+PidTree *pid_tree_create(pid_t *pids, pid_t *ppids, size_t numPids);
+
+/**
+ *    pid_tree_destroy - Deallocate a PidTree including all referenced memory
+ *
+ *          @param pidTree <PidTree *> - Pointer to the tree to free
+ */
+void pid_tree_destroy(PidTree *pidTree);
+
+/**
+ *    pid_tree_index_of - Find the index of a pid within the tree
+ *
+ *          @param pidTree <PidTree *> - Pointer to the tree to search
+ *
+ *          @param pid <pid_t> - Pid to search for
+ *
+ *          @return <ssize_t> - Index of #pid in pidTree->pids, or -1 if not present
+ */
+ssize_t pid_tree_index_of(const PidTree *pidTree, pid_t pid);
+
+/**
+ *    pid_tree_get_children - Get the children of one or more pids
+ *
+ *          @param pidTree <PidTree *> - Pointer to the tree to search
+ *
+ *          @param rootPids <const pid_t *> - The pids whose children to collect
+ *
+ *          @param numRootPids <size_t> - Number of elements in #rootPids
+ *
+ *          @param isRecursive <int> - If 0, only direct children are collected.
+ *                      Otherwise, children of children (and so on) are collected as well.
+ *
+ *          @param retLen <size_t *> - The size of the returned list will be stored here
+ *
+ *          @return <pid_t *> - A sorted list of the unique matched pids, or NULL if none matched.
+ *
+ *              You are responsible for freeing this list
+ */
+pid_t *pid_tree_get_children(PidTree *pidTree, const pid_t *rootPids, size_t numRootPids, int isRecursive, size_t *retLen);
+
+/**
+ *    pid_tree_intervals_create - Number every pid of a tree by a depth-first walk,
+ *                                  for constant-time ancestor checks
+ *
+ *          @param pidTree <const PidTree *> - The tree. Must outlive the returned intervals
+ *
+ *          @return <PidTreeIntervals *> - Allocated intervals. Free with pid_tree_intervals_destroy
+ */
+PidTreeIntervals *pid_tree_intervals_create(const PidTree *pidTree);
+
+/**
+ *    pid_tree_intervals_destroy - Free intervals made by pid_tree_intervals_create
+ *
+ *          @param intervals <PidTreeIntervals *> - The intervals. The tree itself is not freed
+ */
+void pid_tree_intervals_destroy(PidTreeIntervals *intervals);
+
+/**
+ *    pid_tree_intervals_is_ancestor - Check if a pid is a parent (of any level) of another
+ *
+ *          @param intervals <const PidTreeIntervals *> - Intervals of the tree
+ *
+ *          @param ancestorPid <pid_t> - The possible parent, grandparent, etc.
+ *
+ *          @param pid <pid_t> - The pid to check
+ *
+ *          @return <int> - 1 if #ancestorPid is an ancestor of #pid, 0 if not,
+ *                      -1 if either pid is not in the tree
+ */
+int pid_tree_intervals_is_ancestor(const PidTreeIntervals *intervals, pid_t ancestorPid, pid_t pid);
+
+/**
+ *    pid_tree_root_table_create - Build a table for finding which of a set of roots a pid is under
+ *
+ *          @param intervals <const PidTreeIntervals *> - Intervals of the tree. Must outlive the table
+ *
+ *          @param rootPids <const pid_t *> - The roots. Those not in the tree are ignored
+ *
+ *          @param numRootPids <size_t> - Number of elements in #rootPids
+ *
+ *          @return <PidTreeRootTable *> - Allocated table. Free with pid_tree_root_table_destroy
+ */
+PidTreeRootTable *pid_tree_root_table_create(const PidTreeIntervals *intervals, const pid_t *rootPids, size_t numRootPids);
+
+/**
+ *    pid_tree_root_table_destroy - Free a table made by pid_tree_root_table_create
+ *
+ *          @param rootTable <PidTreeRootTable *> - The table
+ */
+void pid_tree_root_table_destroy(PidTreeRootTable *rootTable);
+
+/**
+ *    pid_tree_root_table_find - Find the root a pid is under, with a binary search of the table
+ *
+ *          @param rootTable <const PidTreeRootTable *> - The table
+ *
+ *          @param pid <pid_t> - The pid
+ *
+ *          @return <pid_t> - The nearest root which is an ancestor of #pid (when roots are nested,
+ *                      the innermost one), 0 if it is under none of them, or -1 if #pid is not in the tree
+ */
+pid_t pid_tree_root_table_find(const PidTreeRootTable *rootTable, pid_t pid);
+
+
+#endif
@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * pid_waiter.c - Interface implementations for waiting on the exit of many
+ *                  processes which are not (necessarily) our children
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+
+#include "pid_tools.h"
+
+#include "pid_waiter.h"
+#include "pid_ident.h"
+#include "proc_pidfd.h"
+
+
+/* PID_WAITER_INITIAL_CAPACITY - Starting number of slots, if the size hint is smaller */
+#define PID_WAITER_INITIAL_CAPACITY 64
+
+/* PID_WAITER_MAX_EVENTS - Most exits collected by one epoll_wait */
+#define PID_WAITER_MAX_EVENTS 256
+
+/* PID_WAITER_FD_LIMIT_SLACK - Descriptors beyond one per pid to allow for when raising the limit */
+#define PID_WAITER_FD_LIMIT_SLACK 64
+
+
+/**
+ * _pid_waiter_now_ms - Milliseconds of CLOCK_MONOTONIC
+ */
+static inline long long _pid_waiter_now_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * _pid_waiter_alloc_slot - Take a free slot, growing the arrays if there are none
+ *
+ *    @return <size_t> - Index of the slot
+ */
+static size_t _pid_waiter_alloc_slot(PidWaiter *waiter)
+{
+    if ( waiter->numFree > 0 )
+        return waiter->freeSlots[ --waiter->numFree ];
+
+    if ( unlikely( waiter->numEntries == waiter->capacity ) )
+    {
+        waiter->capacity *= 2;
+        waiter->entries = realloc(waiter->entries, sizeof(struct PidWaiterEntry) * waiter->capacity);
+        waiter->freeSlots = realloc(waiter->freeSlots, sizeof(size_t) * waiter->capacity);
+        waiter->polled = realloc(waiter->polled, sizeof(size_t) * waiter->capacity);
+    }
+
+    return waiter->numEntries++;
+}
+
+/**
+ * _pid_waiter_release - Mark the pid in a slot as exited, and free the slot
+ *
+ *    @return <pid_t> - The pid which was in the slot
+ */
+static pid_t _pid_waiter_release(PidWaiter *waiter, size_t slot)
+{
+    struct PidWaiterEntry *entry = &waiter->entries[slot];
+    pid_t pid = entry->ident.pid;
+
+    /* Closing the (only) descriptor also removes it from the epoll set */
+    if ( entry->pidFd >= 0 )
+        close(entry->pidFd);
+
+    entry->ident.pid = 0;
+    entry->pidFd = -1;
+
+    waiter->freeSlots[ waiter->numFree++ ] = slot;
+    waiter->numRunning--;
+
+    return pid;
+}
+
+/**
+ * _pid_waiter_check_polled - Check the identity of every polled pid, and collect those which are gone
+ *
+ *    @return <size_t> - Number of pids placed in #exitedOut
+ */
+static size_t _pid_waiter_check_polled(PidWaiter *waiter, pid_t *exitedOut, size_t maxExited)
+{
+    struct PidWaiterEntry *entry;
+    size_t numExited = 0;
+    size_t i = 0;
+
+    while ( i < waiter->numPolled && numExited < maxExited )
+    {
+        entry = &waiter->entries[ waiter->polled[i] ];
+
+        if ( pid_ident_check(&entry->ident) == PID_IDENT_OK )
+        {
+            i++;
+            continue;
+        }
+
+        /* Gone, or the pid is now another process. Order of the polled list doesn't matter */
+        exitedOut[numExited++] = _pid_waiter_release(waiter, waiter->polled[i]);
+        waiter->polled[i] = waiter->polled[ --waiter->numPolled ];
+    }
+
+    return numExited;
+}
+
+PidWaiter *pid_waiter_create(size_t sizeHint)
+{
+    PidWaiter *waiter;
+    int epollFd;
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if ( unlikely( epollFd < 0 ) )
+        return NULL;
+
+    proc_pidfd_raise_fd_limit( sizeHint + PID_WAITER_FD_LIMIT_SLACK );
+
+    if ( sizeHint < PID_WAITER_INITIAL_CAPACITY )
+        sizeHint = PID_WAITER_INITIAL_CAPACITY;
+
+    waiter = malloc( sizeof(PidWaiter) );
+
+    waiter->epollFd = epollFd;
+    waiter->noPidFds = 0;
+
+    waiter->capacity = sizeHint;
+    waiter->entries = malloc( sizeof(struct PidWaiterEntry) * sizeHint );
+    waiter->numEntries = 0;
+
+    waiter->freeSlots = malloc( sizeof(size_t) * sizeHint );
+    waiter->numFree = 0;
+
+    waiter->polled = malloc( sizeof(size_t) * sizeHint );
+    waiter->numPolled = 0;
+
+    waiter->numRunning = 0;
+
+    return waiter;
+}
+
+void pid_waiter_destroy(PidWaiter *waiter)
+{
+    size_t i;
+
+    for( i=0; i < waiter->numEntries; i++ )
+    {
+        if ( waiter->entries[i].pidFd >= 0 )
+            close(waiter->entries[i].pidFd);
+    }
+
+    close(waiter->epollFd);
+
+    free(waiter->polled);
+    free(waiter->freeSlots);
+    free(waiter->entries);
+    free(waiter);
+}
+
+int pid_waiter_add(PidWaiter *waiter, pid_t pid)
+{
+    struct PidWaiterEntry *entry;
+    struct epoll_event event;
+    PidIdent ident;
+    size_t slot;
+    int pidFd = -1;
+
+    /* Straight from /proc, as pidtreed's table may still list a pid which just exited */
+    if ( pid_ident_read(pid, &ident, NULL) != PID_IDENT_OK )
+    {
+        errno = ESRCH;
+        return -1;
+    }
+
+    if ( ! waiter->noPidFds )
+    {
+        pidFd = proc_pidfd_open(pid);
+        if ( pidFd < 0 )
+        {
+            if ( errno == ENOSYS )
+                waiter->noPidFds = 1;
+        }
+        else if ( unlikely( pid_ident_check(&ident) != PID_IDENT_OK ) )
+        {
+            /* The pid was reused in between, so this pidfd is for a new process.
+             *   Leave it to polling, which will report the one we want as gone.
+             */
+            close(pidFd);
+            pidFd = -1;
+        }
+    }
+
+    slot = _pid_waiter_alloc_slot(waiter);
+    entry = &waiter->entries[slot];
+
+    entry->ident = ident;
+    entry->pidFd = pidFd;
+
+    if ( pidFd >= 0 )
+    {
+        event.events = EPOLLIN;
+        event.data.u64 = slot;
+        if ( unlikely( epoll_ctl(waiter->epollFd, EPOLL_CTL_ADD, pidFd, &event) != 0 ) )
+        {
+            close(pidFd);
+            entry->pidFd = -1;
+        }
+    }
+
+    /* No pidfd (no kernel support, a thread id, out of descriptors) - poll it instead */
+    if ( entry->pidFd < 0 )
+        waiter->polled[ waiter->numPolled++ ] = slot;
+
+    waiter->numRunning++;
+
+    return 0;
+}
+
+ssize_t pid_waiter_wait(PidWaiter *waiter, pid_t *exitedOut, size_t maxExited, int timeoutMs)
+{
+    struct epoll_event events[PID_WAITER_MAX_EVENTS];
+    long long deadline = 0;
+    long long remaining;
+    int waitMs;
+    int maxEvents;
+    int numEvents;
+    int i;
+    size_t numExited;
+
+    if ( waiter->numRunning == 0 || maxExited == 0 )
+        return 0;
+
+    if ( timeoutMs >= 0 )
+        deadline = _pid_waiter_now_ms() + timeoutMs;
+
+    maxEvents = maxExited < PID_WAITER_MAX_EVENTS ? (int)maxExited : PID_WAITER_MAX_EVENTS;
+
+    while ( 1 )
+    {
+        waitMs = timeoutMs;
+        if ( timeoutMs >= 0 )
+        {
+            remaining = deadline - _pid_waiter_now_ms();
+            waitMs = remaining > 0 ? (int)remaining : 0;
+        }
+
+        if ( waiter->numPolled > 0 && ( waitMs < 0 || waitMs > PID_WAITER_POLL_MS ) )
+            waitMs = PID_WAITER_POLL_MS;
+
+        numEvents = epoll_wait(waiter->epollFd, events, maxEvents, waitMs);
+        if ( unlikely( numEvents < 0 ) )
+        {
+            if ( errno != EINTR )
+                return -1;
+
+            numEvents = 0;
+        }
+
+        numExited = 0;
+        for( i=0; i < numEvents; i++ )
+            exitedOut[numExited++] = _pid_waiter_release(waiter, (size_t)events[i].data.u64);
+
+        if ( waiter->numPolled > 0 )
+            numExited += _pid_waiter_check_polled(waiter, &exitedOut[numExited], maxExited - numExited);
+
+        if ( numExited > 0 )
+            return (ssize_t)numExited;
+
+        if ( timeoutMs >= 0 && _pid_waiter_now_ms() >= deadline )
+            return 0;
+    }
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * pid_waiter.h - Interface definitions for waiting on the exit of many
+ *                  processes which are not (necessarily) our children
+ *
+ *   Each pid gets a pidfd (Linux 5.3+) in one epoll set, so a wait costs
+ *     nothing until something exits, and then only the pids which exited
+ *     are touched. Pids which cannot get a pidfd (older kernels, thread ids,
+ *     or out of descriptors) are polled instead, by their PidIdent (pid_ident.h),
+ *     so a pid reused by a new process is still seen to have exited.
+ */
+
+#ifndef _PID_WAITER_H
+#define _PID_WAITER_H
+
+#include <sys/types.h>
+
+#include "pid_tools.h"
+#include "pid_ident.h"
+
+/*******************
+ * DATA TYPES
+ ******************/
+
+/**
+ *   struct PidWaiterEntry - One pid being waited on.
+ *          You should not need to reference this directly.
+ */
+struct PidWaiterEntry {
+    PidIdent ident; /* ident.pid is 0 if this slot is free */
+    int pidFd;      /* -1 if this pid is polled */
+};
+
+/**
+ *   PidWaiter - A set of pids to wait on.
+ *
+ *      Pids may be added at any time, including between waits.
+ *
+ *      Create with - pid_waiter_create
+ *
+ *      Free/Destroy with - pid_waiter_destroy
+ */
+typedef struct {
+
+    int epollFd;
+    int noPidFds;       /* 1 once pidfd_open has failed with ENOSYS */
+
+    struct PidWaiterEntry *entries;
+    size_t numEntries;  /* Slots used at the end of #entries (some may be free) */
+    size_t capacity;
+
+    size_t *freeSlots;  /* Indexes of free slots below #numEntries */
+    size_t numFree;
+
+    size_t *polled;     /* Indexes of the entries without a pidfd */
+    size_t numPolled;
+
+    size_t numRunning;
+
+} PidWaiter;
+
+
+/*******************
+ * MACROS
+ ******************/
+
+/* PID_WAITER_POLL_MS - How often pids without a pidfd are checked, in milliseconds */
+#define PID_WAITER_POLL_MS 10
+
+/* PID_WAITER_NUM_RUNNING - Number of pids added which have not yet been returned as exited */
+#define PID_WAITER_NUM_RUNNING(waiter) ((waiter)->numRunning)
+
+/* PID_WAITER_FD - The epoll descriptor, which is readable when a pid with a pidfd has exited.
+ *   For waiting on other descriptors too (poll it with them, then pid_waiter_wait with timeout 0)
+ */
+#define PID_WAITER_FD(waiter) ((waiter)->epollFd)
+
+/* PID_WAITER_NUM_POLLED - Number of those which are being polled, rather than waited on with a pidfd */
+#define PID_WAITER_NUM_POLLED(waiter) ((waiter)->numPolled)
+
+
+/*******************
+ * PUBLIC FUNCTIONS
+ ******************/
+
+/**
+ *    pid_waiter_create - Allocate an empty PidWaiter
+ *
+ *          @param sizeHint <size_t> - Expected number of pids. The limit of open files
+ *                          is raised (as far as allowed) to hold a pidfd for each
+ *
+ *          @return - Pointer to an allocated PidWaiter ready to use, or NULL if
+ *                      epoll is unavailable (errno is set)
+ *
+ *              This must be freed using pid_waiter_destroy
+ */
+PidWaiter *pid_waiter_create(size_t sizeHint);
+
+/**
+ *    pid_waiter_destroy - Free a PidWaiter, and close every pidfd
+ *
+ *          @param waiter <PidWaiter *> - The waiter
+ */
+void pid_waiter_destroy(PidWaiter *waiter);
+
+/**
+ *    pid_waiter_add - Start waiting on a pid
+ *
+ *          @param waiter <PidWaiter *> - The waiter
+ *
+ *          @param pid <pid_t> - The pid, which must be running now
+ *
+ *          @return <int> - 0 on success, or -1 if #pid is not running (errno is ESRCH)
+ */
+int pid_waiter_add(PidWaiter *waiter, pid_t pid);
+
+/**
+ *    pid_waiter_wait - Wait for one or more of the pids to exit
+ *
+ *          Each pid is returned exactly once. A pid which is reused by a new
+ *            process after its exit is still returned.
+ *
+ *          @param waiter <PidWaiter *> - The waiter
+ *
+ *          @param exitedOut <pid_t *> - Array which will hold the pids which exited
+ *
+ *          @param maxExited <size_t> - Size of #exitedOut
+ *
+ *          @param timeoutMs <int> - Max milliseconds to wait, or -1 to wait until one exits
+ *
+ *          @return <ssize_t> - Number of pids placed in #exitedOut (0 on timeout,
+ *                      or right away if none are running), or -1 on error (errno is set)
+ */
+ssize_t pid_waiter_wait(PidWaiter *waiter, pid_t *exitedOut, size_t maxExited, int timeoutMs);
+
+
+#endif
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * pidsnap.c - "main" for "pidsnap" application -
+ *   Writes a binary snapshot of the process table (see pid_snapshot.h),
+ *   which "getcpids --snapshot" can query later, or lists one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "pid_tools.h"
+#include "pid_utils.h"
+
+#include "pid_snapshot.h"
+
+const volatile char *copyright = "pidsnap - Copyright (c) 2018 Tim Savannah.";
+
+static inline void usage()
+{
+    fputs("Usage: pidsnap (Options) [file]\n", stderr);
+    fputs("  Writes a snapshot of every process on the system (pid, ppid, start time, uid, name) to a file.\n", stderr);
+    fputs("  Query it later with \"getcpids --snapshot [file]\".\n\n", stderr);
+    fputs("    Options:\n\t\t-j [num]\tNumber of threads to use when scanning /proc. Default is number of online cpus.\n", stderr);
+    fputs("\t\t--list\t\tInstead of writing [file], print the contents of an existing snapshot.\n\n", stderr);
+}
+
+/**
+ * list_snapshot - Print every entry of a snapshot, one per line
+ *
+ *      @return <int> - Exit code for main
+ */
+static int list_snapshot(const char *path)
+{
+    PidSnapshot *snapshot;
+    time_t createTime;
+    size_t i;
+
+    snapshot = pid_snapshot_open(path);
+    if ( snapshot == NULL )
+    {
+        fprintf(stderr, "Cannot open snapshot '%s'. Error %d: %s\n", path, errno, strerror(errno));
+        return 1;
+    }
+
+    createTime = (time_t)snapshot->header->createTime;
+    printf("# Host: %s  Taken: %s", snapshot->header->hostname, ctime(&createTime));
+    printf("# %zu processes\n", PID_SNAPSHOT_NUM_ENTRIES(snapshot));
+    printf("#%9s %10s %10s %20s  %s\n", "PID", "PPID", "UID", "STARTTIME", "COMM");
+
+    for( i=0; i < PID_SNAPSHOT_NUM_ENTRIES(snapshot); i++ )
+    {
+        printf("%10d %10d %10u %20llu  %s\n", (int)snapshot->pids[i], (int)snapshot->ppids[i], snapshot->uids[i],
+            (unsigned long long)snapshot->startTimes[i], PID_SNAPSHOT_COMM(snapshot, i));
+    }
+
+    pid_snapshot_close(snapshot);
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    PidSnapshotEntry *entries;
+    size_t numEntries;
+    const char *path = NULL;
+    char *numThreadsStr;
+    int numThreads = 0;
+    int isListMode = 0;
+    int i;
+
+    for( i=1; i < argc; i++ )
+    {
+        if ( strcmp("--help", argv[i]) == 0 )
+        {
+            usage();
+            return 0;
+        }
+
+        if ( strcmp("--version", argv[i]) == 0 )
+        {
+            fprintf(stderr, "\npidsnap version %s by Timothy Savannah\n\n", PID_TOOLS_VERSION);
+            return 0;
+        }
+
+        if ( strcmp("--list", argv[i]) == 0 )
+        {
+            isListMode = 1;
+            continue;
+        }
+
+        if ( argv[i][0] == '-' && argv[i][1] == 'j' )
+        {
+            /* Accept both "-j N" and "-jN" */
+            if ( argv[i][2] != '\0' )
+                numThreadsStr = &argv[i][2];
+            else if ( i + 1 < argc )
+                numThreadsStr = argv[++i];
+            else
+                numThreadsStr = "";
+
+            numThreads = strtoint(numThreadsStr);
+            if ( numThreads <= 0 )
+            {
+                fprintf(stderr, "Invalid number of threads: '%s'\n", numThreadsStr);
+                return 1;
+            }
+            continue;
+        }
+
+        if ( path != NULL )
+        {
+            fprintf(stderr, "Unexpected argument: %s\n\n", argv[i]);
+            usage();
+            return 1;
+        }
+
+        path = argv[i];
+    }
+
+    if ( path == NULL )
+    {
+        fputs("Missing snapshot file.\n\n", stderr);
+        usage();
+        return 1;
+    }
+
+    if ( isListMode )
+        return list_snapshot(path);
+
+    entries = pid_snapshot_read_live(numThreads, &numEntries);
+    if ( entries == NULL )
+    {
+        fprintf(stderr, "Failed to list /proc. Error %d: %s\n", errno, strerror(errno));
+        return 1;
+    }
+
+    if ( pid_snapshot_write(path, entries, numEntries) != 0 )
+    {
+        fprintf(stderr, "Failed to write snapshot '%s'. Error %d: %s\n", path, errno, strerror(errno));
+        free(entries);
+        return 1;
+    }
+
+    free(entries);
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * pidtools.c - "main" for the "pidtools" multicall application -
+ *  Every tool in one executable, which runs the tool it is named as
+ *  (through a symlink, e.x. getppid -> pidtools), or the tool given
+ *  as the first argument (e.x. "pidtools getppid 1234").
+ *
+ *  Each tool is compiled with PIDTOOLS_MULTICALL defined and its main
+ *    renamed to [tool]_main (see the Makefile).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pid_tools.h"
+
+const volatile char *copyright = "pidtools - Copyright (c) 2018 Tim Savannah.";
+
+/* pidtools_main_func - Signature of every tool's (renamed) main */
+typedef int (*pidtools_main_func)(int argc, char* argv[]);
+
+int getppid_main(int argc, char* argv[]);
+int getcpids_main(int argc, char* argv[]);
+int isaparentof_main(int argc, char* argv[]);
+int isachildof_main(int argc, char* argv[]);
+int getpcmd_main(int argc, char* argv[]);
+int waitpid_main(int argc, char* argv[]);
+int getpenv_main(int argc, char* argv[]);
+int getpmem_main(int argc, char* argv[]);
+
+/**
+ * struct pidtools_applet - A tool within the multicall binary
+ */
+struct pidtools_applet {
+    const char *name;
+    pidtools_main_func mainFunc;
+};
+
+static const struct pidtools_applet APPLETS[] = {
+    { "getppid", getppid_main },
+    { "getcpids", getcpids_main },
+    { "isaparentof", isaparentof_main },
+    { "isachildof", isachildof_main },
+    { "getpcmd", getpcmd_main },
+    { "waitpid", waitpid_main },
+    { "getpenv", getpenv_main },
+    { "getpmem", getpmem_main },
+};
+
+#define NUM_APPLETS ( sizeof(APPLETS) / sizeof(APPLETS[0]) )
+
+
+/*
+ * usage - print usage/help to stderr
+ */
+static inline void usage()
+{
+    unsigned int i;
+
+    fputs("Usage: pidtools [tool] (Tool arguments)\n", stderr);
+    fputs("  Runs one of the pid-tools. When run through a link named as one of\n", stderr);
+    fputs("  the tools (e.x. getppid -> pidtools), runs that tool.\n\n", stderr);
+    fputs("  Tools:\n", stderr);
+    for( i=0; i < NUM_APPLETS; i++ )
+        fprintf(stderr, "     %s\n", APPLETS[i].name);
+    fputs("\n  Options:\n\n     --list               Print the name of every tool, one per line\n\n", stderr);
+}
+
+/**
+ * find_applet - Find a tool by name
+ *
+ *      @param name <const char *> - The name, which may be a path (e.x. /usr/bin/getppid)
+ *
+ *      @return <const struct pidtools_applet *> - The tool, or NULL if there is none by that name
+ */
+static const struct pidtools_applet *find_applet(const char *name)
+{
+    const char *baseName;
+    unsigned int i;
+
+    baseName = strrchr(name, '/');
+    baseName = baseName != NULL ? baseName + 1 : name;
+
+    for( i=0; i < NUM_APPLETS; i++ )
+    {
+        if ( strcmp(baseName, APPLETS[i].name) == 0 )
+            return &APPLETS[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * main - Runs the tool named by argv[0], or by the first argument
+ */
+int main(int argc, char* argv[])
+{
+    const struct pidtools_applet *applet;
+    unsigned int i;
+
+    applet = find_applet(argv[0]);
+    if ( applet != NULL )
+        return applet->mainFunc(argc, argv);
+
+    if ( argc < 2 )
+    {
+        usage();
+        return 1;
+    }
+
+    if ( strcmp("--help", argv[1]) == 0 || strcmp("-h", argv[1]) == 0 )
+    {
+        usage();
+        return 0;
+    }
+
+    if ( strcmp("--version", argv[1]) == 0 )
+    {
+        fprintf(stderr, "\npidtools version %s by Timothy Savannah\n\n", PID_TOOLS_VERSION);
+        return 0;
+    }
+
+    if ( strcmp("--list", argv[1]) == 0 )
+    {
+        for( i=0; i < NUM_APPLETS; i++ )
+            puts(APPLETS[i].name);
+        return 0;
+    }
+
+    /* Only a bare name as a subcommand, so "pidtools /x/getppid" is not a getppid */
+    applet = strchr(argv[1], '/') == NULL ? find_applet(argv[1]) : NULL;
+    if ( applet == NULL )
+    {
+        fprintf(stderr, "Unknown tool: '%s'\n\n", argv[1]);
+        usage();
+        return 1;
+    }
+
+    return applet->mainFunc(argc - 1, argv + 1);
+}
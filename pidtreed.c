@@ -0,0 +1,564 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * pidtreed.c - "main" for "pidtreed" application -
+ *   Keeps an up-to-date process table (pid, ppid, start time, comm) in shared memory,
+ *   which getppid, getcpids, isachildof and isaparentof read instead of scanning /proc.
+ *
+ *   See pidtreed_shm.h for the layout and the client side.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+#include "pid_tools.h"
+
+#include "proc_handle.h"
+#include "proc_stat.h"
+#include "proc_pids.h"
+#include "proc_scan.h"
+#include "proc_events.h"
+#include "simple_int_map.h"
+#include "pid_bitset.h"
+#include "pidtreed_shm.h"
+
+const volatile char *copyright = "pidtreed - Copyright (c) 2018 Tim Savannah.";
+
+static inline void usage()
+{
+    fputs("Usage: pidtreed\n", stderr);
+    fputs("  Keeps a table of all processes in shared memory, which the other pid-tools\n", stderr);
+    fputs("  (getppid, getcpids, isachildof, isaparentof) use instead of scanning /proc.\n\n", stderr);
+    fputs("  Runs in the foreground until sent SIGTERM or SIGINT. Start it from your init system.\n\n", stderr);
+    fputs("  The table is kept current from the kernel's process events when running as root,\n", stderr);
+    fputs("  otherwise by rescanning /proc every 250ms. A rescanned table can lag behind,\n", stderr);
+    fputs("  so the tools ignore it and read /proc themselves.\n\n", stderr);
+    fputs("  Environment:\n", stderr);
+    fputs("\t\tPIDTREED_SHM\tPath of the table. Default is " PIDTREED_SHM_DEFAULT_PATH ".\n", stderr);
+    fputs("\t\t\t\t  Must be the same for the daemon and the tools.\n", stderr);
+    fputs("\t\tPIDTREED_DISABLE\tIf set to 1, the tools ignore the table and always read /proc.\n\n", stderr);
+}
+
+/* PIDTREED_MAX_EVENTS - Max number of events to handle in one batch */
+#define PIDTREED_MAX_EVENTS 1024
+
+/* PIDTREED_LOCK_MAX_TRIES - Give up replacing someone else's lock file after this many tries */
+#define PIDTREED_LOCK_MAX_TRIES 8
+
+static volatile sig_atomic_t keepRunning = 1;
+
+static void handle_stop_signal(int signum)
+{
+    keepRunning = 0;
+}
+
+
+/**
+ * read_stat_entry - Read a process's table entry from /proc/$PID/stat
+ *
+ *      @param pid <pid_t> - The pid
+ *
+ *      @param entry <PidTreedEntry *> - Entry to fill in
+ *
+ *      @return <int> - 0 on success, -1 if the process is gone
+ */
+static int read_stat_entry(pid_t pid, PidTreedEntry *entry)
+{
+    ProcStat stat;
+
+    if ( proc_stat_read(pid, PROC_STAT_FIELD_PPID | PROC_STAT_FIELD_STARTTIME | PROC_STAT_FIELD_COMM, &stat) != 0 )
+        return -1;
+
+    memset(entry, 0, sizeof(PidTreedEntry));
+    entry->pid = pid;
+    entry->ppid = stat.ppid;
+    entry->startTime = stat.startTime;
+    strncpy(entry->comm, stat.comm, PIDTREED_COMM_SIZE - 1);
+
+    return 0;
+}
+
+/**
+ * scan_stat_entry - proc_scan_func which reads the table entry of #pid into #result.
+ *                     The entry's pid is 0 if the process is gone.
+ */
+static void scan_stat_entry(pid_t pid, void *result, void *threadBuffer)
+{
+    if ( read_stat_entry(pid, (PidTreedEntry *)result) != 0 )
+        ((PidTreedEntry *)result)->pid = 0;
+}
+
+
+/*
+ * Table updates. Only the daemon writes, and every change is made between
+ *   table_write_begin and table_write_end, so readers can detect it.
+ */
+
+static inline void table_write_begin(PidTreedHeader *table)
+{
+    table->seq++;
+    __sync_synchronize();
+}
+
+static inline void table_write_end(PidTreedHeader *table)
+{
+    __sync_synchronize();
+    table->seq++;
+    table->updateTimeNs = pidtreed_now_ns();
+}
+
+/**
+ * table_lower_bound - Get the index of the first entry with pid >= #pid
+ */
+static uint32_t table_lower_bound(PidTreedHeader *table, pid_t pid)
+{
+    uint32_t low, high, mid;
+
+    low = 0;
+    high = table->numEntries;
+
+    while ( low < high )
+    {
+        mid = low + ( (high - low) >> 1 );
+        if ( table->entries[mid].pid < pid )
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+/**
+ * table_set_entry - Add an entry, or replace the existing entry with the same pid
+ */
+static void table_set_entry(PidTreedHeader *table, const PidTreedEntry *entry)
+{
+    uint32_t idx;
+
+    idx = table_lower_bound(table, entry->pid);
+    if ( idx < table->numEntries && table->entries[idx].pid == entry->pid )
+    {
+        memcpy(&table->entries[idx], entry, sizeof(PidTreedEntry));
+        return;
+    }
+
+    if ( unlikely( table->numEntries >= table->capacity ) )
+        return;
+
+    memmove(&table->entries[idx + 1], &table->entries[idx], sizeof(PidTreedEntry) * (table->numEntries - idx));
+    memcpy(&table->entries[idx], entry, sizeof(PidTreedEntry));
+    table->numEntries++;
+}
+
+/**
+ * table_remove_entry - Remove the entry for #pid, if present
+ */
+static void table_remove_entry(PidTreedHeader *table, pid_t pid)
+{
+    uint32_t idx;
+
+    idx = table_lower_bound(table, pid);
+    if ( idx >= table->numEntries || table->entries[idx].pid != pid )
+        return;
+
+    memmove(&table->entries[idx], &table->entries[idx + 1], sizeof(PidTreedEntry) * (table->numEntries - idx - 1));
+    table->numEntries--;
+}
+
+/**
+ * table_rescan - Replace the whole table with a fresh scan of /proc
+ *
+ *      @return <int> - 0 on success, -1 if /proc could not be listed
+ */
+static int table_rescan(PidTreedHeader *table)
+{
+    pid_t *pids;
+    size_t numPids;
+    PidTreedEntry *entries;
+    size_t i, numEntries;
+
+    pids = proc_pids_get_all(&numPids);
+    if ( unlikely( pids == NULL ) )
+        return -1;
+
+    entries = malloc( sizeof(PidTreedEntry) * (numPids + 1) );
+    proc_scan_run(pids, numPids, entries, sizeof(PidTreedEntry), scan_stat_entry, 0, 0);
+    free(pids);
+
+    /* Drop any which exited during the scan. Order (sorted by pid) is kept. */
+    numEntries = 0;
+    for( i=0; i < numPids; i++ )
+    {
+        if ( entries[i].pid == 0 )
+            continue;
+        if ( numEntries != i )
+            memcpy(&entries[numEntries], &entries[i], sizeof(PidTreedEntry));
+        numEntries++;
+    }
+
+    if ( numEntries > table->capacity )
+        numEntries = table->capacity;
+
+    table_write_begin(table);
+
+    memcpy(table->entries, entries, sizeof(PidTreedEntry) * numEntries);
+    table->numEntries = numEntries;
+
+    table_write_end(table);
+
+    free(entries);
+
+    return 0;
+}
+
+/**
+ * table_apply_events - Apply a batch of process events to the table
+ *
+ *      Everything is read from /proc first, then all the changes are made
+ *        in a single write, so readers wait as little as possible.
+ */
+static void table_apply_events(PidTreedHeader *table, const ProcEvent *events, int numEvents)
+{
+    static PidTreedEntry *newEntries = NULL;
+    static char *hasNewEntry = NULL;
+    static PidTreedEntry *reparented = NULL;
+
+    SimpleIntMap *exitedMap = NULL;
+    size_t numReparented;
+    uint32_t i;
+
+    if ( unlikely( newEntries == NULL ) )
+    {
+        newEntries = malloc( sizeof(PidTreedEntry) * PIDTREED_MAX_EVENTS );
+        hasNewEntry = malloc( PIDTREED_MAX_EVENTS );
+    }
+
+    for( i=0; i < (uint32_t)numEvents; i++ )
+    {
+        hasNewEntry[i] = 0;
+
+        switch( events[i].eventType )
+        {
+            case PROC_EVENT_TYPE_FORK:
+            case PROC_EVENT_TYPE_EXEC:
+                /* Fails if the process already exited, then its exit event follows */
+                if ( read_stat_entry(events[i].pid, &newEntries[i]) == 0 )
+                    hasNewEntry[i] = 1;
+                break;
+            case PROC_EVENT_TYPE_EXIT:
+                if ( exitedMap == NULL )
+                    exitedMap = simple_int_map_create(100);
+                simple_int_map_add(exitedMap, events[i].pid);
+                break;
+        }
+    }
+
+    /* The kernel gives the children of an exited process a new parent, without an event.
+     *   Find those and read their new parent.
+     */
+    numReparented = 0;
+    if ( exitedMap != NULL )
+    {
+        for( i=0; i < table->numEntries; i++ )
+        {
+            if ( ! simple_int_map_contains(exitedMap, table->entries[i].ppid) )
+                continue;
+
+            if ( unlikely( reparented == NULL ) )
+                reparented = malloc( sizeof(PidTreedEntry) * table->capacity );
+
+            if ( read_stat_entry(table->entries[i].pid, &reparented[numReparented]) == 0 )
+                numReparented++;
+        }
+    }
+
+    table_write_begin(table);
+
+    for( i=0; i < (uint32_t)numEvents; i++ )
+    {
+        if ( hasNewEntry[i] )
+            table_set_entry(table, &newEntries[i]);
+        else if ( events[i].eventType == PROC_EVENT_TYPE_EXIT )
+            table_remove_entry(table, events[i].pid);
+    }
+
+    for( i=0; i < numReparented; i++ )
+        table_set_entry(table, &reparented[i]);
+
+    table_write_end(table);
+
+    if ( exitedMap != NULL )
+        simple_int_map_destroy(exitedMap);
+}
+
+/**
+ * create_table - Create and map a new table file at #tmpPath
+ *
+ *      The file is sparse, so only the pages actually holding entries use memory.
+ *
+ *      @return <PidTreedHeader *> - The mapped table, or NULL on error (errno is set)
+ */
+static PidTreedHeader *create_table(const char *tmpPath, uint32_t capacity)
+{
+    PidTreedHeader *table;
+    size_t tableSize;
+    int fd;
+
+    tableSize = PIDTREED_SHM_SIZE(capacity);
+
+    unlink(tmpPath);
+    fd = open(tmpPath, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if ( fd < 0 )
+        return NULL;
+
+    /* Ignore the umask, the table must be readable by everyone */
+    fchmod(fd, 0644);
+
+    if ( ftruncate(fd, tableSize) != 0 )
+    {
+        close(fd);
+        unlink(tmpPath);
+        return NULL;
+    }
+
+    table = mmap(NULL, tableSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if ( table == MAP_FAILED )
+    {
+        unlink(tmpPath);
+        return NULL;
+    }
+
+    table->magic = PIDTREED_SHM_MAGIC;
+    table->layoutVersion = PIDTREED_SHM_LAYOUT_VERSION;
+    table->capacity = capacity;
+    table->daemonPid = getpid();
+    table->seq = 0;
+    table->numEntries = 0;
+    table->flags = 0;
+
+    return table;
+}
+
+/**
+ * open_lock_file - Open (creating if needed) the lock file which allows one daemon per table
+ *
+ *      It lives next to the table, usually in /dev/shm where anyone can create files,
+ *        so someone else could create it first and hold the lock to keep the daemon from
+ *        starting. It is only used if it is a regular file owned by us and writable by no
+ *        one else. Otherwise it is removed and created again, if we are allowed to (root,
+ *        or the owner of the directory), else this fails.
+ *
+ *      @return <int> - The open file descriptor, or -1 on error (errno is set)
+ */
+static int open_lock_file(const char *lockPath)
+{
+    struct stat statBuf;
+    int fd;
+    int tries;
+
+    for( tries=0; tries < PIDTREED_LOCK_MAX_TRIES; tries++ )
+    {
+        fd = open(lockPath, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644);
+        if ( fd >= 0 )
+        {
+            if ( fstat(fd, &statBuf) != 0 )
+            {
+                close(fd);
+                return -1;
+            }
+
+            if ( S_ISREG(statBuf.st_mode) && statBuf.st_uid == geteuid() &&
+                 ! ( statBuf.st_mode & (S_IWGRP | S_IWOTH) ) )
+            {
+                return fd;
+            }
+
+            close(fd);
+        }
+        else if ( errno != ELOOP && errno != EACCES )
+        {
+            return -1;
+        }
+
+        /* Someone else's (or a symlink), replace it with our own */
+        if ( unlink(lockPath) != 0 && errno != ENOENT )
+            return -1;
+    }
+
+    errno = EEXIST;
+    return -1;
+}
+
+/**
+ * main - Create the table, then keep it up to date until signalled.
+ */
+int main(int argc, char* argv[])
+{
+    PidTreedHeader *table = NULL;
+    ProcEvent *events = NULL;
+    struct sigaction sigAction;
+    const char *shmPath;
+    char *lockPath = NULL;
+    char *tmpPath = NULL;
+    int lockFd = -1;
+    int eventsFd = -1;
+    int numEvents;
+    int needsRescan;
+    int i;
+    int returnCode = 0;
+
+    for( i=1; i < argc; i++ )
+    {
+        if ( strcmp("--help", argv[i]) == 0 )
+        {
+            usage();
+            return 0;
+        }
+
+        if ( strcmp("--version", argv[i]) == 0 )
+        {
+            fprintf(stderr, "\npidtreed version %s by Timothy Savannah\n\n", PID_TOOLS_VERSION);
+            return 0;
+        }
+
+        fprintf(stderr, "Unknown argument: %s\n\n", argv[i]);
+        usage();
+        return 1;
+    }
+
+    shmPath = pidtreed_get_path();
+
+    lockPath = malloc( strlen(shmPath) + 16 );
+    sprintf(lockPath, "%s.lock", shmPath);
+    tmpPath = malloc( strlen(shmPath) + 32 );
+    sprintf(tmpPath, "%s.tmp.%d", shmPath, (int)getpid());
+
+    /* Only one daemon per table */
+    lockFd = open_lock_file(lockPath);
+    if ( lockFd < 0 )
+    {
+        fprintf(stderr, "Cannot open lock file '%s'. Error %d: %s\n", lockPath, errno, strerror(errno));
+        returnCode = 1;
+        goto __cleanup_and_exit;
+    }
+    if ( flock(lockFd, LOCK_EX | LOCK_NB) != 0 )
+    {
+        fprintf(stderr, "pidtreed is already running for '%s'\n", shmPath);
+        returnCode = 1;
+        goto __cleanup_and_exit;
+    }
+
+    memset(&sigAction, 0, sizeof(sigAction));
+    sigAction.sa_handler = handle_stop_signal;
+    sigaction(SIGTERM, &sigAction, NULL);
+    sigaction(SIGINT, &sigAction, NULL);
+    sigaction(SIGHUP, &sigAction, NULL);
+
+    table = create_table(tmpPath, (uint32_t)pid_bitset_read_pid_max());
+    if ( table == NULL )
+    {
+        fprintf(stderr, "Cannot create table '%s'. Error %d: %s\n", tmpPath, errno, strerror(errno));
+        returnCode = 1;
+        goto __cleanup_and_exit;
+    }
+
+    /* Subscribe before the first scan, so nothing happening in between is missed */
+    eventsFd = proc_events_open();
+    if ( eventsFd >= 0 )
+    {
+        events = malloc( sizeof(ProcEvent) * PIDTREED_MAX_EVENTS );
+        table->flags |= PIDTREED_FLAG_EVENTS;
+    }
+    else
+        fprintf(stderr, "Process events unavailable (Error %d: %s), rescanning /proc every %dms instead. The tools will not use the table.\n", errno, strerror(errno), PIDTREED_HEARTBEAT_MS);
+
+    if ( table_rescan(table) != 0 )
+    {
+        fprintf(stderr, "Failed to list /proc. Error %d: %s\n", errno, strerror(errno));
+        unlink(tmpPath);
+        returnCode = 1;
+        goto __cleanup_and_exit;
+    }
+
+    /* Publish the complete table all at once */
+    if ( rename(tmpPath, shmPath) != 0 )
+    {
+        fprintf(stderr, "Cannot create table '%s'. Error %d: %s\n", shmPath, errno, strerror(errno));
+        unlink(tmpPath);
+        returnCode = 1;
+        goto __cleanup_and_exit;
+    }
+
+    needsRescan = 0;
+    while ( keepRunning )
+    {
+        if ( eventsFd < 0 )
+        {
+            usleep( PIDTREED_HEARTBEAT_MS * 1000 );
+            needsRescan = 1;
+        }
+        else
+        {
+            numEvents = proc_events_read(eventsFd, events, PIDTREED_MAX_EVENTS, PIDTREED_HEARTBEAT_MS);
+
+            if ( numEvents == PROC_EVENTS_ERROR_OVERRUN )
+                needsRescan = 1;
+            else if ( unlikely( numEvents < 0 ) )
+            {
+                fprintf(stderr, "Failed to read process events (Error %d: %s), falling back to rescanning /proc. The tools will not use the table.\n", errno, strerror(errno));
+                proc_events_close(eventsFd);
+                eventsFd = -1;
+                needsRescan = 1;
+
+                /* Clients stop using the table, as a rescan may lag behind */
+                table->flags &= ~PIDTREED_FLAG_EVENTS;
+                __sync_synchronize();
+            }
+            else if ( numEvents > 0 )
+                table_apply_events(table, events, numEvents);
+        }
+
+        if ( needsRescan )
+        {
+            if ( table_rescan(table) != 0 )
+                fprintf(stderr, "Failed to list /proc. Error %d: %s\n", errno, strerror(errno));
+            needsRescan = 0;
+        }
+
+        /* Heartbeat, so clients know we're alive even when nothing changes */
+        table->updateTimeNs = pidtreed_now_ns();
+    }
+
+    unlink(shmPath);
+
+__cleanup_and_exit:
+
+    if ( eventsFd >= 0 )
+        proc_events_close(eventsFd);
+    if ( events != NULL )
+        free(events);
+    if ( table != NULL )
+        munmap(table, PIDTREED_SHM_SIZE(table->capacity));
+    if ( lockFd >= 0 )
+        close(lockFd);
+
+    free(lockPath);
+    free(tmpPath);
+
+    return returnCode;
+}
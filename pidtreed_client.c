@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * pidtreed_client.c - Maps pidtreed's shared table for the client side.
+ *
+ *   The rest of the client (the lookups) is static in pidtreed_shm.h, but the
+ *     mapping lives here so the whole process shares one, and one record of
+ *     when it last looked for the table.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "pid_tools.h"
+
+#include "pidtreed_shm.h"
+
+
+/* The table, once mapped. Kept mapped for the life of the process. */
+static const PidTreedHeader * volatile clientHeader = NULL;
+
+/* CLOCK_MONOTONIC of the last attempt to map the table, 0 if never tried */
+static volatile uint64_t lastCheckNs = 0;
+
+
+/**
+ * _map_table - Open, check, and map the table
+ *
+ *      @return <const PidTreedHeader *> - The table, or NULL if it is not usable
+ */
+static const PidTreedHeader *_map_table(void)
+{
+    const char *disableStr;
+    const PidTreedHeader *header;
+    struct stat statBuf;
+    void *mapping;
+    int fd;
+
+    disableStr = getenv("PIDTREED_DISABLE");
+    if ( disableStr != NULL && disableStr[0] != '\0' && disableStr[0] != '0' )
+        return NULL;
+
+    fd = open(pidtreed_get_path(), O_RDONLY | O_CLOEXEC);
+    if ( fd < 0 )
+        return NULL;
+
+    if ( fstat(fd, &statBuf) != 0 || (size_t)statBuf.st_size < sizeof(PidTreedHeader) ||
+         ! S_ISREG(statBuf.st_mode) ||
+         ( statBuf.st_uid != 0 && statBuf.st_uid != geteuid() ) ||
+         ( statBuf.st_mode & (S_IWGRP | S_IWOTH) ) )
+    {
+        close(fd);
+        return NULL;
+    }
+
+    mapping = mmap(NULL, statBuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if ( mapping == MAP_FAILED )
+        return NULL;
+
+    header = (const PidTreedHeader *)mapping;
+    if ( header->magic != PIDTREED_SHM_MAGIC ||
+         header->layoutVersion != PIDTREED_SHM_LAYOUT_VERSION ||
+         PIDTREED_SHM_SIZE(header->capacity) > (size_t)statBuf.st_size ||
+         header->daemonPid <= 0 ||
+         ( kill(header->daemonPid, 0) != 0 && errno != EPERM ) )
+    {
+        munmap(mapping, statBuf.st_size);
+        return NULL;
+    }
+
+    /* If another thread beat us to it, use theirs */
+    if ( ! __sync_bool_compare_and_swap( &clientHeader, NULL, header ) )
+        munmap(mapping, statBuf.st_size);
+
+    return clientHeader;
+}
+
+const PidTreedHeader *pidtreed_client_get(void)
+{
+    const PidTreedHeader *header;
+    uint64_t nowNs, lastNs;
+
+    header = clientHeader;
+    if ( likely( header != NULL ) )
+        return header;
+
+    /* Look again at most once a heartbeat, and only in one thread at a time */
+    nowNs = pidtreed_now_ns();
+    lastNs = lastCheckNs;
+    if ( lastNs != 0 && ( nowNs - lastNs ) < ( (uint64_t)PIDTREED_HEARTBEAT_MS * 1000000ULL ) )
+        return NULL;
+
+    if ( ! __sync_bool_compare_and_swap( &lastCheckNs, lastNs, nowNs ) )
+        return clientHeader;
+
+    return _map_table();
+}
@@ -0,0 +1,428 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * pidtreed_shm.h - Layout of the shared-memory process table maintained by
+ *                    "pidtreed", and static functions for reading it.
+ *
+ *         The table is a file on tmpfs (default /dev/shm/pidtreed, or $PIDTREED_SHM)
+ *         which each client maps read-only. It holds one entry per process,
+ *         sorted by pid, so lookups are a binary search in shared memory.
+ *
+ *         Consistency is seqlock-style: the daemon makes #seq odd before it changes
+ *         anything and even again after. A reader notes #seq, copies what it needs,
+ *         and only trusts the copy if #seq was even and unchanged.
+ *
+ *         Clients only use the table if the daemon has touched it within the
+ *         last PIDTREED_MAX_AGE_MS, and is updating it from process events.
+ *         A daemon rescanning /proc lags behind (a pid which just exited may
+ *         still be listed with its old parent), so then they read /proc as usual.
+ *
+ *         /dev/shm is writable by everyone, so the table is only trusted if it is
+ *         a regular file owned by root or by the client's own user, and writable
+ *         by no one else. Otherwise any local user could plant a forged table
+ *         which tools run as root would believe.
+ *         Set PIDTREED_DISABLE=1 in the environment to always read /proc.
+ *
+ *         These are contained in this header versus a .c file to allow
+ *         optimizations which wouldn't otherwise get applied if not single unit
+ *         (e.x. inlining). Only the mapping itself (pidtreed_client_get) is in
+ *         pidtreed_client.c, so every unit shares it.
+ *
+ */
+
+#ifndef _PIDTREED_SHM_H
+#define _PIDTREED_SHM_H
+
+#include "pid_tools.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/* PIDTREED_SHM_DEFAULT_PATH - Where the table lives, unless $PIDTREED_SHM is set */
+#define PIDTREED_SHM_DEFAULT_PATH "/dev/shm/pidtreed"
+
+/* PIDTREED_SHM_MAGIC - "PIDT" */
+#define PIDTREED_SHM_MAGIC (0x54444950)
+
+/* PIDTREED_SHM_LAYOUT_VERSION - Bump whenever the layout of the structures below changes */
+#define PIDTREED_SHM_LAYOUT_VERSION (2)
+
+/* PIDTREED_FLAG_EVENTS - Set in #flags while the daemon is updating the table from process events */
+#define PIDTREED_FLAG_EVENTS (1)
+
+/* PIDTREED_COMM_SIZE - Size of the comm field, same as the kernel's TASK_COMM_LEN */
+#define PIDTREED_COMM_SIZE 16
+
+/* PIDTREED_HEARTBEAT_MS - How often the daemon touches #updateTimeNs, even if nothing changed */
+#define PIDTREED_HEARTBEAT_MS 250
+
+/* PIDTREED_MAX_AGE_MS - Clients ignore the table if it hasn't been touched in this long (daemon is gone or hung) */
+#define PIDTREED_MAX_AGE_MS 2000
+
+/* PIDTREED_READ_MAX_TRIES - Give up and read /proc after this many torn reads in a row */
+#define PIDTREED_READ_MAX_TRIES 1000
+
+
+/**
+ *   PidTreedEntry - A single process in the table
+ */
+typedef struct {
+
+    pid_t pid;
+    pid_t ppid;         /* 0 if no parent (e.x. pid 1 and kthreadd) */
+    uint64_t startTime; /* Field 22 of /proc/$PID/stat, in clock ticks since boot */
+    char comm[PIDTREED_COMM_SIZE];
+
+} PidTreedEntry;
+
+/**
+ *   PidTreedHeader - The start of the shared segment, followed by #capacity entries
+ */
+typedef struct {
+
+    uint32_t magic;
+    uint32_t layoutVersion;
+    uint32_t capacity;      /* Max number of entries, fixed for the life of the segment */
+    pid_t daemonPid;
+
+    volatile uint64_t seq;           /* Odd while the daemon is writing */
+    volatile uint64_t updateTimeNs;  /* CLOCK_MONOTONIC of the daemon's last heartbeat or change */
+    volatile uint32_t numEntries;
+    volatile uint32_t flags;         /* PIDTREED_FLAG_* */
+
+    PidTreedEntry entries[];
+
+} PidTreedHeader;
+
+/* PIDTREED_SHM_SIZE - Size of a segment holding #_capacity entries */
+#define PIDTREED_SHM_SIZE(_capacity) ( sizeof(PidTreedHeader) + ( sizeof(PidTreedEntry) * (size_t)(_capacity) ) )
+
+
+/**
+ * pidtreed_now_ns - Current CLOCK_MONOTONIC time in nanoseconds
+ */
+MAYBE_UNUSED static inline uint64_t pidtreed_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ( (uint64_t)ts.tv_sec * 1000000000ULL ) + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * pidtreed_get_path - Get the path of the table, $PIDTREED_SHM or the default
+ */
+MAYBE_UNUSED static inline const char *pidtreed_get_path(void)
+{
+    const char *path;
+
+    path = getenv("PIDTREED_SHM");
+    if ( path == NULL || path[0] == '\0' )
+        path = PIDTREED_SHM_DEFAULT_PATH;
+
+    return path;
+}
+
+/**
+ * pidtreed_client_get - Get the table, which is mapped on first use and kept
+ *                         mapped for the life of the process. Implemented in
+ *                         pidtreed_client.c, so there is one mapping per process.
+ *
+ *      If there is no usable table, this is checked again at most once every
+ *        PIDTREED_HEARTBEAT_MS, so a daemon started later is picked up.
+ *
+ *      @return <const PidTreedHeader *> - The table, or NULL if there is no
+ *                  usable table (no daemon, disabled, wrong layout, or not
+ *                  trusted, see above)
+ */
+const PidTreedHeader *pidtreed_client_get(void);
+
+/**
+ * pidtreed_is_usable - Check that the daemon has touched the table recently,
+ *                        and is keeping it current from process events
+ *
+ *      @param header <const PidTreedHeader *> - The table
+ *
+ *      @return <int> - 1 if the table can be trusted, otherwise 0
+ */
+MAYBE_UNUSED static inline int pidtreed_is_usable(const PidTreedHeader *header)
+{
+    uint64_t updateTimeNs;
+
+    if ( ! ( header->flags & PIDTREED_FLAG_EVENTS ) )
+        return 0;
+
+    updateTimeNs = header->updateTimeNs;
+
+    return ( pidtreed_now_ns() - updateTimeNs ) < ( (uint64_t)PIDTREED_MAX_AGE_MS * 1000000ULL );
+}
+
+/**
+ * pidtreed_read_begin - Start a read. Waits out any write in progress.
+ *
+ *      @param header <const PidTreedHeader *> - The table
+ *
+ *      @param seqOut <uint64_t *> - Will be set to the sequence to pass to pidtreed_read_retry
+ *
+ *      @return <int> - 0 to go ahead, -1 if the daemon is stuck mid-write (use /proc instead)
+ */
+MAYBE_UNUSED static inline int pidtreed_read_begin(const PidTreedHeader *header, uint64_t *seqOut)
+{
+    unsigned int tries;
+    uint64_t seq;
+
+    for( tries=0; tries < PIDTREED_READ_MAX_TRIES; tries++ )
+    {
+        seq = header->seq;
+        if ( likely( (seq & 1) == 0 ) )
+        {
+            __sync_synchronize();
+            *seqOut = seq;
+            return 0;
+        }
+        sched_yield();
+    }
+
+    return -1;
+}
+
+/**
+ * pidtreed_read_retry - Check whether anything read since pidtreed_read_begin may be torn
+ *
+ *      @return <int> - 1 if the table changed during the read (start over), 0 if the read is good
+ */
+MAYBE_UNUSED static inline int pidtreed_read_retry(const PidTreedHeader *header, uint64_t seq)
+{
+    __sync_synchronize();
+
+    return header->seq != seq;
+}
+
+/**
+ * pidtreed_num_entries - Get the number of entries, clamped to the capacity
+ *                          (so a torn read can never walk off the end)
+ */
+MAYBE_UNUSED static inline uint32_t pidtreed_num_entries(const PidTreedHeader *header)
+{
+    uint32_t numEntries;
+
+    numEntries = header->numEntries;
+
+    return numEntries <= header->capacity ? numEntries : header->capacity;
+}
+
+/**
+ * pidtreed_find_entry - Binary search the table for a pid. Must be called between
+ *                         pidtreed_read_begin and pidtreed_read_retry.
+ *
+ *      @return <const PidTreedEntry *> - The entry, or NULL if not present
+ */
+MAYBE_UNUSED static inline const PidTreedEntry *pidtreed_find_entry(const PidTreedHeader *header, pid_t pid)
+{
+    uint32_t low, high, mid;
+    pid_t midPid;
+
+    low = 0;
+    high = pidtreed_num_entries(header);
+
+    while ( low < high )
+    {
+        mid = low + ( (high - low) >> 1 );
+        midPid = header->entries[mid].pid;
+
+        if ( midPid == pid )
+            return &header->entries[mid];
+
+        if ( midPid < pid )
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return NULL;
+}
+
+/**
+ * pidtreed_lookup_ppid - Get the parent of a pid from the daemon's table
+ *
+ *      @param pid <pid_t> - The pid
+ *
+ *      @return <pid_t> - The parent pid (0 if it has no parent),
+ *                         or -1 if the table is unavailable or doesn't contain #pid
+ */
+MAYBE_UNUSED static inline pid_t pidtreed_lookup_ppid(pid_t pid)
+{
+    const PidTreedHeader *header;
+    const PidTreedEntry *entry;
+    uint64_t seq;
+    pid_t ppid;
+    unsigned int tries;
+
+    header = pidtreed_client_get();
+    if ( header == NULL || ! pidtreed_is_usable(header) )
+        return -1;
+
+    for( tries=0; tries < PIDTREED_READ_MAX_TRIES; tries++ )
+    {
+        if ( pidtreed_read_begin(header, &seq) != 0 )
+            return -1;
+
+        entry = pidtreed_find_entry(header, pid);
+        ppid = entry != NULL ? entry->ppid : -1;
+
+        if ( ! pidtreed_read_retry(header, seq) )
+            return ppid;
+    }
+
+    return -1;
+}
+
+/**
+ * pidtreed_lookup_entry - Get a copy of the daemon's entry for a pid
+ *
+ *      @param pid <pid_t> - The pid
+ *
+ *      @param entryOut <PidTreedEntry *> - Will be filled in with the entry
+ *
+ *      @return <int> - 0 on success, -1 if the table is unavailable or doesn't contain #pid
+ */
+MAYBE_UNUSED static inline int pidtreed_lookup_entry(pid_t pid, PidTreedEntry *entryOut)
+{
+    const PidTreedHeader *header;
+    const PidTreedEntry *entry;
+    uint64_t seq;
+    unsigned int tries;
+
+    header = pidtreed_client_get();
+    if ( header == NULL || ! pidtreed_is_usable(header) )
+        return -1;
+
+    for( tries=0; tries < PIDTREED_READ_MAX_TRIES; tries++ )
+    {
+        if ( pidtreed_read_begin(header, &seq) != 0 )
+            return -1;
+
+        entry = pidtreed_find_entry(header, pid);
+        if ( entry != NULL )
+            *entryOut = *entry;
+
+        if ( ! pidtreed_read_retry(header, seq) )
+            return entry != NULL ? 0 : -1;
+    }
+
+    return -1;
+}
+
+/**
+ * pidtreed_lookup_ppids - Get the parents of many pids from the daemon's table,
+ *                           all within one consistent read
+ *
+ *      @param pids <const pid_t *> - The pids
+ *
+ *      @param numPids <size_t> - Number of elements in #pids
+ *
+ *      @param ppidsOut <pid_t *> - ppidsOut[i] will be set to the parent of pids[i]
+ *                      (0 if it has no parent), or -1 if the table doesn't contain it
+ *
+ *      @return <int> - 0 on success, -1 if the table is unavailable (#ppidsOut is undefined)
+ */
+MAYBE_UNUSED static inline int pidtreed_lookup_ppids(const pid_t *pids, size_t numPids, pid_t *ppidsOut)
+{
+    const PidTreedHeader *header;
+    const PidTreedEntry *entry;
+    uint64_t seq;
+    unsigned int tries;
+    size_t i;
+
+    header = pidtreed_client_get();
+    if ( header == NULL || ! pidtreed_is_usable(header) )
+        return -1;
+
+    for( tries=0; tries < PIDTREED_READ_MAX_TRIES; tries++ )
+    {
+        if ( pidtreed_read_begin(header, &seq) != 0 )
+            return -1;
+
+        for( i=0; i < numPids; i++ )
+        {
+            entry = pidtreed_find_entry(header, pids[i]);
+            ppidsOut[i] = entry != NULL ? entry->ppid : -1;
+        }
+
+        if ( ! pidtreed_read_retry(header, seq) )
+            return 0;
+    }
+
+    return -1;
+}
+
+/**
+ * pidtreed_copy_table - Copy every pid and its parent out of the daemon's table
+ *
+ *      @param pidsOut <pid_t **> - Will be set to a malloc'd, sorted array of pids
+ *
+ *      @param ppidsOut <pid_t **> - Will be set to a malloc'd array of the parent of each pid
+ *                      (0 if it has no parent)
+ *
+ *      @param numOut <size_t *> - Will be set to the number of elements in both arrays
+ *
+ *      @return <int> - 0 on success, -1 if the table is unavailable (nothing is allocated)
+ */
+MAYBE_UNUSED static inline int pidtreed_copy_table(pid_t **pidsOut, pid_t **ppidsOut, size_t *numOut)
+{
+    const PidTreedHeader *header;
+    pid_t *pids, *ppids;
+    uint64_t seq;
+    uint32_t numEntries, i;
+    unsigned int tries;
+
+    header = pidtreed_client_get();
+    if ( header == NULL || ! pidtreed_is_usable(header) )
+        return -1;
+
+    /* Size for the whole table, so a retry never needs to grow these */
+    pids = malloc( sizeof(pid_t) * ( header->capacity + 1 ) );
+    ppids = malloc( sizeof(pid_t) * ( header->capacity + 1 ) );
+
+    for( tries=0; tries < PIDTREED_READ_MAX_TRIES; tries++ )
+    {
+        if ( pidtreed_read_begin(header, &seq) != 0 )
+            break;
+
+        numEntries = pidtreed_num_entries(header);
+        for( i=0; i < numEntries; i++ )
+        {
+            pids[i] = header->entries[i].pid;
+            ppids[i] = header->entries[i].ppid;
+        }
+
+        if ( ! pidtreed_read_retry(header, seq) )
+        {
+            *pidsOut = pids;
+            *ppidsOut = ppids;
+            *numOut = numEntries;
+            return 0;
+        }
+    }
+
+    free(pids);
+    free(ppids);
+
+    return -1;
+}
+
+#endif
@@ -21,9 +21,9 @@
 #include "pid_tools.h"
 
 #include "ppid.h"
-
-
-#define PROC_STAT_PPID_IDX 3
+#include "proc_handle.h"
+#include "proc_stat.h"
+#include "pidtreed_shm.h"
 
 /*
  * getPpid - Gets the parent process ID of a provided pid.
@@ -31,59 +31,38 @@
  * If no parent id is present, "1" (init) is returned. This includes
  * for pid 1 itself.
  *
+ * If pidtreed is running, the answer comes from its shared table
+ *  (see pidtreed_shm.h) without touching /proc.
+ *
  *  Returns "0" on error, and prints an error message
  *
  * pid - Search for parent of this pid.
  */
-ALWAYS_INLINE_EXE_ONLY pid_t getPpid(pid_t pid)
+STATIC_MULTICALL_ONLY ALWAYS_INLINE_EXE_ONLY pid_t getPpid(pid_t pid)
 {
-    /* path - Array which will point to string: "/proc/$PID/stat" */
-
-    static char path[64] = { '/', 'p', 'r', 'o', 'c', '/' };
-
-    /* _buff - Short buffer. We only need to read the first couple fields, so 128 characters is plenty. */
-    static char _buff[128];
-    /* buff - Pointer to _buff which we modify address */
-    char *buff;
-
+    ProcStat stat;
     int fd;
     pid_t ret;
 
-    sprintf(&path[6], "%u/stat", pid);
+    ret = pidtreed_lookup_ppid(pid);
+    if ( ret >= 0 )
+        return ret == 0 ? 1 : ret;
 
-    fd = open(path, O_RDONLY);
-    if ( fd <= 0 ) {
+    fd = proc_open_pid_file(pid, "stat", O_RDONLY);
+    if ( fd < 0 ) {
         return 0;
     }
 
-    buff = _buff;
-
-    buff[0] = '\0';
-
-    if ( read(fd, buff, 127) <= 0 ) {
+    if ( proc_stat_read_fd(fd, PROC_STAT_FIELD_PPID, &stat) != 0 ) {
         /* Failed to read from "stat" */
-        fprintf(stderr, "Error trying to read from '%s' [%d]: %s\n", buff, errno, strerror(errno));
+        fprintf(stderr, "Error trying to read from '/proc/%d/stat' [%d]: %s\n", (int)pid, errno, strerror(errno));
         close(fd);
         return 0;
     }
 
     close(fd);
 
-    for(unsigned int numSpaces=0; numSpaces < PROC_STAT_PPID_IDX; buff = &buff[1] )
-    {
-        if ( *buff == ' ' ) {
-            numSpaces++;
-        }
-    }
-
-    {
-      unsigned int nextIdx = 1;
-      for( ; buff[nextIdx] != ' '; nextIdx++);
-
-      buff[nextIdx] = '\0';
-    }
-
-    ret = atoi(buff);
+    ret = stat.ppid;
 
     /* No parent means init is parent */
     if(ret == 0)
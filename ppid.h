@@ -15,7 +15,7 @@
  *  If you define SHARED_LIB, you'll need to link your .o with ppid.o
 */
 
-INLINE_EXE_ONLY pid_t getPpid(pid_t pid);
+STATIC_MULTICALL_ONLY INLINE_EXE_ONLY pid_t getPpid(pid_t pid);
 
 #ifndef SHARED_LIB
 #include "ppid.c"
@@ -0,0 +1,479 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * proc_children.c - Interface implementations for walking process children via
+ *                     the kernel's /proc/PID/task/TID/children files
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+
+#include "pid_tools.h"
+
+#include "simple_int_map.h"
+#include "pid_bitset.h"
+#include "proc_children.h"
+#include "proc_handle.h"
+#include "proc_stat.h"
+#include "pid_ident.h"
+
+
+/* CHILDREN_READ_BUFFER_SIZE - Initial size of the buffer used to read a children file.
+ *    Each entry is at most 8 characters, so this holds a few hundred children before growing.
+ */
+#define CHILDREN_READ_BUFFER_SIZE 4096
+
+/**
+ *   struct _ChildrenReadBuffer - Buffer children files are read into. Owned by the caller
+ *          of each walk (never shared between calls), so walks in different threads don't
+ *          touch each other's. Grown as needed, free #data when done.
+ */
+struct _ChildrenReadBuffer {
+    char *data;     /* NULL until first used */
+    size_t size;
+};
+
+/* MATCHED_DENSE_CHECK_MIN - Number of matched pids at which to first check (reading pid_max)
+ *   whether they are dense enough to move into a PidBitset. Fewer is never worth it.
+ */
+#define MATCHED_DENSE_CHECK_MIN 256
+
+/**
+ *   struct _MatchedPids - The set of pids matched by proc_children_get.
+ *
+ *      Starts as a SimpleIntMap, and moves into a PidBitset once the pids are dense
+ *        (PID_BITSET_IS_DENSE), where the bitset is cheaper to fill and comes out
+ *        already sorted.
+ */
+struct _MatchedPids {
+    SimpleIntMap *map;      /* NULL once moved into #bitset */
+    PidBitset *bitset;      /* NULL until dense */
+    size_t numPids;
+    size_t nextDenseCheck;  /* #numPids at which to check again */
+    pid_t pidMax;           /* 0 until read */
+};
+
+/**
+ * _matched_pids_check_dense - Move the matched pids into a PidBitset if they are now dense
+ */
+static void _matched_pids_check_dense(struct _MatchedPids *matched)
+{
+    pid_t *pids;
+    size_t numPids, i;
+
+    if ( matched->pidMax == 0 )
+    {
+        matched->pidMax = pid_bitset_read_pid_max();
+
+        /* The fewest pids which are dense below pid_max, so this is only checked once more */
+        matched->nextDenseCheck = ( (size_t)matched->pidMax / PID_BITSET_WORD_BITS + PID_BITSET_DENSE_WORDS_PER_PID - 1 ) / PID_BITSET_DENSE_WORDS_PER_PID;
+    }
+
+    if ( ! PID_BITSET_IS_DENSE(matched->numPids, matched->pidMax) )
+        return;
+
+    matched->bitset = pid_bitset_create(matched->pidMax);
+
+    pids = simple_int_map_values(matched->map, &numPids);
+    for( i=0; i < numPids; i++ )
+        pid_bitset_add(matched->bitset, pids[i]);
+    free(pids);
+
+    simple_int_map_destroy(matched->map);
+    matched->map = NULL;
+}
+
+/**
+ * _matched_pids_add - Add a pid to the matched set
+ *
+ *    @return <int> - 1 if it was added, 0 if it was already matched
+ */
+static inline int _matched_pids_add(struct _MatchedPids *matched, pid_t pid)
+{
+    if ( matched->bitset != NULL )
+    {
+        if ( ! pid_bitset_add(matched->bitset, pid) )
+            return 0;
+
+        matched->numPids += 1;
+        return 1;
+    }
+
+    if ( ! simple_int_map_add(matched->map, pid) )
+        return 0;
+
+    matched->numPids += 1;
+    if ( unlikely( matched->numPids >= matched->nextDenseCheck ) )
+        _matched_pids_check_dense(matched);
+
+    return 1;
+}
+
+int proc_children_supported(void)
+{
+    char path[64];
+
+    /* The main thread's tid is the same as the pid */
+    sprintf(path, "/proc/self/task/%d/children", (int)getpid());
+
+    return access(path, R_OK) == 0 ? 1 : 0;
+}
+
+/**
+ * _append_child - Append a pid onto a growable list
+ */
+static inline void _append_child(pid_t childPid, pid_t **children, size_t *numChildren, size_t *childrenCapacity)
+{
+    if ( unlikely( *numChildren >= *childrenCapacity ) )
+    {
+        *childrenCapacity = *childrenCapacity ? *childrenCapacity << 1 : 64;
+        *children = realloc( *children, sizeof(pid_t) * (*childrenCapacity) );
+    }
+
+    (*children)[ (*numChildren)++ ] = childPid;
+}
+
+/**
+ * _read_task_children - Read a single /proc/PID/task/TID/children file and append
+ *                         each listed pid.
+ *
+ *      @param taskDirFd <int> - An open /proc/PID/task directory
+ *
+ *      @param tidStr <const char *> - The thread id, as listed in #taskDirFd
+ *
+ *      @param readBuff <struct _ChildrenReadBuffer *> - Buffer to read the file into
+ *
+ *      @return <int> - 0 on success, -1 if the file could not be opened
+ */
+static int _read_task_children(int taskDirFd, const char *tidStr, struct _ChildrenReadBuffer *readBuff, pid_t **children, size_t *numChildren, size_t *childrenCapacity)
+{
+    char path[PROC_PID_PATH_SIZE];
+    char *buff;
+    size_t buffSize;
+    int fd;
+    ssize_t bytesRead;
+    size_t totalRead;
+    size_t i;
+    pid_t curPid;
+    int inNumber;
+
+    if ( unlikely( strlen(tidStr) + sizeof("/children") > sizeof(path) ) )
+        return -1;
+
+    strcpy(path, tidStr);
+    strcat(path, "/children");
+
+    fd = openat(taskDirFd, path, O_RDONLY | O_CLOEXEC);
+    if ( unlikely( fd < 0 ) )
+        return -1;
+
+    if ( unlikely( readBuff->data == NULL ) )
+    {
+        readBuff->size = CHILDREN_READ_BUFFER_SIZE;
+        readBuff->data = malloc(readBuff->size);
+    }
+    buff = readBuff->data;
+    buffSize = readBuff->size;
+
+    /* The kernel builds this file as a seq_file, so keep reading until we hit EOF */
+    totalRead = 0;
+    while ( (bytesRead = read(fd, &buff[totalRead], buffSize - totalRead)) > 0 )
+    {
+        totalRead += bytesRead;
+        if ( totalRead == buffSize )
+        {
+            buffSize <<= 1;
+            buff = realloc(buff, buffSize);
+        }
+    }
+
+    close(fd);
+
+    readBuff->data = buff;
+    readBuff->size = buffSize;
+
+    /* Contents look like "123 456 789 " */
+    curPid = 0;
+    inNumber = 0;
+    for( i=0; i < totalRead; i++ )
+    {
+        if ( buff[i] >= '0' && buff[i] <= '9' )
+        {
+            curPid = (curPid * 10) + (buff[i] - '0');
+            inNumber = 1;
+        }
+        else if ( inNumber )
+        {
+            _append_child(curPid, children, numChildren, childrenCapacity);
+            curPid = 0;
+            inNumber = 0;
+        }
+    }
+    if ( inNumber )
+        _append_child(curPid, children, numChildren, childrenCapacity);
+
+    return 0;
+}
+
+/**
+ * _read_task_dir_children - Read the children file of every thread in a /proc/PID/task directory
+ *
+ *      @param taskDir <DIR *> - The open /proc/PID/task directory
+ *
+ *      @return <int> - 0 on success, -1 if no children file could be read
+ */
+static int _read_task_dir_children(DIR *taskDir, struct _ChildrenReadBuffer *readBuff, pid_t **children, size_t *numChildren, size_t *childrenCapacity)
+{
+    struct dirent *dirInfo;
+    int foundAny = 0;
+
+    while( (dirInfo = readdir(taskDir)) )
+    {
+        if ( dirInfo->d_name[0] < '0' || dirInfo->d_name[0] > '9' )
+            continue;
+
+        /* A thread may exit between readdir and open, that's fine */
+        if ( _read_task_children(dirfd(taskDir), dirInfo->d_name, readBuff, children, numChildren, childrenCapacity) == 0 )
+            foundAny = 1;
+    }
+
+    return foundAny ? 0 : -1;
+}
+
+/**
+ * _open_task_dir - Open the /proc/PID/task directory of a pid for reading
+ *
+ *      @return <DIR *> - The directory, or NULL on error
+ */
+static DIR *_open_task_dir(pid_t pid)
+{
+    int taskDirFd;
+    DIR *taskDir;
+
+    taskDirFd = proc_open_pid_file(pid, "task", O_RDONLY | O_DIRECTORY);
+    if ( unlikely( taskDirFd < 0 ) )
+        return NULL;
+
+    taskDir = fdopendir(taskDirFd);
+    if ( unlikely( taskDir == NULL ) )
+        close(taskDirFd);
+
+    return taskDir;
+}
+
+/**
+ * _read_children - proc_children_read, reading into #readBuff
+ */
+static int _read_children(pid_t pid, struct _ChildrenReadBuffer *readBuff, pid_t **children, size_t *numChildren, size_t *childrenCapacity)
+{
+    DIR *taskDir;
+    int ret;
+
+    /* Each thread has its own list of children (the ones it forked),
+     *   so we must read the file for every thread in the process.
+     */
+    taskDir = _open_task_dir(pid);
+    if ( unlikely( taskDir == NULL ) )
+        return -1;
+
+    ret = _read_task_dir_children(taskDir, readBuff, children, numChildren, childrenCapacity);
+
+    /* Also closes the descriptor */
+    closedir(taskDir);
+
+    return ret;
+}
+
+int proc_children_read(pid_t pid, pid_t **children, size_t *numChildren, size_t *childrenCapacity)
+{
+    struct _ChildrenReadBuffer readBuff = { NULL, 0 };
+    int ret;
+
+    ret = _read_children(pid, &readBuff, children, numChildren, childrenCapacity);
+
+    free(readBuff.data);
+
+    return ret;
+}
+
+/**
+ * _read_children_checked - Read the direct children of a pid which was listed as a child
+ *                            of #parent, if it is still that process
+ *
+ *      An open /proc/PID/task belongs to one process (like a ProcHandle), so the children
+ *        and the stat of its main thread read through it are of the same process. If it
+ *        has any children, that process must still have #parent as its parent, and have
+ *        started no earlier than it. Otherwise the listed pid exited (and maybe was reused)
+ *        since it was listed, and the children read now would not be descendants.
+ *
+ *      @param parent <const PidIdent *> - The pid which listed #pid, or NULL if #pid is a root
+ *
+ *      @param ident <PidIdent *> - Will be set to the identity of #pid, to check its children
+ *                      with. Left as-is if it has none
+ *
+ *      @param readBuff <struct _ChildrenReadBuffer *> - Buffer to read the children files into
+ *
+ *      @return <int> - 0 on success, -1 if #pid is gone or is no longer the listed process
+ *                      (nothing is appended to #children)
+ */
+static int _read_children_checked(pid_t pid, const PidIdent *parent, PidIdent *ident, struct _ChildrenReadBuffer *readBuff, pid_t **children, size_t *numChildren, size_t *childrenCapacity)
+{
+    char path[PROC_PID_PATH_SIZE];
+    DIR *taskDir;
+    ProcStat stat = { 0 };
+    size_t prevNumChildren;
+    size_t pathLen;
+    int statFd;
+    int ret;
+
+    taskDir = _open_task_dir(pid);
+    if ( unlikely( taskDir == NULL ) )
+        return -1;
+
+    prevNumChildren = *numChildren;
+    ret = _read_task_dir_children(taskDir, readBuff, children, numChildren, childrenCapacity);
+
+    /* Leaves (most pids) need no check, as nothing is walked into from them */
+    if ( ret != 0 || *numChildren == prevNumChildren )
+        goto __cleanup_and_exit;
+
+    /* The main thread's tid is the same as the pid */
+    pathLen = pid_to_str(pid, path);
+    memcpy(&path[pathLen], "/stat", sizeof("/stat"));
+
+    ret = -1;
+    statFd = openat(dirfd(taskDir), path, O_RDONLY | O_CLOEXEC);
+    if ( unlikely( statFd < 0 ) )
+        goto __discard;
+
+    if ( unlikely( proc_stat_read_fd(statFd, PROC_STAT_FIELD_PPID | PROC_STAT_FIELD_STARTTIME, &stat) != 0 ) )
+    {
+        close(statFd);
+        goto __discard;
+    }
+    close(statFd);
+
+    ident->pid = pid;
+    ident->startTime = stat.startTime;
+
+    if ( parent != NULL && unlikely( stat.ppid != parent->pid || ! PID_IDENT_CAN_BE_PARENT(parent, ident) ) )
+        goto __discard;
+
+    ret = 0;
+    goto __cleanup_and_exit;
+
+__discard:
+    *numChildren = prevNumChildren;
+
+__cleanup_and_exit:
+    closedir(taskDir);
+
+    return ret;
+}
+
+pid_t *proc_children_get(const pid_t *rootPids, size_t numRootPids, int isRecursive, size_t *retLen)
+{
+    struct _MatchedPids matched;
+    struct _ChildrenReadBuffer readBuff = { NULL, 0 };
+    pid_t *queue = NULL;
+    PidIdent *queueParents = NULL; /* Identity of the pid which listed each queued pid */
+    PidIdent ident;
+    size_t queueHead, queueLen, queueCapacity, parentsCapacity;
+    size_t i, j, prevLen, curIdx;
+    pid_t *ret = NULL;
+
+    *retLen = 0;
+
+    matched.map = simple_int_map_create(1000);
+    matched.bitset = NULL;
+    matched.numPids = 0;
+    matched.nextDenseCheck = MATCHED_DENSE_CHECK_MIN;
+    matched.pidMax = 0;
+
+    queueCapacity = parentsCapacity = 0;
+
+    for( i=0; i < numRootPids; i++ )
+    {
+        /* Queue holds pids to expand. Roots are expanded but not matched themselves */
+        queueHead = queueLen = 0;
+        _append_child(rootPids[i], &queue, &queueLen, &queueCapacity);
+
+        while ( queueHead < queueLen )
+        {
+            prevLen = queueLen;
+            curIdx = queueHead++;
+
+            if ( ! isRecursive )
+            {
+                /* A single read of the root's children, so there is nothing to go stale */
+                _read_children(queue[curIdx], &readBuff, &queue, &queueLen, &queueCapacity);
+            }
+            else if ( _read_children_checked(queue[curIdx], curIdx == 0 ? NULL : &queueParents[curIdx],
+                        &ident, &readBuff, &queue, &queueLen, &queueCapacity) != 0 )
+            {
+                /* Gone, or no longer the process which was listed */
+                continue;
+            }
+
+            /* Compact newly-read children down to those we haven't seen yet */
+            for( j = prevLen; j < queueLen; )
+            {
+                if ( _matched_pids_add( &matched, queue[j] ) )
+                {
+                    j++;
+                }
+                else
+                {
+                    queue[j] = queue[ --queueLen ];
+                }
+            }
+
+            if ( ! isRecursive )
+            {
+                /* Only the root's direct children */
+                break;
+            }
+
+            /* Remember who listed the new ones, to check them against when they are expanded */
+            if ( unlikely( parentsCapacity < queueCapacity ) )
+            {
+                parentsCapacity = queueCapacity;
+                queueParents = realloc(queueParents, sizeof(PidIdent) * parentsCapacity);
+            }
+            for( j = prevLen; j < queueLen; j++ )
+                queueParents[j] = ident;
+        }
+    }
+
+    if ( matched.bitset != NULL )
+    {
+        /* Already in order */
+        ret = pid_bitset_values(matched.bitset, retLen);
+        pid_bitset_destroy(matched.bitset);
+    }
+    else
+    {
+        if ( matched.numPids > 0 )
+        {
+            ret = simple_int_map_sorted_values(matched.map, retLen);
+        }
+        simple_int_map_destroy(matched.map);
+    }
+    if ( queue != NULL )
+        free(queue);
+    if ( queueParents != NULL )
+        free(queueParents);
+    free(readBuff.data);
+
+    return ret;
+}
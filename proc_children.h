@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * proc_children.h - Interface definitions for walking process children via
+ *                     the kernel's /proc/PID/task/TID/children files
+ *
+ *   These files only exist on kernels built with CONFIG_PROC_CHILDREN,
+ *     so check proc_children_supported before using anything else here.
+ */
+
+#ifndef _PROC_CHILDREN_H
+#define _PROC_CHILDREN_H
+
+#include <sys/types.h>
+
+#include "pid_tools.h"
+
+/*******************
+ * PUBLIC FUNCTIONS
+ ******************/
+
+/**
+ *    proc_children_supported - Check if the running kernel provides /proc/PID/task/TID/children
+ *
+ *          @return <int> - 1 if supported, 0 if not
+ */
+int proc_children_supported(void);
+
+/**
+ *    proc_children_read - Read the direct children of a pid (from all of its threads)
+ *
+ *          @param pid <pid_t> - The pid whose children to read
+ *
+ *          @param children <pid_t **> - Pointer to an allocated (or NULL) list which the
+ *                      children will be appended to. It is realloc'd as needed.
+ *
+ *          @param numChildren <size_t *> - Number of entries currently in *children,
+ *                      updated as children are appended.
+ *
+ *          @param childrenCapacity <size_t *> - Allocated size (in elements) of *children,
+ *                      updated as the list grows.
+ *
+ *          @return <int> - 0 on success
+ *                          -1 if the pid does not exist or is not accessible
+ */
+int proc_children_read(pid_t pid, pid_t **children, size_t *numChildren, size_t *childrenCapacity);
+
+/**
+ *    proc_children_get - Get the children of one or more pids, by walking only
+ *                          the requested pids (and their children, if recursive)
+ *
+ *          @param rootPids <const pid_t *> - The pids whose children to collect
+ *
+ *          @param numRootPids <size_t> - Number of elements in #rootPids
+ *
+ *          @param isRecursive <int> - If 0, only direct children are collected.
+ *                      Otherwise, children of children (and so on) are collected as well.
+ *                      Each child is only walked into if it is still the same process
+ *                      (by start time, see pid_ident.h), and still the child it was listed as.
+ *
+ *          @param retLen <size_t *> - The size of the returned list will be stored here
+ *
+ *          @return <pid_t *> - A sorted list of the unique matched pids, or NULL if none matched.
+ *
+ *              You are responsible for freeing this list
+ */
+pid_t *proc_children_get(const pid_t *rootPids, size_t numRootPids, int isRecursive, size_t *retLen);
+
+
+#endif
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * proc_events.c - Interface implementations for receiving process fork/exec/exit
+ *                   events from the kernel's netlink process connector
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+
+#include "pid_tools.h"
+
+#include "proc_events.h"
+
+
+/* PROC_EVENTS_RECV_BUFFER_SIZE - Size of the buffer for a single recv.
+ *    Each event is well under 128 bytes, so this holds many at once.
+ */
+#define PROC_EVENTS_RECV_BUFFER_SIZE 8192
+
+/* PROC_EVENTS_SOCKET_RCVBUF - Receive buffer size to request for the socket,
+ *    so bursts of forks don't overrun us as easily
+ */
+#define PROC_EVENTS_SOCKET_RCVBUF (1024 * 1024)
+
+/* PROC_EVENTS_PROBE_TIMEOUT_MS - How long to wait for the probe child's fork event
+ *    before deciding events are not being delivered to us
+ */
+#define PROC_EVENTS_PROBE_TIMEOUT_MS 500
+
+
+/**
+ * _send_mcast_op - Send a listen/ignore request to the connector
+ *
+ *      @return <int> - 0 on success, -1 on error (errno is set)
+ */
+static int _send_mcast_op(int sockFd, enum proc_cn_mcast_op op)
+{
+    char buff[ NLMSG_SPACE( sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op) ) ] ALIGN_8;
+    struct nlmsghdr *header;
+    struct cn_msg *message;
+
+    memset(buff, 0, sizeof(buff));
+
+    header = (struct nlmsghdr *)buff;
+    header->nlmsg_len = NLMSG_LENGTH( sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op) );
+    header->nlmsg_type = NLMSG_DONE;
+    header->nlmsg_pid = getpid();
+
+    message = (struct cn_msg *)NLMSG_DATA(header);
+    message->id.idx = CN_IDX_PROC;
+    message->id.val = CN_VAL_PROC;
+    message->len = sizeof(enum proc_cn_mcast_op);
+    memcpy(message->data, &op, sizeof(enum proc_cn_mcast_op));
+
+    if ( send(sockFd, buff, header->nlmsg_len, 0) < 0 )
+        return -1;
+
+    return 0;
+}
+
+/**
+ * _probe_events - Fork a child which exits immediately, and make sure we see it.
+ *
+ *     Subscribing may "succeed" without any events ever arriving (e.x. when we
+ *       are not in the initial network namespace), so this is the only reliable
+ *       way to know the connector works for us.
+ *
+ *      @return <int> - 0 if the child's fork event was received, otherwise -1
+ */
+static int _probe_events(int sockFd)
+{
+    ProcEvent events[64];
+    pid_t childPid;
+    int numEvents;
+    int i;
+    int elapsedMs;
+
+    childPid = fork();
+    if ( childPid < 0 )
+        return -1;
+
+    if ( childPid == 0 )
+        _exit(0);
+
+    waitpid(childPid, NULL, 0);
+
+    /* Other processes' events may come first, so keep reading until ours shows up */
+    for( elapsedMs = 0; elapsedMs < PROC_EVENTS_PROBE_TIMEOUT_MS; elapsedMs += 50 )
+    {
+        numEvents = proc_events_read(sockFd, events, 64, 50);
+        if ( numEvents == PROC_EVENTS_ERROR_OVERRUN )
+            continue;
+        if ( numEvents < 0 )
+            return -1;
+
+        for( i=0; i < numEvents; i++ )
+        {
+            if ( events[i].eventType == PROC_EVENT_TYPE_FORK && events[i].pid == childPid )
+                return 0;
+        }
+    }
+
+    return -1;
+}
+
+int proc_events_open(void)
+{
+    struct sockaddr_nl addr;
+    int sockFd;
+    int rcvBufSize;
+    int savedErrno;
+
+    sockFd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if ( sockFd < 0 )
+        return -1;
+
+    rcvBufSize = PROC_EVENTS_SOCKET_RCVBUF;
+    setsockopt(sockFd, SOL_SOCKET, SO_RCVBUF, &rcvBufSize, sizeof(rcvBufSize));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = CN_IDX_PROC;
+    addr.nl_pid = 0; /* Let the kernel assign our port id */
+
+    /* Binding to the group fails with EPERM without CAP_NET_ADMIN */
+    if ( bind(sockFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 )
+        goto __error_close;
+
+    if ( _send_mcast_op(sockFd, PROC_CN_MCAST_LISTEN) < 0 )
+        goto __error_close;
+
+    if ( _probe_events(sockFd) < 0 )
+    {
+        _send_mcast_op(sockFd, PROC_CN_MCAST_IGNORE);
+        errno = ENOTSUP;
+        goto __error_close;
+    }
+
+    return sockFd;
+
+__error_close:
+    savedErrno = errno;
+    close(sockFd);
+    errno = savedErrno;
+
+    return -1;
+}
+
+int proc_events_read(int sockFd, ProcEvent *events, int maxEvents, int timeoutMs)
+{
+    char buff[PROC_EVENTS_RECV_BUFFER_SIZE] ALIGN_8;
+    struct pollfd pollInfo;
+    struct nlmsghdr *header;
+    struct cn_msg *message;
+    struct proc_event *procEvent;
+    ssize_t bytesRead;
+    int numEvents;
+    int pollRet;
+
+    pollInfo.fd = sockFd;
+    pollInfo.events = POLLIN;
+    pollInfo.revents = 0;
+
+    do {
+        pollRet = poll(&pollInfo, 1, timeoutMs);
+    } while ( pollRet < 0 && errno == EINTR );
+
+    if ( pollRet < 0 )
+        return -1;
+    if ( pollRet == 0 )
+        return 0;
+
+    numEvents = 0;
+
+    /* Drain whatever is queued (up to #maxEvents), without blocking again.
+     *   The kernel sends each event as its own datagram, so stopping
+     *   once #events is full never drops anything.
+     */
+    while ( numEvents < maxEvents )
+    {
+        bytesRead = recv(sockFd, buff, sizeof(buff), MSG_DONTWAIT);
+        if ( bytesRead < 0 )
+        {
+            if ( errno == EAGAIN || errno == EWOULDBLOCK )
+                break;
+            if ( errno == EINTR )
+                continue;
+            if ( errno == ENOBUFS )
+                return PROC_EVENTS_ERROR_OVERRUN;
+
+            return -1;
+        }
+        if ( bytesRead == 0 )
+            break;
+
+        for( header = (struct nlmsghdr *)buff; NLMSG_OK(header, (size_t)bytesRead); header = NLMSG_NEXT(header, bytesRead) )
+        {
+            if ( header->nlmsg_type == NLMSG_NOOP )
+                continue;
+            if ( header->nlmsg_type == NLMSG_ERROR || header->nlmsg_type == NLMSG_OVERRUN )
+                return PROC_EVENTS_ERROR_OVERRUN;
+
+            message = (struct cn_msg *)NLMSG_DATA(header);
+            if ( message->id.idx != CN_IDX_PROC || message->id.val != CN_VAL_PROC )
+                continue;
+
+            procEvent = (struct proc_event *)message->data;
+
+            switch( procEvent->what )
+            {
+                case PROC_EVENT_FORK:
+                    /* Skip new threads, only new processes are interesting */
+                    if ( procEvent->event_data.fork.child_pid != procEvent->event_data.fork.child_tgid )
+                        continue;
+
+                    events[numEvents].eventType = PROC_EVENT_TYPE_FORK;
+                    events[numEvents].pid = procEvent->event_data.fork.child_tgid;
+                    events[numEvents].ppid = procEvent->event_data.fork.parent_tgid;
+                    break;
+                case PROC_EVENT_EXEC:
+                    events[numEvents].eventType = PROC_EVENT_TYPE_EXEC;
+                    events[numEvents].pid = procEvent->event_data.exec.process_tgid;
+                    events[numEvents].ppid = 0;
+                    break;
+                case PROC_EVENT_EXIT:
+                    /* Only the thread group leader exiting means the process is gone */
+                    if ( procEvent->event_data.exit.process_pid != procEvent->event_data.exit.process_tgid )
+                        continue;
+
+                    events[numEvents].eventType = PROC_EVENT_TYPE_EXIT;
+                    events[numEvents].pid = procEvent->event_data.exit.process_tgid;
+                    events[numEvents].ppid = 0;
+                    break;
+                default:
+                    continue;
+            }
+
+            if ( ++numEvents == maxEvents )
+                break;
+        }
+    }
+
+    return numEvents;
+}
+
+void proc_events_close(int sockFd)
+{
+    if ( sockFd < 0 )
+        return;
+
+    _send_mcast_op(sockFd, PROC_CN_MCAST_IGNORE);
+    close(sockFd);
+}
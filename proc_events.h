@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * proc_events.h - Interface definitions for receiving process fork/exec/exit
+ *                   events from the kernel's netlink process connector
+ *
+ *   The connector requires CAP_NET_ADMIN (usually root), and only reports
+ *     events from the initial network namespace. proc_events_open verifies
+ *     that events are actually being delivered, so callers can fall back
+ *     to rescanning /proc whenever it fails.
+ */
+
+#ifndef _PROC_EVENTS_H
+#define _PROC_EVENTS_H
+
+#include <sys/types.h>
+
+#include "pid_tools.h"
+
+/*******************
+ * DATA TYPES
+ ******************/
+
+/* Values for ProcEvent.eventType */
+
+/* PROC_EVENT_TYPE_FORK - A new process was created. #pid is the child, #ppid the parent */
+#define PROC_EVENT_TYPE_FORK (1)
+/* PROC_EVENT_TYPE_EXEC - A process called exec. #pid is the process, #ppid is unset */
+#define PROC_EVENT_TYPE_EXEC (2)
+/* PROC_EVENT_TYPE_EXIT - A process exited. #pid is the process, #ppid is unset */
+#define PROC_EVENT_TYPE_EXIT (3)
+
+/**
+ *   ProcEvent - A single process event.
+ *
+ *      Only whole processes are reported (thread creation and the exit
+ *        of non-leader threads are filtered out), and pids are thread group ids.
+ */
+typedef struct {
+
+    int eventType;
+    pid_t pid;
+    pid_t ppid;
+
+} ProcEvent;
+
+
+/*******************
+ * MACROS
+ ******************/
+
+/* PROC_EVENTS_ERROR_OVERRUN - Returned by proc_events_read if the kernel dropped events
+ *     because we didn't read fast enough. Any state built from events must be resynced.
+ */
+#define PROC_EVENTS_ERROR_OVERRUN (-2)
+
+
+/*******************
+ * PUBLIC FUNCTIONS
+ ******************/
+
+/**
+ *    proc_events_open - Connect to the process connector and subscribe to events
+ *
+ *          Subscribe before taking any snapshot of the process table, then apply
+ *            events on top of the snapshot, so nothing is missed in between.
+ *
+ *          @return <int> - A socket to pass to proc_events_read, or -1 if the
+ *                      connector is unavailable (errno is set where possible)
+ */
+int proc_events_open(void);
+
+/**
+ *    proc_events_read - Wait for and read events
+ *
+ *          @param sockFd <int> - Socket returned by proc_events_open
+ *
+ *          @param events <ProcEvent *> - Array which will hold the events read
+ *
+ *          @param maxEvents <int> - Size of #events
+ *
+ *          @param timeoutMs <int> - Max milliseconds to wait for an event, or -1 to wait forever
+ *
+ *          @return <int> - Number of events placed in #events (0 on timeout),
+ *                      PROC_EVENTS_ERROR_OVERRUN if events were lost,
+ *                      or -1 on error (errno is set)
+ */
+int proc_events_read(int sockFd, ProcEvent *events, int maxEvents, int timeoutMs);
+
+/**
+ *    proc_events_close - Unsubscribe and close a socket returned by proc_events_open
+ *
+ *          @param sockFd <int> - Socket returned by proc_events_open
+ */
+void proc_events_close(int sockFd);
+
+
+#endif
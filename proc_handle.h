@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * proc_handle.h - some static utility functions shared by several executables
+ *            for opening files under /proc/$PID
+ *
+ *         Everything here is opened relative to a cached file descriptor for /proc,
+ *         so the kernel never has to walk the path from "/" again, and paths are
+ *         built with a small integer formatter instead of sprintf.
+ *
+ *         These are contained in this header versus a .c file to allow
+ *         optimizations which wouldn't otherwise get applied if not single unit
+ *         (e.x. inlining).
+ *
+ */
+
+#ifndef _PROC_HANDLE_H
+#define _PROC_HANDLE_H
+
+#include "pid_tools.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/* PROC_PID_STR_SIZE - Big enough to hold any pid as a string, plus the null */
+#define PROC_PID_STR_SIZE 16
+
+/* PROC_PID_PATH_SIZE - Big enough to hold "$PID/" plus any file name we use (e.x. "task/$TID/children") */
+#define PROC_PID_PATH_SIZE 64
+
+
+/**
+ *   ProcHandle - An open /proc/$PID directory.
+ *
+ *      Every file opened through one handle is guaranteed to belong to the
+ *        same process, even if the pid is reused in between (the kernel
+ *        will fail the open with ESRCH instead).
+ *
+ *      Open with - proc_handle_open
+ *
+ *      Close with - proc_handle_close
+ */
+typedef struct {
+
+    pid_t pid;
+    int dirFd;
+
+} ProcHandle;
+
+
+/**
+ * pid_to_str - Format a pid as a decimal string
+ *
+ *    @param pid <pid_t> - The pid. Must be > 0
+ *
+ *    @param buf <char *> - Buffer of at least PROC_PID_STR_SIZE. Will be null-terminated
+ *
+ *    @return <int> - Length of the string written (not including the null)
+ */
+MAYBE_UNUSED static inline int pid_to_str(pid_t pid, char *buf)
+{
+    char reversed[PROC_PID_STR_SIZE];
+    unsigned int value;
+    int len, i;
+
+    value = (unsigned int)pid;
+    len = 0;
+    do {
+        reversed[len++] = '0' + (value % 10);
+        value /= 10;
+    } while ( value != 0 );
+
+    for( i=0; i < len; i++ )
+        buf[i] = reversed[ len - 1 - i ];
+
+    buf[len] = '\0';
+
+    return len;
+}
+
+/**
+ * proc_get_dirfd - Get a file descriptor for /proc, which is opened on first use
+ *                   and kept open for the life of the process.
+ *
+ *    @return <int> - The file descriptor, or -1 if /proc could not be opened (errno is set)
+ */
+MAYBE_UNUSED static int proc_get_dirfd(void)
+{
+    static int procDirFd = -1;
+    int newFd;
+
+    if ( likely( procDirFd >= 0 ) )
+        return procDirFd;
+
+    newFd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if ( unlikely( newFd < 0 ) )
+        return -1;
+
+    /* If another thread beat us to it, use theirs */
+    if ( ! __sync_bool_compare_and_swap( &procDirFd, -1, newFd ) )
+        close(newFd);
+
+    return procDirFd;
+}
+
+/**
+ * proc_open_pid_file - Open a single file under /proc/$PID
+ *
+ *      This is the cheapest way to read just one file from a pid (a single openat).
+ *        Use a ProcHandle instead if reading several files from the same pid.
+ *
+ *    @param pid <pid_t> - The pid
+ *
+ *    @param fileName <const char *> - Name relative to /proc/$PID, e.x. "stat"
+ *
+ *    @param flags <int> - Flags for open, e.x. O_RDONLY
+ *
+ *    @return <int> - An open file descriptor, or -1 on error (errno is set)
+ */
+MAYBE_UNUSED static int proc_open_pid_file(pid_t pid, const char *fileName, int flags)
+{
+    char path[PROC_PID_PATH_SIZE];
+    size_t pathLen;
+    size_t fileNameLen;
+    int procDirFd;
+
+    procDirFd = proc_get_dirfd();
+    if ( unlikely( procDirFd < 0 ) )
+        return -1;
+
+    fileNameLen = strlen(fileName);
+    if ( unlikely( fileNameLen + PROC_PID_STR_SIZE + 1 > PROC_PID_PATH_SIZE ) )
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    pathLen = pid_to_str(pid, path);
+    path[pathLen++] = '/';
+    memcpy(&path[pathLen], fileName, fileNameLen + 1);
+
+    return openat(procDirFd, path, flags | O_CLOEXEC);
+}
+
+/**
+ * proc_handle_open - Open the /proc/$PID directory of a pid
+ *
+ *    @param handle <ProcHandle *> - Handle to fill in
+ *
+ *    @param pid <pid_t> - The pid
+ *
+ *    @return <int> - 0 on success, -1 on error (errno is set, e.x. ENOENT if no such pid)
+ */
+MAYBE_UNUSED static int proc_handle_open(ProcHandle *handle, pid_t pid)
+{
+    char pidStr[PROC_PID_STR_SIZE];
+    int procDirFd;
+
+    handle->pid = pid;
+    handle->dirFd = -1;
+
+    procDirFd = proc_get_dirfd();
+    if ( unlikely( procDirFd < 0 ) )
+        return -1;
+
+    pid_to_str(pid, pidStr);
+
+    handle->dirFd = openat(procDirFd, pidStr, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if ( unlikely( handle->dirFd < 0 ) )
+        return -1;
+
+    return 0;
+}
+
+/**
+ * proc_handle_openat - Open a file relative to an open /proc/$PID
+ *
+ *    @param handle <ProcHandle *> - An open handle
+ *
+ *    @param fileName <const char *> - Name relative to /proc/$PID, e.x. "status"
+ *
+ *    @param flags <int> - Flags for open, e.x. O_RDONLY
+ *
+ *    @return <int> - An open file descriptor, or -1 on error (errno is set)
+ */
+MAYBE_UNUSED static inline int proc_handle_openat(ProcHandle *handle, const char *fileName, int flags)
+{
+    return openat(handle->dirFd, fileName, flags | O_CLOEXEC);
+}
+
+/**
+ * proc_handle_close - Close an open /proc/$PID handle
+ *
+ *    @param handle <ProcHandle *> - The handle to close
+ */
+MAYBE_UNUSED static inline void proc_handle_close(ProcHandle *handle)
+{
+    if ( handle->dirFd >= 0 )
+    {
+        close(handle->dirFd);
+        handle->dirFd = -1;
+    }
+}
+
+/**
+ * proc_stat_pid_dir - fstat the /proc/$PID directory, without opening it
+ *
+ *    @param pid <pid_t> - The pid
+ *
+ *    @param statBuf <struct stat *> - Will be filled with the result
+ *
+ *    @return <int> - 0 on success, -1 on error (errno is set, e.x. ENOENT if no such pid)
+ */
+MAYBE_UNUSED static int proc_stat_pid_dir(pid_t pid, struct stat *statBuf)
+{
+    char pidStr[PROC_PID_STR_SIZE];
+    int procDirFd;
+
+    procDirFd = proc_get_dirfd();
+    if ( unlikely( procDirFd < 0 ) )
+        return -1;
+
+    pid_to_str(pid, pidStr);
+
+    return fstatat(procDirFd, pidStr, statBuf, 0);
+}
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * proc_pidfd.h - some static utility functions for process file descriptors
+ *            (pidfd_open, Linux 5.3+), which become readable (poll/epoll)
+ *            when the process they refer to exits.
+ *
+ *         A pidfd always refers to the process it was opened for, even if the
+ *         pid is later reused, so nothing has to be polled to notice an exit.
+ *
+ *         These are contained in this header versus a .c file to allow
+ *         optimizations which wouldn't otherwise get applied if not single unit
+ *         (e.x. inlining).
+ *
+ */
+
+#ifndef _PROC_PIDFD_H
+#define _PROC_PIDFD_H
+
+#include "pid_tools.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+
+/* Older headers may not have the syscall number, which is the same on every architecture */
+#ifndef SYS_pidfd_open
+  #define SYS_pidfd_open 434
+#endif
+
+
+/**
+ * proc_pidfd_open - Open a pidfd for a process
+ *
+ *    @param pid <pid_t> - The pid. Must be the pid of a process (thread group leader),
+ *                           not of another thread
+ *
+ *    @return <int> - The pidfd (close-on-exec), or -1 on error (errno is set).
+ *                      ESRCH if the process does not exist, ENOSYS if the kernel has
+ *                      no pidfd_open, EINVAL if #pid is not a thread group leader
+ */
+MAYBE_UNUSED static inline int proc_pidfd_open(pid_t pid)
+{
+    /* pidfds are always close-on-exec */
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+/**
+ * proc_pidfd_raise_fd_limit - Raise the limit of open files, if it is below #numWanted,
+ *                               to hold one pidfd per process
+ *
+ *      The hard limit is raised too when allowed (root), otherwise the soft limit
+ *        is raised as far as the hard limit.
+ *
+ *    @param numWanted <rlim_t> - The number of descriptors that will be opened
+ */
+MAYBE_UNUSED static void proc_pidfd_raise_fd_limit(rlim_t numWanted)
+{
+    struct rlimit limit;
+
+    if ( getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur >= numWanted )
+        return;
+
+    if ( limit.rlim_max != RLIM_INFINITY && limit.rlim_max < numWanted )
+    {
+        limit.rlim_cur = limit.rlim_max = numWanted;
+        if ( setrlimit(RLIMIT_NOFILE, &limit) == 0 )
+            return;
+
+        getrlimit(RLIMIT_NOFILE, &limit);
+        limit.rlim_cur = limit.rlim_max;
+    }
+    else
+    {
+        limit.rlim_cur = numWanted;
+    }
+
+    setrlimit(RLIMIT_NOFILE, &limit);
+}
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * proc_pids.c - Interface implementations for listing all live pids
+ *
+ *   Reads the /proc directory with raw getdents64 calls into a large buffer,
+ *     and parses the numeric names in place (no readdir, no atoi).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+
+#include "pid_tools.h"
+
+#include "proc_pids.h"
+
+
+/**
+ *   struct _linux_dirent64 - A directory entry as returned by the getdents64 syscall
+ */
+struct _linux_dirent64 {
+    uint64_t       d_ino;
+    int64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+static int _cmp_pids(const void *p1, const void *p2)
+{
+    pid_t val1, val2;
+
+    val1 = *((pid_t *)p1);
+    val2 = *((pid_t *)p2);
+
+    return (val1 > val2) - (val1 < val2);
+}
+
+pid_t *proc_pids_get_all(size_t *numPids)
+{
+    int procFd;
+    char *dentsBuffer;
+    long bytesRead;
+    long offset;
+    struct _linux_dirent64 *dirEntry;
+    const char *name;
+    pid_t curPid;
+    pid_t lastPid;
+    int isSorted;
+    int oldErrno;
+
+    pid_t *ret;
+    size_t retLen, retCapacity;
+
+    *numPids = 0;
+
+    procFd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if ( unlikely( procFd < 0 ) )
+        return NULL;
+
+    dentsBuffer = malloc( PROC_PIDS_DENTS_BUFFER_SIZE );
+
+    retLen = 0;
+    retCapacity = 1024;
+    ret = malloc( sizeof(pid_t) * retCapacity );
+
+    lastPid = 0;
+    isSorted = 1;
+
+    while ( (bytesRead = syscall(SYS_getdents64, procFd, dentsBuffer, PROC_PIDS_DENTS_BUFFER_SIZE)) > 0 )
+    {
+        for( offset = 0; offset < bytesRead; offset += dirEntry->d_reclen )
+        {
+            dirEntry = (struct _linux_dirent64 *) &dentsBuffer[offset];
+            name = dirEntry->d_name;
+
+            /* Pids are the only entries which start with a digit */
+            if ( (unsigned char)(name[0] - '0') > 9 )
+                continue;
+
+            curPid = 0;
+            do {
+                curPid = (curPid * 10) + (*name - '0');
+                name++;
+            } while ( *name != '\0' );
+
+            if ( unlikely( retLen >= retCapacity ) )
+            {
+                retCapacity <<= 1;
+                ret = realloc( ret, sizeof(pid_t) * retCapacity );
+            }
+            ret[ retLen++ ] = curPid;
+
+            if ( unlikely( curPid < lastPid ) )
+                isSorted = 0;
+            lastPid = curPid;
+        }
+    }
+
+    if ( unlikely( bytesRead < 0 ) )
+    {
+        oldErrno = errno;
+        free(ret);
+        free(dentsBuffer);
+        close(procFd);
+        errno = oldErrno;
+        return NULL;
+    }
+
+    free(dentsBuffer);
+    close(procFd);
+
+    /* The kernel hands these out in pid order, but it doesn't promise to. */
+    if ( unlikely( ! isSorted ) )
+        qsort(ret, retLen, sizeof(pid_t), _cmp_pids);
+
+    *numPids = retLen;
+
+    return ret;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * proc_pids.h - Interface definitions for listing all live pids
+ *
+ */
+
+#ifndef _PROC_PIDS_H
+#define _PROC_PIDS_H
+
+#include <sys/types.h>
+
+#include "pid_tools.h"
+
+/*******************
+ * MACROS
+ ******************/
+
+/* PROC_PIDS_DENTS_BUFFER_SIZE - Size of the buffer handed to each getdents64 call.
+ *    /proc entries are 24-32 bytes each, so this reads ~2000+ pids per syscall.
+ */
+#define PROC_PIDS_DENTS_BUFFER_SIZE ( 64 * 1024 )
+
+
+/*******************
+ * PUBLIC FUNCTIONS
+ ******************/
+
+/**
+ *    proc_pids_get_all - Get a list of every pid currently present in /proc
+ *
+ *          @param numPids <size_t *> - The size of the returned list will be stored here
+ *
+ *          @return <pid_t *> - A list of all pids, sorted ascending, or NULL on error
+ *                      (with errno set from the failed call).
+ *
+ *              You are responsible for freeing this list
+ */
+pid_t *proc_pids_get_all(size_t *numPids);
+
+
+#endif
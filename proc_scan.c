@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * proc_scan.c - Interface implementations for scanning per-pid /proc files
+ *                 with a pool of worker threads
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "pid_tools.h"
+
+#include "proc_scan.h"
+
+
+/* PROC_SCAN_CHUNK_SIZE - Number of pids a worker claims at a time.
+ *    Large enough to keep contention on the shared counter low, small
+ *    enough that a few slow pids don't leave other threads idle at the end.
+ */
+#define PROC_SCAN_CHUNK_SIZE 32
+
+/**
+ *   struct _proc_scan_job - State shared between all workers of a single proc_scan_run
+ */
+struct _proc_scan_job {
+
+    const pid_t *pids;
+    size_t numPids;
+
+    char *results;
+    size_t resultSize;
+
+    proc_scan_func scanFunc;
+    size_t threadBufferSize;
+
+    size_t nextIdx; /* Next unclaimed index into #pids. Only modified atomically */
+
+};
+
+unsigned int proc_scan_get_default_num_threads(void)
+{
+    long numCpus;
+
+    numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if ( unlikely( numCpus < 1 ) )
+        return 1;
+
+    if ( unlikely( numCpus > PROC_SCAN_MAX_THREADS ) )
+        return PROC_SCAN_MAX_THREADS;
+
+    return (unsigned int)numCpus;
+}
+
+/**
+ * _proc_scan_worker - Body of each worker. Claims chunks of pids until none remain.
+ */
+static void *_proc_scan_worker(void *_job)
+{
+    struct _proc_scan_job *job = (struct _proc_scan_job *)_job;
+    void *threadBuffer = NULL;
+    size_t startIdx, endIdx, i;
+
+    if ( job->threadBufferSize > 0 )
+        threadBuffer = malloc( job->threadBufferSize );
+
+    while ( 1 )
+    {
+        startIdx = __sync_fetch_and_add( &(job->nextIdx), PROC_SCAN_CHUNK_SIZE );
+        if ( startIdx >= job->numPids )
+            break;
+
+        endIdx = startIdx + PROC_SCAN_CHUNK_SIZE;
+        if ( endIdx > job->numPids )
+            endIdx = job->numPids;
+
+        for( i = startIdx; i < endIdx; i++ )
+        {
+            job->scanFunc( job->pids[i], &(job->results[ i * job->resultSize ]), threadBuffer );
+        }
+    }
+
+    if ( threadBuffer != NULL )
+        free(threadBuffer);
+
+    return NULL;
+}
+
+void proc_scan_run(const pid_t *pids, size_t numPids, void *results, size_t resultSize,
+    proc_scan_func scanFunc, size_t threadBufferSize, unsigned int numThreads)
+{
+    struct _proc_scan_job job;
+    pthread_t *threads;
+    unsigned int numStarted;
+    unsigned int i;
+
+    if ( numThreads == 0 )
+        numThreads = proc_scan_get_default_num_threads();
+
+    if ( numThreads > PROC_SCAN_MAX_THREADS )
+        numThreads = PROC_SCAN_MAX_THREADS;
+
+    /* Only use as many threads as there is meaningful work for */
+    if ( numThreads > numPids / PROC_SCAN_MIN_PIDS_PER_THREAD )
+        numThreads = numPids / PROC_SCAN_MIN_PIDS_PER_THREAD;
+
+    if ( numThreads < 1 )
+        numThreads = 1;
+
+    job.pids = pids;
+    job.numPids = numPids;
+    job.results = (char *)results;
+    job.resultSize = resultSize;
+    job.scanFunc = scanFunc;
+    job.threadBufferSize = threadBufferSize;
+    job.nextIdx = 0;
+
+    /* The calling thread is one of the workers, so start one fewer */
+    threads = NULL;
+    numStarted = 0;
+    if ( numThreads > 1 )
+    {
+        threads = malloc( sizeof(pthread_t) * (numThreads - 1) );
+        for( i=0; i < numThreads - 1; i++ )
+        {
+            if ( unlikely( pthread_create( &threads[numStarted], NULL, _proc_scan_worker, &job ) != 0 ) )
+                break; /* Whatever we have started (plus this thread) will finish the job */
+
+            numStarted++;
+        }
+    }
+
+    _proc_scan_worker(&job);
+
+    for( i=0; i < numStarted; i++ )
+        pthread_join( threads[i], NULL );
+
+    if ( threads != NULL )
+        free(threads);
+}
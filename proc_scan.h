@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * proc_scan.h - Interface definitions for scanning per-pid /proc files
+ *                 with a pool of worker threads
+ *
+ */
+
+#ifndef _PROC_SCAN_H
+#define _PROC_SCAN_H
+
+#include <sys/types.h>
+
+#include "pid_tools.h"
+
+/*******************
+ * DATA TYPES
+ ******************/
+
+/**
+ *   proc_scan_func - Function called once for every pid being scanned.
+ *
+ *      @param pid <pid_t> - The pid to read
+ *
+ *      @param result <void *> - This pid's slot in the results array, of the
+ *                          #resultSize passed to proc_scan_run. Write the parsed result here.
+ *
+ *      @param threadBuffer <void *> - Scratch space of #threadBufferSize bytes,
+ *                          private to the calling worker thread. May be NULL if
+ *                          #threadBufferSize was 0.
+ *
+ *   This will be called concurrently from several threads, so it must not use static data.
+ */
+typedef void (*proc_scan_func)(pid_t pid, void *result, void *threadBuffer);
+
+
+/*******************
+ * MACROS
+ ******************/
+
+/* PROC_SCAN_MIN_PIDS_PER_THREAD - Don't start another thread unless it has at least this many pids to scan */
+#define PROC_SCAN_MIN_PIDS_PER_THREAD 64
+
+/* PROC_SCAN_MAX_THREADS - Upper bound on the number of worker threads */
+#define PROC_SCAN_MAX_THREADS 256
+
+
+/*******************
+ * PUBLIC FUNCTIONS
+ ******************/
+
+/**
+ *    proc_scan_get_default_num_threads - Get the default number of worker threads,
+ *                                           which is the number of online cpus
+ *
+ *          @return <unsigned int> - Number of threads (at least 1)
+ */
+unsigned int proc_scan_get_default_num_threads(void);
+
+/**
+ *    proc_scan_run - Call #scanFunc for every pid in #pids, spread across worker threads
+ *
+ *          @param pids <const pid_t *> - The pids to scan
+ *
+ *          @param numPids <size_t> - Number of elements in #pids
+ *
+ *          @param results <void *> - Array of #numPids elements, each #resultSize bytes.
+ *                      The result for pids[i] is written to the i'th element, so the
+ *                      results are in the same order as #pids no matter which thread did the work.
+ *
+ *          @param resultSize <size_t> - Size of a single element in #results
+ *
+ *          @param scanFunc <proc_scan_func> - Function to call for each pid
+ *
+ *          @param threadBufferSize <size_t> - Size of a scratch buffer to allocate for each thread, or 0 for none
+ *
+ *          @param numThreads <unsigned int> - Maximum number of threads to use, or 0 to use the default.
+ *                      Fewer may be used if there are not many pids.
+ */
+void proc_scan_run(const pid_t *pids, size_t numPids, void *results, size_t resultSize,
+    proc_scan_func scanFunc, size_t threadBufferSize, unsigned int numThreads);
+
+
+#endif
@@ -0,0 +1,468 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * proc_stat.h - some static utility functions shared by several executables
+ *            for reading and parsing /proc/$PID/stat
+ *
+ *         The process name (field 2) is in parens, and may itself contain spaces
+ *         and parens, so it is found by scanning back from the end for the last ')'.
+ *         Everything after that is space-separated numbers (and the state letter),
+ *         of which only the fields the caller asks for are converted.
+ *
+ *         Both the scan for the ')' and skipping over runs of unwanted fields look
+ *         at 8 bytes at a time, finding the matching bytes in each word with bit
+ *         tricks (SWAR) instead of testing byte by byte.
+ *
+ *         These are contained in this header versus a .c file to allow
+ *         optimizations which wouldn't otherwise get applied if not single unit
+ *         (e.x. inlining).
+ *
+ */
+
+#ifndef _PROC_STAT_H
+#define _PROC_STAT_H
+
+#include "pid_tools.h"
+
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+
+#include "proc_handle.h"
+
+/* PROC_STAT_READ_SIZE - Bytes of /proc/$PID/stat to read. Comfortably past rss (field 24), the last one we parse */
+#define PROC_STAT_READ_SIZE 1024
+
+/* PROC_STAT_COMM_SIZE - Size of ProcStat.comm. Longer names are truncated */
+#define PROC_STAT_COMM_SIZE 64
+
+/* Flags for the fields to parse. OR together the ones you need. */
+#define PROC_STAT_FIELD_COMM        (1 << 0)
+#define PROC_STAT_FIELD_STATE       (1 << 1)
+#define PROC_STAT_FIELD_PPID        (1 << 2)
+#define PROC_STAT_FIELD_PGRP        (1 << 3)
+#define PROC_STAT_FIELD_SESSION     (1 << 4)
+#define PROC_STAT_FIELD_UTIME       (1 << 5)
+#define PROC_STAT_FIELD_STIME       (1 << 6)
+#define PROC_STAT_FIELD_NUM_THREADS (1 << 7)
+#define PROC_STAT_FIELD_STARTTIME   (1 << 8)
+#define PROC_STAT_FIELD_RSS         (1 << 9)
+
+/* Field numbers within the stat line (see proc(5)), counting from 1 */
+#define _PROC_STAT_IDX_STATE 3
+#define _PROC_STAT_IDX_PPID 4
+#define _PROC_STAT_IDX_PGRP 5
+#define _PROC_STAT_IDX_SESSION 6
+#define _PROC_STAT_IDX_UTIME 14
+#define _PROC_STAT_IDX_STIME 15
+#define _PROC_STAT_IDX_NUM_THREADS 20
+#define _PROC_STAT_IDX_STARTTIME 22
+#define _PROC_STAT_IDX_RSS 24
+
+
+/**
+ *   ProcStat - Parsed fields of /proc/$PID/stat.
+ *
+ *      Only the fields requested are filled in, the rest are left as-is.
+ *      #pid is always filled in.
+ */
+typedef struct {
+
+    pid_t pid;
+    char state;          /* e.x. 'R', 'S', 'Z' */
+    pid_t ppid;          /* 0 if no parent */
+    pid_t pgrp;
+    pid_t session;
+
+    unsigned long long utime;     /* Clock ticks in user mode */
+    unsigned long long stime;     /* Clock ticks in kernel mode */
+    unsigned long long startTime; /* Clock ticks after boot the process started */
+
+    long numThreads;
+    long rss;            /* Resident set size, in pages */
+
+    char comm[PROC_STAT_COMM_SIZE];
+
+} ProcStat;
+
+
+/**
+ * _proc_stat_field_flag - Get the PROC_STAT_FIELD_* flag for a field number, or 0 if we don't parse it
+ */
+static inline unsigned int _proc_stat_field_flag(unsigned int fieldIdx)
+{
+    switch( fieldIdx )
+    {
+        case _PROC_STAT_IDX_STATE:
+            return PROC_STAT_FIELD_STATE;
+        case _PROC_STAT_IDX_PPID:
+            return PROC_STAT_FIELD_PPID;
+        case _PROC_STAT_IDX_PGRP:
+            return PROC_STAT_FIELD_PGRP;
+        case _PROC_STAT_IDX_SESSION:
+            return PROC_STAT_FIELD_SESSION;
+        case _PROC_STAT_IDX_UTIME:
+            return PROC_STAT_FIELD_UTIME;
+        case _PROC_STAT_IDX_STIME:
+            return PROC_STAT_FIELD_STIME;
+        case _PROC_STAT_IDX_NUM_THREADS:
+            return PROC_STAT_FIELD_NUM_THREADS;
+        case _PROC_STAT_IDX_STARTTIME:
+            return PROC_STAT_FIELD_STARTTIME;
+        case _PROC_STAT_IDX_RSS:
+            return PROC_STAT_FIELD_RSS;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * _proc_stat_byte_mask - Get a mask with the high bit set in every byte of #word that equals #ch
+ */
+static inline uint64_t _proc_stat_byte_mask(uint64_t word, unsigned char ch)
+{
+    uint64_t x;
+
+    /* Matching bytes become zero, then set the high bit of exactly the zero bytes */
+    x = word ^ ( 0x0101010101010101ULL * ch );
+
+    return ~( ( (x & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL ) | x | 0x7f7f7f7f7f7f7f7fULL );
+}
+
+/**
+ * _proc_stat_find_last_paren - Scan back from #end for the last ')' at or after #start
+ *
+ *    @return <const char *> - The ')', or NULL if there is none
+ */
+static inline const char *_proc_stat_find_last_paren(const char *start, const char *end)
+{
+    uint64_t word, mask;
+
+    while ( end - start >= 8 )
+    {
+        memcpy(&word, end - 8, 8);
+        mask = _proc_stat_byte_mask(word, ')');
+        if ( mask )
+        {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            return end - 1 - ( __builtin_ctzll(mask) >> 3 );
+#else
+            return end - 8 + ( ( 63 - __builtin_clzll(mask) ) >> 3 );
+#endif
+        }
+        end -= 8;
+    }
+
+    while ( end > start )
+    {
+        if ( *(--end) == ')' )
+            return end;
+    }
+
+    return NULL;
+}
+
+/**
+ * _proc_stat_skip_fields - Skip forward past #numFields space-terminated fields
+ *
+ *    @return <const char *> - Start of the field after them, or NULL if the line ended first
+ */
+static inline const char *_proc_stat_skip_fields(const char *cur, const char *end, unsigned int numFields)
+{
+    uint64_t word;
+    unsigned int numSpaces;
+
+    /* Whole words for as long as the last space we need is past this word */
+    while ( end - cur >= 8 )
+    {
+        memcpy(&word, cur, 8);
+        numSpaces = __builtin_popcountll( _proc_stat_byte_mask(word, ' ') );
+        if ( numSpaces >= numFields )
+            break;
+
+        numFields -= numSpaces;
+        cur += 8;
+    }
+
+    for( ; cur < end; cur++ )
+    {
+        if ( *cur == ' ' && --numFields == 0 )
+            return cur + 1;
+    }
+
+    return NULL;
+}
+
+/**
+ * _proc_stat_parse_num - Parse a (maybe negative) decimal number
+ *
+ *    @return <const char *> - Start of the next field, or NULL if the line ended first
+ */
+static inline const char *_proc_stat_parse_num(const char *cur, const char *end, long long *value)
+{
+    unsigned long long num = 0;
+    int isNegative = 0;
+
+    if ( cur < end && *cur == '-' )
+    {
+        isNegative = 1;
+        cur++;
+    }
+
+    for( ; cur < end && *cur >= '0' && *cur <= '9'; cur++ )
+        num = (num * 10) + (*cur - '0');
+
+    *value = isNegative ? -(long long)num : (long long)num;
+
+    if ( cur >= end || *cur != ' ' )
+        return NULL;
+
+    return cur + 1;
+}
+
+/**
+ * proc_stat_parse - Parse the contents of a /proc/$PID/stat file
+ *
+ *    @param buff <const char *> - The contents (need not be null-terminated)
+ *
+ *    @param len <size_t> - Number of bytes in #buff
+ *
+ *    @param fields <unsigned int> - PROC_STAT_FIELD_* flags of the fields to parse
+ *
+ *    @param stat <ProcStat *> - Will be filled in with the requested fields
+ *
+ *    @return <int> - 0 on success, -1 if the contents were not valid (errno is set to EINVAL)
+ */
+MAYBE_UNUSED static int proc_stat_parse(const char *buff, size_t len, unsigned int fields, ProcStat *stat)
+{
+    const char *end, *cur, *commStart, *commEnd;
+    unsigned int fieldIdx, lastFieldIdx, numSkip;
+    long long value;
+    size_t commLen;
+
+    end = buff + len;
+
+    /* pid (field 1) */
+    stat->pid = 0;
+    for( cur = buff; cur < end && *cur >= '0' && *cur <= '9'; cur++ )
+        stat->pid = (stat->pid * 10) + (*cur - '0');
+
+    if ( unlikely( cur + 1 >= end || cur[1] != '(' ) )
+        goto __invalid;
+    commStart = cur + 2;
+
+    /* Nothing after the name can contain a ')', so the last one ends it */
+    commEnd = _proc_stat_find_last_paren(commStart, end);
+
+    if ( unlikely( commEnd == NULL || commEnd + 2 >= end ) )
+        goto __invalid;
+
+    if ( fields & PROC_STAT_FIELD_COMM )
+    {
+        commLen = commEnd - commStart;
+        if ( commLen > PROC_STAT_COMM_SIZE - 1 )
+            commLen = PROC_STAT_COMM_SIZE - 1;
+        memcpy(stat->comm, commStart, commLen);
+        stat->comm[commLen] = '\0';
+    }
+
+    /* ") " then field 3, the state */
+    cur = commEnd + 2;
+    if ( fields & PROC_STAT_FIELD_STATE )
+        stat->state = *cur;
+
+    if ( fields & PROC_STAT_FIELD_RSS )
+        lastFieldIdx = _PROC_STAT_IDX_RSS;
+    else if ( fields & PROC_STAT_FIELD_STARTTIME )
+        lastFieldIdx = _PROC_STAT_IDX_STARTTIME;
+    else if ( fields & PROC_STAT_FIELD_NUM_THREADS )
+        lastFieldIdx = _PROC_STAT_IDX_NUM_THREADS;
+    else if ( fields & PROC_STAT_FIELD_STIME )
+        lastFieldIdx = _PROC_STAT_IDX_STIME;
+    else if ( fields & PROC_STAT_FIELD_UTIME )
+        lastFieldIdx = _PROC_STAT_IDX_UTIME;
+    else if ( fields & PROC_STAT_FIELD_SESSION )
+        lastFieldIdx = _PROC_STAT_IDX_SESSION;
+    else if ( fields & PROC_STAT_FIELD_PGRP )
+        lastFieldIdx = _PROC_STAT_IDX_PGRP;
+    else if ( fields & PROC_STAT_FIELD_PPID )
+        lastFieldIdx = _PROC_STAT_IDX_PPID;
+    else
+        return 0;
+
+    fieldIdx = _PROC_STAT_IDX_STATE;
+    numSkip = 1; /* The state */
+
+    while ( 1 )
+    {
+        if ( numSkip )
+        {
+            cur = _proc_stat_skip_fields(cur, end, numSkip);
+            if ( unlikely( cur == NULL ) )
+                goto __invalid;
+            fieldIdx += numSkip;
+            numSkip = 0;
+        }
+
+        /* #cur is now the start of field #fieldIdx */
+        switch( fieldIdx )
+        {
+            case _PROC_STAT_IDX_PPID:
+                if ( ! (fields & PROC_STAT_FIELD_PPID) )
+                    goto __skip_one;
+                cur = _proc_stat_parse_num(cur, end, &value);
+                stat->ppid = (pid_t)value;
+                break;
+            case _PROC_STAT_IDX_PGRP:
+                if ( ! (fields & PROC_STAT_FIELD_PGRP) )
+                    goto __skip_one;
+                cur = _proc_stat_parse_num(cur, end, &value);
+                stat->pgrp = (pid_t)value;
+                break;
+            case _PROC_STAT_IDX_SESSION:
+                if ( ! (fields & PROC_STAT_FIELD_SESSION) )
+                    goto __skip_one;
+                cur = _proc_stat_parse_num(cur, end, &value);
+                stat->session = (pid_t)value;
+                break;
+            case _PROC_STAT_IDX_UTIME:
+                if ( ! (fields & PROC_STAT_FIELD_UTIME) )
+                    goto __skip_one;
+                cur = _proc_stat_parse_num(cur, end, &value);
+                stat->utime = (unsigned long long)value;
+                break;
+            case _PROC_STAT_IDX_STIME:
+                if ( ! (fields & PROC_STAT_FIELD_STIME) )
+                    goto __skip_one;
+                cur = _proc_stat_parse_num(cur, end, &value);
+                stat->stime = (unsigned long long)value;
+                break;
+            case _PROC_STAT_IDX_NUM_THREADS:
+                if ( ! (fields & PROC_STAT_FIELD_NUM_THREADS) )
+                    goto __skip_one;
+                cur = _proc_stat_parse_num(cur, end, &value);
+                stat->numThreads = (long)value;
+                break;
+            case _PROC_STAT_IDX_STARTTIME:
+                if ( ! (fields & PROC_STAT_FIELD_STARTTIME) )
+                    goto __skip_one;
+                cur = _proc_stat_parse_num(cur, end, &value);
+                stat->startTime = (unsigned long long)value;
+                break;
+            case _PROC_STAT_IDX_RSS:
+                /* Always wanted if we got here, it is the last field */
+                _proc_stat_parse_num(cur, end, &value);
+                stat->rss = (long)value;
+                return 0;
+            default:
+__skip_one:
+                /* Count the run of fields we don't want, to skip them all at once */
+                for( numSkip = 1; fieldIdx + numSkip < lastFieldIdx; numSkip++ )
+                {
+                    if ( fields & _proc_stat_field_flag(fieldIdx + numSkip) )
+                        break;
+                }
+                continue;
+        }
+
+        if ( fieldIdx == lastFieldIdx )
+            return 0;
+
+        if ( unlikely( cur == NULL ) )
+            goto __invalid;
+
+        fieldIdx++;
+    }
+
+__invalid:
+    errno = EINVAL;
+    return -1;
+}
+
+/**
+ * proc_stat_read_fd - Read and parse an open /proc/$PID/stat file
+ *
+ *    @param fd <int> - The open file. Not closed here
+ *
+ *    @param fields <unsigned int> - PROC_STAT_FIELD_* flags of the fields to parse
+ *
+ *    @param stat <ProcStat *> - Will be filled in with the requested fields
+ *
+ *    @return <int> - 0 on success, -1 on error (errno is set, EINVAL if the contents were not valid)
+ */
+MAYBE_UNUSED static int proc_stat_read_fd(int fd, unsigned int fields, ProcStat *stat)
+{
+    char buff[PROC_STAT_READ_SIZE];
+    ssize_t bytesRead;
+
+    bytesRead = read(fd, buff, sizeof(buff));
+    if ( bytesRead <= 0 )
+    {
+        if ( bytesRead == 0 )
+            errno = EINVAL;
+        return -1;
+    }
+
+    return proc_stat_parse(buff, bytesRead, fields, stat);
+}
+
+/**
+ * proc_stat_read - Read and parse /proc/$PID/stat
+ *
+ *    @param pid <pid_t> - The pid
+ *
+ *    @param fields <unsigned int> - PROC_STAT_FIELD_* flags of the fields to parse
+ *
+ *    @param stat <ProcStat *> - Will be filled in with the requested fields
+ *
+ *    @return <int> - 0 on success, -1 on error (errno is set, e.x. ENOENT if no such pid)
+ */
+MAYBE_UNUSED static int proc_stat_read(pid_t pid, unsigned int fields, ProcStat *stat)
+{
+    int fd;
+    int ret;
+
+    fd = proc_open_pid_file(pid, "stat", O_RDONLY);
+    if ( fd < 0 )
+        return -1;
+
+    ret = proc_stat_read_fd(fd, fields, stat);
+    close(fd);
+
+    return ret;
+}
+
+/**
+ * proc_stat_read_handle - Read and parse the stat file of an open ProcHandle
+ *
+ *    @param handle <ProcHandle *> - An open handle
+ *
+ *    @param fields <unsigned int> - PROC_STAT_FIELD_* flags of the fields to parse
+ *
+ *    @param stat <ProcStat *> - Will be filled in with the requested fields
+ *
+ *    @return <int> - 0 on success, -1 on error (errno is set)
+ */
+MAYBE_UNUSED static int proc_stat_read_handle(ProcHandle *handle, unsigned int fields, ProcStat *stat)
+{
+    int fd;
+    int ret;
+
+    fd = proc_handle_openat(handle, "stat", O_RDONLY);
+    if ( fd < 0 )
+        return -1;
+
+    ret = proc_stat_read_fd(fd, fields, stat);
+    close(fd);
+
+    return ret;
+}
+
+#endif
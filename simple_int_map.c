@@ -11,312 +11,575 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "pid_tools.h"
 
 #include "simple_int_map.h"
 
-/* ENFORCE_UNIQUE_ENTRIES - If defined, duplicate values are not added (so all values are unique) */
-#define ENFORCE_UNIQUE_ENTRIES
+/* SIMPLE_INT_MAP_MIN_CAPACITY - Smallest number of slots. Must be a power of 2 */
+#define SIMPLE_INT_MAP_MIN_CAPACITY 16
 
-SimpleIntMap *simple_int_map_create(unsigned int modSize)
+/* SIMPLE_INT_MAP_EMPTY - Value of an empty slot */
+#define SIMPLE_INT_MAP_EMPTY 0
+
+/* SIMPLE_INT_MAP_BATCH_SIZE - Number of values the *_many calls prefetch the slots of at once.
+ *   Enough misses in flight to cover memory latency, without the first prefetches of a
+ *   block being evicted before they are probed.
+ */
+#define SIMPLE_INT_MAP_BATCH_SIZE 32
+
+/* SIMPLE_INT_MAP_PREFETCH_MIN_CAPACITY - Below this many slots (256KB) the table stays in cache,
+ *   where prefetching only adds work, so the *_many calls just probe each value in turn
+ */
+#define SIMPLE_INT_MAP_PREFETCH_MIN_CAPACITY 65536
+
+/* SIMPLE_INT_MAP_INSERTION_SORT_MAX - Lists up to this long are insertion sorted, as the
+ *   radix sort's counting passes cost more than they save
+ */
+#define SIMPLE_INT_MAP_INSERTION_SORT_MAX 64
+
+/* SIMPLE_INT_MAP_SIGN_BIT - Flipped in each key by the radix sort, so negatives order first as unsigned */
+#define SIMPLE_INT_MAP_SIGN_BIT 0x80000000U
+
+
+/**
+ * _simple_int_map_ideal_slot - The slot a value hashes to, where its probe run starts
+ */
+static inline size_t _simple_int_map_ideal_slot(const SimpleIntMap *intMap, int value)
 {
-    SimpleIntMap *ret;
+    uint32_t hash;
 
-    ret = malloc( sizeof(SimpleIntMap) );
+    /* Multiply so runs of sequential pids spread out, then fold the high bits down into
+     *   the low bits used for the slot. Taking the top bits instead would keep slot order
+     *   the same at every capacity, so copying one map into another in slot order
+     *   (e.x. from simple_int_map_values) would pile everything into one long run.
+     */
+    hash = (uint32_t)value * 2654435769U;
+    hash ^= hash >> 16;
 
-    ret->modSize = modSize;
-    ret->nodeData = calloc( modSize + 1, sizeof(struct SimpleIntMapNode ) );
+    return (size_t)hash & ( intMap->capacity - 1 );
+}
 
-    ret->nodeHasData = calloc( modSize + 1, ((float)modSize) / ((float)sizeof(char)) );
-    ret->numEntries = 0;
+/**
+ * _simple_int_map_probe - Starting at #idx (the ideal slot of #value), find the slot
+ *                           holding #value, or the empty slot which ends its probe run
+ */
+static inline size_t _simple_int_map_probe(const SimpleIntMap *intMap, size_t idx, int value)
+{
+    size_t mask = intMap->capacity - 1;
 
-    return ret;
+    while ( intMap->slots[idx] != value && intMap->slots[idx] != SIMPLE_INT_MAP_EMPTY )
+        idx = (idx + 1) & mask;
+
+    return idx;
 }
 
-static int _simple_int_map_search_node_data(struct SimpleIntMapNode *nodeToSearch, int findInt)
+/**
+ * _simple_int_map_find_slot - Find the slot holding #value, or the empty slot which ends its probe run
+ */
+static inline size_t _simple_int_map_find_slot(const SimpleIntMap *intMap, int value)
 {
-    struct SimpleIntMapNode *curNode;
+    return _simple_int_map_probe(intMap, _simple_int_map_ideal_slot(intMap, value), value);
+}
 
-    curNode = nodeToSearch;
-    do {
+/**
+ * _simple_int_map_prefetch_batch - Work out the ideal slot of each of #values into #idealIdxs,
+ *                                    and start loading each slot's cache line
+ */
+static inline void _simple_int_map_prefetch_batch(const SimpleIntMap *intMap, const int *values, size_t numValues, size_t *idealIdxs, int forWrite)
+{
+    size_t i;
 
-        if ( curNode->data == findInt )
-            return 1;
-        
-        curNode = NODE_NEXT(curNode);
-    } while ( curNode != NULL );
+    for( i=0; i < numValues; i++ )
+        idealIdxs[i] = _simple_int_map_ideal_slot(intMap, values[i]);
 
-    return 0;
+    if ( forWrite )
+    {
+        for( i=0; i < numValues; i++ )
+            prefetch_write(&intMap->slots[ idealIdxs[i] ]);
+    }
+    else
+    {
+        for( i=0; i < numValues; i++ )
+            prefetch_read(&intMap->slots[ idealIdxs[i] ]);
+    }
 }
 
-int simple_int_map_contains(SimpleIntMap *intMap, int testInt)
+/**
+ * _simple_int_map_alloc_slots - Set up an empty table of #capacity (a power of 2) slots
+ */
+static void _simple_int_map_alloc_slots(SimpleIntMap *intMap, size_t capacity)
 {
-    unsigned int modSize;
-    unsigned int idxVal;
+    intMap->capacity = capacity;
+    intMap->slots = calloc( capacity, sizeof(int) );
+    intMap->numAllocs += 1;
+}
 
-    modSize = intMap->modSize;
+/**
+ * _simple_int_map_grow - Double the number of slots, and rehash everything into them
+ */
+static void _simple_int_map_grow(SimpleIntMap *intMap)
+{
+    int *oldSlots;
+    size_t oldCapacity;
+    size_t i;
 
-    idxVal = testInt % modSize;
+    oldSlots = intMap->slots;
+    oldCapacity = intMap->capacity;
 
-    /* Check if any data is valid here, if not no match. */
-    if ( ! intMap->nodeHasData[idxVal] )
-        return 0;
+    _simple_int_map_alloc_slots(intMap, oldCapacity * 2);
 
-    /* Data is present in this mod container, see if the linked list contains our number */
+    for( i=0; i < oldCapacity; i++ )
+    {
+        if ( oldSlots[i] != SIMPLE_INT_MAP_EMPTY )
+            intMap->slots[ _simple_int_map_find_slot(intMap, oldSlots[i]) ] = oldSlots[i];
+    }
 
-    return _simple_int_map_search_node_data( &(intMap->nodeData[idxVal]), testInt );
+    free(oldSlots);
 }
 
-int simple_int_map_add(SimpleIntMap *intMap, int toAdd)
+SimpleIntMap *simple_int_map_create(unsigned int sizeHint)
 {
-    unsigned int modSize;
-    unsigned int idxVal;
-    struct SimpleIntMapNode *intMapNode;
+    SimpleIntMap *ret;
+    size_t capacity;
+
+    ret = malloc( sizeof(SimpleIntMap) );
+    ret->numAllocs = 1;
+
+    /* Room for #sizeHint entries without going over half full */
+    capacity = SIMPLE_INT_MAP_MIN_CAPACITY;
+    while ( capacity < (size_t)sizeHint * 2 )
+        capacity <<= 1;
 
-    modSize = intMap->modSize;
+    _simple_int_map_alloc_slots(ret, capacity);
 
-    idxVal = toAdd % modSize;
+    ret->hasZero = 0;
+    ret->numEntries = 0;
 
-    intMapNode = &(intMap->nodeData[idxVal]);
+    return ret;
+}
 
-    /* See if any data is yet mapped at this mod container */
-    if ( ! intMap->nodeHasData[idxVal] )
+int simple_int_map_contains(SimpleIntMap *intMap, int testInt)
+{
+    if ( unlikely( testInt == SIMPLE_INT_MAP_EMPTY ) )
+        return intMap->hasZero;
+
+    return intMap->slots[ _simple_int_map_find_slot(intMap, testInt) ] == testInt;
+}
+
+/**
+ * _simple_int_map_rem_slot - Empty slot #idx, which holds a value, keeping every probe run whole
+ */
+static void _simple_int_map_rem_slot(SimpleIntMap *intMap, size_t idx)
+{
+    size_t mask = intMap->capacity - 1;
+    size_t nextIdx, idealIdx;
+
+    /* Walk the rest of the run, moving back into the hole every value which can no
+     *   longer be reached from its ideal slot (one whose ideal slot is not between
+     *   the hole and where it sits). The hole then moves to where that value was.
+     */
+    for( nextIdx = (idx + 1) & mask; intMap->slots[nextIdx] != SIMPLE_INT_MAP_EMPTY; nextIdx = (nextIdx + 1) & mask )
     {
-        /* Set the "data contained" flag and set the first "data" entry in container */
-        intMap->nodeHasData[idxVal] = 1;
+        idealIdx = _simple_int_map_ideal_slot(intMap, intMap->slots[nextIdx]);
+
+        if ( ( (nextIdx - idealIdx) & mask ) >= ( (nextIdx - idx) & mask ) )
+        {
+            intMap->slots[idx] = intMap->slots[nextIdx];
+            idx = nextIdx;
+        }
+    }
+
+    intMap->slots[idx] = SIMPLE_INT_MAP_EMPTY;
+    intMap->numEntries -= 1;
+}
 
-        intMapNode->data = toAdd;
-        intMapNode->next = NULL; /* TODO: Is this needed with calloc? */
+int simple_int_map_add(SimpleIntMap *intMap, int toAdd)
+{
+    size_t idx;
+
+    if ( unlikely( toAdd == SIMPLE_INT_MAP_EMPTY ) )
+    {
+        if ( intMap->hasZero )
+            return 0;
 
+        intMap->hasZero = 1;
         intMap->numEntries += 1;
 
         return 1;
     }
-    else
+
+    idx = _simple_int_map_find_slot(intMap, toAdd);
+    if ( intMap->slots[idx] == toAdd )
+        return 0;
+
+    /* Keep it at most half full (not counting 0, which has no slot) */
+    if ( unlikely( ( intMap->numEntries - intMap->hasZero + 1 ) * 2 > intMap->capacity ) )
     {
-        /* Otherwise, we need to add onto the next empty spot in the linked-list */
-        struct SimpleIntMapNode *curNode;
+        _simple_int_map_grow(intMap);
+        idx = _simple_int_map_find_slot(intMap, toAdd);
+    }
+
+    intMap->slots[idx] = toAdd;
+    intMap->numEntries += 1;
 
-        curNode = intMapNode;
+    return 1;
+}
 
-        while ( 1 ) 
+int simple_int_map_rem(SimpleIntMap *intMap, int toRem)
+{
+    size_t idx;
+
+    if ( unlikely( toRem == SIMPLE_INT_MAP_EMPTY ) )
+    {
+        if ( ! intMap->hasZero )
+            return 0;
+
+        intMap->hasZero = 0;
+        intMap->numEntries -= 1;
+
+        return 1;
+    }
+
+    idx = _simple_int_map_find_slot(intMap, toRem);
+    if ( intMap->slots[idx] != toRem )
+        return 0;
+
+    _simple_int_map_rem_slot(intMap, idx);
+
+    return 1;
+}
+
+size_t simple_int_map_add_many(SimpleIntMap *intMap, const int *values, size_t numValues)
+{
+    size_t idealIdxs[SIMPLE_INT_MAP_BATCH_SIZE];
+    size_t batchStart, batchLen, i, idx;
+    size_t numAdded = 0;
+    int value;
+
+    for( batchStart=0; batchStart < numValues; batchStart += batchLen )
+    {
+        batchLen = numValues - batchStart;
+        if ( batchLen > SIMPLE_INT_MAP_BATCH_SIZE )
+            batchLen = SIMPLE_INT_MAP_BATCH_SIZE;
+
+        if ( intMap->capacity < SIMPLE_INT_MAP_PREFETCH_MIN_CAPACITY )
         {
-            #ifdef ENFORCE_UNIQUE_ENTRIES
-            if ( curNode->data == toAdd )
-            {
-                /* We found a duplicate entry, so just exit */
-                return 0;
-            }
-            #endif
-            if ( curNode->next == NULL )
-            {
-                /* We found an empty "next", so take it and mark following as empty */
-                curNode->next = malloc( sizeof(struct SimpleIntMapNode) );
+            for( i=0; i < batchLen; i++ )
+                numAdded += simple_int_map_add(intMap, values[batchStart + i]);
+            continue;
+        }
 
-                curNode = NODE_NEXT( curNode );
+        /* Grow before working out the slots, so none of the block can move them */
+        while ( unlikely( ( intMap->numEntries - intMap->hasZero + batchLen ) * 2 > intMap->capacity ) )
+            _simple_int_map_grow(intMap);
 
-                curNode->data = toAdd;
-                curNode->next = NULL;
+        _simple_int_map_prefetch_batch(intMap, &values[batchStart], batchLen, idealIdxs, 1);
 
-                intMap->numEntries += 1;
+        for( i=0; i < batchLen; i++ )
+        {
+            value = values[batchStart + i];
 
-                return 1;
+            if ( unlikely( value == SIMPLE_INT_MAP_EMPTY ) )
+            {
+                numAdded += simple_int_map_add(intMap, value);
+                continue;
             }
-        
-            curNode = NODE_NEXT( curNode );
 
-        } /* while ( 1 ) */
-    } /* else */
+            idx = _simple_int_map_probe(intMap, idealIdxs[i], value);
+            if ( intMap->slots[idx] == value )
+                continue;
+
+            intMap->slots[idx] = value;
+            intMap->numEntries += 1;
+            numAdded++;
+        }
+    }
 
-    return 0; /* Should be unreachable */
+    return numAdded;
 }
 
-int simple_int_map_rem(SimpleIntMap *intMap, int toRem)
+size_t simple_int_map_contains_many(SimpleIntMap *intMap, const int *values, size_t numValues, uint64_t *resultBits)
 {
-    unsigned int modSize;
-    unsigned int idxVal;
-    struct SimpleIntMapNode *intMapNode;
+    size_t idealIdxs[SIMPLE_INT_MAP_BATCH_SIZE];
+    size_t batchStart, batchLen, i;
+    size_t numFound = 0;
+    uint64_t bits = 0;
+    int value, isFound;
+    int doPrefetch;
 
-    modSize = intMap->modSize;
+    doPrefetch = intMap->capacity >= SIMPLE_INT_MAP_PREFETCH_MIN_CAPACITY;
 
-    idxVal = toRem % modSize;
+    /* Blocks evenly divide 64, so each result word is built up in #bits, and stored once */
+    for( batchStart=0; batchStart < numValues; batchStart += batchLen )
+    {
+        batchLen = numValues - batchStart;
+        if ( batchLen > SIMPLE_INT_MAP_BATCH_SIZE )
+            batchLen = SIMPLE_INT_MAP_BATCH_SIZE;
 
-    intMapNode = &(intMap->nodeData[idxVal]);
+        if ( doPrefetch )
+            _simple_int_map_prefetch_batch(intMap, &values[batchStart], batchLen, idealIdxs, 0);
 
-    /* See if any data is yet mapped at this mod container */
-    if ( unlikely( ! intMap->nodeHasData[idxVal] ) )
-    {
-        return 0;
+        for( i=0; i < batchLen; i++ )
+        {
+            value = values[batchStart + i];
+
+            if ( unlikely( value == SIMPLE_INT_MAP_EMPTY ) )
+                isFound = intMap->hasZero;
+            else if ( doPrefetch )
+                isFound = intMap->slots[ _simple_int_map_probe(intMap, idealIdxs[i], value) ] == value;
+            else
+                isFound = intMap->slots[ _simple_int_map_find_slot(intMap, value) ] == value;
+
+            bits |= (uint64_t)isFound << ( (batchStart + i) % 64 );
+            numFound += isFound;
+        }
+
+        if ( ( batchStart + batchLen ) % 64 == 0 || batchStart + batchLen == numValues )
+        {
+            resultBits[ batchStart / 64 ] = bits;
+            bits = 0;
+        }
     }
-    else
+
+    return numFound;
+}
+
+size_t simple_int_map_rem_many(SimpleIntMap *intMap, const int *values, size_t numValues)
+{
+    size_t idealIdxs[SIMPLE_INT_MAP_BATCH_SIZE];
+    size_t batchStart, batchLen, i, idx;
+    size_t numRemoved = 0;
+    int value;
+
+    for( batchStart=0; batchStart < numValues; batchStart += batchLen )
     {
-        /* There are entries in this bin, see if we can find ours and if so remove it. */
-        struct SimpleIntMapNode *prevNode;
-        struct SimpleIntMapNode *curNode;
-        struct SimpleIntMapNode *nextNode;
+        batchLen = numValues - batchStart;
+        if ( batchLen > SIMPLE_INT_MAP_BATCH_SIZE )
+            batchLen = SIMPLE_INT_MAP_BATCH_SIZE;
 
-        prevNode = NULL;
-        curNode = intMapNode;
+        if ( intMap->capacity < SIMPLE_INT_MAP_PREFETCH_MIN_CAPACITY )
+        {
+            for( i=0; i < batchLen; i++ )
+                numRemoved += simple_int_map_rem(intMap, values[batchStart + i]);
+            continue;
+        }
+
+        _simple_int_map_prefetch_batch(intMap, &values[batchStart], batchLen, idealIdxs, 1);
 
-        while ( 1 ) 
+        for( i=0; i < batchLen; i++ )
         {
-            if ( curNode->data == toRem )
-            {
-                nextNode = NODE_NEXT(curNode);
-                /* Found our entry, now remove it. */
-                if ( prevNode == NULL )
-                {
-                    /* We are on the first node. */
-                    if ( nextNode == NULL )
-                    {
-                        /* There is no next node, so remove this bin. */
-                        intMap->nodeHasData[idxVal] = 0;
-                        /* 
-                           Zero-out the "data", even though it should be skipped
-                             since nodeHasData[idxVal] == 0
-                         */
-                        curNode->data = 0;
-                    }
-                    else
-                    {
-                        /* There is a next node, so lets move it to the first node */
-                        curNode->data = nextNode->data;
-                        curNode->next = (void*)nextNode->next;
-                        free(nextNode);
-
-                    }
-
-                }
-                else
-                {
-                    /* We are NOT on the first node */
-
-                    /* Make prevNode point to next and free this node */
-                    prevNode->next = (void*)nextNode;
-                    free(curNode);
-                }
-
-                intMap->numEntries -= 1;
-                return 1;
-            }
-            else
+            value = values[batchStart + i];
+
+            if ( unlikely( value == SIMPLE_INT_MAP_EMPTY ) )
             {
-                /* Not a match here, move onto next node */
-                prevNode = curNode;
-                curNode = NODE_NEXT( curNode );
-                if ( curNode == NULL )
-                {
-                    /* We have moved to the end of this bucket's linked list
-                        without finding a match. Must not be present.
-                    */
-                    return 0;
-                }
+                numRemoved += simple_int_map_rem(intMap, value);
+                continue;
             }
 
-        } /* while ( 1 ) */
-    } /* else */
+            /* Removing shifts values back, but never before their ideal slot, so the
+             *   ideal slots worked out for the rest of the block still start their runs
+             */
+            idx = _simple_int_map_probe(intMap, idealIdxs[i], value);
+            if ( intMap->slots[idx] != value )
+                continue;
 
-    return 0; /* Should be unreachable */
+            _simple_int_map_rem_slot(intMap, idx);
+            numRemoved++;
+        }
+    }
+
+    return numRemoved;
 }
 
 int *simple_int_map_values(SimpleIntMap *intMap, size_t *retLen)
 {
     int *ret;
-    unsigned int i;
-    unsigned int retIdx;
-    struct SimpleIntMapNode *curNode, *nextNode;
+    size_t i;
+    size_t retIdx;
 
     ret = malloc( intMap->numEntries * sizeof(int) );
     retIdx = 0;
 
-    for ( i = 0; i < intMap->modSize; i++ )
+    for ( i = 0; i < intMap->capacity; i++ )
     {
-        if ( ! intMap->nodeHasData[i] )
-            continue;
-
-        curNode = &(intMap->nodeData[i]);
+        if ( intMap->slots[i] != SIMPLE_INT_MAP_EMPTY )
+            ret[ retIdx++ ] = intMap->slots[i];
+    }
 
-        /* Add in top-level data to return result */
-        ret[ retIdx++ ] = curNode->data;
+    if ( intMap->hasZero )
+        ret[ retIdx++ ] = 0;
 
-        /* Iterate until no more data to add */
-        nextNode = NODE_NEXT(curNode);
-        while ( nextNode != NULL )
-        {
-            ret[ retIdx++ ] = nextNode->data;
+    *retLen = intMap->numEntries;
 
-            nextNode = NODE_NEXT(nextNode);
-        }
+    return ret;
+}
 
-    }
+int *simple_int_map_sorted_values(SimpleIntMap *intMap, size_t *retLen)
+{
+    int *ret;
 
-    *retLen = intMap->numEntries;
+    ret = simple_int_map_values(intMap, retLen);
+    simple_int_map_sort_ints(ret, *retLen);
 
     return ret;
 }
 
-void simple_int_map_destroy(SimpleIntMap *intMap)
+void simple_int_map_sort_ints(int *values, size_t numValues)
 {
-    unsigned int i;
+    size_t counts[4][256];
+    uint32_t *src, *dst, *swap, *buffer;
+    size_t i, j, total, count;
+    unsigned int pass, shift;
+    uint32_t key;
+    int value;
+
+    if ( numValues <= SIMPLE_INT_MAP_INSERTION_SORT_MAX )
+    {
+        for( i=1; i < numValues; i++ )
+        {
+            value = values[i];
+            for( j=i; j > 0 && values[j - 1] > value; j-- )
+                values[j] = values[j - 1];
+            values[j] = value;
+        }
+        return;
+    }
+
+    /* Count every byte of every key in one read through */
+    memset(counts, 0, sizeof(counts));
+    for( i=0; i < numValues; i++ )
+    {
+        key = (uint32_t)values[i] ^ SIMPLE_INT_MAP_SIGN_BIT;
 
-    void **toFree;
-    unsigned int toFreeIdx;
+        counts[0][ key & 0xff ]++;
+        counts[1][ (key >> 8) & 0xff ]++;
+        counts[2][ (key >> 16) & 0xff ]++;
+        counts[3][ key >> 24 ]++;
+    }
 
-    struct SimpleIntMapNode *curNode, *nextNode;
+    buffer = malloc( sizeof(uint32_t) * numValues );
+    src = (uint32_t *)values;
+    dst = buffer;
 
-    if ( likely( intMap->numEntries > 0 ) )
+    for( pass=0; pass < 4; pass++ )
     {
-        toFree = malloc( sizeof(void *) * intMap->numEntries );
-        toFreeIdx = 0;
+        shift = pass * 8;
+
+        /* Every key has the same byte here, so this pass would not move anything */
+        if ( counts[pass][ ( ( src[0] ^ SIMPLE_INT_MAP_SIGN_BIT ) >> shift ) & 0xff ] == numValues )
+            continue;
 
-        for ( i = 0; i < intMap->modSize; i++ )
+        /* Turn the counts into where each byte value's run starts */
+        for( i=0, total=0; i < 256; i++ )
         {
-            if ( ! intMap->nodeHasData[i] )
-                continue;
+            count = counts[pass][i];
+            counts[pass][i] = total;
+            total += count;
+        }
 
-            curNode = &(intMap->nodeData[i]);
+        for( i=0; i < numValues; i++ )
+            dst[ counts[pass][ ( ( src[i] ^ SIMPLE_INT_MAP_SIGN_BIT ) >> shift ) & 0xff ]++ ] = src[i];
 
-            /* Add in top-level data to list of items to free */
-            /*toFree[ toFreeIdx++ ] = curNode;*/
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
 
-            /* Iterate until no more nodes found at this level */
-            nextNode = NODE_NEXT(curNode);
-            while ( nextNode != NULL )
-            {
-                toFree[ toFreeIdx++ ] = nextNode;
+    if ( src != (uint32_t *)values )
+        memcpy(values, src, sizeof(int) * numValues);
 
-                nextNode = NODE_NEXT(nextNode);
-            }
-        } /* for i < intMap->modSize */
+    free(buffer);
+}
 
-        for( i=0; i < toFreeIdx; i++ )
-        {
-            free( toFree[i] );
-        }
+size_t simple_int_map_union(SimpleIntMap *dest, SimpleIntMap *src)
+{
+    int *values;
+    size_t numValues, numAdded;
 
-        free(toFree);
+    if ( MAP_NUM_ENTRIES(src) == 0 )
+        return 0;
+
+    values = simple_int_map_values(src, &numValues);
+    numAdded = simple_int_map_add_many(dest, values, numValues);
+    free(values);
+
+    return numAdded;
+}
+
+/**
+ * _simple_int_map_rem_by_membership - Remove every value from #dest whose membership
+ *                                       of #src is #isMember
+ *
+ *      @return <size_t> - Number of values removed from #dest
+ */
+static size_t _simple_int_map_rem_by_membership(SimpleIntMap *dest, SimpleIntMap *src, int isMember)
+{
+    int *values;
+    uint64_t *resultBits;
+    size_t numValues, numToRem, numRemoved, i;
+
+    if ( MAP_NUM_ENTRIES(dest) == 0 )
+        return 0;
+
+    /* Copied out first, as removing moves values around the slots */
+    values = simple_int_map_values(dest, &numValues);
+    resultBits = malloc( sizeof(uint64_t) * SIMPLE_INT_MAP_RESULT_WORDS(numValues) );
+
+    simple_int_map_contains_many(src, values, numValues, resultBits);
+
+    for( i=0, numToRem=0; i < numValues; i++ )
+    {
+        if ( SIMPLE_INT_MAP_RESULT_BIT(resultBits, i) == isMember )
+            values[ numToRem++ ] = values[i];
     }
 
-    free(intMap->nodeData);
-    free(intMap->nodeHasData);
-    free(intMap);
+    numRemoved = simple_int_map_rem_many(dest, values, numToRem);
 
+    free(resultBits);
+    free(values);
+
+    return numRemoved;
 }
 
-/*typedef struct {
-    
-    int curBucket;
-    struct SimpleIntMapNode *curNode;
+size_t simple_int_map_intersect(SimpleIntMap *dest, SimpleIntMap *src)
+{
+    return _simple_int_map_rem_by_membership(dest, src, 0);
+}
+
+size_t simple_int_map_difference(SimpleIntMap *dest, SimpleIntMap *src)
+{
+    int *values;
+    size_t numValues, numRemoved;
+
+    /* Look up whichever side has fewer values in the other */
+    if ( MAP_NUM_ENTRIES(src) > MAP_NUM_ENTRIES(dest) )
+        return _simple_int_map_rem_by_membership(dest, src, 1);
+
+    if ( MAP_NUM_ENTRIES(src) == 0 )
+        return 0;
+
+    values = simple_int_map_values(src, &numValues);
+    numRemoved = simple_int_map_rem_many(dest, values, numValues);
+    free(values);
+
+    return numRemoved;
+}
 
-} SimpleIntMapIterator;
-*/
+void simple_int_map_destroy(SimpleIntMap *intMap)
+{
+    free(intMap->slots);
+    free(intMap);
+}
 
 SimpleIntMapIterator *simple_int_map_get_iter(SimpleIntMap *intMap)
 {
-    SimpleIntMapIterator *iter = calloc( sizeof(SimpleIntMapIterator), 1 );
+    SimpleIntMapIterator *iter = malloc( sizeof(SimpleIntMapIterator) );
 
     iter->intMap = intMap;
+    iter->curSlot = SIMPLE_INT_MAP_ITER_NOT_STARTED;
 
     return iter;
 }
@@ -328,94 +591,51 @@ void simple_int_map_iter_destroy(SimpleIntMapIterator *mapIter)
 
 void simple_int_map_iter_reset(SimpleIntMapIterator *mapIter)
 {
-    mapIter->curBucket = 0;
-    mapIter->curNode = NULL;
+    mapIter->curSlot = SIMPLE_INT_MAP_ITER_NOT_STARTED;
 }
 
-static int _simple_int_map_move_iter_forward(SimpleIntMapIterator *mapIter)
+/**
+ * _simple_int_map_iter_seek - Find the next slot at or after #slot which holds a value
+ *
+ *    @return <size_t> - The slot, #capacity for the 0 value, or #capacity + 1 if there are no more
+ */
+static size_t _simple_int_map_iter_seek(const SimpleIntMap *intMap, size_t slot)
 {
-    SimpleIntMap *intMap;
-    struct SimpleIntMapNode *nextNode;
-    struct SimpleIntMapNode *curNode;
-    int bucketNum;
-    int stopIteration = 0;
-
-    intMap = mapIter->intMap;
-
-    curNode = mapIter->curNode;
-
-    if ( curNode != NULL )
-    {
-    
-        nextNode = NODE_NEXT(curNode);
-        if ( nextNode != NULL )
-        {
-            mapIter->curNode = nextNode;
-            return stopIteration;
-        }
-        else
-        {
-            /* Clear curNode marker, bump up bucket, and do the walk */
-            mapIter->curNode = NULL;
-            mapIter->curBucket += 1;
-        }
-    }
-
-    if ( unlikely( mapIter->curBucket >= intMap->modSize ) )
+    for( ; slot < intMap->capacity; slot++ )
     {
-        /* We are already at the end. */
-        stopIteration = 1;
-        return stopIteration;
+        if ( intMap->slots[slot] != SIMPLE_INT_MAP_EMPTY )
+            return slot;
     }
 
-    for( bucketNum = mapIter->curBucket; bucketNum < intMap->modSize; bucketNum++ )
-    {
-        if ( intMap->nodeHasData[ bucketNum ] )
-        {
-            mapIter->curBucket = bucketNum;
-            mapIter->curNode = &(intMap->nodeData[bucketNum]);
-            return stopIteration;
-        }
-    }
-    /* We hit the end without finding a value */
-    mapIter->curBucket = bucketNum;
-    mapIter->curNode = NULL;
+    if ( slot == intMap->capacity && intMap->hasZero )
+        return slot;
 
-    stopIteration = 1;
-    
-    return stopIteration;
+    return intMap->capacity + 1;
 }
 
 int simple_int_map_iter_next(SimpleIntMapIterator *mapIter, int *completedIterationPtr)
 {
+    SimpleIntMap *intMap;
     int ret;
-    struct SimpleIntMapNode *curNode;
-    int stopIteration = 0;
 
-    curNode = mapIter->curNode;
+    intMap = mapIter->intMap;
 
-    if ( curNode == NULL )
-    {
-        /* If we aren't on a node yet, move onto one */
-        stopIteration = _simple_int_map_move_iter_forward(mapIter);
-        if ( stopIteration )
-            *completedIterationPtr = stopIteration;
-    }
+    /* Found lazily, so values added between creating the iterator and the first call are seen */
+    if ( mapIter->curSlot == SIMPLE_INT_MAP_ITER_NOT_STARTED )
+        mapIter->curSlot = _simple_int_map_iter_seek(intMap, 0);
 
-    curNode = mapIter->curNode;
-    if ( curNode == NULL )
+    if ( mapIter->curSlot > intMap->capacity )
     {
         /* No value, stop iteration. */
-        *completedIterationPtr = 2;
+        *completedIterationPtr = MAP_ITER_PAST_END_RETURN_INVALID;
         return 0;
     }
 
-    /* If we moved onto a node, grab and return data */
-    ret = curNode->data;
+    ret = mapIter->curSlot == intMap->capacity ? 0 : intMap->slots[ mapIter->curSlot ];
 
-    stopIteration = _simple_int_map_move_iter_forward(mapIter);
-    if ( stopIteration )
-        *completedIterationPtr = stopIteration;
+    mapIter->curSlot = _simple_int_map_iter_seek(intMap, mapIter->curSlot + 1);
+    if ( mapIter->curSlot > intMap->capacity )
+        *completedIterationPtr = MAP_ITER_RETURNED_FINAL_VALUE;
 
     return ret;
 }
@@ -12,6 +12,7 @@
 #ifndef _SIMPLE_INT_MAP_H
 #define _SIMPLE_INT_MAP_H
 
+#include <stdint.h>
 #include <sys/types.h>
 
 #include "pid_tools.h"
@@ -21,25 +22,17 @@
  ******************/
 
 /**
- *   struct SimpleIntMapNode - A node of a single-linked list for use in SimpleIntMap
+ *   SimpleIntMap - The public structure for using a simple int map
+ *                    (which is really a set of unique ints)
  *
- *          You should not need to reference this directly.
- */
-struct SimpleIntMapNode {
-    
-    int data;
-    void *next;
-
-} ALIGN_16; 
-/* NOTE: If we refactor the above to have int instead be a pointer, then
- *         we can store a struct with its integer hash as first element.
+ *      Open-addressed table with linear probing, so a lookup reads one or two
+ *        neighbouring cache lines instead of chasing a linked list. The capacity is
+ *        always a power of 2, and doubles once the table is half full.
  *
- *    For now, we don't need that, so for optimization purposes the
- *         current implementation here is more like a "hashed set for ints"
- */
-
-/**
- *   SimpleIntMap - The public structure for using a simple int map
+ *      Removing shifts the rest of the probe run back into place, so there are no
+ *        tombstones, and lookups don't slow down however many values come and go.
+ *
+ *      0 marks an empty slot, so 0 itself is tracked by #hasZero instead.
  *
  *      Create with - simple_int_map_create
  *
@@ -49,19 +42,21 @@ struct SimpleIntMapNode {
  */
 typedef struct {
 
-    unsigned int modSize;
-    struct SimpleIntMapNode *nodeData;
-    char *nodeHasData; /* TODO: instead of 1 or 0 taking up entire byte, split by bits? */
+    int *slots;
+    size_t capacity;     /* Always a power of 2 */
+    int hasZero;         /* 1 if 0 is in the map */
 
     size_t numEntries;
 
+    size_t numAllocs;    /* Allocations made for this map, see MAP_NUM_ALLOCS */
+
 } SimpleIntMap ALIGN_32;
 
 
 typedef struct {
-    
-    unsigned int curBucket;
-    struct SimpleIntMapNode *curNode;
+
+    size_t curSlot;      /* Slot of the next value, #capacity for the 0 value (#hasZero), past that
+                          *   for the end, or SIMPLE_INT_MAP_ITER_NOT_STARTED before the first call */
     SimpleIntMap *intMap;
 
 } SimpleIntMapIterator;
@@ -70,11 +65,23 @@ typedef struct {
  * MACROS
  ******************/
 
-/* NODE_NEXT - Get the "next" node from a current node */
-#define NODE_NEXT(curNode) ((struct SimpleIntMapNode*)(curNode)->next)
-
 #define MAP_NUM_ENTRIES(mapObj) ((mapObj)->numEntries)
 
+/* MAP_NUM_ALLOCS - Number of allocations (malloc / calloc) made for a map so far: two when
+ *   created, and one each time it grows. Adds and removes which don't grow it allocate nothing,
+ *   and every allocation still held is freed by simple_int_map_destroy (two frees).
+ */
+#define MAP_NUM_ALLOCS(mapObj) ((mapObj)->numAllocs)
+
+/* SIMPLE_INT_MAP_RESULT_WORDS - Number of uint64_t needed for the results of simple_int_map_contains_many on #numValues */
+#define SIMPLE_INT_MAP_RESULT_WORDS(numValues) ( ( (size_t)(numValues) + 63 ) / 64 )
+
+/* SIMPLE_INT_MAP_RESULT_BIT - 1 if value #idx was found by simple_int_map_contains_many, otherwise 0 */
+#define SIMPLE_INT_MAP_RESULT_BIT(resultBits, idx) ( (int)( ( (resultBits)[ (idx) / 64 ] >> ( (idx) % 64 ) ) & 1 ) )
+
+/* SIMPLE_INT_MAP_ITER_NOT_STARTED - SimpleIntMapIterator.curSlot of a new (or reset) iterator */
+#define SIMPLE_INT_MAP_ITER_NOT_STARTED ((size_t)-1)
+
 /*******************
  * PUBLIC FUNCTIONS
  ******************/
@@ -82,16 +89,14 @@ typedef struct {
 /**
  *    simple_int_map_create - Allocate a SimpleIntMap for use
  *
- *          @param modSize <uint> - The number of buckets and modulus used in this map.
- *                      Powers of 10 work well.
- *
- *                      Smaller values take up less space but may be less efficient
+ *          @param sizeHint <uint> - Expected number of entries. The map grows as needed,
+ *                      this just saves growing it while it fills
  *
  *          @return - Pointer to an allocated SimpleIntMap ready to use
  *
  *              This must be freed using simple_int_map_destroy
  */
-SimpleIntMap *simple_int_map_create(unsigned int modSize);
+SimpleIntMap *simple_int_map_create(unsigned int sizeHint);
 
 /**
  *    simple_int_map_destroy - Deallocate a SimpleIntMap including all referenced memory
@@ -140,6 +145,57 @@ int simple_int_map_add(SimpleIntMap *intMap, int toAdd);
 int simple_int_map_rem(SimpleIntMap *intMap, int toRem);
 
 
+/*
+ * Batch operations - These work through #values in blocks, working out the slot of every
+ *   value in the block and prefetching it before probing any. The cache misses of a block
+ *   then overlap instead of being waited on one after another, which is a large win once
+ *   the map no longer fits in cache. Each gives the same results as the single call on
+ *   every value in turn.
+ */
+
+/**
+ *    simple_int_map_add_many - Add many entries to the map
+ *
+ *      @param intMap <SimpleIntMap *> - Pointer to the map into which to add
+ *
+ *      @param values <const int *> - Integers to add
+ *
+ *      @param numValues <size_t> - Number of elements in #values
+ *
+ *      @return <size_t> - Number added (not counting any already present)
+ */
+size_t simple_int_map_add_many(SimpleIntMap *intMap, const int *values, size_t numValues);
+
+/**
+ *    simple_int_map_contains_many - Check which of many values the map contains
+ *
+ *      @param intMap <SimpleIntMap *> - Pointer to the map to search
+ *
+ *      @param values <const int *> - Integers to search for
+ *
+ *      @param numValues <size_t> - Number of elements in #values
+ *
+ *      @param resultBits <uint64_t *> - SIMPLE_INT_MAP_RESULT_WORDS(numValues) words, which are
+ *                  set so bit #i is 1 if values[i] was found. See SIMPLE_INT_MAP_RESULT_BIT
+ *
+ *      @return <size_t> - Number of #values found
+ */
+size_t simple_int_map_contains_many(SimpleIntMap *intMap, const int *values, size_t numValues, uint64_t *resultBits);
+
+/**
+ *    simple_int_map_rem_many - Remove many entries from the map
+ *
+ *      @param intMap <SimpleIntMap *> - Pointer to the map from which to remove
+ *
+ *      @param values <const int *> - Integers to remove
+ *
+ *      @param numValues <size_t> - Number of elements in #values
+ *
+ *      @return <size_t> - Number removed (not counting any which weren't present)
+ */
+size_t simple_int_map_rem_many(SimpleIntMap *intMap, const int *values, size_t numValues);
+
+
 /**
  *    simple_int_map_values - Return a list of all the values in #intMap
  *
@@ -153,6 +209,59 @@ int simple_int_map_rem(SimpleIntMap *intMap, int toRem);
  */
 int *simple_int_map_values(SimpleIntMap *intMap, size_t *retLen);
 
+/**
+ *    simple_int_map_sorted_values - Return a list of all the values in #intMap, sorted ascending
+ *
+ *      @param intMap <SimpleIntMap *> - Pointer to the map of interest
+ *
+ *      @param retLen <size_t *> - The size of the returned list will be stored here
+ *
+ *      @return <int *> - A list of all the values in #intMap, sorted with simple_int_map_sort_ints
+ *
+ *          You are responsible for freeing this list
+ */
+int *simple_int_map_sorted_values(SimpleIntMap *intMap, size_t *retLen);
+
+/**
+ *    simple_int_map_sort_ints - Sort a list of ints ascending, in place
+ *
+ *      An LSD radix sort (a byte per pass), so linear in #numValues. Passes over
+ *        a byte which is the same in every value are skipped, so pids (all
+ *        positive, below pid_max) usually take 2 or 3 passes instead of 4.
+ *        Short lists are insertion sorted instead.
+ *
+ *      @param values <int *> - The list to sort
+ *
+ *      @param numValues <size_t> - Number of elements in #values
+ */
+void simple_int_map_sort_ints(int *values, size_t numValues);
+
+/*
+ * Set operations - Combine two maps in place, as with PidBitset. #dest and #src must
+ *   be different maps. They use the batch calls above, so are quickest on large maps.
+ */
+
+/**
+ *    simple_int_map_union - Add every value in #src to #dest
+ *
+ *      @return <size_t> - Number of values added to #dest
+ */
+size_t simple_int_map_union(SimpleIntMap *dest, SimpleIntMap *src);
+
+/**
+ *    simple_int_map_intersect - Remove every value from #dest which is not in #src
+ *
+ *      @return <size_t> - Number of values removed from #dest
+ */
+size_t simple_int_map_intersect(SimpleIntMap *dest, SimpleIntMap *src);
+
+/**
+ *    simple_int_map_difference - Remove every value in #src from #dest
+ *
+ *      @return <size_t> - Number of values removed from #dest
+ */
+size_t simple_int_map_difference(SimpleIntMap *dest, SimpleIntMap *src);
+
 /*
   * Constants for the `completedIterationPtr' values below.
  */
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * simple_int_value_map.c - Interface implementations for an integer-keyed Map of
+ *                            fixed-size values
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pid_tools.h"
+
+#include "simple_int_value_map.h"
+
+/* VALUE_MAP_MIN_INDEX_CAPACITY - Smallest number of index slots. Must be a power of 2 */
+#define VALUE_MAP_MIN_INDEX_CAPACITY 16
+
+/* VALUE_MAP_MIN_ENTRIES_CAPACITY - Smallest number of entries allocated */
+#define VALUE_MAP_MIN_ENTRIES_CAPACITY 8
+
+/* VALUE_MAP_INDEX_EMPTY - Value of an empty index slot (entry numbers are stored plus 1) */
+#define VALUE_MAP_INDEX_EMPTY 0
+
+/* _VALUE_MAP_ENTRY - The entry numbered #_num */
+#define _VALUE_MAP_ENTRY(_valueMap, _num) \
+    ( (struct SimpleIntValueMapEntry *)( (_valueMap)->entries + (size_t)(_num) * (_valueMap)->entrySize ) )
+
+/* _VALUE_MAP_VALUE - The value which follows an entry's header */
+#define _VALUE_MAP_VALUE(_entry) ( (void *)( (_entry) + 1 ) )
+
+
+/**
+ * _value_map_ideal_slot - The index slot a key hashes to, where its probe run starts
+ */
+static inline size_t _value_map_ideal_slot(const SimpleIntValueMap *valueMap, int key)
+{
+    uint32_t hash;
+
+    /* As SimpleIntMap: spread out sequential pids, then fold the high bits into the low */
+    hash = (uint32_t)key * 2654435769U;
+    hash ^= hash >> 16;
+
+    return (size_t)hash & ( valueMap->indexCapacity - 1 );
+}
+
+/**
+ * _value_map_find_slot - Find the index slot of #key, or the empty slot which ends its probe run
+ */
+static inline size_t _value_map_find_slot(const SimpleIntValueMap *valueMap, int key)
+{
+    size_t mask = valueMap->indexCapacity - 1;
+    size_t idx;
+    uint32_t entryNum;
+
+    idx = _value_map_ideal_slot(valueMap, key);
+    while ( (entryNum = valueMap->index[idx]) != VALUE_MAP_INDEX_EMPTY )
+    {
+        if ( _VALUE_MAP_ENTRY(valueMap, entryNum - 1)->key == key )
+            break;
+
+        idx = (idx + 1) & mask;
+    }
+
+    return idx;
+}
+
+/**
+ * _value_map_rebuild_index - Replace the index with one of #indexCapacity (a power of 2)
+ *                              slots, holding every entry which is not removed
+ */
+static void _value_map_rebuild_index(SimpleIntValueMap *valueMap, size_t indexCapacity)
+{
+    size_t i;
+
+    free(valueMap->index);
+    valueMap->indexCapacity = indexCapacity;
+    valueMap->index = calloc( indexCapacity, sizeof(uint32_t) );
+
+    for( i=0; i < valueMap->numUsed; i++ )
+    {
+        if ( ! _VALUE_MAP_ENTRY(valueMap, i)->isRemoved )
+            valueMap->index[ _value_map_find_slot(valueMap, _VALUE_MAP_ENTRY(valueMap, i)->key) ] = (uint32_t)( i + 1 );
+    }
+}
+
+/**
+ * _value_map_make_room - Make sure there is room to append one more entry, and for its
+ *                          key in the index. May move the entries, and rebuild the index
+ */
+static void _value_map_make_room(SimpleIntValueMap *valueMap)
+{
+    size_t indexCapacity;
+    size_t i, numLive;
+    int isRenumbered = 0;
+
+    if ( unlikely( valueMap->numUsed >= valueMap->entriesCapacity ) )
+    {
+        if ( valueMap->numUsed - valueMap->numEntries >= valueMap->numUsed / 4 )
+        {
+            /* Enough removed to be worth sliding the rest down over them, keeping their order */
+            for( i=0, numLive=0; i < valueMap->numUsed; i++ )
+            {
+                if ( _VALUE_MAP_ENTRY(valueMap, i)->isRemoved )
+                    continue;
+
+                if ( numLive != i )
+                    memcpy(_VALUE_MAP_ENTRY(valueMap, numLive), _VALUE_MAP_ENTRY(valueMap, i), valueMap->entrySize);
+                numLive++;
+            }
+
+            valueMap->numUsed = numLive;
+            isRenumbered = 1;
+        }
+        else
+        {
+            valueMap->entriesCapacity *= 2;
+            valueMap->entries = realloc(valueMap->entries, valueMap->entriesCapacity * valueMap->entrySize);
+        }
+    }
+
+    /* Keep the index at most half full */
+    indexCapacity = valueMap->indexCapacity;
+    while ( ( valueMap->numEntries + 1 ) * 2 > indexCapacity )
+        indexCapacity *= 2;
+
+    if ( isRenumbered || indexCapacity != valueMap->indexCapacity )
+        _value_map_rebuild_index(valueMap, indexCapacity);
+}
+
+SimpleIntValueMap *simple_int_value_map_create(size_t valueSize, unsigned int sizeHint)
+{
+    SimpleIntValueMap *ret;
+    size_t indexCapacity;
+
+    ret = malloc( sizeof(SimpleIntValueMap) );
+
+    ret->valueSize = valueSize;
+    /* Round the value up to 8 bytes, so the header and every value stay 8-byte aligned */
+    ret->entrySize = sizeof(struct SimpleIntValueMapEntry) + ( (valueSize + 7) & ~(size_t)7 );
+
+    ret->entriesCapacity = sizeHint > VALUE_MAP_MIN_ENTRIES_CAPACITY ? sizeHint : VALUE_MAP_MIN_ENTRIES_CAPACITY;
+    ret->entries = malloc( ret->entriesCapacity * ret->entrySize );
+    ret->numUsed = 0;
+    ret->numEntries = 0;
+
+    /* Room for #sizeHint entries without going over half full */
+    indexCapacity = VALUE_MAP_MIN_INDEX_CAPACITY;
+    while ( indexCapacity < (size_t)sizeHint * 2 )
+        indexCapacity <<= 1;
+
+    ret->indexCapacity = indexCapacity;
+    ret->index = calloc( indexCapacity, sizeof(uint32_t) );
+
+    return ret;
+}
+
+void simple_int_value_map_destroy(SimpleIntValueMap *valueMap)
+{
+    free(valueMap->index);
+    free(valueMap->entries);
+    free(valueMap);
+}
+
+void *simple_int_value_map_get(SimpleIntValueMap *valueMap, int key)
+{
+    uint32_t entryNum;
+
+    entryNum = valueMap->index[ _value_map_find_slot(valueMap, key) ];
+    if ( entryNum == VALUE_MAP_INDEX_EMPTY )
+        return NULL;
+
+    return _VALUE_MAP_VALUE( _VALUE_MAP_ENTRY(valueMap, entryNum - 1) );
+}
+
+void *simple_int_value_map_get_or_insert(SimpleIntValueMap *valueMap, int key, int *wasInserted)
+{
+    struct SimpleIntValueMapEntry *entry;
+    size_t idx;
+
+    idx = _value_map_find_slot(valueMap, key);
+    if ( valueMap->index[idx] != VALUE_MAP_INDEX_EMPTY )
+    {
+        if ( wasInserted != NULL )
+            *wasInserted = 0;
+
+        return _VALUE_MAP_VALUE( _VALUE_MAP_ENTRY(valueMap, valueMap->index[idx] - 1) );
+    }
+
+    if ( unlikely( valueMap->numUsed >= valueMap->entriesCapacity || ( valueMap->numEntries + 1 ) * 2 > valueMap->indexCapacity ) )
+    {
+        _value_map_make_room(valueMap);
+        idx = _value_map_find_slot(valueMap, key);
+    }
+
+    entry = _VALUE_MAP_ENTRY(valueMap, valueMap->numUsed);
+    entry->key = key;
+    entry->isRemoved = 0;
+    memset(_VALUE_MAP_VALUE(entry), 0, valueMap->entrySize - sizeof(struct SimpleIntValueMapEntry));
+
+    valueMap->index[idx] = (uint32_t)( valueMap->numUsed + 1 );
+    valueMap->numUsed += 1;
+    valueMap->numEntries += 1;
+
+    if ( wasInserted != NULL )
+        *wasInserted = 1;
+
+    return _VALUE_MAP_VALUE(entry);
+}
+
+int simple_int_value_map_put(SimpleIntValueMap *valueMap, int key, const void *value)
+{
+    int wasInserted;
+
+    memcpy(simple_int_value_map_get_or_insert(valueMap, key, &wasInserted), value, valueMap->valueSize);
+
+    return wasInserted;
+}
+
+int simple_int_value_map_rem(SimpleIntValueMap *valueMap, int key)
+{
+    size_t mask = valueMap->indexCapacity - 1;
+    size_t idx, nextIdx, idealIdx;
+    uint32_t entryNum;
+
+    idx = _value_map_find_slot(valueMap, key);
+    entryNum = valueMap->index[idx];
+    if ( entryNum == VALUE_MAP_INDEX_EMPTY )
+        return 0;
+
+    /* The entry keeps its place (so iteration order holds), until the entries are next compacted */
+    _VALUE_MAP_ENTRY(valueMap, entryNum - 1)->isRemoved = 1;
+
+    /* As SimpleIntMap: move back into the hole each key in the rest of the run which
+     *   could no longer be reached from its ideal slot, so there are no tombstones.
+     */
+    for( nextIdx = (idx + 1) & mask; (entryNum = valueMap->index[nextIdx]) != VALUE_MAP_INDEX_EMPTY; nextIdx = (nextIdx + 1) & mask )
+    {
+        idealIdx = _value_map_ideal_slot(valueMap, _VALUE_MAP_ENTRY(valueMap, entryNum - 1)->key);
+
+        if ( ( (nextIdx - idealIdx) & mask ) >= ( (nextIdx - idx) & mask ) )
+        {
+            valueMap->index[idx] = entryNum;
+            idx = nextIdx;
+        }
+    }
+
+    valueMap->index[idx] = VALUE_MAP_INDEX_EMPTY;
+    valueMap->numEntries -= 1;
+
+    return 1;
+}
+
+void *simple_int_value_map_next(SimpleIntValueMap *valueMap, size_t *pos, int *keyOut)
+{
+    struct SimpleIntValueMapEntry *entry;
+
+    while ( *pos < valueMap->numUsed )
+    {
+        entry = _VALUE_MAP_ENTRY(valueMap, *pos);
+        *pos += 1;
+
+        if ( entry->isRemoved )
+            continue;
+
+        if ( keyOut != NULL )
+            *keyOut = entry->key;
+
+        return _VALUE_MAP_VALUE(entry);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * simple_int_value_map.h - Interface definitions for an integer-keyed Map of
+ *                            fixed-size values (e.x. a record per pid)
+ *
+ */
+
+#ifndef _SIMPLE_INT_VALUE_MAP_H
+#define _SIMPLE_INT_VALUE_MAP_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "pid_tools.h"
+
+/*******************
+ * DATA TYPES
+ ******************/
+
+/**
+ *   struct SimpleIntValueMapEntry - The header of each entry, followed by the value.
+ *          You should not need to reference this directly.
+ */
+struct SimpleIntValueMapEntry {
+    int key;
+    int isRemoved;  /* 1 once removed. Its space is reclaimed when the entries are next compacted */
+};
+
+/**
+ *   SimpleIntValueMap - A map of int keys to values of a size fixed at create time
+ *
+ *      The entries (key, then the value) are packed one after another in the order
+ *        they were added, and found through a separate open-addressed (linear probing)
+ *        index of entry numbers, which doubles when half full. So no entry is allocated
+ *        on its own, a lookup reads the index and then the one entry, and iterating
+ *        is a walk straight through the entries, in the order they were added
+ *        (unchanged by growing, or by removing other keys).
+ *
+ *      A pointer to a value stays valid until the next put or get_or_insert (which may
+ *        move the entries), or until the key is removed.
+ *
+ *      Create with - simple_int_value_map_create
+ *
+ *      Free/Destroy with - simple_int_value_map_destroy
+ *
+ *      Other operations -- see functions below
+ */
+typedef struct {
+
+    uint32_t *index;        /* Entry number + 1 of each key, or 0 for an empty slot */
+    size_t indexCapacity;   /* Always a power of 2 */
+
+    char *entries;
+    size_t entrySize;       /* Header plus the value, rounded up to keep values 8-byte aligned */
+    size_t valueSize;
+    size_t numUsed;         /* Entries used at the start of #entries, including removed ones */
+    size_t entriesCapacity;
+
+    size_t numEntries;      /* Keys present */
+
+} SimpleIntValueMap;
+
+
+/*******************
+ * MACROS
+ ******************/
+
+/* VALUE_MAP_NUM_ENTRIES - Number of keys in the map */
+#define VALUE_MAP_NUM_ENTRIES(mapObj) ((mapObj)->numEntries)
+
+/* VALUE_MAP_VALUE_SIZE - Size of each value, as given at create time */
+#define VALUE_MAP_VALUE_SIZE(mapObj) ((mapObj)->valueSize)
+
+/*******************
+ * PUBLIC FUNCTIONS
+ ******************/
+
+/**
+ *    simple_int_value_map_create - Allocate a SimpleIntValueMap for use
+ *
+ *          @param valueSize <size_t> - Size of each value, e.x. sizeof(struct MyRecord)
+ *
+ *          @param sizeHint <uint> - Expected number of entries. The map grows as needed,
+ *                      this just saves growing it while it fills
+ *
+ *          @return - Pointer to an allocated SimpleIntValueMap ready to use
+ *
+ *              This must be freed using simple_int_value_map_destroy
+ */
+SimpleIntValueMap *simple_int_value_map_create(size_t valueSize, unsigned int sizeHint);
+
+/**
+ *    simple_int_value_map_destroy - Deallocate a SimpleIntValueMap including all values
+ *
+ *          @param valueMap <SimpleIntValueMap *> - Pointer to the map to free
+ */
+void simple_int_value_map_destroy(SimpleIntValueMap *valueMap);
+
+/**
+ *    simple_int_value_map_get - Get the value of a key
+ *
+ *          @param valueMap <SimpleIntValueMap *> - Pointer to the map to search
+ *
+ *          @param key <int> - Key to search for
+ *
+ *          @return <void *> - Pointer to the value, which may be changed in place,
+ *                      or NULL if #key is not present
+ */
+void *simple_int_value_map_get(SimpleIntValueMap *valueMap, int key);
+
+/**
+ *    simple_int_value_map_get_or_insert - Get the value of a key, adding the key
+ *                                           with a zeroed value if it is not present
+ *
+ *          @param valueMap <SimpleIntValueMap *> - Pointer to the map
+ *
+ *          @param key <int> - Key to search for, or add
+ *
+ *          @param wasInserted <int *> - If not NULL, set to 1 if #key was added, otherwise 0
+ *
+ *          @return <void *> - Pointer to the value, to fill in if it was added
+ */
+void *simple_int_value_map_get_or_insert(SimpleIntValueMap *valueMap, int key, int *wasInserted);
+
+/**
+ *    simple_int_value_map_put - Set the value of a key, adding the key if not present
+ *
+ *          @param valueMap <SimpleIntValueMap *> - Pointer to the map
+ *
+ *          @param key <int> - Key to set
+ *
+ *          @param value <const void *> - The value, #valueSize bytes, which is copied
+ *
+ *          @return <int> - 1 if #key was added
+ *                          0 if its value was replaced
+ */
+int simple_int_value_map_put(SimpleIntValueMap *valueMap, int key, const void *value);
+
+/**
+ *    simple_int_value_map_rem - Remove a key (and its value) from the map
+ *
+ *          @param valueMap <SimpleIntValueMap *> - Pointer to the map
+ *
+ *          @param key <int> - Key to remove
+ *
+ *          @return <int> - 1 if removed
+ *                          0 if wasn't present
+ */
+int simple_int_value_map_rem(SimpleIntValueMap *valueMap, int key);
+
+/**
+ *    simple_int_value_map_next - Iterate the entries, in the order their keys were added
+ *
+ *          size_t pos = 0;
+ *          while ( (value = simple_int_value_map_next(valueMap, &pos, &key)) != NULL )
+ *
+ *          Keys may be removed (including the current one) and values changed while
+ *            iterating, but not added (which may compact the entries, moving them).
+ *
+ *          @param valueMap <SimpleIntValueMap *> - Pointer to the map
+ *
+ *          @param pos <size_t *> - Position, which should start at 0. Will be advanced
+ *
+ *          @param keyOut <int *> - If not NULL, set to the key of the returned value
+ *
+ *          @return <void *> - Pointer to the next value, or NULL once there are no more
+ */
+void *simple_int_value_map_next(SimpleIntValueMap *valueMap, size_t *pos, int *keyOut);
+
+
+#endif
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * stdin_query.h - Static functions for the "--stdin" mode of the tools, where one
+ *                   long-running process answers one query per line of stdin, with
+ *                   one answer per line on stdout (e.x. as a shell coprocess).
+ *
+ *   Every answer is flushed before blocking to read more, so a caller which writes
+ *     one query and waits for its answer never deadlocks. Queries which arrive
+ *     together (e.x. from a file or pipe) are answered with one write between them.
+ *
+ *         These are contained in this header versus a .c file to allow
+ *         optimizations which wouldn't otherwise get applied if not single unit
+ *         (e.x. inlining).
+ *
+ */
+
+#ifndef _STDIN_QUERY_H
+#define _STDIN_QUERY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "pid_tools.h"
+
+
+/* STDIN_QUERY_MAX_ARGS - Most words of one line passed to the query func.
+ *   Any beyond this are still counted in numArgs.
+ */
+#define STDIN_QUERY_MAX_ARGS 8
+
+/* STDIN_QUERY_INITIAL_BUFFER_SIZE - Starting size of the read buffer, which grows
+ *   if a single line is longer.
+ */
+#define STDIN_QUERY_INITIAL_BUFFER_SIZE 8192
+
+/* STDIN_QUERY_WHITESPACE - Characters which separate the words of a query */
+#define STDIN_QUERY_WHITESPACE " \t\r"
+
+/**
+ *   stdin_query_func - Function which answers one query, printing exactly one line to stdout
+ *
+ *          @param args <char **> - The words of the query line (at most STDIN_QUERY_MAX_ARGS)
+ *
+ *          @param numArgs <int> - The number of words on the line, which may be more than
+ *                                  were placed in #args
+ *
+ *          @param data <void *> - The #data given to stdin_query_run
+ *
+ *          @return <int> - 0 if the query was answered successfully, otherwise non-zero
+ */
+typedef int (*stdin_query_func)(char **args, int numArgs, void *data);
+
+
+/**
+ * _stdin_query_line - Split one line into words and answer it. Blank lines are skipped.
+ *
+ *    @return <int> - Return of #func, or 0 for a blank line
+ */
+MAYBE_UNUSED static int _stdin_query_line(char *line, stdin_query_func func, void *data)
+{
+    char *args[STDIN_QUERY_MAX_ARGS];
+    char *word, *savePtr;
+    int numArgs = 0;
+
+    for( word = strtok_r(line, STDIN_QUERY_WHITESPACE, &savePtr); word != NULL; word = strtok_r(NULL, STDIN_QUERY_WHITESPACE, &savePtr) )
+    {
+        if ( numArgs < STDIN_QUERY_MAX_ARGS )
+            args[numArgs] = word;
+        numArgs++;
+    }
+
+    if ( numArgs == 0 )
+        return 0;
+
+    return func(args, numArgs, data);
+}
+
+/**
+ * stdin_query_run - Answer one query per line of stdin, until it is closed
+ *
+ *      Reads with read(2) directly rather than through stdio, so it knows when every
+ *        query received so far has been answered, which is when stdout is flushed.
+ *
+ *      @param func <stdin_query_func> - Answers each (non-blank) line
+ *
+ *      @param data <void *> - Passed along to #func
+ *
+ *      @return <int> - 0 if every query was answered successfully, otherwise 1
+ */
+MAYBE_UNUSED static int stdin_query_run(stdin_query_func func, void *data)
+{
+    char *buff;
+    size_t buffSize = STDIN_QUERY_INITIAL_BUFFER_SIZE;
+    size_t buffLen = 0;
+    size_t lineStart;
+    ssize_t numRead;
+    char *newline;
+    int ret = 0;
+
+    buff = malloc( buffSize );
+
+    while ( 1 )
+    {
+        /* Always leave room to terminate a final line which has no newline */
+        if ( unlikely( buffLen + 1 >= buffSize ) )
+        {
+            buffSize *= 2;
+            buff = realloc(buff, buffSize);
+        }
+
+        numRead = read(STDIN_FILENO, &buff[buffLen], buffSize - buffLen - 1);
+        if ( unlikely( numRead < 0 ) )
+        {
+            if ( errno == EINTR )
+                continue;
+
+            fprintf(stderr, "Error reading from stdin. Error %d: %s\n", errno, strerror(errno));
+            ret = 1;
+            break;
+        }
+
+        if ( numRead == 0 )
+        {
+            if ( buffLen > 0 )
+            {
+                buff[buffLen] = '\0';
+                if ( _stdin_query_line(buff, func, data) != 0 )
+                    ret = 1;
+            }
+            break;
+        }
+
+        buffLen += numRead;
+
+        lineStart = 0;
+        while ( (newline = memchr(&buff[lineStart], '\n', buffLen - lineStart)) != NULL )
+        {
+            *newline = '\0';
+            if ( _stdin_query_line(&buff[lineStart], func, data) != 0 )
+                ret = 1;
+
+            lineStart = (newline - buff) + 1;
+        }
+
+        /* Everything received so far is answered, so send it before waiting for more */
+        fflush(stdout);
+
+        if ( lineStart > 0 )
+        {
+            buffLen -= lineStart;
+            memmove(buff, &buff[lineStart], buffLen);
+        }
+    }
+
+    fflush(stdout);
+    free(buff);
+
+    return ret;
+}
+
+/**
+ * stdin_query_print_value - Print the rest of an answer line, with any newlines
+ *                             in #value (e.x. within an argument) printed as spaces,
+ *                             so every answer is exactly one line
+ *
+ *      @param value <const char *> - The value
+ *
+ *      @param valueLen <size_t> - Number of bytes of #value to print
+ */
+MAYBE_UNUSED static void stdin_query_print_value(const char *value, size_t valueLen)
+{
+    const char *end = value + valueLen;
+    const char *newline;
+
+    while ( (newline = memchr(value, '\n', end - value)) != NULL )
+    {
+        fwrite(value, 1, newline - value, stdout);
+        putchar(' ');
+        value = newline + 1;
+    }
+
+    fwrite(value, 1, end - value, stdout);
+}
+
+#endif
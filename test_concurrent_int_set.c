@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * test_concurrent_int_set.c - Stress test for the concurrent int set. Many threads
+ *                               add the same values at once, each checking its own
+ *                               adds are found, then the results are checked whole.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "pid_tools.h"
+#include "concurrent_int_set.h"
+
+
+/* NUM_THREADS - Number of threads adding at once, more than most machines have cpus */
+#define NUM_THREADS 16
+
+/* VALUES_RANGE - Every thread adds every value in [-RANGE/2, RANGE/2) */
+#define VALUES_RANGE 200000
+
+/* YIELD_EVERY - Give up the cpu after this many adds, so the threads interleave even
+ *   with fewer cpus than threads (a thread would otherwise finish in one time slice)
+ */
+#define YIELD_EVERY 256
+
+/* NUM_ROUNDS - Number of times the whole test is run, on a new set */
+#define NUM_ROUNDS 5
+
+/* Steps through the range, each coprime to VALUES_RANGE (2^6 * 5^5), so each visits every value */
+static const size_t threadSteps[] = { 1, 3, 7, 11, 13, 17, 19, 23, 7919, 104729, 99991, 31, 37, 41, 43, 47 };
+
+struct StressThreadArgs {
+    ConcurrentIntSet *intSet;
+    pthread_barrier_t *startBarrier;
+    unsigned int threadNum;
+
+    size_t numAdded;        /* Adds which returned 1 */
+    size_t numFailures;     /* Adds which returned an error, or adds not found after */
+};
+
+/**
+ * stress_thread - Add every value of the range, in an order of this thread's own,
+ *                   and check each is found once the add returns
+ */
+static void *stress_thread(void *argsPtr)
+{
+    struct StressThreadArgs *args = argsPtr;
+    size_t i, idx, step;
+    int value, ret;
+
+    step = threadSteps[ args->threadNum % (sizeof(threadSteps) / sizeof(threadSteps[0])) ];
+    idx = ( (size_t)args->threadNum * 12345 ) % VALUES_RANGE;
+
+    /* Start together, so the adds overlap as much as they can */
+    pthread_barrier_wait(args->startBarrier);
+
+    for( i=0; i < VALUES_RANGE; i++ )
+    {
+        value = (int)idx - VALUES_RANGE / 2;
+
+        ret = concurrent_int_set_add(args->intSet, value);
+        if ( ret == 1 )
+            args->numAdded++;
+        else if ( ret != 0 )
+            args->numFailures++;
+
+        if ( ! concurrent_int_set_contains(args->intSet, value) )
+            args->numFailures++;
+
+        /* Never added by anyone */
+        if ( concurrent_int_set_contains(args->intSet, value + VALUES_RANGE) )
+            args->numFailures++;
+
+        idx = (idx + step) % VALUES_RANGE;
+
+        if ( i % YIELD_EVERY == 0 )
+            sched_yield();
+    }
+
+    return NULL;
+}
+
+/**
+ * test_stress - Run NUM_THREADS threads adding the same values at once, then check
+ *                 each value was added exactly once, and the frozen set holds them all
+ *
+ *      @return <int> - 0 if everything matched, otherwise 1
+ */
+static int test_stress(void)
+{
+    ConcurrentIntSet *intSet;
+    pthread_t threads[NUM_THREADS];
+    struct StressThreadArgs threadArgs[NUM_THREADS];
+    pthread_barrier_t startBarrier;
+    static char seen[VALUES_RANGE];
+    unsigned int round, i;
+    size_t totalAdded, totalFailures, numValues, j;
+    int *values;
+
+    for( round=0; round < NUM_ROUNDS; round++ )
+    {
+        intSet = concurrent_int_set_create(VALUES_RANGE);
+        pthread_barrier_init(&startBarrier, NULL, NUM_THREADS);
+
+        for( i=0; i < NUM_THREADS; i++ )
+        {
+            threadArgs[i].intSet = intSet;
+            threadArgs[i].startBarrier = &startBarrier;
+            threadArgs[i].threadNum = i + round;
+            threadArgs[i].numAdded = 0;
+            threadArgs[i].numFailures = 0;
+
+            if ( pthread_create(&threads[i], NULL, stress_thread, &threadArgs[i]) != 0 )
+            {
+                printf("FAILED: could not start thread %u\n", i);
+                return 1;
+            }
+        }
+
+        totalAdded = totalFailures = 0;
+        for( i=0; i < NUM_THREADS; i++ )
+        {
+            pthread_join(threads[i], NULL);
+            totalAdded += threadArgs[i].numAdded;
+            totalFailures += threadArgs[i].numFailures;
+        }
+        pthread_barrier_destroy(&startBarrier);
+
+        if ( totalFailures != 0 || totalAdded != VALUES_RANGE )
+        {
+            printf("FAILED: round %u: %zu adds returned 1 (expected %d), %zu failures\n", round, totalAdded, VALUES_RANGE, totalFailures);
+            return 1;
+        }
+
+        if ( concurrent_int_set_freeze(intSet) != VALUES_RANGE )
+        {
+            printf("FAILED: round %u: frozen set has %zu values (expected %d)\n", round, CONCURRENT_INT_SET_NUM_ENTRIES(intSet), VALUES_RANGE);
+            return 1;
+        }
+
+        /* Each value exactly once */
+        memset(seen, 0, sizeof(seen));
+        values = concurrent_int_set_values(intSet, &numValues);
+        for( j=0; j < numValues; j++ )
+        {
+            if ( values[j] < -(VALUES_RANGE / 2) || values[j] >= VALUES_RANGE / 2 || seen[ values[j] + VALUES_RANGE / 2 ]++ )
+            {
+                printf("FAILED: round %u: values has %d, which is out of range or repeated\n", round, values[j]);
+                return 1;
+            }
+        }
+        free(values);
+
+        if ( numValues != VALUES_RANGE )
+        {
+            printf("FAILED: round %u: values returned %zu (expected %d)\n", round, numValues, VALUES_RANGE);
+            return 1;
+        }
+
+        if ( concurrent_int_set_add(intSet, VALUES_RANGE) != CONCURRENT_INT_SET_ADD_FAILED || ! concurrent_int_set_contains(intSet, 0) )
+        {
+            printf("FAILED: round %u: frozen set was added to, or lost 0\n", round);
+            return 1;
+        }
+
+        concurrent_int_set_destroy(intSet);
+    }
+
+    printf("%d threads adding the same %d values, %d rounds: PASSED\n", NUM_THREADS, VALUES_RANGE, NUM_ROUNDS);
+
+    return 0;
+}
+
+/**
+ * test_full - Fill every slot of a small set, and check the next add fails cleanly
+ *
+ *      @return <int> - 0 if everything matched, otherwise 1
+ */
+static int test_full(void)
+{
+    ConcurrentIntSet *intSet;
+    size_t capacity;
+    int value;
+
+    intSet = concurrent_int_set_create(8);
+    capacity = intSet->capacity;
+
+    for( value=1; value <= (int)capacity; value++ )
+    {
+        if ( concurrent_int_set_add(intSet, value * 1000) != 1 )
+        {
+            printf("FAILED: add %d of %zu to a small set did not return 1\n", value, capacity);
+            return 1;
+        }
+    }
+
+    if ( concurrent_int_set_add(intSet, -1) != CONCURRENT_INT_SET_ADD_FAILED || concurrent_int_set_add(intSet, 1000) != 0 ||
+         concurrent_int_set_contains(intSet, -1) || ! concurrent_int_set_contains(intSet, capacity * 1000) )
+    {
+        printf("FAILED: full set did not refuse a new value, or lost one\n");
+        return 1;
+    }
+
+    concurrent_int_set_destroy(intSet);
+
+    printf("Completely full set: PASSED\n");
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if ( test_stress() != 0 )
+        return 1;
+    if ( test_full() != 0 )
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * test_getcpids_follow.c - Test program for "getcpids --follow"
+ *
+ *   Forks a small tree of processes under a root, follows the root with
+ *     "getcpids --follow -r", and checks the add/remove events it prints.
+ *
+ *   When run as root, this runs twice: once normally (using process events),
+ *     and once as "nobody" (which must fall back to rescanning /proc).
+ *
+ *   Usage: test_getcpids_follow (Optional: [path to getcpids, default bin/getcpids])
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "pid_tools.h"
+
+/* Time to let getcpids take its initial snapshot before changing the tree */
+#define STARTUP_WAIT_USEC 500000
+
+/* How long the grandchild lives, and the child after it.
+ *   Longer than the getcpids rescan interval, so fallback mode sees them.
+ */
+#define GRANDCHILD_LIFE_USEC 1000000
+#define CHILD_LINGER_USEC 500000
+
+/* Give up if getcpids hasn't exited after this many seconds */
+#define TEST_TIMEOUT_SECONDS 20
+
+#define MAX_OUTPUT 4096
+
+#define NOBODY_UID 65534
+
+
+/**
+ * run_root - The root of the followed tree.
+ *
+ *    Forks a "sleeper" child right away (which should appear in the initial snapshot),
+ *      then waits for the go signal and forks a child, which forks a grandchild.
+ *
+ *    Pids are written to #infoFd in the order: sleeper, child, grandchild
+ */
+static void run_root(int goFd, int stopFd, int infoFd)
+{
+    pid_t pids[3];
+    char goByte;
+
+    pids[0] = fork();
+    if ( pids[0] == 0 )
+    {
+        /* Sleeper - wait until the stop pipe is closed */
+        while ( read(stopFd, &goByte, 1) > 0 );
+        _exit(0);
+    }
+    close(stopFd);
+
+    if ( read(goFd, &goByte, 1) != 1 )
+        _exit(1);
+
+    pids[1] = fork();
+    if ( pids[1] == 0 )
+    {
+        pids[1] = getpid();
+        pids[2] = fork();
+        if ( pids[2] == 0 )
+        {
+            usleep(GRANDCHILD_LIFE_USEC);
+            _exit(0);
+        }
+
+        if ( write(infoFd, pids, sizeof(pids)) != sizeof(pids) )
+            _exit(1);
+
+        waitpid(pids[2], NULL, 0);
+        usleep(CHILD_LINGER_USEC);
+        _exit(0);
+    }
+
+    while ( wait(NULL) > 0 );
+    _exit(0);
+}
+
+/**
+ * find_line - Find the index of a line in the output
+ *
+ *    @return <int> - Line number, or -1 if not present. Prints a failure if present more than once.
+ */
+static int find_line(char **lines, int numLines, char sign, pid_t pid)
+{
+    char expected[32];
+    int i;
+    int found = -1;
+
+    sprintf(expected, "%c%d", sign, (int)pid);
+
+    for( i=0; i < numLines; i++ )
+    {
+        if ( strcmp(lines[i], expected) == 0 )
+        {
+            if ( found != -1 )
+            {
+                printf("FAIL: '%s' printed more than once.\n", expected);
+                return -1;
+            }
+            found = i;
+        }
+    }
+
+    if ( found == -1 )
+        printf("FAIL: '%s' never printed.\n", expected);
+
+    return found;
+}
+
+/**
+ * run_test - Run one pass of the test
+ *
+ *    @param getcpidsPath <const char *> - Path to getcpids
+ *
+ *    @param runAsUid <int> - If >= 0, run getcpids as this user
+ *
+ *    @return <int> - 0 on pass, 1 on failure
+ */
+static int run_test(const char *getcpidsPath, int runAsUid)
+{
+    int goPipe[2], stopPipe[2], infoPipe[2], outPipe[2];
+    pid_t rootPid, followPid;
+    pid_t treePids[3];
+    char rootPidStr[16];
+    char output[MAX_OUTPUT];
+    size_t outputLen;
+    ssize_t bytesRead;
+    char *lines[128];
+    int numLines;
+    int sleeperAdd, sleeperRem, childAdd, childRem, grandchildAdd, grandchildRem;
+    int status;
+    int i;
+    int failed = 0;
+
+    if ( pipe(goPipe) || pipe(stopPipe) || pipe(infoPipe) || pipe(outPipe) )
+    {
+        perror("pipe");
+        return 1;
+    }
+
+    rootPid = fork();
+    if ( rootPid == 0 )
+    {
+        close(goPipe[1]);
+        close(stopPipe[1]);
+        close(infoPipe[0]);
+        close(outPipe[0]);
+        close(outPipe[1]);
+        run_root(goPipe[0], stopPipe[0], infoPipe[1]);
+    }
+    close(goPipe[0]);
+    close(stopPipe[0]);
+    close(infoPipe[1]);
+
+    sprintf(rootPidStr, "%d", (int)rootPid);
+
+    followPid = fork();
+    if ( followPid == 0 )
+    {
+        /* Must not hold the stop pipe open, or the sleeper would never exit */
+        close(goPipe[1]);
+        close(stopPipe[1]);
+        close(infoPipe[0]);
+
+        dup2(outPipe[1], 1);
+        close(outPipe[0]);
+        close(outPipe[1]);
+
+        if ( runAsUid >= 0 && ( setgid(runAsUid) != 0 || setuid(runAsUid) != 0 ) )
+        {
+            perror("setuid");
+            _exit(1);
+        }
+
+        execl(getcpidsPath, getcpidsPath, "--follow", "-r", rootPidStr, NULL);
+        perror("execl");
+        _exit(1);
+    }
+    close(outPipe[1]);
+
+    usleep(STARTUP_WAIT_USEC);
+
+    /* Start the child and grandchild, and let the sleeper go */
+    if ( write(goPipe[1], "g", 1) != 1 || read(infoPipe[0], treePids, sizeof(treePids)) != sizeof(treePids) )
+    {
+        printf("FAIL: Could not start the process tree.\n");
+        kill(rootPid, SIGKILL);
+        kill(followPid, SIGKILL);
+        return 1;
+    }
+    close(goPipe[1]);
+    close(stopPipe[1]);
+    close(infoPipe[0]);
+
+    /* getcpids exits on its own once the whole tree is gone */
+    outputLen = 0;
+    while ( outputLen < MAX_OUTPUT - 1 && (bytesRead = read(outPipe[0], &output[outputLen], MAX_OUTPUT - 1 - outputLen)) > 0 )
+        outputLen += bytesRead;
+    output[outputLen] = '\0';
+    close(outPipe[0]);
+
+    waitpid(rootPid, NULL, 0);
+    waitpid(followPid, &status, 0);
+
+    printf("Root=%d  Sleeper=%d  Child=%d  Grandchild=%d\nOutput:\n%s", (int)rootPid, (int)treePids[0], (int)treePids[1], (int)treePids[2], output);
+
+    if ( ! WIFEXITED(status) || WEXITSTATUS(status) != 0 )
+    {
+        printf("FAIL: getcpids did not exit cleanly (status=%d)\n", status);
+        failed = 1;
+    }
+
+    numLines = 0;
+    for( lines[0] = strtok(output, "\n"); lines[numLines] != NULL && numLines < 127; lines[numLines] = strtok(NULL, "\n") )
+        numLines++;
+
+    if ( numLines != 6 )
+    {
+        printf("FAIL: Expected 6 lines of output, got %d\n", numLines);
+        failed = 1;
+    }
+
+    sleeperAdd = find_line(lines, numLines, '+', treePids[0]);
+    sleeperRem = find_line(lines, numLines, '-', treePids[0]);
+    childAdd = find_line(lines, numLines, '+', treePids[1]);
+    childRem = find_line(lines, numLines, '-', treePids[1]);
+    grandchildAdd = find_line(lines, numLines, '+', treePids[2]);
+    grandchildRem = find_line(lines, numLines, '-', treePids[2]);
+
+    if ( sleeperAdd == -1 || sleeperRem == -1 || childAdd == -1 || childRem == -1 || grandchildAdd == -1 || grandchildRem == -1 )
+    {
+        failed = 1;
+    }
+    else
+    {
+        if ( sleeperAdd != 0 )
+        {
+            printf("FAIL: Sleeper should be in the initial snapshot\n");
+            failed = 1;
+        }
+        if ( sleeperRem < sleeperAdd || childRem < childAdd || grandchildRem < grandchildAdd )
+        {
+            printf("FAIL: A pid was removed before it was added\n");
+            failed = 1;
+        }
+        if ( grandchildRem > childRem )
+        {
+            printf("FAIL: Child was removed before grandchild exited\n");
+            failed = 1;
+        }
+    }
+
+    for( i=0; i < numLines; i++ )
+    {
+        if ( lines[i][0] != '+' && lines[i][0] != '-' )
+        {
+            printf("FAIL: Unexpected line '%s'\n", lines[i]);
+            failed = 1;
+        }
+    }
+
+    printf("%s\n\n", failed ? "FAILED" : "PASSED");
+
+    return failed;
+}
+
+int main(int argc, char* argv[])
+{
+    const char *getcpidsPath = "bin/getcpids";
+    int failed;
+
+    if ( argc > 1 )
+        getcpidsPath = argv[1];
+
+    alarm(TEST_TIMEOUT_SECONDS);
+
+    printf("++++ Following with default mode\n");
+    failed = run_test(getcpidsPath, -1);
+
+    if ( getuid() == 0 )
+    {
+        printf("++++ Following as an unprivileged user (rescan mode)\n");
+        failed |= run_test(getcpidsPath, NOBODY_UID);
+    }
+
+    return failed;
+}
@@ -0,0 +1,423 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * test_libpidtools.c - Test program for libpidtools
+ *
+ *   Starts a small tree of processes (3 children, one of which has a child),
+ *     checks the answers of each libpidtools function against it, then asks
+ *     the same questions from several threads at once.
+ *
+ *   pidtreed is disabled, so the answers come from /proc. Build with
+ *     -fsanitize=thread to have the threaded cases catch shared state as well
+ *     as wrong answers.
+ *
+ *   Linked against the static library, so it runs without installing anything.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "libpidtools.h"
+
+
+#define NUM_CHILDREN 3
+
+#define NUM_THREADS 4
+#define NUM_THREAD_ITERATIONS 200
+
+/* NUM_CHILDREN_THREADS - Threads walking children at once, each NUM_CHILDREN_ITERATIONS times */
+#define NUM_CHILDREN_THREADS 8
+#define NUM_CHILDREN_ITERATIONS 100
+
+static pid_t myPid;
+static pid_t children[NUM_CHILDREN];
+static pid_t grandchild;
+
+static volatile int numThreadFailures = 0;
+
+static pthread_barrier_t childrenBarrier;
+
+
+/**
+ * wait_for_eof - Block until the other end of #fd is closed, then exit
+ */
+static void wait_for_eof(int fd)
+{
+    char c;
+
+    while ( read(fd, &c, 1) != 0 && errno == EINTR );
+    _exit(0);
+}
+
+/**
+ * start_tree - Fork the children and grandchild. They exit when #stopPipe is closed.
+ *
+ *      @return <int> - 0 on success
+ */
+static int start_tree(int stopPipe[2])
+{
+    int infoPipe[2];
+    int i;
+
+    if ( pipe(infoPipe) != 0 )
+        return -1;
+
+    for( i=0; i < NUM_CHILDREN; i++ )
+    {
+        children[i] = fork();
+        if ( children[i] == 0 )
+        {
+            close(stopPipe[1]);
+            close(infoPipe[0]);
+
+            if ( i == 0 )
+            {
+                grandchild = fork();
+                if ( grandchild == 0 )
+                {
+                    close(infoPipe[1]);
+                    wait_for_eof(stopPipe[0]);
+                }
+                write(infoPipe[1], &grandchild, sizeof(pid_t));
+            }
+            close(infoPipe[1]);
+
+            wait_for_eof(stopPipe[0]);
+        }
+        if ( children[i] < 0 )
+            return -1;
+    }
+
+    close(infoPipe[1]);
+    if ( read(infoPipe[0], &grandchild, sizeof(pid_t)) != sizeof(pid_t) )
+        return -1;
+    close(infoPipe[0]);
+
+    return 0;
+}
+
+/**
+ * check_children - Check pidtools_get_children of this process
+ *
+ *      @return <int> - Number of failures
+ */
+static int check_children(int isRecursive, int isQuiet)
+{
+    pid_t *found = NULL;
+    size_t numFound = 0;
+    size_t numExpected;
+    int failed = 0;
+    int i;
+
+    if ( pidtools_get_children(&myPid, 1, isRecursive, &found, &numFound) != 0 )
+    {
+        if ( ! isQuiet )
+            printf("FAIL: pidtools_get_children returned an error: %s\n", strerror(errno));
+        return 1;
+    }
+
+    numExpected = isRecursive ? NUM_CHILDREN + 1 : NUM_CHILDREN;
+    if ( numFound != numExpected )
+    {
+        if ( ! isQuiet )
+            printf("FAIL: pidtools_get_children(recursive=%d) found %zu pids, expected %zu\n", isRecursive, numFound, numExpected);
+        failed++;
+    }
+
+    for( i=1; i < (int)numFound; i++ )
+    {
+        if ( found[i] <= found[i - 1] )
+        {
+            if ( ! isQuiet )
+                printf("FAIL: pidtools_get_children did not return a sorted list\n");
+            failed++;
+            break;
+        }
+    }
+
+    free(found);
+
+    return failed;
+}
+
+/**
+ * check_forest - Check the answers of a forest against the tree we started
+ *
+ *      @return <int> - Number of failures
+ */
+static int check_forest(void)
+{
+    PidToolsForest *forest;
+    pid_t rootPids[2];
+    pid_t pids[NUM_CHILDREN + 3];
+    pid_t roots[NUM_CHILDREN + 3];
+    size_t numFound;
+    int failed = 0;
+    int i;
+
+    forest = pidtools_forest_create();
+    if ( forest == NULL )
+    {
+        printf("FAIL: pidtools_forest_create returned NULL. Error %d: %s\n", errno, strerror(errno));
+        return 1;
+    }
+
+    if ( pidtools_forest_is_ancestor(forest, myPid, children[1]) != 1 ||
+         pidtools_forest_is_ancestor(forest, myPid, grandchild) != 1 ||
+         pidtools_forest_is_ancestor(forest, 1, grandchild) != 1 ||
+         pidtools_forest_is_ancestor(forest, children[1], grandchild) != 0 ||
+         pidtools_forest_is_ancestor(forest, grandchild, myPid) != 0 ||
+         pidtools_forest_is_ancestor(forest, myPid, myPid) != 0 )
+    {
+        printf("FAIL: pidtools_forest_is_ancestor gave a wrong answer\n");
+        failed++;
+    }
+
+    errno = 0;
+    if ( pidtools_forest_is_ancestor(forest, myPid, 0x7ffffff0) != -1 || errno != ENOENT )
+    {
+        printf("FAIL: pidtools_forest_is_ancestor of a missing pid should be -1 with ENOENT\n");
+        failed++;
+    }
+
+    /* Nested roots: the grandchild should be found under the innermost */
+    rootPids[0] = myPid;
+    rootPids[1] = children[0];
+
+    memcpy(pids, children, sizeof(children));
+    pids[NUM_CHILDREN] = grandchild;
+    pids[NUM_CHILDREN + 1] = myPid;
+    pids[NUM_CHILDREN + 2] = 0x7ffffff0;
+
+    numFound = pidtools_forest_find_roots(forest, rootPids, 2, pids, NUM_CHILDREN + 3, roots);
+    if ( numFound != NUM_CHILDREN + 1 )
+    {
+        printf("FAIL: pidtools_forest_find_roots found %zu, expected %d\n", numFound, NUM_CHILDREN + 1);
+        failed++;
+    }
+    for( i=0; i < NUM_CHILDREN; i++ )
+    {
+        if ( roots[i] != myPid )
+        {
+            printf("FAIL: pidtools_forest_find_roots gave root of %d as %d, expected %d\n", (int)pids[i], (int)roots[i], (int)myPid);
+            failed++;
+        }
+    }
+    if ( roots[NUM_CHILDREN] != children[0] || roots[NUM_CHILDREN + 1] != 0 || roots[NUM_CHILDREN + 2] != -1 )
+    {
+        printf("FAIL: pidtools_forest_find_roots gave wrong results for the grandchild, a root, or a missing pid\n");
+        failed++;
+    }
+
+    pidtools_forest_destroy(forest);
+
+    return failed;
+}
+
+static void *thread_main(void *arg)
+{
+    pid_t pids[NUM_CHILDREN + 1];
+    pid_t ppids[NUM_CHILDREN + 1];
+    int failed;
+    int i, j;
+
+    memcpy(pids, children, sizeof(children));
+    pids[NUM_CHILDREN] = grandchild;
+
+    for( i=0; i < NUM_THREAD_ITERATIONS; i++ )
+    {
+        failed = 0;
+
+        if ( pidtools_get_ppids(pids, NUM_CHILDREN + 1, ppids) != NUM_CHILDREN + 1 )
+            failed++;
+
+        for( j=0; j < NUM_CHILDREN; j++ )
+        {
+            if ( ppids[j] != myPid || pidtools_get_ppid(pids[j]) != myPid )
+                failed++;
+        }
+        if ( ppids[NUM_CHILDREN] != children[0] )
+            failed++;
+
+        if ( pidtools_is_child_of(grandchild, myPid, 1) != 1 )
+            failed++;
+
+        if ( i % 20 == 0 )
+            failed += check_children(i % 40 == 0, 1);
+
+        if ( failed )
+            __sync_fetch_and_add(&numThreadFailures, failed);
+    }
+
+    return NULL;
+}
+
+/**
+ * children_thread_main - Walk the children of this process over and over, starting
+ *                          together with the other threads so the walks overlap
+ */
+static void *children_thread_main(void *arg)
+{
+    int failed = 0;
+    int i;
+
+    pthread_barrier_wait(&childrenBarrier);
+
+    for( i=0; i < NUM_CHILDREN_ITERATIONS; i++ )
+        failed += check_children(i % 2, 1);
+
+    if ( failed )
+        __sync_fetch_and_add(&numThreadFailures, failed);
+
+    return NULL;
+}
+
+/**
+ * check_children_threaded - Check pidtools_get_children from many threads at once
+ *
+ *      @return <int> - Number of failures
+ */
+static int check_children_threaded(void)
+{
+    pthread_t threads[NUM_CHILDREN_THREADS];
+    int i;
+
+    numThreadFailures = 0;
+    pthread_barrier_init(&childrenBarrier, NULL, NUM_CHILDREN_THREADS);
+
+    for( i=0; i < NUM_CHILDREN_THREADS; i++ )
+        pthread_create(&threads[i], NULL, children_thread_main, NULL);
+    for( i=0; i < NUM_CHILDREN_THREADS; i++ )
+        pthread_join(threads[i], NULL);
+
+    pthread_barrier_destroy(&childrenBarrier);
+
+    if ( numThreadFailures )
+    {
+        printf("FAIL: %d wrong answers from pidtools_get_children when called from %d threads at once\n", numThreadFailures, NUM_CHILDREN_THREADS);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    int stopPipe[2];
+    pthread_t threads[NUM_THREADS];
+    pid_t pids[NUM_CHILDREN + 2];
+    pid_t ppids[NUM_CHILDREN + 2];
+    size_t numFound;
+    int failed = 0;
+    int i;
+
+    myPid = getpid();
+
+    /* Test the /proc readers, whether or not a daemon is running */
+    setenv("PIDTREED_DISABLE", "1", 1);
+
+    if ( pipe(stopPipe) != 0 || start_tree(stopPipe) != 0 )
+    {
+        printf("FAIL: Could not start the process tree.\n");
+        return 1;
+    }
+    close(stopPipe[0]);
+
+    printf("libpidtools version %s\n", pidtools_version());
+
+    if ( pidtools_get_ppid(myPid) != getppid() )
+    {
+        printf("FAIL: pidtools_get_ppid(self) = %d, expected %d\n", (int)pidtools_get_ppid(myPid), (int)getppid());
+        failed++;
+    }
+
+    if ( pidtools_get_ppid(1) != 1 )
+    {
+        printf("FAIL: pidtools_get_ppid(1) should be 1\n");
+        failed++;
+    }
+
+    errno = 0;
+    if ( pidtools_get_ppid(0x7ffffff0) != -1 || errno != ENOENT )
+    {
+        printf("FAIL: pidtools_get_ppid of a missing pid should be -1 with ENOENT\n");
+        failed++;
+    }
+
+    /* Batch, with a missing pid in the middle */
+    memcpy(pids, children, sizeof(children));
+    pids[NUM_CHILDREN] = 0x7ffffff0;
+    pids[NUM_CHILDREN + 1] = grandchild;
+
+    numFound = pidtools_get_ppids(pids, NUM_CHILDREN + 2, ppids);
+    if ( numFound != NUM_CHILDREN + 1 )
+    {
+        printf("FAIL: pidtools_get_ppids found %zu, expected %d\n", numFound, NUM_CHILDREN + 1);
+        failed++;
+    }
+    for( i=0; i < NUM_CHILDREN; i++ )
+    {
+        if ( ppids[i] != myPid )
+        {
+            printf("FAIL: pidtools_get_ppids gave parent of %d as %d, expected %d\n", (int)pids[i], (int)ppids[i], (int)myPid);
+            failed++;
+        }
+    }
+    if ( ppids[NUM_CHILDREN] != -1 || ppids[NUM_CHILDREN + 1] != children[0] )
+    {
+        printf("FAIL: pidtools_get_ppids gave wrong results for the missing pid or the grandchild\n");
+        failed++;
+    }
+
+    failed += check_children(0, 0);
+    failed += check_children(1, 0);
+
+    if ( pidtools_is_child_of(children[1], myPid, 0) != 1 ||
+         pidtools_is_child_of(grandchild, myPid, 0) != 0 ||
+         pidtools_is_child_of(grandchild, myPid, 1) != 1 ||
+         pidtools_is_child_of(myPid, children[1], 1) != 0 )
+    {
+        printf("FAIL: pidtools_is_child_of gave a wrong answer\n");
+        failed++;
+    }
+
+    failed += check_forest();
+
+    if ( pidtools_get_inode(myPid) <= 0 || pidtools_get_inode(0x7ffffff0) != -1 )
+    {
+        printf("FAIL: pidtools_get_inode gave a wrong answer\n");
+        failed++;
+    }
+
+    for( i=0; i < NUM_THREADS; i++ )
+        pthread_create(&threads[i], NULL, thread_main, NULL);
+    for( i=0; i < NUM_THREADS; i++ )
+        pthread_join(threads[i], NULL);
+
+    if ( numThreadFailures )
+    {
+        printf("FAIL: %d wrong answers when called from %d threads at once\n", numThreadFailures, NUM_THREADS);
+        failed++;
+    }
+
+    failed += check_children_threaded();
+
+    close(stopPipe[1]);
+    for( i=0; i < NUM_CHILDREN; i++ )
+        waitpid(children[i], NULL, 0);
+
+    printf("%s\n", failed ? "FAILED" : "PASSED");
+
+    return failed ? 1 : 0;
+}
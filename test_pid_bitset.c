@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * test_pid_bitset.c - Test program for the pid bitset
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pid_tools.h"
+#include "pid_bitset.h"
+
+
+/* TEST_PID_MAX - pid_max the sets are created with. Not a multiple of 64, to test the last word */
+#define TEST_PID_MAX 5000
+
+/* RANDOM_OPS_COUNT - Number of random adds and removes made by test_random_ops */
+#define RANDOM_OPS_COUNT 200000
+
+/* NUM_SET_OPS_ROUNDS - Number of random pairs of sets test_set_ops combines */
+#define NUM_SET_OPS_ROUNDS 50
+
+static unsigned int testSeed = 12345;
+
+/**
+ * test_rand - Small LCG, so runs are reproducible
+ */
+static unsigned int test_rand(void)
+{
+    testSeed = testSeed * 1103515245U + 12345U;
+
+    return testSeed >> 8;
+}
+
+/**
+ * check_contents - Check contains, count, values and next against a plain array
+ *
+ *      @param present <const char *> - 1 for every pid (below #range) which should be in the set
+ *
+ *      @return <int> - 0 if everything matched, otherwise 1
+ */
+static int check_contents(const PidBitset *bitset, const char *present, pid_t range, const char *what)
+{
+    pid_t pid, nextPid;
+    pid_t *values;
+    size_t numValues, numPresent, i;
+
+    numPresent = 0;
+    for( pid=0; pid < range; pid++ )
+    {
+        if ( pid_bitset_contains(bitset, pid) != present[pid] )
+        {
+            printf("FAILED: %s: contains %d returned %d\n", what, pid, ! present[pid]);
+            return 1;
+        }
+        numPresent += present[pid];
+    }
+
+    if ( pid_bitset_count(bitset) != numPresent )
+    {
+        printf("FAILED: %s: count returned %zu (expected %zu)\n", what, pid_bitset_count(bitset), numPresent);
+        return 1;
+    }
+
+    values = pid_bitset_values(bitset, &numValues);
+    if ( numValues != numPresent )
+    {
+        printf("FAILED: %s: values returned %zu (expected %zu)\n", what, numValues, numPresent);
+        return 1;
+    }
+
+    /* values and next must both give exactly the present pids, in ascending order */
+    nextPid = pid_bitset_next(bitset, 0);
+    for( i=0, pid=0; pid < range; pid++ )
+    {
+        if ( ! present[pid] )
+            continue;
+
+        if ( values[i] != pid || nextPid != pid )
+        {
+            printf("FAILED: %s: value %zu is %d, next is %d (expected %d)\n", what, i, values[i], nextPid, pid);
+            return 1;
+        }
+        i++;
+        nextPid = pid_bitset_next(bitset, pid + 1);
+    }
+    free(values);
+
+    if ( nextPid != -1 )
+    {
+        printf("FAILED: %s: next returned %d after the last pid\n", what, nextPid);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * test_random_ops - Make many random adds and removes, checking every result,
+ *                     and every so often the whole contents
+ *
+ *      @return <int> - 0 if everything matched, otherwise 1
+ */
+static int test_random_ops(void)
+{
+    PidBitset *bitset;
+    char present[TEST_PID_MAX] = { 0 };
+    unsigned int i;
+    pid_t pid;
+    int ret, expected;
+
+    bitset = pid_bitset_create(TEST_PID_MAX);
+
+    for( i=0; i < RANDOM_OPS_COUNT; i++ )
+    {
+        pid = (pid_t)( test_rand() % TEST_PID_MAX );
+
+        if ( test_rand() % 8 < ( i < RANDOM_OPS_COUNT / 2 ? 5 : 3 ) )
+        {
+            ret = pid_bitset_add(bitset, pid);
+            expected = ! present[pid];
+            present[pid] = 1;
+        }
+        else
+        {
+            ret = pid_bitset_rem(bitset, pid);
+            expected = present[pid];
+            present[pid] = 0;
+        }
+
+        if ( ret != expected )
+        {
+            printf("FAILED: op %u on %d returned %d (expected %d)\n", i, pid, ret, expected);
+            return 1;
+        }
+
+        if ( i % 4096 == 0 && check_contents(bitset, present, TEST_PID_MAX, "random ops") != 0 )
+            return 1;
+    }
+
+    if ( check_contents(bitset, present, TEST_PID_MAX, "random ops") != 0 )
+        return 1;
+
+    if ( pid_bitset_contains(bitset, -1) || pid_bitset_contains(bitset, TEST_PID_MAX * 2) || pid_bitset_rem(bitset, TEST_PID_MAX * 2) )
+    {
+        printf("FAILED: pids outside the set were found\n");
+        return 1;
+    }
+
+    printf("Random adds and removes: PASSED (%zu pids left)\n", pid_bitset_count(bitset));
+
+    pid_bitset_destroy(bitset);
+
+    return 0;
+}
+
+/**
+ * test_grow - Add pids above the pid_max the set was created with
+ *
+ *      @return <int> - 0 if everything matched, otherwise 1
+ */
+static int test_grow(void)
+{
+    PidBitset *bitset;
+    static char present[TEST_PID_MAX * 4];
+
+    memset(present, 0, sizeof(present));
+
+    bitset = pid_bitset_create(64);
+
+    pid_bitset_add(bitset, 3);
+    pid_bitset_add(bitset, 63);
+    pid_bitset_add(bitset, 64);
+    pid_bitset_add(bitset, TEST_PID_MAX * 4 - 1);
+    present[3] = present[63] = present[64] = present[TEST_PID_MAX * 4 - 1] = 1;
+
+    if ( check_contents(bitset, present, TEST_PID_MAX * 4, "grow") != 0 )
+        return 1;
+
+    pid_bitset_destroy(bitset);
+
+    printf("Grow past pid_max: PASSED\n");
+
+    return 0;
+}
+
+/**
+ * test_set_ops - Check union, intersect and difference of random sets (of
+ *                  different sizes) against a plain array
+ *
+ *      @return <int> - 0 if everything matched, otherwise 1
+ */
+static int test_set_ops(void)
+{
+    PidBitset *setA, *setB, *result;
+    char inA[TEST_PID_MAX], inB[TEST_PID_MAX], expected[TEST_PID_MAX];
+    unsigned int round, op;
+    pid_t pid, pidMaxB;
+    static const char *opNames[] = { "union", "intersect", "difference" };
+
+    for( round=0; round < NUM_SET_OPS_ROUNDS; round++ )
+    {
+        /* B is sometimes smaller, sometimes larger than A */
+        pidMaxB = (pid_t)( TEST_PID_MAX / 2 + test_rand() % (TEST_PID_MAX / 2) );
+
+        setA = pid_bitset_create(TEST_PID_MAX / 2 + 1);
+        setB = pid_bitset_create(pidMaxB);
+        memset(inA, 0, sizeof(inA));
+        memset(inB, 0, sizeof(inB));
+
+        for( pid=0; pid < TEST_PID_MAX; pid++ )
+        {
+            if ( test_rand() % 3 == 0 )
+                inA[pid] = (char)pid_bitset_add(setA, pid);
+            if ( pid < pidMaxB && test_rand() % 3 == 0 )
+                inB[pid] = (char)pid_bitset_add(setB, pid);
+        }
+
+        for( op=0; op < 3; op++ )
+        {
+            /* A copy of A, combined with B */
+            result = pid_bitset_create(setA->pidMax);
+            memcpy(result->words, setA->words, sizeof(uint64_t) * setA->numWords);
+
+            if ( op == 0 )
+                pid_bitset_union(result, setB);
+            else if ( op == 1 )
+                pid_bitset_intersect(result, setB);
+            else
+                pid_bitset_difference(result, setB);
+
+            for( pid=0; pid < TEST_PID_MAX; pid++ )
+            {
+                if ( op == 0 )
+                    expected[pid] = inA[pid] | inB[pid];
+                else if ( op == 1 )
+                    expected[pid] = inA[pid] & inB[pid];
+                else
+                    expected[pid] = inA[pid] & ! inB[pid];
+            }
+
+            if ( check_contents(result, expected, TEST_PID_MAX, opNames[op]) != 0 )
+                return 1;
+
+            pid_bitset_destroy(result);
+        }
+
+        pid_bitset_destroy(setA);
+        pid_bitset_destroy(setB);
+    }
+
+    printf("Union, intersect and difference: PASSED\n");
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    PidBitset *bitset;
+
+    /* pid_max from /proc */
+    bitset = pid_bitset_create(0);
+    if ( bitset->pidMax < pid_bitset_read_pid_max() || pid_bitset_count(bitset) != 0 || pid_bitset_next(bitset, 0) != -1 )
+    {
+        printf("FAILED: new set from pid_max %d is not empty and large enough\n", (int)pid_bitset_read_pid_max());
+        return 1;
+    }
+    pid_bitset_destroy(bitset);
+
+    if ( test_random_ops() != 0 )
+        return 1;
+    if ( test_grow() != 0 )
+        return 1;
+    if ( test_set_ops() != 0 )
+        return 1;
+
+    return 0;
+}
@@ -11,12 +11,443 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <unistd.h>
 
 #include "pid_tools.h"
 #include "simple_int_map.h"
 
 
+/* RANDOM_OPS_RANGE - Values used by test_random_ops are in [-RANGE/2, RANGE/2) */
+#define RANDOM_OPS_RANGE 4096
+
+/* RANDOM_OPS_COUNT - Number of random adds and removes made by test_random_ops */
+#define RANDOM_OPS_COUNT 200000
+
+/**
+ * test_random_ops - Make many random adds and removes (including 0 and negatives,
+ *                     enough to grow the map several times), checking every result,
+ *                     the contents, values and iteration against a plain array
+ *
+ *      @return <int> - 0 if everything matched, otherwise 1
+ */
+static int test_random_ops(void)
+{
+    SimpleIntMap *intMap;
+    SimpleIntMapIterator *mapIter;
+    char present[RANDOM_OPS_RANGE] = { 0 };
+    size_t numPresent = 0;
+    unsigned int seed = 12345;
+    unsigned int i;
+    int val, ret, expected;
+    int *values;
+    size_t valuesSize, numSeen;
+    int stopIteration;
+
+    intMap = simple_int_map_create(10);
+
+    for( i=0; i < RANDOM_OPS_COUNT; i++ )
+    {
+        seed = seed * 1103515245U + 12345U;
+        val = (int)( (seed >> 8) % RANDOM_OPS_RANGE ) - (RANDOM_OPS_RANGE / 2);
+
+        /* Mostly adds early on, then mostly removes, so the map fills up and drains */
+        expected = ( (seed >> 4) % 8 ) < ( i < RANDOM_OPS_COUNT / 2 ? 5 : 3 );
+        if ( expected )
+        {
+            ret = simple_int_map_add(intMap, val);
+            expected = ! present[val + RANDOM_OPS_RANGE / 2];
+            if ( expected )
+                numPresent++;
+            present[val + RANDOM_OPS_RANGE / 2] = 1;
+        }
+        else
+        {
+            ret = simple_int_map_rem(intMap, val);
+            expected = present[val + RANDOM_OPS_RANGE / 2];
+            if ( expected )
+                numPresent--;
+            present[val + RANDOM_OPS_RANGE / 2] = 0;
+        }
+
+        if ( ret != expected || MAP_NUM_ENTRIES(intMap) != numPresent )
+        {
+            printf("FAILED: op %u on %d returned %d (expected %d), %zu entries (expected %zu)\n",
+                i, val, ret, expected, MAP_NUM_ENTRIES(intMap), numPresent);
+            return 1;
+        }
+
+        /* Every so often, check that everything else is still findable */
+        if ( i % 4096 == 0 )
+        {
+            for( val = -(RANDOM_OPS_RANGE / 2); val < RANDOM_OPS_RANGE / 2; val++ )
+            {
+                if ( simple_int_map_contains(intMap, val) != present[val + RANDOM_OPS_RANGE / 2] )
+                {
+                    printf("FAILED: contains %d after op %u\n", val, i);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    values = simple_int_map_values(intMap, &valuesSize);
+    if ( valuesSize != numPresent )
+    {
+        printf("FAILED: values returned %zu (expected %zu)\n", valuesSize, numPresent);
+        return 1;
+    }
+    for( i=0; i < valuesSize; i++ )
+    {
+        if ( ! present[ values[i] + RANDOM_OPS_RANGE / 2 ] )
+        {
+            printf("FAILED: values contains %d, which is not present\n", values[i]);
+            return 1;
+        }
+    }
+    free(values);
+
+    numSeen = 0;
+    stopIteration = 0;
+    mapIter = simple_int_map_get_iter(intMap);
+    while ( stopIteration != MAP_ITER_PAST_END_RETURN_INVALID )
+    {
+        val = simple_int_map_iter_next(mapIter, &stopIteration);
+        if ( stopIteration == MAP_ITER_PAST_END_RETURN_INVALID )
+            break;
+
+        if ( ! present[val + RANDOM_OPS_RANGE / 2] )
+        {
+            printf("FAILED: iteration returned %d, which is not present\n", val);
+            return 1;
+        }
+        numSeen++;
+
+        if ( stopIteration == MAP_ITER_RETURNED_FINAL_VALUE )
+            break;
+    }
+    simple_int_map_iter_destroy(mapIter);
+
+    if ( numSeen != numPresent )
+    {
+        printf("FAILED: iteration returned %zu values (expected %zu)\n", numSeen, numPresent);
+        return 1;
+    }
+
+    simple_int_map_destroy(intMap);
+
+    printf("Random adds and removes: PASSED (%zu values left)\n", numPresent);
+
+    return 0;
+}
+
+/* BATCH_OPS_ROUNDS - Number of random batches made by test_batch_ops */
+#define BATCH_OPS_ROUNDS 20000
+
+/* BATCH_OPS_MAX_LEN - Longest batch made by test_batch_ops, several times the prefetch block */
+#define BATCH_OPS_MAX_LEN 100
+
+/**
+ * test_batch_ops - Make many random add_many, rem_many and contains_many calls (of
+ *                    random lengths, with repeats inside a batch, 0 and negatives),
+ *                    checking every count and result bit against a plain array
+ *
+ *      @return <int> - 0 if everything matched, otherwise 1
+ */
+static int test_batch_ops(void)
+{
+    SimpleIntMap *intMap;
+    char present[RANDOM_OPS_RANGE] = { 0 };
+    int batch[BATCH_OPS_MAX_LEN];
+    uint64_t resultBits[ SIMPLE_INT_MAP_RESULT_WORDS(BATCH_OPS_MAX_LEN) ];
+    size_t numPresent = 0;
+    size_t batchLen, i, ret, expected;
+    unsigned int seed = 54321;
+    unsigned int round, op;
+    int val;
+
+    intMap = simple_int_map_create(10);
+
+    for( round=0; round < BATCH_OPS_ROUNDS; round++ )
+    {
+        seed = seed * 1103515245U + 12345U;
+        batchLen = (seed >> 8) % (BATCH_OPS_MAX_LEN + 1);
+        op = (seed >> 4) % 3;
+
+        for( i=0; i < batchLen; i++ )
+        {
+            seed = seed * 1103515245U + 12345U;
+            batch[i] = (int)( (seed >> 8) % RANDOM_OPS_RANGE ) - (RANDOM_OPS_RANGE / 2);
+        }
+
+        expected = 0;
+        if ( op == 0 )
+        {
+            ret = simple_int_map_add_many(intMap, batch, batchLen);
+            for( i=0; i < batchLen; i++ )
+            {
+                if ( ! present[ batch[i] + RANDOM_OPS_RANGE / 2 ] )
+                    expected++;
+                present[ batch[i] + RANDOM_OPS_RANGE / 2 ] = 1;
+            }
+            numPresent += expected;
+        }
+        else if ( op == 1 )
+        {
+            ret = simple_int_map_rem_many(intMap, batch, batchLen);
+            for( i=0; i < batchLen; i++ )
+            {
+                if ( present[ batch[i] + RANDOM_OPS_RANGE / 2 ] )
+                    expected++;
+                present[ batch[i] + RANDOM_OPS_RANGE / 2 ] = 0;
+            }
+            numPresent -= expected;
+        }
+        else
+        {
+            /* Set every bit first, so any not cleared past the end of the results are noticed */
+            memset(resultBits, 0xff, sizeof(resultBits));
+
+            ret = simple_int_map_contains_many(intMap, batch, batchLen, resultBits);
+            for( i=0; i < batchLen; i++ )
+            {
+                if ( SIMPLE_INT_MAP_RESULT_BIT(resultBits, i) != present[ batch[i] + RANDOM_OPS_RANGE / 2 ] )
+                {
+                    printf("FAILED: contains_many result %zu for %d is %d\n", i, batch[i], SIMPLE_INT_MAP_RESULT_BIT(resultBits, i));
+                    return 1;
+                }
+                expected += present[ batch[i] + RANDOM_OPS_RANGE / 2 ];
+            }
+
+            for( ; i < SIMPLE_INT_MAP_RESULT_WORDS(batchLen) * 64; i++ )
+            {
+                if ( SIMPLE_INT_MAP_RESULT_BIT(resultBits, i) )
+                {
+                    printf("FAILED: contains_many set result bit %zu, past the %zu values\n", i, batchLen);
+                    return 1;
+                }
+            }
+        }
+
+        if ( ret != expected || MAP_NUM_ENTRIES(intMap) != numPresent )
+        {
+            printf("FAILED: batch op %u of %zu values returned %zu (expected %zu), %zu entries (expected %zu)\n",
+                op, batchLen, ret, expected, MAP_NUM_ENTRIES(intMap), numPresent);
+            return 1;
+        }
+
+        /* Every so often, check that everything else is still findable */
+        if ( round % 1024 == 0 )
+        {
+            for( val = -(RANDOM_OPS_RANGE / 2); val < RANDOM_OPS_RANGE / 2; val++ )
+            {
+                if ( simple_int_map_contains(intMap, val) != present[val + RANDOM_OPS_RANGE / 2] )
+                {
+                    printf("FAILED: contains %d after batch %u\n", val, round);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    simple_int_map_destroy(intMap);
+
+    printf("Batch adds, removes and contains: PASSED (%zu values left)\n", numPresent);
+
+    return 0;
+}
+
+/* SORT_ROUNDS - Number of random lists sorted by test_sort */
+#define SORT_ROUNDS 400
+
+/* SORT_MAX_LEN - Longest list sorted by test_sort */
+#define SORT_MAX_LEN 5000
+
+/* NUM_SET_OPS_ROUNDS - Number of random pairs of maps test_set_ops combines */
+#define NUM_SET_OPS_ROUNDS 50
+
+static int cmp_ints(const void *p1, const void *p2)
+{
+    int val1, val2;
+
+    val1 = *((int *)p1);
+    val2 = *((int *)p2);
+
+    return (val1 > val2) - (val1 < val2);
+}
+
+/**
+ * test_sort - Sort random lists (of lengths either side of the insertion sort cutoff, with
+ *               repeats, negatives, the extremes, and pid-like values which skip radix
+ *               passes) with simple_int_map_sort_ints, checking against qsort. Then check
+ *               simple_int_map_sorted_values.
+ *
+ *      @return <int> - 0 if everything matched, otherwise 1
+ */
+static int test_sort(void)
+{
+    static int values[SORT_MAX_LEN], expected[SORT_MAX_LEN];
+    SimpleIntMap *intMap;
+    int *sortedValues;
+    size_t numValues, i;
+    unsigned int seed = 9876;
+    unsigned int round, kind;
+
+    for( round=0; round < SORT_ROUNDS; round++ )
+    {
+        seed = seed * 1103515245U + 12345U;
+        numValues = (seed >> 8) % ( round < SORT_ROUNDS / 2 ? 200 : SORT_MAX_LEN );
+        kind = round % 4;
+
+        for( i=0; i < numValues; i++ )
+        {
+            seed = seed * 1103515245U + 12345U;
+            if ( kind == 0 )
+                values[i] = (int)( seed ^ ( seed << 13 ) );    /* Anything, including negatives */
+            else if ( kind == 1 )
+                values[i] = (int)( 1 + (seed >> 8) % 4194304 ); /* Pids */
+            else if ( kind == 2 )
+                values[i] = (int)( (seed >> 8) % 64 ) - 32;     /* Many repeats, and 0 */
+            else
+                values[i] = ( (seed >> 8) & 1 ) ? INT_MAX : INT_MIN;
+        }
+
+        memcpy(expected, values, sizeof(int) * numValues);
+        qsort(expected, numValues, sizeof(int), cmp_ints);
+        simple_int_map_sort_ints(values, numValues);
+
+        if ( memcmp(values, expected, sizeof(int) * numValues) != 0 )
+        {
+            printf("FAILED: sort of %zu values (kind %u) does not match qsort\n", numValues, kind);
+            return 1;
+        }
+    }
+
+    intMap = simple_int_map_create(10);
+    for( i=0; i < SORT_MAX_LEN; i++ )
+    {
+        seed = seed * 1103515245U + 12345U;
+        simple_int_map_add(intMap, (int)( (seed >> 8) % 100000 ) - 50000);
+    }
+
+    sortedValues = simple_int_map_sorted_values(intMap, &numValues);
+    for( i=0; i < numValues; i++ )
+    {
+        if ( ( i > 0 && sortedValues[i - 1] >= sortedValues[i] ) || ! simple_int_map_contains(intMap, sortedValues[i]) )
+        {
+            printf("FAILED: sorted_values[%zu] is %d, out of order or not in the map\n", i, sortedValues[i]);
+            return 1;
+        }
+    }
+    if ( numValues != MAP_NUM_ENTRIES(intMap) )
+    {
+        printf("FAILED: sorted_values returned %zu (expected %zu)\n", numValues, MAP_NUM_ENTRIES(intMap));
+        return 1;
+    }
+    free(sortedValues);
+    simple_int_map_destroy(intMap);
+
+    printf("Sort and sorted values: PASSED\n");
+
+    return 0;
+}
+
+/**
+ * test_set_ops - Check union, intersect and difference of random maps (of different
+ *                  sizes, so both ways of working out a difference are used) against
+ *                  a plain array
+ *
+ *      @return <int> - 0 if everything matched, otherwise 1
+ */
+static int test_set_ops(void)
+{
+    SimpleIntMap *mapA, *mapB, *result;
+    char inA[RANDOM_OPS_RANGE], inB[RANDOM_OPS_RANGE];
+    char expected;
+    unsigned int seed = 2468;
+    unsigned int round, op, oddsA, oddsB;
+    size_t numChanged, expectedChanged, numExpected;
+    int val, idx;
+    static const char *opNames[] = { "union", "intersect", "difference" };
+
+    for( round=0; round < NUM_SET_OPS_ROUNDS; round++ )
+    {
+        /* Each map holds 1 in #odds of the range, so sometimes one is much larger */
+        seed = seed * 1103515245U + 12345U;
+        oddsA = 1 + (seed >> 8) % 16;
+        oddsB = 1 + (seed >> 16) % 16;
+
+        mapA = simple_int_map_create(10);
+        mapB = simple_int_map_create(10);
+
+        for( idx=0; idx < RANDOM_OPS_RANGE; idx++ )
+        {
+            val = idx - RANDOM_OPS_RANGE / 2;
+
+            seed = seed * 1103515245U + 12345U;
+            inA[idx] = (char)( (seed >> 8) % oddsA == 0 );
+            inB[idx] = (char)( (seed >> 16) % oddsB == 0 );
+
+            if ( inA[idx] )
+                simple_int_map_add(mapA, val);
+            if ( inB[idx] )
+                simple_int_map_add(mapB, val);
+        }
+
+        for( op=0; op < 3; op++ )
+        {
+            /* A copy of A, combined with B */
+            result = simple_int_map_create(10);
+            simple_int_map_union(result, mapA);
+
+            if ( op == 0 )
+                numChanged = simple_int_map_union(result, mapB);
+            else if ( op == 1 )
+                numChanged = simple_int_map_intersect(result, mapB);
+            else
+                numChanged = simple_int_map_difference(result, mapB);
+
+            expectedChanged = 0;
+            numExpected = 0;
+            for( idx=0; idx < RANDOM_OPS_RANGE; idx++ )
+            {
+                if ( op == 0 )
+                    expected = inA[idx] | inB[idx];
+                else if ( op == 1 )
+                    expected = inA[idx] & inB[idx];
+                else
+                    expected = inA[idx] & ! inB[idx];
+
+                if ( simple_int_map_contains(result, idx - RANDOM_OPS_RANGE / 2) != expected )
+                {
+                    printf("FAILED: %s: contains %d is wrong\n", opNames[op], idx - RANDOM_OPS_RANGE / 2);
+                    return 1;
+                }
+
+                expectedChanged += ( expected != inA[idx] );
+                numExpected += expected;
+            }
+
+            if ( numChanged != expectedChanged || MAP_NUM_ENTRIES(result) != numExpected )
+            {
+                printf("FAILED: %s: changed %zu (expected %zu), %zu entries (expected %zu)\n",
+                    opNames[op], numChanged, expectedChanged, MAP_NUM_ENTRIES(result), numExpected);
+                return 1;
+            }
+
+            simple_int_map_destroy(result);
+        }
+
+        simple_int_map_destroy(mapA);
+        simple_int_map_destroy(mapB);
+    }
+
+    printf("Union, intersect and difference: PASSED\n");
+
+    return 0;
+}
+
 void iterateOverMap(SimpleIntMap *intMap)
 {
     SimpleIntMapIterator *mapIter;
@@ -130,6 +561,14 @@ int main(int argc, char* argv[])
     free(values);
     simple_int_map_destroy(intMap);
 
-    return 0;
+    if ( test_random_ops() != 0 )
+        return 1;
+
+    if ( test_batch_ops() != 0 )
+        return 1;
+    if ( test_sort() != 0 )
+        return 1;
+
+    return test_set_ops();
 }
 
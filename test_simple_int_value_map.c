@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * test_simple_int_value_map.c - Test program for the simple int value map
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pid_tools.h"
+#include "simple_int_value_map.h"
+
+
+/* RANDOM_OPS_RANGE - Keys used by test_random_ops are in [-RANGE/2, RANGE/2) */
+#define RANDOM_OPS_RANGE 4096
+
+/* RANDOM_OPS_COUNT - Number of random operations made by test_random_ops */
+#define RANDOM_OPS_COUNT 300000
+
+/**
+ *   struct TestRecord - The value stored. An odd size, so entries are padded
+ */
+struct TestRecord {
+    int key;
+    unsigned int stamp;
+    char tag[5];
+};
+
+static unsigned int testSeed = 12345;
+
+/**
+ * test_rand - Small LCG, so runs are reproducible
+ */
+static unsigned int test_rand(void)
+{
+    testSeed = testSeed * 1103515245U + 12345U;
+
+    return testSeed >> 8;
+}
+
+/**
+ * check_contents - Check get, the number of entries and iteration against plain arrays
+ *
+ *      @param present <const char *> - 1 for every key (offset by RANGE/2) which should be present
+ *
+ *      @param records <const struct TestRecord *> - The value each present key should have
+ *
+ *      @param addedAt <const unsigned int *> - When each present key was added, which
+ *                      iteration must follow
+ *
+ *      @return <int> - 0 if everything matched, otherwise 1
+ */
+static int check_contents(SimpleIntValueMap *valueMap, const char *present, const struct TestRecord *records, const unsigned int *addedAt)
+{
+    struct TestRecord *record;
+    size_t numPresent, numSeen, pos;
+    unsigned int lastAddedAt;
+    int i, key;
+
+    numPresent = 0;
+    for( i=0; i < RANDOM_OPS_RANGE; i++ )
+    {
+        record = simple_int_value_map_get(valueMap, i - RANDOM_OPS_RANGE / 2);
+        if ( ( record != NULL ) != present[i] )
+        {
+            printf("FAILED: get %d returned %s\n", i - RANDOM_OPS_RANGE / 2, record ? "a value" : "NULL");
+            return 1;
+        }
+
+        if ( record != NULL && memcmp(record, &records[i], sizeof(struct TestRecord)) != 0 )
+        {
+            printf("FAILED: get %d returned the wrong value\n", i - RANDOM_OPS_RANGE / 2);
+            return 1;
+        }
+        numPresent += present[i];
+    }
+
+    if ( VALUE_MAP_NUM_ENTRIES(valueMap) != numPresent )
+    {
+        printf("FAILED: map has %zu entries (expected %zu)\n", VALUE_MAP_NUM_ENTRIES(valueMap), numPresent);
+        return 1;
+    }
+
+    /* Every present key once, in the order they were added */
+    numSeen = 0;
+    lastAddedAt = 0;
+    pos = 0;
+    while ( (record = simple_int_value_map_next(valueMap, &pos, &key)) != NULL )
+    {
+        i = key + RANDOM_OPS_RANGE / 2;
+        if ( i < 0 || i >= RANDOM_OPS_RANGE || ! present[i] || record->key != key )
+        {
+            printf("FAILED: iteration returned key %d, which is not present\n", key);
+            return 1;
+        }
+
+        if ( numSeen != 0 && addedAt[i] <= lastAddedAt )
+        {
+            printf("FAILED: iteration returned key %d out of the order it was added\n", key);
+            return 1;
+        }
+        lastAddedAt = addedAt[i];
+        numSeen++;
+    }
+
+    if ( numSeen != numPresent )
+    {
+        printf("FAILED: iteration returned %zu values (expected %zu)\n", numSeen, numPresent);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * test_random_ops - Make many random puts, get_or_inserts and removes (including 0
+ *                     and negatives, enough to grow and compact the map many times),
+ *                     checking every result, and every so often the whole contents
+ *
+ *      @return <int> - 0 if everything matched, otherwise 1
+ */
+static int test_random_ops(void)
+{
+    SimpleIntValueMap *valueMap;
+    static char present[RANDOM_OPS_RANGE];
+    static struct TestRecord records[RANDOM_OPS_RANGE];
+    static unsigned int addedAt[RANDOM_OPS_RANGE];
+    struct TestRecord record, *valuePtr;
+    struct TestRecord zeroRecord;
+    unsigned int i, op;
+    int key, idx, ret, wasInserted;
+
+    memset(&zeroRecord, 0, sizeof(zeroRecord));
+
+    valueMap = simple_int_value_map_create(sizeof(struct TestRecord), 10);
+
+    for( i=0; i < RANDOM_OPS_COUNT; i++ )
+    {
+        idx = (int)( test_rand() % RANDOM_OPS_RANGE );
+        key = idx - RANDOM_OPS_RANGE / 2;
+
+        /* Mostly adds early on, then mostly removes, so the map fills up and drains */
+        op = test_rand() % 8;
+        if ( op < ( i < RANDOM_OPS_COUNT / 2 ? 3 : 2 ) )
+        {
+            memset(&record, 0, sizeof(record));
+            record.key = key;
+            record.stamp = i;
+            snprintf(record.tag, sizeof(record.tag), "%04u", i % 10000);
+
+            ret = simple_int_value_map_put(valueMap, key, &record);
+            if ( ret != ! present[idx] )
+            {
+                printf("FAILED: put %d returned %d\n", key, ret);
+                return 1;
+            }
+        }
+        else if ( op < ( i < RANDOM_OPS_COUNT / 2 ? 5 : 3 ) )
+        {
+            valuePtr = simple_int_value_map_get_or_insert(valueMap, key, &wasInserted);
+            if ( wasInserted != ! present[idx] || memcmp(valuePtr, wasInserted ? &zeroRecord : &records[idx], sizeof(record)) != 0 )
+            {
+                printf("FAILED: get_or_insert %d returned %d, or the wrong value\n", key, wasInserted);
+                return 1;
+            }
+
+            /* Filled in place */
+            valuePtr->key = key;
+            valuePtr->stamp = i;
+            record = *valuePtr;
+            ret = wasInserted;
+        }
+        else
+        {
+            ret = simple_int_value_map_rem(valueMap, key);
+            if ( ret != present[idx] )
+            {
+                printf("FAILED: rem %d returned %d\n", key, ret);
+                return 1;
+            }
+
+            present[idx] = 0;
+            continue;
+        }
+
+        if ( ret == 1 )
+            addedAt[idx] = i;
+        present[idx] = 1;
+        records[idx] = record;
+
+        if ( i % 4096 == 0 && check_contents(valueMap, present, records, addedAt) != 0 )
+            return 1;
+    }
+
+    if ( check_contents(valueMap, present, records, addedAt) != 0 )
+        return 1;
+
+    printf("Random puts, get_or_inserts and removes: PASSED (%zu keys left)\n", VALUE_MAP_NUM_ENTRIES(valueMap));
+
+    simple_int_value_map_destroy(valueMap);
+
+    return 0;
+}
+
+/**
+ * test_rem_while_iterating - Remove every other key while iterating, then check the
+ *                              rest are still there, in order, after adding more
+ *
+ *      @return <int> - 0 if everything matched, otherwise 1
+ */
+static int test_rem_while_iterating(void)
+{
+    SimpleIntValueMap *valueMap;
+    size_t pos;
+    int *value;
+    int key, expectedKey;
+
+    valueMap = simple_int_value_map_create(sizeof(int), 0);
+
+    for( key=1; key <= 1000; key++ )
+        simple_int_value_map_put(valueMap, key * 7, &key);
+
+    pos = 0;
+    while ( (value = simple_int_value_map_next(valueMap, &pos, &key)) != NULL )
+    {
+        if ( *value % 2 == 0 )
+            simple_int_value_map_rem(valueMap, key);
+        else
+            *value = -*value;
+    }
+
+    /* Enough to fill the entries array, so the removed ones are compacted away */
+    for( key=1001; key <= 2000; key++ )
+        simple_int_value_map_put(valueMap, key * 7, &key);
+
+    expectedKey = 7;
+    pos = 0;
+    while ( (value = simple_int_value_map_next(valueMap, &pos, &key)) != NULL )
+    {
+        if ( key != expectedKey || ( key <= 7000 ? -*value : *value ) != key / 7 )
+        {
+            printf("FAILED: remove while iterating: got key %d value %d (expected key %d)\n", key, *value, expectedKey);
+            return 1;
+        }
+
+        /* The odd ones up to 999 (* 7) were kept, then every one added after */
+        expectedKey += ( expectedKey < 7000 ) ? 14 : 7;
+    }
+
+    if ( VALUE_MAP_NUM_ENTRIES(valueMap) != 1500 )
+    {
+        printf("FAILED: remove while iterating: %zu entries left (expected 1500)\n", VALUE_MAP_NUM_ENTRIES(valueMap));
+        return 1;
+    }
+
+    simple_int_value_map_destroy(valueMap);
+
+    printf("Remove while iterating: PASSED\n");
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if ( test_random_ops() != 0 )
+        return 1;
+    if ( test_rem_while_iterating() != 0 )
+        return 1;
+
+    return 0;
+}
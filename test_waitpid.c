@@ -0,0 +1,641 @@
+/*
+ * Copyright (c) 2018 Timothy Savannah All Rights Reserved
+ *
+ * Licensed under terms of Gnu General Public License Version 2
+ *
+ * See "LICENSE" with the source distribution for details.
+ *
+ * test_waitpid.c - Test program for "waitpid"
+ *
+ *   Forks many short-lived children, waits on all of them with "waitpid --print",
+ *     and checks that every pid is printed exactly once. Each child records the
+ *     time just before it exits, which is compared against the time waitpid
+ *     printed to measure the wakeup latency.
+ *
+ *   Also checks --any, --timeout, a thread id (which has no pidfd, so is polled),
+ *     and --tree on a multi-level tree which forks (and reparents) while being waited on.
+ *
+ *   When run as root, --tree is tested twice: once normally (using process events),
+ *     and once as "nobody" (which must fall back to rescanning).
+ *
+ *   Usage: test_waitpid (Optional: [num children, default 500] [path to waitpid, default bin/waitpid])
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+#include "pid_tools.h"
+
+/* Time to let waitpid set up before the children start to exit */
+#define STARTUP_WAIT_USEC 300000
+
+/* Children exit in this many groups, CHILD_STEP_USEC apart */
+#define CHILD_NUM_STEPS 50
+#define CHILD_STEP_USEC 10000
+
+/* Fail if any exit is reported later than this (generous, for a loaded machine) */
+#define MAX_LATENCY_MS 250.0
+
+/* How long the thread lives in the thread id test */
+#define THREAD_LIFE_USEC 300000
+
+/* Shape of the tree for --tree. Each process which is not a leaf forks one child,
+ *   waits for its own parent to exit (so it is reparented), then forks a second.
+ */
+#define TREE_DEPTH 3
+#define TREE_NUM_PROCS 15   /* 2^(TREE_DEPTH+1) - 1 */
+#define TREE_ROOT_DELAY_USEC 200000
+#define TREE_LINGER_USEC 200000
+#define TREE_LEAF_LIFE_USEC 300000
+
+#define NOBODY_UID 65534
+
+
+/**
+ * now_sec - Seconds of CLOCK_MONOTONIC, the same clock waitpid prints
+ */
+static double now_sec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * cloexec_pipe - pipe(2), with both ends closed in waitpid (on exec) but kept by forked children
+ */
+static int cloexec_pipe(int fds[2])
+{
+    if ( pipe(fds) != 0 )
+        return -1;
+
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+    return 0;
+}
+
+/**
+ * spawn_waitpid - Start waitpid with the given options and pids, with stdout to a pipe
+ *
+ *    @param options <const char **> - NULL-terminated options, placed before the pids
+ *
+ *    @param outFdOut <int *> - Set to the read end of waitpid's stdout
+ *
+ *    @param runAsUid <int> - If >= 0, run waitpid as this user
+ *
+ *    @return <pid_t> - Pid of waitpid
+ */
+static pid_t spawn_waitpid(const char *waitpidPath, const char **options, const pid_t *pids, int numPids, int *outFdOut, int runAsUid)
+{
+    char **args;
+    char *pidStrs;
+    int numArgs = 0;
+    int outPipe[2];
+    pid_t waitpidPid;
+    int i;
+
+    args = malloc( sizeof(char *) * (numPids + 8) );
+    pidStrs = malloc( numPids * 16 );
+
+    args[numArgs++] = (char *)waitpidPath;
+    for( i=0; options[i] != NULL; i++ )
+        args[numArgs++] = (char *)options[i];
+    for( i=0; i < numPids; i++ )
+    {
+        sprintf(&pidStrs[i * 16], "%d", (int)pids[i]);
+        args[numArgs++] = &pidStrs[i * 16];
+    }
+    args[numArgs] = NULL;
+
+    if ( pipe(outPipe) != 0 )
+    {
+        perror("pipe");
+        exit(1);
+    }
+
+    waitpidPid = fork();
+    if ( waitpidPid == 0 )
+    {
+        dup2(outPipe[1], 1);
+        close(outPipe[0]);
+        close(outPipe[1]);
+
+        if ( runAsUid >= 0 && ( setgid(runAsUid) != 0 || setuid(runAsUid) != 0 ) )
+        {
+            perror("setuid");
+            _exit(1);
+        }
+
+        execv(waitpidPath, args);
+        perror("execv");
+        _exit(1);
+    }
+    close(outPipe[1]);
+
+    free(pidStrs);
+    free(args);
+
+    *outFdOut = outPipe[0];
+    return waitpidPid;
+}
+
+/**
+ * read_all - Read everything from #fd until it is closed
+ *
+ *    @return <char *> - Null-terminated output, to be freed
+ */
+static char *read_all(int fd)
+{
+    char *output;
+    size_t outputLen = 0;
+    size_t outputSize = 4096;
+    ssize_t bytesRead;
+
+    output = malloc(outputSize);
+    while ( (bytesRead = read(fd, &output[outputLen], outputSize - outputLen - 1)) > 0 )
+    {
+        outputLen += bytesRead;
+        if ( outputLen + 1 == outputSize )
+        {
+            outputSize *= 2;
+            output = realloc(output, outputSize);
+        }
+    }
+    output[outputLen] = '\0';
+    close(fd);
+
+    return output;
+}
+
+/**
+ * test_many - Wait on #numChildren children which all exit within about half a second
+ *
+ *    @return <int> - 0 on pass, 1 on failure
+ */
+static int test_many(const char *waitpidPath, int numChildren)
+{
+    const char *options[] = { "--print", NULL };
+    volatile double *exitTimes;
+    pid_t *pids;
+    int *numSeen;
+    int goPipe[2];
+    int outFd;
+    pid_t waitpidPid;
+    char *output, *line, *savePtr;
+    char goByte;
+    int pid;
+    double reportTime, latency;
+    double totalLatency = 0, maxLatency = 0;
+    int numReports = 0;
+    int status;
+    int i;
+    int failed = 0;
+
+    exitTimes = mmap(NULL, sizeof(double) * numChildren, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    pids = malloc( sizeof(pid_t) * numChildren );
+    numSeen = calloc( numChildren, sizeof(int) );
+
+    if ( exitTimes == MAP_FAILED || cloexec_pipe(goPipe) != 0 )
+    {
+        perror("setup");
+        return 1;
+    }
+
+    for( i=0; i < numChildren; i++ )
+    {
+        pids[i] = fork();
+        if ( pids[i] == 0 )
+        {
+            close(goPipe[1]);
+            /* Wait for the pipe to close, then exit in one of the steps */
+            while ( read(goPipe[0], &goByte, 1) > 0 );
+            usleep( (i % CHILD_NUM_STEPS) * CHILD_STEP_USEC );
+
+            exitTimes[i] = now_sec();
+            _exit(0);
+        }
+    }
+    close(goPipe[0]);
+
+    waitpidPid = spawn_waitpid(waitpidPath, options, pids, numChildren, &outFd, -1);
+
+    usleep(STARTUP_WAIT_USEC);
+    close(goPipe[1]);
+
+    output = read_all(outFd);
+    waitpid(waitpidPid, &status, 0);
+
+    if ( ! WIFEXITED(status) || WEXITSTATUS(status) != 0 )
+    {
+        printf("FAIL: waitpid returned %d, expected 0.\n", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        failed = 1;
+    }
+
+    for( line = strtok_r(output, "\n", &savePtr); line != NULL; line = strtok_r(NULL, "\n", &savePtr) )
+    {
+        if ( sscanf(line, "%d %lf", &pid, &reportTime) != 2 )
+        {
+            printf("FAIL: Unexpected line '%s'\n", line);
+            failed = 1;
+            continue;
+        }
+
+        for( i=0; i < numChildren && pids[i] != pid; i++ );
+        if ( i == numChildren )
+        {
+            printf("FAIL: Printed pid %d which was not waited on.\n", pid);
+            failed = 1;
+            continue;
+        }
+
+        if ( ++numSeen[i] != 1 )
+            continue;
+
+        latency = (reportTime - exitTimes[i]) * 1000.0;
+        totalLatency += latency;
+        if ( latency > maxLatency )
+            maxLatency = latency;
+        numReports++;
+    }
+
+    for( i=0; i < numChildren; i++ )
+    {
+        if ( numSeen[i] != 1 )
+        {
+            printf("FAIL: Pid %d printed %d times, expected once.\n", (int)pids[i], numSeen[i]);
+            failed = 1;
+        }
+        waitpid(pids[i], NULL, 0);
+    }
+
+    if ( numReports > 0 )
+    {
+        printf("%d children: average wakeup latency %.3f ms, max %.3f ms\n", numChildren, totalLatency / numReports, maxLatency);
+        if ( maxLatency > MAX_LATENCY_MS )
+        {
+            printf("FAIL: Max latency over %.0f ms.\n", MAX_LATENCY_MS);
+            failed = 1;
+        }
+    }
+
+    free(output);
+    free(numSeen);
+    free(pids);
+    munmap((void *)exitTimes, sizeof(double) * numChildren);
+
+    return failed;
+}
+
+/**
+ * fork_until_closed - Fork a child which exits after #lifeUsec, or when #fd is closed if #lifeUsec is 0
+ */
+static pid_t fork_until_closed(int fd, int otherFd, useconds_t lifeUsec)
+{
+    pid_t pid;
+    char goByte;
+
+    pid = fork();
+    if ( pid == 0 )
+    {
+        close(otherFd);
+        if ( lifeUsec > 0 )
+            usleep(lifeUsec);
+        else
+            while ( read(fd, &goByte, 1) > 0 );
+        _exit(0);
+    }
+
+    return pid;
+}
+
+/**
+ * test_any_and_timeout - Check --any returns after the first exit, and --timeout gives up
+ *
+ *    @return <int> - 0 on pass, 1 on failure
+ */
+static int test_any_and_timeout(const char *waitpidPath)
+{
+    const char *anyOptions[] = { "--any", "--print", NULL };
+    const char *timeoutOptions[] = { "--timeout", "0.2", NULL };
+    pid_t pids[2];
+    int stopPipe[2];
+    int outFd;
+    pid_t waitpidPid;
+    char *output;
+    double startTime, elapsed;
+    int pid;
+    int status;
+    int failed = 0;
+
+    if ( cloexec_pipe(stopPipe) != 0 )
+    {
+        perror("pipe");
+        return 1;
+    }
+
+    /* One child exits soon, the other when the stop pipe is closed */
+    pids[0] = fork_until_closed(stopPipe[0], stopPipe[1], 100000);
+    pids[1] = fork_until_closed(stopPipe[0], stopPipe[1], 0);
+    close(stopPipe[0]);
+
+    waitpidPid = spawn_waitpid(waitpidPath, anyOptions, pids, 2, &outFd, -1);
+    output = read_all(outFd);
+    waitpid(waitpidPid, &status, 0);
+
+    if ( ! WIFEXITED(status) || WEXITSTATUS(status) != 0 || sscanf(output, "%d", &pid) != 1 || pid != pids[0] ||
+         strchr(output, '\n') != &output[strlen(output) - 1] )
+    {
+        printf("FAIL: --any returned %d and printed '%s', expected 0 and only pid %d.\n",
+            WIFEXITED(status) ? WEXITSTATUS(status) : -1, output, (int)pids[0]);
+        failed = 1;
+    }
+    free(output);
+
+    startTime = now_sec();
+    waitpidPid = spawn_waitpid(waitpidPath, timeoutOptions, &pids[1], 1, &outFd, -1);
+    output = read_all(outFd);
+    waitpid(waitpidPid, &status, 0);
+    elapsed = now_sec() - startTime;
+
+    if ( ! WIFEXITED(status) || WEXITSTATUS(status) != 124 || elapsed < 0.2 || elapsed > 5 )
+    {
+        printf("FAIL: --timeout 0.2 returned %d after %.3f seconds, expected 124 after 0.2 seconds.\n",
+            WIFEXITED(status) ? WEXITSTATUS(status) : -1, elapsed);
+        failed = 1;
+    }
+    free(output);
+
+    close(stopPipe[1]);
+    waitpid(pids[0], NULL, 0);
+    waitpid(pids[1], NULL, 0);
+
+    return failed;
+}
+
+static void *thread_sleep(void *arg)
+{
+    *(volatile pid_t *)arg = (pid_t)syscall(SYS_gettid);
+    usleep(THREAD_LIFE_USEC);
+    return NULL;
+}
+
+/**
+ * test_thread_id - Wait on a thread id, which has no pidfd, so is found by polling
+ *
+ *    @return <int> - 0 on pass, 1 on failure
+ */
+static int test_thread_id(const char *waitpidPath)
+{
+    const char *options[] = { "--print", NULL };
+    pthread_t thread;
+    volatile pid_t tid = 0;
+    pid_t tids[1];
+    int outFd;
+    pid_t waitpidPid;
+    char *output;
+    double startTime, elapsed;
+    int pid;
+    int status;
+    int failed = 0;
+
+    if ( pthread_create(&thread, NULL, thread_sleep, (void *)&tid) != 0 )
+    {
+        perror("pthread_create");
+        return 1;
+    }
+    while ( tid == 0 )
+        usleep(1000);
+
+    tids[0] = tid;
+    startTime = now_sec();
+    waitpidPid = spawn_waitpid(waitpidPath, options, tids, 1, &outFd, -1);
+    output = read_all(outFd);
+    waitpid(waitpidPid, &status, 0);
+    elapsed = now_sec() - startTime;
+
+    pthread_join(thread, NULL);
+
+    if ( ! WIFEXITED(status) || WEXITSTATUS(status) != 0 || sscanf(output, "%d", &pid) != 1 || pid != tids[0] || elapsed > 5 )
+    {
+        printf("FAIL: Waiting on thread id %d returned %d and printed '%s' after %.3f seconds.\n",
+            (int)tids[0], WIFEXITED(status) ? WEXITSTATUS(status) : -1, output, elapsed);
+        failed = 1;
+    }
+    free(output);
+
+    return failed;
+}
+
+/**
+ *   struct tree_record - Shared between the processes of the --tree test, which each
+ *                          record their pid and the time just before they exit
+ */
+struct tree_record {
+    int numProcs;
+    pid_t pids[TREE_NUM_PROCS];
+    double exitTimes[TREE_NUM_PROCS];
+};
+
+/**
+ * run_tree_node - One process of the --tree test. Never returns
+ */
+static void run_tree_node(volatile struct tree_record *record, int depth, int isRoot)
+{
+    pid_t parentPid;
+    int i, idx;
+
+__start_node:
+    if ( depth > 0 )
+    {
+        parentPid = getppid();
+
+        for( i=0; i < 2; i++ )
+        {
+            if ( i == 1 )
+            {
+                if ( isRoot )
+                {
+                    usleep(TREE_ROOT_DELAY_USEC);
+                }
+                else
+                {
+                    /* Fork the second child after being reparented */
+                    while ( getppid() == parentPid )
+                        usleep(10000);
+                }
+            }
+
+            if ( fork() == 0 )
+            {
+                /* The child runs as the next level down */
+                depth--;
+                isRoot = 0;
+                goto __start_node;
+            }
+        }
+        usleep(TREE_LINGER_USEC);
+    }
+    else
+    {
+        usleep(TREE_LEAF_LIFE_USEC);
+    }
+
+    idx = __sync_fetch_and_add(&record->numProcs, 1);
+    record->pids[idx] = getpid();
+    record->exitTimes[idx] = now_sec();
+
+    _exit(0);
+}
+
+/**
+ * test_tree - Wait with --tree on a tree which forks (and reparents) while being waited on.
+ *               Every process must be printed, and waitpid must not return before the last exits.
+ *
+ *    @param runAsUid <int> - If >= 0, run waitpid as this user
+ *
+ *    @return <int> - 0 on pass, 1 on failure
+ */
+static int test_tree(const char *waitpidPath, int runAsUid)
+{
+    const char *options[] = { "--tree", "--print", NULL };
+    volatile struct tree_record *record;
+    int goPipe[2];
+    pid_t rootPid;
+    int outFd;
+    pid_t waitpidPid;
+    char *output, *line, *savePtr;
+    char goByte;
+    int numSeen[TREE_NUM_PROCS] = { 0 };
+    double doneTime, lastExitTime = 0;
+    int pid;
+    int status;
+    int i;
+    int failed = 0;
+
+    record = mmap(NULL, sizeof(struct tree_record), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if ( record == MAP_FAILED || cloexec_pipe(goPipe) != 0 )
+    {
+        perror("setup");
+        return 1;
+    }
+    memset((void *)record, 0, sizeof(struct tree_record));
+
+    rootPid = fork();
+    if ( rootPid == 0 )
+    {
+        close(goPipe[1]);
+        while ( read(goPipe[0], &goByte, 1) > 0 );
+        run_tree_node(record, TREE_DEPTH, 1);
+    }
+    close(goPipe[0]);
+
+    waitpidPid = spawn_waitpid(waitpidPath, options, &rootPid, 1, &outFd, runAsUid);
+
+    /* Everything but the root is forked after waitpid has started */
+    usleep(STARTUP_WAIT_USEC);
+    close(goPipe[1]);
+
+    output = read_all(outFd);
+    doneTime = now_sec();
+    waitpid(waitpidPid, &status, 0);
+    waitpid(rootPid, NULL, 0);
+
+    if ( ! WIFEXITED(status) || WEXITSTATUS(status) != 0 )
+    {
+        printf("FAIL: waitpid --tree returned %d, expected 0.\n", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        failed = 1;
+    }
+
+    /* Give any stragglers (if waitpid returned early) a chance to record themselves */
+    for( i=0; i < 100 && record->numProcs < TREE_NUM_PROCS; i++ )
+        usleep(50000);
+
+    if ( record->numProcs != TREE_NUM_PROCS )
+    {
+        printf("FAIL: Only %d of the %d tree processes ran.\n", record->numProcs, TREE_NUM_PROCS);
+        failed = 1;
+    }
+
+    for( line = strtok_r(output, "\n", &savePtr); line != NULL; line = strtok_r(NULL, "\n", &savePtr) )
+    {
+        if ( sscanf(line, "%d", &pid) != 1 )
+            continue;
+
+        for( i=0; i < record->numProcs && record->pids[i] != pid; i++ );
+        if ( i < record->numProcs )
+            numSeen[i]++;
+    }
+
+    for( i=0; i < record->numProcs; i++ )
+    {
+        if ( numSeen[i] != 1 )
+        {
+            printf("FAIL: Tree pid %d printed %d times, expected once.\n", (int)record->pids[i], numSeen[i]);
+            failed = 1;
+        }
+        if ( record->exitTimes[i] > lastExitTime )
+            lastExitTime = record->exitTimes[i];
+    }
+
+    if ( lastExitTime > doneTime )
+    {
+        printf("FAIL: waitpid --tree returned %.3f seconds before the last process exited.\n", lastExitTime - doneTime);
+        failed = 1;
+    }
+    else if ( ! failed )
+    {
+        printf("--tree%s: all %d processes seen, returned %.3f ms after the last exit\n",
+            runAsUid >= 0 ? " (as nobody)" : "", TREE_NUM_PROCS, (doneTime - lastExitTime) * 1000.0);
+    }
+
+    free(output);
+    munmap((void *)record, sizeof(struct tree_record));
+
+    return failed;
+}
+
+int main(int argc, char* argv[])
+{
+    int numChildren = 500;
+    const char *waitpidPath = "bin/waitpid";
+    int failed = 0;
+
+    if ( argc > 1 )
+        numChildren = atoi(argv[1]);
+    if ( argc > 2 )
+        waitpidPath = argv[2];
+
+    if ( numChildren <= 0 )
+    {
+        fputs("Usage: test_waitpid (Optional: [num children, default 500] [path to waitpid, default bin/waitpid])\n", stderr);
+        return 1;
+    }
+
+    failed |= test_many(waitpidPath, numChildren);
+    failed |= test_any_and_timeout(waitpidPath);
+    failed |= test_thread_id(waitpidPath);
+    failed |= test_tree(waitpidPath, -1);
+    if ( geteuid() == 0 )
+        failed |= test_tree(waitpidPath, NOBODY_UID);
+
+    if ( failed )
+    {
+        printf("\nFAILED.\n");
+        return 1;
+    }
+
+    printf("\nAll tests passed.\n");
+    return 0;
+}
@@ -6,7 +6,7 @@
  * See "LICENSE" with the source distribution for details.
  *
  * waitpid.c - "main" for "waitpid" application -
- *   waits for a given pid to finish.
+ *   waits for a given pid (or any / all of several pids, or a whole process tree) to finish.
  */
 
 #include <stdio.h>
@@ -18,72 +18,81 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <poll.h>
 
 #include "pid_tools.h"
 
 #include "pid_utils.h"
-#include "pid_inode_utils.h"
+#include "pid_waiter.h"
+#include "simple_int_map.h"
+#include "proc_events.h"
+#include "proc_children.h"
+#include "proc_pids.h"
+#include "proc_stat.h"
 
-const volatile char *copyright = "waitpid - Copyright (c) 2017 Tim Savannah.";
+STATIC_MULTICALL_ONLY const volatile char *copyright = "waitpid - Copyright (c) 2017 Tim Savannah.";
 
 /*
  * usage - print usage/help to stderr
  */
 static inline void usage()
 {
-    fputs("Usage: waitpid [pid1] (Optional: [pid2] [pid...N])\n", stderr);
-    fputs("  Waits for a given set of pids to finish.\n\nReturns 0 after pid terminates,\n  or 127 if provided pid does not exist.\n\nn", stderr);
+    fputs("Usage: waitpid (Options) [pid1] (Optional: [pid2] [pid...N])\n", stderr);
+    fputs("  Waits for a given set of pids to finish.\n\n", stderr);
+    fputs("    Options:\n", stderr);
+    fputs("\t\t--all\t\tWait for every pid to finish. This is the default.\n", stderr);
+    fputs("\t\t--any\t\tWait for any one of the pids to finish.\n", stderr);
+    fputs("\t\t--tree\t\tWait for the pids and all of their descendants (even those reparented\n", stderr);
+    fputs("\t\t\t\t  away) to finish, including processes forked while waiting.\n", stderr);
+    fputs("\t\t--timeout [sec]\tGive up after this many seconds (may be fractional), and return 124.\n", stderr);
+    fputs("\t\t-p / --print\tPrint \"PID TIMESTAMP\" as each pid finishes, where TIMESTAMP is the\n", stderr);
+    fputs("\t\t\t\t  seconds of CLOCK_MONOTONIC at which it was seen to finish.\n\n", stderr);
+    fputs("Returns 0 after the pid(s) terminate,\n  or 127 if a provided pid does not exist (the others are still waited on),\n  or 124 on timeout.\n\n", stderr);
 }
 
-#define USEC_IN_SECOND 1000000
+/* RET_TIMEOUT - Return code when --timeout passes first (the same as timeout(1)) */
+#define RET_TIMEOUT (124)
 
-#define POLL_TIME ( USEC_IN_SECOND / 100.0 )
-
-#define ERR_NONE (0)
-#define ERR_INVALID_PID_FORMAT (1)
-#define ERR_NO_SUCH_PID (2)
+/* RET_NO_SUCH_PID - Return code when a given pid does not exist */
+#define RET_NO_SUCH_PID (127)
 
+/* MAX_EXITED_PER_WAIT - Most exits collected (and printed) per wait */
+#define MAX_EXITED_PER_WAIT (256)
 
-#define MAX_PROC_PATH_SIZE (64)
-/**
- * create_proc_path - Allocate a string of #MAX_PROC_PATH_SIZE and set contents to '/proc/'
- *          Used in construction of proc paths
- *
- *
- *      @return <char *> - An allocated string of size #MAX_PROC_PATH_SIZE with copied in '/proc/'
+/* TREE_RESCAN_INTERVAL_MS - How often to look for new descendants in --tree mode when
+ *   process events are unavailable (e.x. not running as root)
  */
-static char *create_proc_path(void)
-{
-    static char baseStr[8] = { '/', 'p', 'r', 'o', 'c', '/' };
-
-    char *ret;
+#define TREE_RESCAN_INTERVAL_MS (100)
 
-    ret = malloc(MAX_PROC_PATH_SIZE);
+/* TREE_MAX_EVENTS - Max number of process events to handle in one batch */
+#define TREE_MAX_EVENTS (256)
 
-    strncpy(ret, baseStr, 6);
-
-    return ret;
-}
+#define ERR_NONE (0)
+#define ERR_INVALID_PID_FORMAT (1)
+#define ERR_NO_SUCH_PID (2)
 
 
 /**
- * setup_proc_path - Convers a pid string to integer and appends to the path pointed-by #procPath
+ * setup_pid - Converts a pid string to integer and starts waiting on it
  *
  *
- *      @param procPath <char *> - Pointer to an allocated string which starts with '/proc/'
+ *      @param waiter <PidWaiter *> - The waiter to add the pid to
  *
  *      @param pidStr <const char *> - Pointer to a string of the pid
  *
- *      @param pidOut <int *> - Pointer to an integer which will be set with the
+ *      @param pidOut <pid_t *> - Pointer to a pid which will be set with the
  *                      integer value of #pidStr.
  *
  *      @return <int> - If ERR_NONE (0) - Success
  *                      If ERR_INVALID_PID_FORMAT (1) - #pidStr is not a valid integer
  *                      IF ERR_NO_SUCH_PID (2) - Requested pid does not exist
  */
-static unsigned int setup_proc_path(char *procPath, const char* pidStr, pid_t *pidOut)
+static unsigned int setup_pid(PidWaiter *waiter, const char* pidStr, pid_t *pidOut)
 {
-    static pid_t pid;
+    pid_t pid;
 
     pid = *pidOut = strtoint(pidStr);
     if ( pid <= 0 )
@@ -91,9 +100,7 @@ static unsigned int setup_proc_path(char *procPath, const char* pidStr, pid_t *p
         return ERR_INVALID_PID_FORMAT;
     }
 
-
-    sprintf(&procPath[6], "%d", pid);
-    if ( access( procPath, F_OK ) != 0 )
+    if ( pid_waiter_add(waiter, pid) != 0 )
     {
         /* Pid does not exist... */
         return ERR_NO_SUCH_PID;
@@ -103,22 +110,419 @@ static unsigned int setup_proc_path(char *procPath, const char* pidStr, pid_t *p
 }
 
 /**
- * main - takes one argument, the pid to wait on
+ * parse_timeout - Parse the seconds given to --timeout
  *
+ *      @return <long long> - Milliseconds, or -1 if #str is not a number >= 0
  */
-int main(int argc, char* argv[])
+static long long parse_timeout(const char *str)
+{
+    double seconds;
+    char *endptr = NULL;
+
+    errno = 0;
+    seconds = strtod(str, &endptr);
+    if ( errno != 0 || endptr == str || *endptr != '\0' || !( seconds >= 0 ) || seconds > (double)LLONG_MAX / 1000 )
+        return -1;
+
+    return (long long)(seconds * 1000);
+}
+
+/**
+ * now_ms - Milliseconds of CLOCK_MONOTONIC
+ */
+static inline long long now_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * print_exited - Print a line for each pid which exited, with the current time
+ */
+static void print_exited(const pid_t *exited, size_t numExited)
+{
+    struct timespec now;
+    size_t i;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for(i = 0; i < numExited; i++)
+        printf("%d %lld.%09ld\n", (int)exited[i], (long long)now.tv_sec, (long)now.tv_nsec);
+
+    fflush(stdout);
+}
+
+/**
+ * ms_until - Milliseconds until a deadline, for a poll/epoll timeout
+ *
+ *      @param deadline <long long> - CLOCK_MONOTONIC milliseconds, or -1 for none
+ *
+ *      @return <int> - Milliseconds (0 if passed), or -1 if there is no deadline
+ */
+static int ms_until(long long deadline)
+{
+    long long remaining;
+
+    if ( deadline < 0 )
+        return -1;
+
+    remaining = deadline - now_ms();
+    if ( remaining <= 0 )
+        return 0;
+
+    return remaining > INT_MAX ? INT_MAX : (int)remaining;
+}
+
+/**
+ *   TreeWait - State of waiting on a process tree (--tree)
+ */
+typedef struct {
+
+    PidWaiter *waiter;
+
+    SimpleIntMap *treeMap;  /* The roots and every descendant found */
+    int hasEvents;          /* 1 if reading process events, 0 if rescanning */
+
+    pid_t *seenPids;        /* Sorted pids of the previous /proc listing (scan_new_pids only) */
+    size_t numSeenPids;
+
+} TreeWait;
+
+/**
+ * tree_add - Add a pid to the tree, and start waiting on it
+ *
+ *      @return <int> - 1 if it was added, 0 if it was already in the tree or already gone
+ */
+static int tree_add(TreeWait *tree, pid_t pid)
+{
+    if ( ! simple_int_map_add(tree->treeMap, (int)pid) )
+        return 0;
+
+    if ( pid_waiter_add(tree->waiter, pid) != 0 )
+    {
+        /* Already gone. With events, keep it until its exit event, to catch
+         *   any fork events for its children which are still to be read.
+         */
+        if ( ! tree->hasEvents )
+            simple_int_map_rem(tree->treeMap, (int)pid);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * tree_scan_children - Read the children of every pid in the tree (and of any found),
+ *                        and add any which are new. Only the children files of the pids
+ *                        in the tree are read, not the rest of /proc.
+ *
+ *      A process which is forked and orphaned (its parent exits) between two scans
+ *        is not seen, as by then its parent is outside the tree.
+ */
+static void tree_scan_children(TreeWait *tree)
+{
+    pid_t *queue;
+    size_t queueLen;
+    size_t i;
+    pid_t *children = NULL;
+    size_t numChildren;
+    size_t childrenCapacity = 0;
+    size_t j;
+
+    queue = (pid_t *)simple_int_map_values(tree->treeMap, &queueLen);
+
+    for( i=0; i < queueLen; i++ )
+    {
+        numChildren = 0;
+        if ( proc_children_read(queue[i], &children, &numChildren, &childrenCapacity) != 0 )
+            continue;
+
+        for( j=0; j < numChildren; j++ )
+        {
+            if ( tree_add(tree, children[j]) )
+            {
+                /* Read the new pid's children too, in this same pass */
+                queue = realloc(queue, sizeof(pid_t) * (queueLen + 1));
+                queue[queueLen++] = children[j];
+            }
+        }
+    }
+
+    if ( children != NULL )
+        free(children);
+    free(queue);
+}
+
+/**
+ * tree_scan_new_pids - List /proc, and read the parent of only those pids which were
+ *                        not there at the last listing, adding any whose parent is in the tree.
+ *
+ *      For kernels without /proc/PID/task/TID/children. Same limitation on orphans as
+ *        tree_scan_children, and a pid reused between two listings is not seen as new.
+ */
+static void tree_scan_new_pids(TreeWait *tree)
+{
+    pid_t *pids;
+    size_t numPids;
+    pid_t *newPids;
+    pid_t *newPpids;
+    size_t numNew = 0;
+    size_t i, j;
+    ProcStat stat;
+    uint64_t *foundBits;
+    int addedAny;
+
+    pids = proc_pids_get_all(&numPids);
+    if ( unlikely( pids == NULL ) )
+        return;
+
+    newPids = malloc( sizeof(pid_t) * (numPids + 1) );
+    newPpids = malloc( sizeof(pid_t) * (numPids + 1) );
+
+    /* Both lists are sorted, so the new pids are found in one merge */
+    for( i=0, j=0; i < numPids; i++ )
+    {
+        while ( j < tree->numSeenPids && tree->seenPids[j] < pids[i] )
+            j++;
+        if ( j < tree->numSeenPids && tree->seenPids[j] == pids[i] )
+            continue;
+
+        if ( proc_stat_read(pids[i], PROC_STAT_FIELD_PPID, &stat) != 0 )
+            continue;
+
+        newPids[numNew] = pids[i];
+        newPpids[numNew] = stat.ppid;
+        numNew++;
+    }
+
+    /* A new pid may be the child of another new pid, in any order. Each round checks
+     *   every parent against the tree at once, and one added during a round is seen
+     *   by its children in the next.
+     */
+    foundBits = malloc( sizeof(uint64_t) * SIMPLE_INT_MAP_RESULT_WORDS(numNew) );
+    do {
+        addedAny = 0;
+        simple_int_map_contains_many(tree->treeMap, (const int *)newPpids, numNew, foundBits);
+        for( i=0; i < numNew; i++ )
+        {
+            if ( newPids[i] != 0 && SIMPLE_INT_MAP_RESULT_BIT(foundBits, i) )
+            {
+                tree_add(tree, newPids[i]);
+                newPids[i] = 0;
+                addedAny = 1;
+            }
+        }
+    } while ( addedAny );
+
+    free(foundBits);
+    free(newPpids);
+    free(newPids);
+
+    if ( tree->seenPids != NULL )
+        free(tree->seenPids);
+    tree->seenPids = pids;
+    tree->numSeenPids = numPids;
+}
+
+/**
+ * tree_rescan - Find new descendants, reading as little of /proc as the kernel allows
+ */
+static inline void tree_rescan(TreeWait *tree, int hasChildrenFiles)
+{
+    if ( hasChildrenFiles )
+        tree_scan_children(tree);
+    else
+        tree_scan_new_pids(tree);
+}
+
+/**
+ * wait_tree - Implements --tree. Wait until the given pids, and every process
+ *               descended from them, have exited.
+ *
+ *      The descendants are found once at the start (reading only the children files
+ *        of the tree, where the kernel has them). After that, new processes are added
+ *        from fork events of the kernel's process connector when available (see
+ *        proc_events.h), and otherwise by looking again every TREE_RESCAN_INTERVAL_MS.
+ *
+ *      A process stays in the tree when it is reparented (e.x. to init after its
+ *        parent exits), and so do any processes it forks after that.
+ *
+ *      @param waiter <PidWaiter *> - Waiter with the root pids already added
+ *
+ *      @param rootPids <const pid_t *> - The root pids which are running
+ *
+ *      @param deadline <long long> - CLOCK_MONOTONIC milliseconds to give up at, or -1
+ *
+ *      @param isPrint <int> - 1 to print each pid as it exits
+ *
+ *      @return <int> - 0 if every process has exited, RET_TIMEOUT, or 1 on error
+ */
+static int wait_tree(PidWaiter *waiter, const pid_t *rootPids, size_t numRootPids, long long deadline, int isPrint)
 {
+    TreeWait tree;
+    ProcEvent *events = NULL;
+    pid_t exited[MAX_EXITED_PER_WAIT];
+    ssize_t numExited;
+    struct pollfd pollFds[2];
+    int numPollFds;
+    int eventsFd;
+    int numEvents;
+    int hasChildrenFiles;
+    long long nextRescan = 0;
+    int waitMs, rescanMs;
+    size_t i;
+    int ret = 0;
+
+    tree.waiter = waiter;
+    tree.treeMap = simple_int_map_create(1000);
+    tree.seenPids = NULL;
+    tree.numSeenPids = 0;
+
+    simple_int_map_add_many(tree.treeMap, (const int *)rootPids, numRootPids);
+
+    /* Subscribe before the first scan, so no fork in between is missed */
+    eventsFd = proc_events_open();
+    tree.hasEvents = eventsFd >= 0;
+    if ( tree.hasEvents )
+        events = malloc( sizeof(ProcEvent) * TREE_MAX_EVENTS );
 
-    static char **procPaths;
-    static char *procPath;
-    static int *inodeNums;
-    static int curInode;
-    static unsigned int tmp;
-    static unsigned int i;
-    static unsigned int numArgs;
-    static pid_t curPid;
+    hasChildrenFiles = proc_children_supported();
 
-    static int keepGoing = 1;
+    tree_rescan(&tree, hasChildrenFiles);
+    if ( ! tree.hasEvents )
+        nextRescan = now_ms() + TREE_RESCAN_INTERVAL_MS;
+
+    pollFds[0].fd = PID_WAITER_FD(waiter);
+    pollFds[0].events = POLLIN;
+    pollFds[1].fd = eventsFd;
+    pollFds[1].events = POLLIN;
+    numPollFds = tree.hasEvents ? 2 : 1;
+
+    while ( 1 )
+    {
+        if ( PID_WAITER_NUM_RUNNING(waiter) == 0 )
+        {
+            /* With events, a fork may still be queued. Otherwise, nothing is left to fork */
+            if ( ! tree.hasEvents || poll(&pollFds[1], 1, 0) <= 0 )
+                break;
+        }
+
+        waitMs = ms_until(deadline);
+        if ( PID_WAITER_NUM_POLLED(waiter) > 0 && ( waitMs < 0 || waitMs > PID_WAITER_POLL_MS ) )
+            waitMs = PID_WAITER_POLL_MS;
+        if ( ! tree.hasEvents )
+        {
+            rescanMs = ms_until(nextRescan);
+            if ( waitMs < 0 || waitMs > rescanMs )
+                waitMs = rescanMs;
+        }
+
+        if ( poll(pollFds, numPollFds, waitMs) < 0 && errno != EINTR )
+        {
+            fprintf(stderr, "Error waiting for pids. Error %d: %s\n", errno, strerror(errno));
+            ret = 1;
+            break;
+        }
+
+        if ( tree.hasEvents )
+        {
+            numEvents = proc_events_read(eventsFd, events, TREE_MAX_EVENTS, 0);
+            if ( numEvents == PROC_EVENTS_ERROR_OVERRUN )
+            {
+                /* We missed some events, look for any new descendants the slow way */
+                tree_rescan(&tree, hasChildrenFiles);
+                numEvents = 0;
+            }
+            else if ( unlikely( numEvents < 0 ) )
+            {
+                fprintf(stderr, "Failed to read process events. Error %d: %s\n", errno, strerror(errno));
+                ret = 1;
+                break;
+            }
+
+            for( i=0; i < (size_t)numEvents; i++ )
+            {
+                if ( events[i].eventType == PROC_EVENT_TYPE_FORK )
+                {
+                    if ( simple_int_map_contains(tree.treeMap, (int)events[i].ppid) )
+                        tree_add(&tree, events[i].pid);
+                }
+                else if ( events[i].eventType == PROC_EVENT_TYPE_EXIT )
+                {
+                    simple_int_map_rem(tree.treeMap, (int)events[i].pid);
+                }
+            }
+        }
+        else if ( now_ms() >= nextRescan )
+        {
+            tree_rescan(&tree, hasChildrenFiles);
+            nextRescan = now_ms() + TREE_RESCAN_INTERVAL_MS;
+        }
+
+        numExited = pid_waiter_wait(waiter, exited, MAX_EXITED_PER_WAIT, 0);
+        if ( unlikely( numExited < 0 ) )
+        {
+            fprintf(stderr, "Error waiting for pids. Error %d: %s\n", errno, strerror(errno));
+            ret = 1;
+            break;
+        }
+
+        if ( numExited > 0 )
+        {
+            if ( isPrint )
+                print_exited(exited, numExited);
+
+            /* Without events, the tree is just the pids still running */
+            if ( ! tree.hasEvents )
+            {
+                for( i=0; i < (size_t)numExited; i++ )
+                    simple_int_map_rem(tree.treeMap, (int)exited[i]);
+            }
+        }
+
+        if ( deadline >= 0 && PID_WAITER_NUM_RUNNING(waiter) > 0 && now_ms() >= deadline )
+        {
+            ret = RET_TIMEOUT;
+            break;
+        }
+    }
+
+    if ( tree.hasEvents )
+    {
+        proc_events_close(eventsFd);
+        free(events);
+    }
+    if ( tree.seenPids != NULL )
+        free(tree.seenPids);
+    simple_int_map_destroy(tree.treeMap);
+
+    return ret;
+}
+
+/**
+ * main - takes the pids to wait on, and options
+ *
+ */
+int main(int argc, char* argv[])
+{
+
+    PidWaiter *waiter;
+    pid_t exited[MAX_EXITED_PER_WAIT];
+    ssize_t numExited;
+    pid_t *pids;
+    size_t numPids = 0;
+    pid_t curPid;
+    long long timeoutMs = -1;
+    long long deadline = -1;
+    unsigned int tmp;
+    int i;
+
+    int isAny = 0;
+    int isTree = 0;
+    int isPrint = 0;
 
     int ret = 0;
 
@@ -140,96 +544,144 @@ int main(int argc, char* argv[])
         return 0;
     }
 
-    numArgs = argc - 1;
+    /* Each pid gets a pidfd in one epoll set, so nothing is checked until one exits.
+     *   Pids which cannot get one (e.x. kernel before 5.3) are checked by their start time in
+     *   /proc/$PID/stat, and if that is unavailable or has changed, the process has died / been replaced.
+     */
+    waiter = pid_waiter_create(argc - 1);
+    if ( unlikely( waiter == NULL ) )
+    {
+        fprintf(stderr, "Cannot create epoll set. Error %d: %s\n", errno, strerror(errno));
+        return 1;
+    }
 
-    /* Gather all inodes and proc paths.
-     *  We will check these in every loop iteration, and if 
-     *   the inode is unavailable or has changed, the process has died / been replaced.
-    */
-    inodeNums = malloc(sizeof(int) * numArgs );
-    procPaths = malloc(sizeof(char*) * numArgs );
+    pids = malloc( sizeof(pid_t) * argc );
 
-    for(i=1; i <= numArgs; i++)
+    for(i=1; i < argc; i++)
     {
-        procPaths[i - 1] = procPath = create_proc_path();
+        if ( strcmp("--any", argv[i]) == 0 )
+        {
+            isAny = 1;
+            continue;
+        }
+
+        if ( strcmp("--all", argv[i]) == 0 )
+        {
+            isAny = 0;
+            continue;
+        }
+
+        if ( strcmp("--tree", argv[i]) == 0 )
+        {
+            isTree = 1;
+            continue;
+        }
+
+        if ( strcmp("-p", argv[i]) == 0 || strcmp("--print", argv[i]) == 0 )
+        {
+            isPrint = 1;
+            continue;
+        }
 
-        tmp = setup_proc_path(procPaths[i - 1], argv[i], &curPid);
+        if ( strcmp("--timeout", argv[i]) == 0 || strncmp("--timeout=", argv[i], 10) == 0 )
+        {
+            /* Accept both "--timeout N" and "--timeout=N" */
+            if ( argv[i][9] == '=' )
+                timeoutMs = parse_timeout(&argv[i][10]);
+            else if ( i + 1 < argc )
+                timeoutMs = parse_timeout(argv[++i]);
+            else
+                timeoutMs = -1;
+
+            if ( timeoutMs < 0 )
+            {
+                fprintf(stderr, "Invalid timeout: '%s'\n", argv[i]);
+                ret = 1;
+                goto __cleanup_exit__main;
+            }
+            continue;
+        }
+
+        tmp = setup_pid(waiter, argv[i], &curPid);
 
         if ( unlikely( tmp != ERR_NONE ) )
         {
             switch(tmp)
             {
                 case ERR_INVALID_PID_FORMAT:
-                    fprintf(stderr, "Invalid pid: %s\n", argv[1]);
+                    fprintf(stderr, "Invalid pid: %s\n", argv[i]);
                     if ( ret < 1)
                         ret = 1;
-                    /*goto __cleanup_exit__main;*/
                     break;
                 case ERR_NO_SUCH_PID:
-                    ret = 127;
-                    /*goto __cleanup_exit__main;*/
+                    ret = RET_NO_SUCH_PID;
                     break;
                 default:
-                    fprintf(stderr, "Unexpected return from setup_proc_path!\n");
+                    fprintf(stderr, "Unexpected return from setup_pid!\n");
                     if ( ret < 1)
                         ret = 1;
-                    /*goto __cleanup_exit__main;*/
                     break;
             }
-
-            /* Free and NULL this slot if we are in error. */
-            free(procPaths[i - 1]);
-            procPaths[i - 1] = NULL;
-            inodeNums[i - 1] = -1;
         }
         else
         {
-            inodeNums[i - 1] = get_inode_by_path(procPath);
+            pids[numPids++] = curPid;
         }
+    }
 
+    if ( isTree && isAny )
+    {
+        fputs("--any cannot be used with --tree\n", stderr);
+        ret = 1;
+        goto __cleanup_exit__main;
     }
 
-    do {
-        usleep( POLL_TIME );
+    if ( timeoutMs >= 0 )
+        deadline = now_ms() + timeoutMs;
 
-        keepGoing = 0;
+    if ( isTree )
+    {
+        tmp = wait_tree(waiter, pids, numPids, deadline, isPrint);
+        if ( tmp != 0 )
+            ret = tmp;
+        goto __cleanup_exit__main;
+    }
 
-        for(i = 0; i < numArgs; i++)
+    while ( PID_WAITER_NUM_RUNNING(waiter) > 0 )
+    {
+        numExited = pid_waiter_wait(waiter, exited, MAX_EXITED_PER_WAIT, ms_until(deadline));
+        if ( unlikely( numExited < 0 ) )
         {
-            /* Check each pid path for a matching inode */
-            procPath = procPaths[i];
-            if ( procPath == NULL )
-                continue;
-
-            curInode = get_inode_by_path(procPath);
+            fprintf(stderr, "Error waiting for pids. Error %d: %s\n", errno, strerror(errno));
+            ret = 1;
+            break;
+        }
 
-            if ( curInode == inodeNums[i] ) {
-                keepGoing = 1;
-                break;
-            }
-            else
+        if ( numExited == 0 )
+        {
+            /* pid_waiter_wait only returns none on timeout, which may be one of several
+             *   if the timeout is longer than INT_MAX ms
+             */
+            if ( deadline >= 0 && now_ms() >= deadline )
             {
-                /* This process has quit and maybe a new process already has
-                 *   the same pid. Don't bother checking it again.
-                 */
-                free(procPaths[i]);
-                procPaths[i] = NULL;
+                ret = RET_TIMEOUT;
+                break;
             }
-
+            continue;
         }
 
-    } while( keepGoing == 1 );
+        if ( isPrint )
+            print_exited(exited, numExited);
+
+        if ( isAny )
+            break;
+    }
 
 
-/*__cleanup_exit__main:*/
+__cleanup_exit__main:
 
-    free(inodeNums);
-    for(i = 0; i < numArgs; i++)
-    {
-        if ( procPaths[i] != NULL )
-            free(procPaths[i]);
-    }
-    free(procPaths);
+    pid_waiter_destroy(waiter);
+    free(pids);
 
     return ret;
 